@@ -0,0 +1,108 @@
+#include"benchmark.h"
+#include<algorithm>
+#include<chrono>
+#include<thread>
+
+const volatile void *volatile Benchmark::sink_ = nullptr;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// A batch shorter than this is dominated by the clock read itself.
+const double kMinBatchNs = 10000.0;
+
+double Percentile(const std::vector<double> &sorted, double p) {
+	double rank = p * (sorted.size() - 1);
+	size_t lo = static_cast<size_t>(rank);
+	size_t hi = std::min(lo + 1, sorted.size() - 1);
+	return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+}
+
+void WriteJsonString(std::ostream &out, const std::string &s) {
+	out << '"';
+	for (char c : s) {
+		if (c == '"' || c == '\\')
+			out << '\\';
+		out << c;
+	}
+	out << '"';
+}
+
+}
+
+Benchmark::Benchmark(double min_time_s, uint64_t min_samples)
+	: min_time_s_(min_time_s), min_samples_(std::max<uint64_t>(min_samples, 1)) {
+}
+
+bool Benchmark::Selected(const std::string &name) const {
+	return filter_.empty() || name.find(filter_) != std::string::npos;
+}
+
+bool Benchmark::Run(const std::string &name, double items, const std::function<void()> &body) {
+	if (!Selected(name))
+		return false;
+
+	// The warm-up call also sizes the batches.
+	Clock::time_point start = Clock::now();
+	body();
+	double first_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	uint64_t batch = first_ns >= kMinBatchNs ? 1 : static_cast<uint64_t>(kMinBatchNs / std::max(first_ns, 1.0)) + 1;
+
+	std::vector<double> samples;
+	double total_ns = 0.0;
+	uint64_t iterations = 0;
+	while (samples.size() < min_samples_ || total_ns < min_time_s_ * 1e9) {
+		start = Clock::now();
+		for (uint64_t i = 0; i < batch; ++i)
+			body();
+		double batch_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+		samples.push_back(batch_ns / batch);
+		total_ns += batch_ns;
+		iterations += batch;
+	}
+	std::sort(samples.begin(), samples.end());
+
+	Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.samples = samples.size();
+	result.mean_ns = total_ns / iterations;
+	result.p50_ns = Percentile(samples, 0.50);
+	result.p99_ns = Percentile(samples, 0.99);
+	result.items_per_sec = items * 1e9 / result.mean_ns;
+	results_.push_back(result);
+	return true;
+}
+
+void Benchmark::WriteJson(std::ostream &out) const {
+	out << "{\n  \"context\": {\n";
+	out << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "    \"min_time_s\": " << min_time_s_ << ",\n";
+	out << "    \"min_samples\": " << min_samples_ << ",\n";
+#if defined(__AVX__)
+	out << "    \"avx\": true,\n";
+#else
+	out << "    \"avx\": false,\n";
+#endif
+#if defined(NDEBUG)
+	out << "    \"build\": \"release\"\n";
+#else
+	out << "    \"build\": \"debug\"\n";
+#endif
+	out << "  },\n  \"benchmarks\": [";
+
+	for (size_t i = 0; i < results_.size(); ++i) {
+		const Result &r = results_[i];
+		out << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+		WriteJsonString(out, r.name);
+		out << ", \"iterations\": " << r.iterations
+			<< ", \"samples\": " << r.samples
+			<< ", \"mean_ns\": " << r.mean_ns
+			<< ", \"p50_ns\": " << r.p50_ns
+			<< ", \"p99_ns\": " << r.p99_ns
+			<< ", \"items_per_sec\": " << r.items_per_sec << "}";
+	}
+	out << "\n  ]\n}\n";
+}
@@ -0,0 +1,63 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include<cstdint>
+#include<functional>
+#include<ostream>
+#include<string>
+#include<vector>
+
+// A small timing harness for the window-less benchmarks.
+// Run() calls the body once to warm up, then in batches long enough for the
+// steady clock to resolve, and keeps one sample per batch until both the
+// minimum time and the minimum sample count are reached.
+class Benchmark {
+public:
+	struct Result {
+		std::string name;
+		uint64_t iterations;
+		uint64_t samples;
+		double mean_ns;		// per call of the body
+		double p50_ns;
+		double p99_ns;
+		double items_per_sec;	// items is what one call processes
+	};
+
+	explicit Benchmark(double min_time_s = 0.5, uint64_t min_samples = 50);
+
+	// Only benchmarks whose name contains filter run; empty runs everything.
+	void SetFilter(const std::string &filter) {
+		filter_ = filter;
+	}
+	bool Selected(const std::string &name) const;
+
+	// Returns false if the benchmark was filtered out.
+	bool Run(const std::string &name, double items, const std::function<void()> &body);
+
+	const std::vector<Result>& Results() const {
+		return results_;
+	}
+
+	// {"context": {...}, "benchmarks": [{"name": ..., "mean_ns": ...}, ...]}
+	void WriteJson(std::ostream &out) const;
+
+	// Keeps the compiler from discarding a result that is otherwise unused.
+	template<typename T>
+	static void DoNotOptimize(const T &value) {
+#if defined(__GNUC__)
+		asm volatile("" : : "r"(&value) : "memory");
+#else
+		sink_ = static_cast<const volatile void*>(&value);
+#endif
+	}
+
+private:
+	double min_time_s_;
+	uint64_t min_samples_;
+	std::string filter_;
+	std::vector<Result> results_;
+
+	static const volatile void *volatile sink_;
+};
+
+#endif
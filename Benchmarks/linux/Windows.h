@@ -0,0 +1,27 @@
+// Stands in for the Windows SDK header when the benchmarks are built on
+// Linux.  winadapter.h from the DirectX-Headers supplies the Win32 types and
+// HRESULT codes; the rest is what Common uses beyond them.
+#ifndef BENCHMARKS_LINUX_WINDOWS_H
+#define BENCHMARKS_LINUX_WINDOWS_H
+
+#include<wsl/winadapter.h>
+#include<cstdlib>
+
+#ifndef ERROR_INVALID_DATA
+#define ERROR_INVALID_DATA 13L
+#endif
+
+#ifndef ERROR_NOT_SUPPORTED
+#define ERROR_NOT_SUPPORTED 50L
+#endif
+
+#ifndef ERROR_HANDLE_EOF
+#define ERROR_HANDLE_EOF 38L
+#endif
+
+#ifndef HRESULT_FROM_WIN32
+#define HRESULT_FROM_WIN32(x) \
+	((HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000))
+#endif
+
+#endif
@@ -0,0 +1,2059 @@
+// Window-less benchmarks of the CPU side of Common: the wave solver, the
+// geometry generator, MathHelper, the text and binary model loaders, the mesh
+// optimizer, simplifier, quantizer and index packer, the chunked and quadtree
+// terrains, the DDS header parser, the flip-book streamer, the texture load
+// pipeline, the block-compression codec, the mip generator, the texture
+// packer, the frame-time statistics and the profiler.  Results go to stdout, or to --out, as JSON.  Correctness checks run
+// next to the benchmarks they cover, and the exit code is 1 if any failed.
+//
+//   Benchmarks [--out results.json] [--filter waves] [--min-time 0.5]
+//              [--models <dir with skull.txt>] [--textures <dir with .dds files>]
+//              [--fire <dir with Fire001.DDS to Fire120.DDS>]
+//              [--trees <dir with tree0.dds to tree3.dds>]
+//
+// Nothing here needs Direct3D, so it also builds on Linux against DirectXMath
+// and the DirectX-Headers (for dxgiformat.h and the Win32 types), with
+// linux/Windows.h standing in for the SDK header:
+//
+//   g++ -std=c++17 -O2 -mavx -pthread -Ilinux -I../Common
+//       -I<DirectXMath>/Inc -I<DirectX-Headers>/include -I<DirectX-Headers>/include/directx
+//       -I<DirectX-Headers>/include/wsl/stubs -I<dir with sal.h>
+//       main.cpp benchmark.cpp ../Common/waves.cpp ../Common/threadpool.cpp
+//       ../Common/geometrygenerator.cpp ../Common/mathhelper.cpp
+//       ../Common/modelloader.cpp ../Common/DDSHeader.cpp ../Common/profiler.cpp
+//       ../Common/mappedfile.cpp ../Common/meshfile.cpp ../Common/meshoptimizer.cpp
+//       ../Common/meshsimplifier.cpp ../Common/vertexquantizer.cpp ../Common/indexpacker.cpp
+//       ../Common/chunkedterrain.cpp ../Common/terrainquadtree.cpp ../Common/flipbookstreamer.cpp
+//       ../Common/texturepipeline.cpp ../Common/blockcompression.cpp ../Common/mipgenerator.cpp
+//       ../Common/texturepacker.cpp ../Common/framestats.cpp -o benchmarks
+
+#include"benchmark.h"
+#include"waves.h"
+#include"geometrygenerator.h"
+#include"mathhelper.h"
+#include"modelloader.h"
+#include"meshfile.h"
+#include"mappedfile.h"
+#include"meshoptimizer.h"
+#include"meshsimplifier.h"
+#include"vertexquantizer.h"
+#include"indexpacker.h"
+#include"chunkedterrain.h"
+#include"terrainquadtree.h"
+#include"DDSHeader.h"
+#include"flipbookstreamer.h"
+#include"texturepipeline.h"
+#include"blockcompression.h"
+#include"mipgenerator.h"
+#include"texturepacker.h"
+#include"threadpool.h"
+#include"framestats.h"
+#include"profiler.h"
+#include<algorithm>
+#include<array>
+#include<cmath>
+#include<cstddef>
+#include<cstdio>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<iostream>
+#include<sstream>
+#include<string>
+#include<thread>
+#include<utility>
+#include<vector>
+
+using namespace DirectX;
+
+namespace {
+
+struct Options {
+	std::string out;
+	std::string filter;
+	double min_time_s = 0.5;
+	std::string models = "../Chapter 7 LitSkull/Models";
+	std::string textures = "../Chapter 8 Texturing- Textured Hills and Waves/Textures";
+	std::string fire = "../Chapter 8 Texturing-Crate/FireAnim/DDS";
+	std::string trees = "../Chapter 11 Geometry Shader- Tree Billboard Demo/Textures";
+};
+
+UINT failed_checks = 0;
+
+// Counts a failed correctness check, whose message goes to the stream
+// returned.  main() exits with 1 when any check failed.
+std::ostream& CheckFailed() {
+	++failed_checks;
+	return std::cerr;
+}
+
+// The vertex the hills-and-waves demo streams the waves into.
+struct WaveVertex {
+	XMFLOAT3 pos;
+	XMFLOAT3 normal;
+	XMFLOAT2 tex;
+};
+
+bool ReadFile(const std::string &filename, std::vector<uint8_t> &data) {
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+
+	fin.seekg(0, std::ios::end);
+	data.resize(static_cast<size_t>(fin.tellg()));
+	fin.seekg(0, std::ios::beg);
+	fin.read(reinterpret_cast<char*>(data.data()), data.size());
+	return !fin.fail();
+}
+
+void InitWaves(Waves &waves, UINT size, UINT thread_cnt) {
+	waves.SetThreadCount(thread_cnt);
+	waves.Init(size, size, 1.0f, 0.03f, 3.25f, 0.4f);
+
+	// Settle into a busy surface so the solver never sees flat water.
+	for (UINT k = 0; k < 64; ++k) {
+		UINT i = 5 + rand() % (size - 10);
+		UINT j = 5 + rand() % (size - 10);
+		waves.Disturb(i, j, MathHelper::RandF(1.0f, 2.0f));
+	}
+	for (UINT k = 0; k < 20; ++k)
+		waves.Update(0.03f);
+}
+
+// One dt of the solver's own step is exactly one step.  Like the demos, drop
+// a new disturbance about every quarter of a second so the waves never die out.
+void StepLikeDemo(Waves &waves, UINT &step) {
+	if (step++ % 8 == 0) {
+		UINT i = 5 + rand() % (waves.RowCount() - 10);
+		UINT j = 5 + rand() % (waves.ColumnCount() - 10);
+		waves.Disturb(i, j, MathHelper::RandF(1.0f, 2.0f));
+	}
+	waves.Update(0.03f);
+}
+
+// Runs the SSE/AVX kernels against the scalar loops they replace, on a grid
+// whose width is no multiple of the vector width, at several thread counts.
+// Both see the same disturbances, and the heights, normals and tangents have
+// to stay bit for bit the same.
+void CheckWavesSimd() {
+	const UINT rows = 157, cols = 203, step_cnt = 200;
+	const UINT thread_cnts[] = { 1, 2, 4 };
+	for (UINT thread_cnt : thread_cnts) {
+		Waves simd, scalar;
+		simd.SetThreadCount(thread_cnt);
+		scalar.SetThreadCount(thread_cnt);
+		scalar.SetSimdEnabled(false);
+		simd.Init(rows, cols, 1.0f, 0.03f, 3.25f, 0.4f);
+		scalar.Init(rows, cols, 1.0f, 0.03f, 3.25f, 0.4f);
+
+		UINT differing = 0;
+		for (UINT step = 0; step < step_cnt; ++step) {
+			if (step % 8 == 0) {
+				UINT i = 5 + (step*37) % (rows - 10), j = 5 + (step*53) % (cols - 10);
+				float magnitude = 1.0f + (step % 5)*0.25f;
+				simd.Disturb(i, j, magnitude);
+				scalar.Disturb(i, j, magnitude);
+			}
+			simd.Update(0.03f);
+			scalar.Update(0.03f);
+		}
+		for (UINT i = 0; i < simd.VertexCount(); ++i) {
+			float height_a = simd.Height(i), height_b = scalar.Height(i);
+			XMFLOAT3 normal_a = simd.Normal(i), normal_b = scalar.Normal(i);
+			XMFLOAT3 tangent_a = simd.TangentX(i), tangent_b = scalar.TangentX(i);
+			differing += std::memcmp(&height_a, &height_b, sizeof(float)) != 0 ||
+				std::memcmp(&normal_a, &normal_b, sizeof(XMFLOAT3)) != 0 ||
+				std::memcmp(&tangent_a, &tangent_b, sizeof(XMFLOAT3)) != 0;
+		}
+		if (differing != 0)
+			CheckFailed() << "Waves: " << differing << " of " << simd.VertexCount() << " points differ between the SIMD and"
+				" scalar kernels on " << thread_cnt << " threads\n";
+	}
+}
+
+// A solver set up with a time step of 0 takes no steps and keeps a finite
+// interpolation alpha, however long the frames.
+void CheckWavesZeroTimeStep() {
+	Waves waves;
+	waves.Init(32, 32, 1.0f, 0.0f, 3.25f, 0.4f);
+	UINT steps = 0;
+	for (UINT k = 0; k < 4; ++k)
+		steps += waves.Update(0.5f);
+	float alpha = waves.InterpolationAlpha();
+	if (steps != 0 || !(alpha >= 0.0f && alpha <= 1.0f))
+		CheckFailed() << "Waves: a time step of 0 takes " << steps << " steps, alpha " << alpha << "\n";
+}
+
+// A vertex buffer that is only rewritten in DirtyRowRanges() has to match
+// one written whole every frame, with the frames blending between steps
+// and a disturbance now and then, also between two steps.
+void CheckWavesDirtyRows() {
+	Waves waves;
+	waves.Init(131, 131, 1.0f, 0.03f, 3.25f, 0.4f);
+	waves.SetActivityThreshold(1e-3f);
+	Waves::VertexLayout layout = { sizeof(WaveVertex), offsetof(WaveVertex, pos),
+		offsetof(WaveVertex, normal), offsetof(WaveVertex, tex) };
+	std::vector<WaveVertex> whole(waves.VertexCount()), kept(waves.VertexCount());
+	waves.WriteVertices(kept.data(), layout, waves.InterpolationAlpha());
+
+	UINT stale_frames = 0;
+	std::vector<std::pair<UINT, UINT>> ranges;
+	for (UINT frame = 0; frame < 1200; ++frame) {
+		if (frame % 97 == 0)
+			waves.Disturb(10 + (frame*7) % 110, 10 + (frame*13) % 110, 1.0f);
+		waves.Update(0.011f);
+
+		float alpha = waves.InterpolationAlpha();
+		waves.WriteVertices(whole.data(), layout, alpha);
+		waves.DirtyRowRanges(ranges);
+		for (const std::pair<UINT, UINT> &range : ranges)
+			waves.WriteVertices(kept.data(), layout, alpha, range.first, range.second);
+		stale_frames += std::memcmp(whole.data(), kept.data(), whole.size()*sizeof(WaveVertex)) != 0;
+		kept = whole;
+	}
+	if (stale_frames != 0)
+		CheckFailed() << "Waves: " << stale_frames << " frames leave vertices outside DirtyRowRanges() stale\n";
+}
+
+void BenchWaves(Benchmark &bench) {
+	if (bench.Selected("waves/")) {
+		CheckWavesSimd();
+		CheckWavesDirtyRows();
+		CheckWavesZeroTimeStep();
+	}
+
+	const UINT sizes[] = { 256, 1024, 4096 };
+
+	std::vector<UINT> thread_cnts = { 1, 2, 4 };
+	UINT hw_cnt = std::thread::hardware_concurrency();
+	if (hw_cnt > 4)
+		thread_cnts.push_back(hw_cnt);
+
+	for (UINT size : sizes) {
+		std::string prefix = "waves/" + std::to_string(size) + "/";
+		double interior = static_cast<double>(size - 2) * (size - 2);
+
+		for (UINT thread_cnt : thread_cnts) {
+			std::string name = prefix + "step/threads:" + std::to_string(thread_cnt);
+			if (!bench.Selected(name))
+				continue;
+
+			Waves waves;
+			InitWaves(waves, size, thread_cnt);
+			UINT step = 0;
+			bench.Run(name, interior, [&]() { StepLikeDemo(waves, step); });
+		}
+
+		if (bench.Selected(prefix + "step_scalar")) {
+			Waves waves;
+			InitWaves(waves, size, 1);
+			waves.SetSimdEnabled(false);
+			UINT step = 0;
+			bench.Run(prefix + "step_scalar", interior, [&]() { StepLikeDemo(waves, step); });
+		}
+
+		if (bench.Selected(prefix + "step_deferred_normals")) {
+			Waves waves;
+			InitWaves(waves, size, 1);
+			waves.SetDeferredNormals(true);
+			UINT step = 0;
+			bench.Run(prefix + "step_deferred_normals", interior, [&]() { StepLikeDemo(waves, step); });
+		}
+
+		// A calm sea with a drop every few steps: most tiles stay asleep.
+		if (bench.Selected(prefix + "step_sparse")) {
+			Waves waves;
+			waves.Init(size, size, 1.0f, 0.03f, 3.25f, 0.4f);
+			waves.SetActivityThreshold(1e-3f);
+			UINT step = 0;
+			bench.Run(prefix + "step_sparse", interior, [&]() {
+				if (step++ % 16 == 0)
+					waves.Disturb(5 + rand() % (size - 10), 5 + rand() % (size - 10), 1.0f);
+				waves.Update(0.03f);
+			});
+		}
+
+		if (bench.Selected(prefix + "write_vertices")) {
+			Waves waves;
+			InitWaves(waves, size, 1);
+			std::vector<WaveVertex> vertices(waves.VertexCount());
+			Waves::VertexLayout layout = { sizeof(WaveVertex), offsetof(WaveVertex, pos),
+				offsetof(WaveVertex, normal), offsetof(WaveVertex, tex) };
+			bench.Run(prefix + "write_vertices", waves.VertexCount(), [&]() {
+				waves.WriteVertices(vertices.data(), layout, 0.5f);
+				Benchmark::DoNotOptimize(vertices[0]);
+			});
+		}
+
+		// On a step boundary, with the stored normals, as copy_loop below.
+		if (bench.Selected(prefix + "write_vertices_stepped")) {
+			Waves waves;
+			InitWaves(waves, size, 1);
+			std::vector<WaveVertex> vertices(waves.VertexCount());
+			Waves::VertexLayout layout = { sizeof(WaveVertex), offsetof(WaveVertex, pos),
+				offsetof(WaveVertex, normal), offsetof(WaveVertex, tex) };
+			bench.Run(prefix + "write_vertices_stepped", waves.VertexCount(), [&]() {
+				waves.WriteVertices(vertices.data(), layout, 1.0f);
+				Benchmark::DoNotOptimize(vertices[0]);
+			});
+		}
+
+		// The loop the demo filled its vertex buffer with before
+		// WriteVertices(): a vertex at a time through the accessors.
+		if (bench.Selected(prefix + "copy_loop")) {
+			Waves waves;
+			InitWaves(waves, size, 1);
+			std::vector<WaveVertex> vertices(waves.VertexCount());
+			bench.Run(prefix + "copy_loop", waves.VertexCount(), [&]() {
+				WaveVertex *v = vertices.data();
+				for (UINT i = 0; i < waves.VertexCount(); ++i) {
+					v[i].pos = waves[i];
+					v[i].normal = waves.Normal(i);
+					v[i].tex.x = 0.5f + waves[i].x / waves.Width();
+					v[i].tex.y = 0.5f - waves[i].z / waves.Depth();
+				}
+				Benchmark::DoNotOptimize(vertices[0]);
+			});
+		}
+
+		// Bytes each path reads from the solver and writes to the vertices
+		// per frame, leaving out the per-row and per-column tables.  On a step
+		// boundary both read a height and a stored normal; between two steps
+		// WriteVertices() reads both height planes and derives the normal.
+		if (bench.Selected(prefix + "copy_loop") || bench.Selected(prefix + "write_vertices")) {
+			double vertex_cnt = static_cast<double>(size) * size;
+			std::cerr << prefix << ": copy_loop and write_vertices_stepped touch "
+				<< vertex_cnt * (4 + 12 + sizeof(WaveVertex)) << " bytes per frame, write_vertices "
+				<< vertex_cnt * (4 + 4 + sizeof(WaveVertex)) << "\n";
+		}
+	}
+}
+
+// The grid as GeometryGenerator built it before it wrote into presized
+// buffers: a push_back per vertex and per index, on one thread.
+void CreateGridWithPushBack(float length_x, float length_z, UINT num_x, UINT num_z,
+	GeometryGenerator::MeshData &mesh_data) {
+	mesh_data.vertices.clear();
+	mesh_data.indices.clear();
+	mesh_data.vertices.reserve(num_x*num_z);
+	mesh_data.indices.reserve((num_x - 1)*(num_z - 1)*6);
+
+	float x_by2 = length_x / 2.0f, z_by2 = length_z / 2.0f;
+	float dx = length_x / (num_x - 1), dz = length_z / (num_z - 1);
+	float du = 1.0f / (num_x - 1), dv = 1.0f / (num_z - 1);
+	for (UINT iz = 0; iz < num_z; ++iz) {
+		for (UINT ix = 0; ix < num_x; ++ix) {
+			mesh_data.vertices.push_back(GeometryGenerator::Vertex(XMFLOAT3(-x_by2 + ix*dx, 0.0f, z_by2 - iz*dz),
+				XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(ix*du, iz*dv)));
+		}
+	}
+	for (UINT iz = 0; iz < num_z - 1; ++iz) {
+		for (UINT ix = 0; ix < num_x - 1; ++ix) {
+			mesh_data.indices.push_back(iz*num_x + ix);
+			mesh_data.indices.push_back(iz*num_x + ix + 1);
+			mesh_data.indices.push_back((iz + 1)*num_x + ix);
+
+			mesh_data.indices.push_back((iz + 1)*num_x + ix);
+			mesh_data.indices.push_back(iz*num_x + ix + 1);
+			mesh_data.indices.push_back((iz + 1)*num_x + ix + 1);
+		}
+	}
+}
+
+// The geosphere as GeometryGenerator built it before subdivision shared
+// midpoints: every triangle split into six vertices of its own.
+void CreateGeosphereWithSplitTriangles(float radius, UINT num_subdiv, GeometryGenerator::MeshData &mesh_data) {
+	const float x = 0.525731f;
+	const float z = 0.850651f;
+	const XMFLOAT3 pos[12] = {
+		XMFLOAT3(-x, 0.0f, z),  XMFLOAT3(x, 0.0f, z),
+		XMFLOAT3(-x, 0.0f, -z), XMFLOAT3(x, 0.0f, -z),
+		XMFLOAT3(0.0f, z, x),   XMFLOAT3(0.0f, z, -x),
+		XMFLOAT3(0.0f, -z, x),  XMFLOAT3(0.0f, -z, -x),
+		XMFLOAT3(z, x, 0.0f),   XMFLOAT3(-z, x, 0.0f),
+		XMFLOAT3(z, -x, 0.0f),  XMFLOAT3(-z, -x, 0.0f)
+	};
+	const UINT idx[60] = {
+		1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,
+		1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,
+		3,10,7, 10,6,7, 6,11,7, 6,0,11, 6,1,0,
+		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7
+	};
+
+	mesh_data.vertices.resize(12);
+	mesh_data.indices.assign(idx, idx + 60);
+	for (UINT i = 0; i < 12; ++i)
+		mesh_data.vertices[i].position = pos[i];
+
+	auto midpoint = [](const XMFLOAT3 &a, const XMFLOAT3 &b) {
+		return XMFLOAT3(0.5f*(a.x + b.x), 0.5f*(a.y + b.y), 0.5f*(a.z + b.z));
+	};
+	for (UINT level = 0; level < num_subdiv; ++level) {
+		GeometryGenerator::MeshData input = mesh_data;
+		mesh_data.clear();
+		for (size_t i = 0; i < input.indices.size() / 3; ++i) {
+			XMFLOAT3 v0 = input.vertices[input.indices[i * 3 + 0]].position;
+			XMFLOAT3 v1 = input.vertices[input.indices[i * 3 + 1]].position;
+			XMFLOAT3 v2 = input.vertices[input.indices[i * 3 + 2]].position;
+			XMFLOAT3 split[6] = { v0, v1, v2, midpoint(v0, v1), midpoint(v1, v2), midpoint(v0, v2) };
+			for (const XMFLOAT3 &p : split) {
+				GeometryGenerator::Vertex v;
+				v.position = p;
+				mesh_data.vertices.push_back(v);
+			}
+			const UINT tris[12] = { 0, 3, 5,  3, 4, 5,  5, 4, 2,  3, 1, 4 };
+			for (UINT k : tris)
+				mesh_data.indices.push_back(static_cast<UINT>(i * 6 + k));
+		}
+	}
+
+	for (GeometryGenerator::Vertex &v : mesh_data.vertices) {
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&v.position));
+		XMStoreFloat3(&v.normal, n);
+		XMStoreFloat3(&v.position, n*radius);
+		float phi = acosf(v.position.y / radius);
+		float theta = MathHelper::AngleFromXY(v.position.x, v.position.z);
+		v.texcoord = XMFLOAT2(theta / (2.0f*XM_PI), phi / XM_PI);
+		v.tangent = XMFLOAT3(-sinf(theta), 0.0f, cosf(theta));
+	}
+}
+
+// Whether two meshes draw the same triangles, vertex for vertex, however
+// their vertices are shared.
+bool SameTriangles(const GeometryGenerator::MeshData &a, const GeometryGenerator::MeshData &b) {
+	if (a.indices.size() != b.indices.size())
+		return false;
+	for (size_t i = 0; i < a.indices.size(); ++i) {
+		if (std::memcmp(&a.vertices[a.indices[i]], &b.vertices[b.indices[i]], sizeof(GeometryGenerator::Vertex)) != 0)
+			return false;
+	}
+	return true;
+}
+
+bool SameMesh(const GeometryGenerator::MeshData &a, const GeometryGenerator::MeshData &b) {
+	return a.indices == b.indices && a.vertices.size() == b.vertices.size() &&
+		std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(GeometryGenerator::Vertex)) == 0;
+}
+
+// The threaded generator must build exactly what one thread and the old
+// push_back code build.
+void CheckGeometry() {
+	GeometryGenerator parallel;
+	GeometryGenerator serial(1);
+	GeometryGenerator::MeshData expected, mesh;
+
+	CreateGridWithPushBack(300.0f, 200.0f, 601, 401, expected);
+	parallel.CreateGrid(300.0f, 200.0f, 601, 401, mesh);
+	if (!SameMesh(mesh, expected))
+		CheckFailed() << "GeometryGenerator::CreateGrid does not match the push_back grid\n";
+
+	serial.CreateGeosphere(0.5f, 6, expected);
+	parallel.CreateGeosphere(0.5f, 6, mesh);
+	if (!SameMesh(mesh, expected))
+		CheckFailed() << "GeometryGenerator::CreateGeosphere differs between thread counts\n";
+
+	for (UINT n = 0; n <= 7; ++n) {
+		CreateGeosphereWithSplitTriangles(0.5f, n, expected);
+		parallel.CreateGeosphere(0.5f, n, mesh);
+		if (!SameTriangles(mesh, expected))
+			CheckFailed() << "GeometryGenerator::CreateGeosphere(" << n << ") does not match the split triangles\n";
+		else
+			std::cerr << "geosphere " << n << ": " << mesh.vertices.size() << " vertices, "
+				<< expected.vertices.size() << " with split triangles\n";
+	}
+
+	// Past the clamp the sizes would overflow and undersize the _into buffers.
+	UINT vertex_cnt, index_cnt, max_vertex_cnt, max_index_cnt;
+	GeometryGenerator::GeosphereSize(GeometryGenerator::kMaxGeosphereSubdivisions, max_vertex_cnt, max_index_cnt);
+	GeometryGenerator::GeosphereSize(20, vertex_cnt, index_cnt);
+	if (max_index_cnt != 60ull << (2 * GeometryGenerator::kMaxGeosphereSubdivisions) ||
+		vertex_cnt != max_vertex_cnt || index_cnt != max_index_cnt)
+		CheckFailed() << "GeometryGenerator::GeosphereSize does not clamp the subdivisions\n";
+
+	serial.CreateSphere(0.5f, 512, 256, expected);
+	parallel.CreateSphere(0.5f, 512, 256, mesh);
+	if (!SameMesh(mesh, expected))
+		CheckFailed() << "GeometryGenerator::CreateSphere differs between thread counts\n";
+
+	serial.CreateCylinder(0.5f, 0.3f, 3.0f, 256, 512, expected);
+	parallel.CreateCylinder(0.5f, 0.3f, 3.0f, 256, 512, mesh);
+	if (!SameMesh(mesh, expected))
+		CheckFailed() << "GeometryGenerator::CreateCylinder differs between thread counts\n";
+}
+
+void BenchGeometry(Benchmark &bench) {
+	if (bench.Selected("geometry/"))
+		CheckGeometry();
+
+	GeometryGenerator geo_gen;
+	GeometryGenerator serial_gen(1);
+	GeometryGenerator::MeshData mesh;
+
+	// items is the vertex count of the mesh built.
+	auto run = [&](const std::string &name, const std::function<void()> &build) {
+		if (!bench.Selected(name))
+			return;
+		build();
+		bench.Run(name, static_cast<double>(mesh.vertices.size()), build);
+	};
+
+	run("geometry/grid_160x160", [&]() { geo_gen.CreateGrid(160.0f, 160.0f, 160, 160, mesh); });
+	run("geometry/grid_1024x1024", [&]() { geo_gen.CreateGrid(1024.0f, 1024.0f, 1024, 1024, mesh); });
+	run("geometry/grid_1024x1024_push_back", [&]() { CreateGridWithPushBack(1024.0f, 1024.0f, 1024, 1024, mesh); });
+	// 16M vertices and 100M indices, about 1.1 GB.
+	run("geometry/grid_4096x4096", [&]() { geo_gen.CreateGrid(4096.0f, 4096.0f, 4096, 4096, mesh); });
+	run("geometry/grid_4096x4096_serial", [&]() { serial_gen.CreateGrid(4096.0f, 4096.0f, 4096, 4096, mesh); });
+	run("geometry/box", [&]() { geo_gen.CreateBox(1.0f, 1.0f, 1.0f, mesh); });
+	run("geometry/sphere_20x20", [&]() { geo_gen.CreateSphere(0.5f, 20, 20, mesh); });
+	run("geometry/sphere_256x256", [&]() { geo_gen.CreateSphere(0.5f, 256, 256, mesh); });
+	for (UINT n = 1; n <= 7; ++n) {
+		std::string name = "geometry/geosphere_" + std::to_string(n);
+		run(name, [&]() { geo_gen.CreateGeosphere(0.5f, n, mesh); });
+		run(name + "_split_triangles", [&]() { CreateGeosphereWithSplitTriangles(0.5f, n, mesh); });
+	}
+	run("geometry/geosphere_7_serial", [&]() { serial_gen.CreateGeosphere(0.5f, 7, mesh); });
+	run("geometry/cylinder_20x20", [&]() { geo_gen.CreateCylinder(0.5f, 0.3f, 3.0f, 20, 20, mesh); });
+	mesh = GeometryGenerator::MeshData();
+
+	// Straight into buffers that stay allocated between runs, as a caller
+	// writing into a mapped vertex buffer would.
+	std::vector<GeometryGenerator::Vertex> vertices;
+	std::vector<UINT> indices;
+	auto run_into = [&](const std::string &name, UINT vertex_cnt, UINT index_cnt, const std::function<void()> &build) {
+		if (!bench.Selected(name))
+			return;
+		vertices.resize(vertex_cnt);
+		indices.resize(index_cnt);
+		bench.Run(name, vertex_cnt, build);
+		vertices = std::vector<GeometryGenerator::Vertex>();
+		indices = std::vector<UINT>();
+	};
+
+	UINT vertex_cnt, index_cnt;
+	GeometryGenerator::GridSize(4096, 4096, vertex_cnt, index_cnt);
+	run_into("geometry/grid_4096x4096_into", vertex_cnt, index_cnt, [&]() {
+		geo_gen.CreateGrid(4096.0f, 4096.0f, 4096, 4096, vertices.data(), indices.data());
+	});
+	GeometryGenerator::GeosphereSize(7, vertex_cnt, index_cnt);
+	run_into("geometry/geosphere_7_into", vertex_cnt, index_cnt, [&]() {
+		geo_gen.CreateGeosphere(0.5f, 7, vertices.data(), indices.data());
+	});
+}
+
+void BenchMath(Benchmark &bench) {
+	const size_t count = 4096;
+
+	std::vector<XMFLOAT2> points(count);
+	for (XMFLOAT2 &p : points)
+		p = XMFLOAT2(MathHelper::RandF(-1.0f, 1.0f), MathHelper::RandF(-1.0f, 1.0f));
+
+	bench.Run("math/angle_from_xy", count, [&]() {
+		float sum = 0.0f;
+		for (const XMFLOAT2 &p : points)
+			sum += MathHelper::AngleFromXY(p.x, p.y);
+		Benchmark::DoNotOptimize(sum);
+	});
+
+	std::vector<XMFLOAT4X4> worlds(count);
+	for (XMFLOAT4X4 &w : worlds) {
+		XMMATRIX m = XMMatrixScaling(MathHelper::RandF(0.5f, 2.0f), 1.0f, MathHelper::RandF(0.5f, 2.0f)) *
+			XMMatrixRotationY(MathHelper::RandF(0.0f, MathHelper::Pi)) *
+			XMMatrixTranslation(MathHelper::RandF(), MathHelper::RandF(), MathHelper::RandF());
+		XMStoreFloat4x4(&w, m);
+	}
+	std::vector<XMFLOAT4X4> inv_transposes(count);
+
+	bench.Run("math/inverse_transpose", count, [&]() {
+		for (size_t i = 0; i < count; ++i)
+			XMStoreFloat4x4(&inv_transposes[i], MathHelper::InverseTranspose(XMLoadFloat4x4(&worlds[i])));
+		Benchmark::DoNotOptimize(inv_transposes[0]);
+	});
+
+	bench.Run("math/rand_unit_vec3", count, [&]() {
+		XMVECTOR sum = XMVectorZero();
+		for (size_t i = 0; i < count; ++i)
+			sum = XMVectorAdd(sum, MathHelper::RandUnitVec3());
+		Benchmark::DoNotOptimize(sum);
+	});
+}
+
+// The loader as it was before ModelLoader parsed without iostreams; the
+// reference the fast parser must match bit for bit.
+bool LoadTextModelWithStream(std::istream &in, std::vector<ModelLoader::Vertex> &vertices, std::vector<UINT> &indices) {
+	UINT vcount = 0;
+	UINT tcount = 0;
+	std::string ignore;
+
+	in >> ignore >> vcount;
+	in >> ignore >> tcount;
+	in >> ignore >> ignore >> ignore >> ignore;
+
+	vertices.resize(vcount);
+	for (UINT i = 0; i < vcount; ++i) {
+		in >> vertices[i].position.x >> vertices[i].position.y >> vertices[i].position.z;
+		in >> vertices[i].normal.x >> vertices[i].normal.y >> vertices[i].normal.z;
+	}
+
+	in >> ignore >> ignore >> ignore;
+
+	indices.resize(3 * tcount);
+	for (UINT i = 0; i < tcount; ++i)
+		in >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+
+	return !in.fail();
+}
+
+// Checks every model in the directory against the stream parser.
+void CheckModelParser(const Options &options) {
+	const char *names[] = { "skull.txt", "car.txt" };
+	for (const char *name : names) {
+		std::string filename = options.models + "/" + name;
+		std::ifstream fin(filename);
+		if (!fin)
+			continue;
+
+		std::vector<ModelLoader::Vertex> expected_vertices, vertices;
+		std::vector<UINT> expected_indices, indices;
+		bool expected_ok = LoadTextModelWithStream(fin, expected_vertices, expected_indices);
+		bool ok = ModelLoader::LoadTextModel(filename, vertices, indices);
+		bool same = ok == expected_ok && vertices.size() == expected_vertices.size() && indices == expected_indices &&
+			std::memcmp(vertices.data(), expected_vertices.data(), vertices.size() * sizeof(ModelLoader::Vertex)) == 0;
+		if (!same)
+			CheckFailed() << "ModelLoader does not match operator>> on " << filename << "\n";
+	}
+}
+
+void BenchModels(Benchmark &bench, const Options &options) {
+	std::string filename = options.models + "/skull.txt";
+	std::vector<uint8_t> text;
+	if (!ReadFile(filename, text)) {
+		std::cerr << "Skipping the model loader: cannot read " << filename << "\n";
+		return;
+	}
+	std::string contents(text.begin(), text.end());
+	CheckModelParser(options);
+
+	std::vector<ModelLoader::Vertex> vertices;
+	std::vector<UINT> indices;
+	ModelLoader::LoadTextModel(filename, vertices, indices);
+	double bytes = static_cast<double>(text.size());
+
+	// items are bytes of text, so items_per_sec is the parse throughput.
+	bench.Run("model/skull_txt_stream", bytes, [&]() {
+		std::istringstream in(contents);
+		LoadTextModelWithStream(in, vertices, indices);
+	});
+	bench.Run("model/skull_txt_serial", bytes, [&]() {
+		ModelLoader::ParseTextModel(contents.data(), contents.size(), vertices, indices, 1);
+	});
+	bench.Run("model/skull_txt_parallel", bytes, [&]() {
+		ModelLoader::ParseTextModel(contents.data(), contents.size(), vertices, indices, 0);
+	});
+	bench.Run("model/skull_txt_file", bytes, [&]() {
+		ModelLoader::LoadTextModel(filename, vertices, indices);
+	});
+
+	// The same model as a .mesh, mapped in place.  items are bytes of the
+	// .mesh file.
+	std::string mesh_filename = "skull_bench.mesh";
+	if (!MeshFile::Write(mesh_filename, vertices, indices)) {
+		std::cerr << "Skipping the mesh file: cannot write " << mesh_filename << "\n";
+		return;
+	}
+	std::vector<uint8_t> mesh_data;
+	ReadFile(mesh_filename, mesh_data);
+	double mesh_bytes = static_cast<double>(mesh_data.size());
+
+	bench.Run("model/skull_mesh_open", mesh_bytes, [&]() {
+		MeshFile mesh;
+		mesh.Open(mesh_filename);
+		Benchmark::DoNotOptimize(mesh.Vertices());
+	});
+	// Open and read every byte, as CreateBuffer would.
+	bench.Run("model/skull_mesh_read", mesh_bytes, [&]() {
+		MeshFile mesh;
+		mesh.Open(mesh_filename);
+		std::memcpy(vertices.data(), mesh.Vertices(), mesh.VertexCount() * sizeof(MeshFile::Vertex));
+		std::memcpy(indices.data(), mesh.Indices(), mesh.IndexCount() * sizeof(uint32_t));
+		Benchmark::DoNotOptimize(vertices[0]);
+	});
+
+	// A file whose indices run past its vertices, or stop mid-triangle, is
+	// refused.  bad_mesh is closed before each write, since Windows does not
+	// let a mapped file be rewritten.
+	std::vector<UINT> bad_indices = indices;
+	bad_indices[bad_indices.size() / 2] = static_cast<UINT>(vertices.size());
+	MeshFile bad_mesh;
+	if (MeshFile::Write(mesh_filename, vertices, bad_indices) && bad_mesh.Open(mesh_filename))
+		CheckFailed() << "MeshFile::Open accepts an index past the vertices\n";
+	bad_mesh.Close();
+	bad_indices = indices;
+	bad_indices.pop_back();
+	if (MeshFile::Write(mesh_filename, vertices, bad_indices) && bad_mesh.Open(mesh_filename))
+		CheckFailed() << "MeshFile::Open accepts a partial triangle\n";
+	bad_mesh.Close();
+	if (MeshFile::Write(mesh_filename, vertices, indices) && !bad_mesh.Open(mesh_filename))
+		CheckFailed() << "MeshFile::Open refuses the skull\n";
+
+	// The LOD chain comes back as it was written, the mesh itself first.
+	std::vector<UINT> lod_indices = indices;
+	std::vector<MeshFile::Lod> lods;
+	MeshFile::BuildLods(vertices, lod_indices, lods);
+	bad_mesh.Close();
+	if (!MeshFile::Write(mesh_filename, vertices, lod_indices, lods) || !bad_mesh.Open(mesh_filename) ||
+		bad_mesh.LodCount() != lods.size() || bad_mesh.LodIndexCount() != lod_indices.size() ||
+		bad_mesh.IndexCount() != lods[0].index_cnt ||
+		std::memcmp(bad_mesh.Lods(), lods.data(), lods.size() * sizeof(MeshFile::Lod)) != 0 ||
+		std::memcmp(bad_mesh.Indices(), lod_indices.data(), lod_indices.size() * sizeof(UINT)) != 0)
+		CheckFailed() << "MeshFile does not read back the LOD chain it wrote\n";
+	bad_mesh.Close();
+	std::remove(mesh_filename.c_str());
+}
+
+void ReportCacheStats(const std::string &name, const MeshOptimizer::Report &report) {
+	std::cerr << name << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+		<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr << "\n";
+}
+
+// items are triangles.
+void BenchMeshOptimizer(Benchmark &bench, const Options &options) {
+	GeometryGenerator generator;
+	GeometryGenerator::MeshData sphere;
+	generator.CreateSphere(1.0f, 64, 64, sphere);
+
+	std::vector<ModelLoader::Vertex> skull_vertices;
+	std::vector<UINT> skull_indices;
+	bool have_skull = ModelLoader::LoadTextModel(options.models + "/skull.txt", skull_vertices, skull_indices);
+
+	if (bench.Selected("mesh/optimize_sphere")) {
+		GeometryGenerator::MeshData mesh = sphere;
+		ReportCacheStats("mesh/optimize_sphere", MeshOptimizer::Optimize(mesh));
+	}
+	bench.Run("mesh/optimize_sphere", sphere.indices.size() / 3.0, [&]() {
+		GeometryGenerator::MeshData mesh = sphere;
+		MeshOptimizer::Optimize(mesh);
+		Benchmark::DoNotOptimize(mesh.indices[0]);
+	});
+	if (!have_skull)
+		return;
+
+	if (bench.Selected("mesh/optimize_skull")) {
+		std::vector<ModelLoader::Vertex> vertices = skull_vertices;
+		std::vector<UINT> indices = skull_indices;
+		ReportCacheStats("mesh/optimize_skull", MeshOptimizer::Optimize(vertices, indices));
+	}
+	bench.Run("mesh/optimize_skull", skull_indices.size() / 3.0, [&]() {
+		std::vector<ModelLoader::Vertex> vertices = skull_vertices;
+		std::vector<UINT> indices = skull_indices;
+		MeshOptimizer::Optimize(vertices, indices);
+		Benchmark::DoNotOptimize(indices[0]);
+	});
+	bench.Run("mesh/simulate_cache_skull", skull_indices.size() / 3.0, [&]() {
+		MeshOptimizer::CacheStats stats = MeshOptimizer::SimulateCache(skull_indices.data(), skull_indices.size(),
+			static_cast<UINT>(skull_vertices.size()));
+		Benchmark::DoNotOptimize(stats.transform_cnt);
+	});
+}
+
+// items are triangles of the full mesh.
+void BenchMeshSimplifier(Benchmark &bench, const Options &options) {
+	std::vector<ModelLoader::Vertex> vertices;
+	std::vector<UINT> indices;
+	if (!ModelLoader::LoadTextModel(options.models + "/skull.txt", vertices, indices))
+		return;
+
+	const std::vector<float> ratios = { 1.0f, 0.5f, 0.25f, 0.1f };
+	if (bench.Selected("mesh/simplify_skull_lod_chain")) {
+		std::vector<UINT> lod_indices;
+		std::vector<MeshSimplifier::Lod> lods;
+		MeshSimplifier::BuildLodChain(vertices, indices, ratios, lod_indices, lods);
+		for (const MeshSimplifier::Lod &lod : lods)
+			std::cerr << "mesh/simplify_skull_lod_chain: ratio " << lod.ratio << ", " << lod.index_cnt / 3
+				<< " triangles, error " << lod.error << "\n";
+	}
+	bench.Run("mesh/simplify_skull_lod_chain", indices.size() / 3.0, [&]() {
+		std::vector<UINT> lod_indices;
+		std::vector<MeshSimplifier::Lod> lods;
+		MeshSimplifier::BuildLodChain(vertices, indices, ratios, lod_indices, lods);
+		Benchmark::DoNotOptimize(lod_indices[0]);
+	});
+}
+
+void ReportQuantizationError(const std::string &name, size_t float_size, size_t quantized_size,
+	const VertexQuantizer::Error &error) {
+	std::cerr << name << ": " << float_size << " -> " << quantized_size << " bytes per vertex, max error: position "
+		<< error.position << ", normal " << error.normal << " deg, tangent " << error.tangent
+		<< " deg, texcoord " << error.texcoord << "\n";
+}
+
+// items are vertices.
+void BenchVertexQuantizer(Benchmark &bench, const Options &options) {
+	GeometryGenerator generator;
+	GeometryGenerator::MeshData sphere;
+	generator.CreateSphere(1.0f, 64, 64, sphere);
+
+	if (bench.Selected("mesh/quantize_sphere")) {
+		std::vector<VertexQuantizer::Vertex> quantized;
+		VertexQuantizer::Bounds bounds = VertexQuantizer::Quantize(sphere.vertices, quantized);
+		ReportQuantizationError("mesh/quantize_sphere", sizeof(GeometryGenerator::Vertex), sizeof(VertexQuantizer::Vertex),
+			VertexQuantizer::MeasureError(sphere.vertices, quantized, bounds));
+	}
+	std::vector<VertexQuantizer::Vertex> sphere_out;
+	bench.Run("mesh/quantize_sphere", static_cast<double>(sphere.vertices.size()), [&]() {
+		VertexQuantizer::Quantize(sphere.vertices, sphere_out);
+		Benchmark::DoNotOptimize(sphere_out[0]);
+	});
+
+	std::vector<ModelLoader::Vertex> skull;
+	std::vector<UINT> indices;
+	if (!ModelLoader::LoadTextModel(options.models + "/skull.txt", skull, indices))
+		return;
+
+	const size_t stride = sizeof(ModelLoader::Vertex);
+	std::vector<VertexQuantizer::PosNormal> skull_out;
+	if (bench.Selected("mesh/quantize_skull")) {
+		VertexQuantizer::Bounds bounds = VertexQuantizer::Quantize(&skull[0].position, &skull[0].normal, stride,
+			skull.size(), skull_out);
+		ReportQuantizationError("mesh/quantize_skull", stride, sizeof(VertexQuantizer::PosNormal),
+			VertexQuantizer::MeasureError(&skull[0].position, &skull[0].normal, stride, skull_out, bounds));
+	}
+	bench.Run("mesh/quantize_skull", static_cast<double>(skull.size()), [&]() {
+		VertexQuantizer::Quantize(&skull[0].position, &skull[0].normal, stride, skull.size(), skull_out);
+		Benchmark::DoNotOptimize(skull_out[0]);
+	});
+}
+
+// Re-expands the packed triangles and compares them with the originals.
+void CheckIndexPacker(const std::string &name, const GeometryGenerator::MeshData &mesh) {
+	std::vector<uint16_t> packed;
+	std::vector<UINT> remap;
+	std::vector<IndexPacker::SubMesh> submeshes;
+	IndexPacker::Split(mesh.indices.data(), mesh.indices.size(), static_cast<UINT>(mesh.vertices.size()),
+		packed, remap, submeshes);
+
+	std::vector<UINT> expanded;
+	IndexPacker::Expand(packed.data(), submeshes, remap, expanded);
+	bool fits = true;
+	for (const IndexPacker::SubMesh &submesh : submeshes)
+		fits = fits && submesh.vertex_cnt <= IndexPacker::kMaxVertices16;
+	if (expanded != mesh.indices || !fits)
+		CheckFailed() << "IndexPacker does not round-trip " << name << "\n";
+	else
+		std::cerr << name << ": " << mesh.vertices.size() << " -> " << remap.size() << " vertices in "
+			<< submeshes.size() << " sub-meshes, index bytes " << mesh.indices.size() * sizeof(UINT)
+			<< " -> " << packed.size() * sizeof(uint16_t) << "\n";
+}
+
+// items are triangles.
+void BenchIndexPacker(Benchmark &bench) {
+	// 512x512 vertices: four times what 16 bits can reach.
+	GeometryGenerator generator;
+	GeometryGenerator::MeshData grid;
+	generator.CreateGrid(160.0f, 160.0f, 512, 512, grid);
+	if (bench.Selected("mesh/split_indices_grid"))
+		CheckIndexPacker("mesh/split_indices_grid", grid);
+
+	std::vector<uint16_t> packed;
+	std::vector<UINT> remap;
+	std::vector<IndexPacker::SubMesh> submeshes;
+	bench.Run("mesh/split_indices_grid", grid.indices.size() / 3.0, [&]() {
+		IndexPacker::Split(grid.indices.data(), grid.indices.size(), static_cast<UINT>(grid.vertices.size()),
+			packed, remap, submeshes);
+		Benchmark::DoNotOptimize(packed[0]);
+	});
+
+	GeometryGenerator::MeshData sphere;
+	generator.CreateSphere(1.0f, 64, 64, sphere);
+	bench.Run("mesh/narrow_indices_sphere", sphere.indices.size() / 3.0, [&]() {
+		IndexPacker::Narrow(sphere.indices.data(), sphere.indices.size(), packed);
+		Benchmark::DoNotOptimize(packed[0]);
+	});
+}
+
+// A chunk the way the demos build their hills: a grid, then the height and
+// the normal of every vertex on its own.
+void BuildChunkPerVertex(const ChunkedTerrain::Desc &desc, int x, int z, std::vector<ChunkedTerrain::Vertex> &vertices) {
+	UINT n = desc.chunk_vertices;
+	GeometryGenerator::MeshData grid;
+	GeometryGenerator(1).CreateGrid(desc.chunk_size, desc.chunk_size, n, n, grid);
+	vertices.resize(grid.vertices.size());
+	for (size_t i = 0; i < grid.vertices.size(); ++i) {
+		float px = grid.vertices[i].position.x + (x + 0.5f)*desc.chunk_size;
+		float pz = grid.vertices[i].position.z + (z + 0.5f)*desc.chunk_size;
+		vertices[i].pos = XMFLOAT3(px, 0.3f*(pz*sinf(0.1f*px) + px*cosf(0.1f*pz)), pz);
+		XMFLOAT3 normal(-0.03f*pz*cosf(0.1f*px) - 0.3f*cosf(0.1f*pz), 1.0f,
+			-0.3f*sinf(0.1f*px) + 0.03f*px*sinf(0.1f*pz));
+		XMStoreFloat3(&vertices[i].normal, XMVector3Normalize(XMLoadFloat3(&normal)));
+		vertices[i].tex = grid.vertices[i].texcoord;
+	}
+}
+
+// The vector rows must match the scalar height field exactly, and chunks
+// must meet their neighbours without cracks.
+void CheckTerrain(const ChunkedTerrain &terrain) {
+	UINT n = terrain.GetDesc().chunk_vertices;
+	std::vector<ChunkedTerrain::Vertex> chunk(terrain.VertexCount()), east(terrain.VertexCount());
+	terrain.BuildChunk(-3, 7, chunk.data());
+	terrain.BuildChunk(-2, 7, east.data());
+
+	bool exact = true, seamless = true;
+	for (const ChunkedTerrain::Vertex &v : chunk) {
+		XMFLOAT3 normal = ChunkedTerrain::HillNormal(v.pos.x, v.pos.z);
+		exact = exact && v.pos.y == ChunkedTerrain::HillHeight(v.pos.x, v.pos.z) &&
+			std::memcmp(&normal, &v.normal, sizeof(normal)) == 0;
+	}
+	for (UINT i = 0; i < n; ++i)
+		seamless = seamless && std::memcmp(&chunk[i*n + n - 1].pos, &east[i*n].pos, sizeof(XMFLOAT3)) == 0;
+	if (!exact)
+		CheckFailed() << "ChunkedTerrain::BuildChunk does not match HillHeight and HillNormal\n";
+	if (!seamless)
+		CheckFailed() << "ChunkedTerrain chunks do not meet their neighbours\n";
+}
+
+// items are vertices for the builds and Update() calls for the walk.
+void BenchTerrain(Benchmark &bench) {
+	ChunkedTerrain::Desc desc;
+	desc.chunk_vertices = 65;
+	desc.thread_cnt = 1;
+	ChunkedTerrain terrain(desc);
+	if (bench.Selected("terrain/"))
+		CheckTerrain(terrain);
+
+	std::vector<ChunkedTerrain::Vertex> vertices(terrain.VertexCount());
+	bench.Run("terrain/build_chunk_65", terrain.VertexCount(), [&]() {
+		terrain.BuildChunk(12, -5, vertices.data());
+		Benchmark::DoNotOptimize(vertices[0]);
+	});
+	bench.Run("terrain/build_chunk_65_per_vertex", terrain.VertexCount(), [&]() {
+		BuildChunkPerVertex(desc, 12, -5, vertices);
+		Benchmark::DoNotOptimize(vertices[0]);
+	});
+
+	// A walk across the map, a chunk every four steps, building what comes
+	// into range on the calling thread.  The slots never grow in number.
+	if (!bench.Selected("terrain/stream_walk"))
+		return;
+	float focus_x = 0.0f;
+	std::vector<ChunkedTerrain::Chunk> chunks;
+	bench.Run("terrain/stream_walk", 1, [&]() {
+		focus_x += 0.25f*desc.chunk_size;
+		terrain.Update(focus_x, 0.5f*focus_x);
+		terrain.ReadyChunks(chunks);
+		Benchmark::DoNotOptimize(chunks.size());
+	});
+	std::cerr << "terrain/stream_walk: " << focus_x / desc.chunk_size << " chunks travelled, "
+		<< chunks.size() << " drawn, " << terrain.SlotCount() << " slots of "
+		<< terrain.VertexCount() * sizeof(ChunkedTerrain::Vertex) << " bytes\n";
+}
+
+struct TerrainMeshStats {
+	size_t triangles = 0;
+	size_t cracks = 0;			// edges of one triangle inside the root
+	size_t overlaps = 0;		// edges of three triangles or more
+	double area = 0.0;			// signed, in the xz plane
+	double flipped_area = 0.0;	// of triangles wound the other way
+};
+
+// Builds every drawn node and matches up the triangles' edges by the exact
+// bits of their end points.  The surface has no cracks when only the edges
+// on the border of the root belong to a single triangle.
+TerrainMeshStats MeasureTerrainMesh(const TerrainQuadtree &tree, const std::vector<TerrainQuadtree::DrawItem> &draws,
+	bool stitched) {
+	typedef std::array<uint32_t, 6> Edge;
+	auto bits = [](float f) {
+		uint32_t u;
+		std::memcpy(&u, &f, sizeof(u));
+		return u;
+	};
+
+	UINT n = tree.GetDesc().patch_vertices;
+	std::vector<ChunkedTerrain::Vertex> vertices(tree.VertexCount());
+	tree.BuildNode(0, 0, 0, vertices.data());
+	float min_x = vertices[0].pos.x, max_x = vertices[n - 1].pos.x;
+	float max_z = vertices[0].pos.z, min_z = vertices[(n - 1)*n].pos.z;
+
+	TerrainMeshStats stats;
+	std::vector<Edge> edges;
+	for (const TerrainQuadtree::DrawItem &draw : draws) {
+		tree.BuildNode(draw.depth, draw.x, draw.z, vertices.data());
+		UINT offset = draw.index_offset, cnt = draw.index_cnt;
+		if (!stitched)
+			tree.PatternRange(0, offset, cnt);
+		for (UINT i = offset; i < offset + cnt; i += 3) {
+			const XMFLOAT3 *p[3];
+			for (int k = 0; k < 3; ++k)
+				p[k] = &vertices[tree.Indices()[i + k]].pos;
+			double area = 0.5*((double(p[1]->x) - p[0]->x)*(double(p[2]->z) - p[0]->z) -
+				(double(p[2]->x) - p[0]->x)*(double(p[1]->z) - p[0]->z));
+			stats.area += area;
+			if (area > 0.0)
+				stats.flipped_area += area;
+			++stats.triangles;
+
+			for (int k = 0; k < 3; ++k) {
+				const XMFLOAT3 &a = *p[k], &b = *p[(k + 1) % 3];
+				bool border = (a.x == min_x && b.x == min_x) || (a.x == max_x && b.x == max_x) ||
+					(a.z == min_z && b.z == min_z) || (a.z == max_z && b.z == max_z);
+				if (border)
+					continue;
+				Edge ea = { bits(a.x), bits(a.y), bits(a.z), bits(b.x), bits(b.y), bits(b.z) };
+				Edge eb = { bits(b.x), bits(b.y), bits(b.z), bits(a.x), bits(a.y), bits(a.z) };
+				edges.push_back(std::min(ea, eb));
+			}
+		}
+	}
+
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size();) {
+		size_t j = i;
+		while (j < edges.size() && edges[j] == edges[i])
+			++j;
+		if (j - i == 1)
+			++stats.cracks;
+		else if (j - i > 2)
+			++stats.overlaps;
+		i = j;
+	}
+	return stats;
+}
+
+// The crack test: from several eyes the stitched selection must close up
+// and cover the root once, and the same nodes without stitching must not.
+void CheckTerrainQuadtree(const TerrainQuadtree &tree) {
+	TerrainQuadtree quadtree = tree;
+	float size = tree.GetDesc().size;
+	const XMFLOAT3 eyes[] = {
+		XMFLOAT3(0.0f, 50.0f, 0.0f),
+		XMFLOAT3(0.3f*size, 400.0f, -0.2f*size),
+		XMFLOAT3(-0.45f*size, ChunkedTerrain::HillHeight(-0.45f*size, 0.45f*size) + 20.0f, 0.45f*size)
+	};
+	std::vector<TerrainQuadtree::DrawItem> draws;
+	for (const XMFLOAT3 &eye : eyes) {
+		quadtree.Select(eye, 0.25f*XM_PI, 720.0f, 1.0f, draws);
+		TerrainMeshStats stitched = MeasureTerrainMesh(quadtree, draws, true);
+		TerrainMeshStats unstitched = MeasureTerrainMesh(quadtree, draws, false);
+		double root_area = double(size)*size;
+		bool covered = std::fabs(-stitched.area - root_area) <= 1e-4*root_area && stitched.flipped_area == 0.0;
+		if (stitched.cracks != 0 || stitched.overlaps != 0 || !covered || unstitched.cracks == 0)
+			CheckFailed() << "TerrainQuadtree cracks from (" << eye.x << ", " << eye.y << ", " << eye.z << "): "
+				<< stitched.cracks << " open edges, " << stitched.overlaps << " overlapping, area "
+				<< -stitched.area / root_area << " of the root; " << unstitched.cracks << " open unstitched\n";
+		else
+			std::cerr << "terrain/quadtree: " << draws.size() << " nodes, " << stitched.triangles
+				<< " triangles, no cracks (" << unstitched.cracks << " open edges unstitched)\n";
+	}
+}
+
+// items are selections and trees built.
+void BenchTerrainQuadtree(Benchmark &bench) {
+	if (!bench.Selected("terrain/quadtree"))
+		return;
+
+	TerrainQuadtree tree{ TerrainQuadtree::Desc() };
+	CheckTerrainQuadtree(tree);
+
+	std::vector<TerrainQuadtree::DrawItem> draws;
+	float radius = 0.3f*tree.GetDesc().size;
+	float t = 0.0f;
+	bench.Run("terrain/quadtree_select", 1, [&]() {
+		// Fly in a circle over the hills.
+		t += 0.01f;
+		XMFLOAT3 eye(radius*cosf(t), 200.0f, radius*sinf(t));
+		tree.Select(eye, 0.25f*XM_PI, 720.0f, 1.0f, draws);
+		Benchmark::DoNotOptimize(draws.size());
+	});
+
+	bench.Run("terrain/quadtree_build", 1, [&]() {
+		TerrainQuadtree built{ TerrainQuadtree::Desc() };
+		Benchmark::DoNotOptimize(built.NodeError(0, 0, 0));
+	});
+}
+
+// Parses the headers and walks the mip chain the way the loader does before it
+// creates the texture.
+size_t DescribeDDS(const std::vector<uint8_t> &data) {
+	const DDS_HEADER *header = nullptr;
+	size_t offset = 0;
+	DDS_TEXTURE_INFO info;
+	if (FAILED(ParseDDSHeader(data.data(), data.size(), &header, &offset)) ||
+		FAILED(GetDDSTextureInfo(header, &info)))
+		return 0;
+
+	size_t total = 0;
+	size_t width = info.width;
+	size_t height = info.height;
+	for (uint32_t level = 0; level < info.mipCount; ++level) {
+		size_t num_bytes = 0;
+		GetSurfaceInfo(width, height, info.format, &num_bytes, nullptr, nullptr);
+		total += num_bytes;
+		width = std::max<size_t>(width / 2, 1);
+		height = std::max<size_t>(height / 2, 1);
+	}
+	return total * info.arraySize;
+}
+
+void BenchDDS(Benchmark &bench, const Options &options) {
+	// A 1024x1024 BC1 texture with a full mip chain; the texels are never read.
+	std::vector<uint8_t> synthetic(sizeof(uint32_t) + sizeof(DDS_HEADER));
+	DDS_HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(DDS_HEADER);
+	header.flags = DDS_HEIGHT | DDS_WIDTH;
+	header.width = 1024;
+	header.height = 1024;
+	header.mipMapCount = 11;
+	header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+	header.ddspf.flags = DDS_FOURCC;
+	header.ddspf.fourCC = MAKEFOURCC('D', 'X', 'T', '1');
+	memcpy(synthetic.data(), &DDS_MAGIC, sizeof(uint32_t));
+	memcpy(synthetic.data() + sizeof(uint32_t), &header, sizeof(header));
+
+	bench.Run("dds/header_bc1_1024", 1, [&]() {
+		size_t bytes = DescribeDDS(synthetic);
+		Benchmark::DoNotOptimize(bytes);
+	});
+
+	const char *files[] = { "grass.dds", "water2.dds", "WoodCrate01.dds" };
+	for (const char *file : files) {
+		std::string name = std::string("dds/header_") + file;
+		if (!bench.Selected(name))
+			continue;
+
+		std::vector<uint8_t> data;
+		if (!ReadFile(options.textures + "/" + file, data) || DescribeDDS(data) == 0) {
+			std::cerr << "Skipping " << name << ": cannot read or parse " << file << "\n";
+			continue;
+		}
+		bench.Run(name, 1, [&]() {
+			size_t bytes = DescribeDDS(data);
+			Benchmark::DoNotOptimize(bytes);
+		});
+
+		// Asking a file for its size and format: reading all of it, as the
+		// loader used to, against reading the headers alone.
+		std::string path = options.textures + "/" + file;
+		DDS_TEXTURE_INFO info, info_read;
+		const DDS_HEADER *header = nullptr;
+		size_t offset = 0;
+		if (FAILED(GetDDSTextureInfoFromFile(path.c_str(), &info)) ||
+			FAILED(ParseDDSHeader(data.data(), data.size(), &header, &offset)) ||
+			FAILED(GetDDSTextureInfo(header, &info_read)) || info.width != info_read.width ||
+			info.height != info_read.height || info.depth != info_read.depth || info.arraySize != info_read.arraySize ||
+			info.mipCount != info_read.mipCount || info.format != info_read.format)
+			CheckFailed() << "GetDDSTextureInfoFromFile: " << file << " differs from its headers\n";
+
+		bench.Run(std::string("dds/read_whole_") + file, 1, [&]() {
+			std::vector<uint8_t> whole;
+			ReadFile(path, whole);
+			Benchmark::DoNotOptimize(DescribeDDS(whole));
+		});
+		bench.Run(std::string("dds/info_from_file_") + file, 1, [&]() {
+			DDS_TEXTURE_INFO mapped;
+			Benchmark::DoNotOptimize(GetDDSTextureInfoFromFile(path.c_str(), &mapped));
+		});
+
+		// Loading the texels, with the copy Direct3D makes of the initial data
+		// standing in for the upload: from a heap copy of the file, as the
+		// loader used to, and straight from a mapping of it.
+		std::vector<uint8_t> upload(data.size() - offset);
+		bench.Run(std::string("dds/load_read_") + file, 1, [&]() {
+			std::vector<uint8_t> whole;
+			ReadFile(path, whole);
+			memcpy(upload.data(), whole.data() + offset, upload.size());
+			Benchmark::DoNotOptimize(upload.data());
+		});
+		bench.Run(std::string("dds/load_mapped_") + file, 1, [&]() {
+			MappedFile mapped;
+			mapped.Open(path);
+			memcpy(upload.data(), mapped.Data() + offset, upload.size());
+			Benchmark::DoNotOptimize(upload.data());
+		});
+	}
+}
+
+// Plays the whole loop twice, waiting for every Update() to finish, and
+// compares each frame with the texels in its file.
+void CheckFlipbook(const FlipbookStreamer::Desc &desc) {
+	FlipbookStreamer fire;
+	fire.Open(desc);
+	UINT mismatches = 0;
+	std::vector<uint8_t> data;
+	for (UINT i = 0; i < 2*fire.FrameCount(); ++i) {
+		UINT index = i % fire.FrameCount();
+		fire.Update(index);
+		fire.Flush();
+
+		FlipbookStreamer::Frame frame;
+		const DDS_HEADER *header = nullptr;
+		size_t offset = 0;
+		if (!fire.GetFrame(index, frame) || !ReadFile(desc.filenames[index], data) ||
+			FAILED(ParseDDSHeader(data.data(), data.size(), &header, &offset)) ||
+			memcmp(frame.data, data.data() + offset, fire.FrameBytes()) != 0)
+			++mismatches;
+	}
+	if (mismatches != 0 || fire.FailedLoads() != 0)
+		CheckFailed() << "FlipbookStreamer: " << mismatches << " frames differ from their files, "
+			<< fire.FailedLoads() << " failed to load\n";
+}
+
+// items are frames.
+void BenchFlipbook(Benchmark &bench, const Options &options) {
+	if (!bench.Selected("fire/"))
+		return;
+
+	FlipbookStreamer::Desc desc;
+	for (UINT i = 0; i < 120; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "/Fire%03u.DDS", i + 1);
+		desc.filenames.push_back(options.fire + name);
+	}
+	FlipbookStreamer probe;
+	if (!probe.Open(desc)) {
+		std::cerr << "Skipping fire/: cannot read " << desc.filenames[0] << "\n";
+		return;
+	}
+	probe.Close();
+	CheckFlipbook(desc);
+
+	// What the Crate demo did at startup: every frame read and kept.
+	std::vector<std::vector<uint8_t>> frames(desc.filenames.size());
+	bench.Run("fire/load_all_frames", static_cast<UINT>(frames.size()), [&]() {
+		for (size_t i = 0; i < frames.size(); ++i)
+			ReadFile(desc.filenames[i], frames[i]);
+		Benchmark::DoNotOptimize(frames.back().data());
+	});
+
+	// Until the first frame can be shown.
+	bench.Run("fire/open_streamer", 1, [&]() {
+		FlipbookStreamer fire;
+		fire.Open(desc);
+		FlipbookStreamer::Frame frame;
+		while (!fire.GetFrame(0, frame))
+			std::this_thread::yield();
+		Benchmark::DoNotOptimize(frame.data);
+	});
+
+	// What the demo pays on its own thread each frame once the frame shown is
+	// resident.
+	FlipbookStreamer fire;
+	fire.Open(desc);
+	fire.Flush();
+	bench.Run("fire/update", 1, [&]() {
+		fire.Update(0);
+		FlipbookStreamer::Frame frame;
+		Benchmark::DoNotOptimize(fire.GetFrame(0, frame));
+	});
+
+	// A new frame a call, waiting for each: how many frames a second the
+	// reader sustains, against the 30 the demo shows.
+	UINT index = 0;
+	bench.Run("fire/stream_loop", 1, [&]() {
+		index = (index + 1) % fire.FrameCount();
+		fire.Update(index);
+		FlipbookStreamer::Frame frame;
+		while (!fire.GetFrame(index, frame))
+			std::this_thread::yield();
+		Benchmark::DoNotOptimize(frame.data);
+	});
+
+	size_t all_bytes = 0;
+	for (const std::vector<uint8_t> &f : frames)
+		all_bytes += f.size();
+	std::cerr << "fire/: " << fire.SlotCount() << " frames resident in " << fire.SlotCount()*fire.FrameBytes()
+		<< " bytes, against " << all_bytes << " for all " << frames.size() << "\n";
+}
+
+// Loads the files with one thread a stage and one file at a time, and with
+// the defaults, and compares what reached the backend with each other and
+// with the files' headers.  A missing file has to fail on its own.
+void CheckTexturePipeline(const std::vector<std::string> &files) {
+	TexturePipeline::Desc serial_desc;
+	serial_desc.io_threads = 1;
+	serial_desc.cpu_threads = 1;
+	serial_desc.max_in_flight = 1;
+	NullTextureBackend serial;
+	{
+		TexturePipeline pipeline(serial_desc, serial);
+		for (const std::string &file : files)
+			pipeline.Load(file);
+	}
+
+	NullTextureBackend parallel;
+	TexturePipeline pipeline(TexturePipeline::Desc(), parallel);
+	for (const std::string &file : files)
+		pipeline.Load(file);
+	UINT missing = pipeline.Load(files[0] + ".missing");
+
+	UINT mismatches = 0;
+	for (UINT i = 0; i < files.size(); ++i) {
+		DDS_TEXTURE_INFO info, expected;
+		if (FAILED(pipeline.Wait(i)) || !parallel.GetInfo(i, info) ||
+			FAILED(GetDDSTextureInfoFromFile(files[i].c_str(), &expected)) ||
+			info.width != expected.width || info.height != expected.height || info.depth != expected.depth ||
+			info.arraySize != expected.arraySize || info.mipCount != expected.mipCount || info.format != expected.format)
+			++mismatches;
+	}
+	if (SUCCEEDED(pipeline.Wait(missing)))
+		++mismatches;
+	if (mismatches != 0 || parallel.Checksum() != serial.Checksum())
+		CheckFailed() << "TexturePipeline: " << mismatches << " files differ from their headers, checksum "
+			<< parallel.Checksum() << " against " << serial.Checksum() << " loading serially\n";
+}
+
+// items are files: the textures and the fire frames, all at once as a demo
+// asks for them at startup.
+void BenchTexturePipeline(Benchmark &bench, const Options &options) {
+	if (!bench.Selected("tex/"))
+		return;
+
+	std::vector<std::string> files;
+	const char *textures[] = { "grass.dds", "water1.dds", "water2.dds", "WoodCrate01.dds", "WoodCrate02.dds" };
+	for (const char *file : textures)
+		files.push_back(options.textures + "/" + file);
+	for (UINT i = 0; i < 120; ++i) {
+		char name[32];
+		snprintf(name, sizeof(name), "/Fire%03u.DDS", i + 1);
+		files.push_back(options.fire + name);
+	}
+	DDS_TEXTURE_INFO probe;
+	for (const std::string &file : files) {
+		if (FAILED(GetDDSTextureInfoFromFile(file.c_str(), &probe))) {
+			std::cerr << "Skipping tex/: cannot read " << file << "\n";
+			return;
+		}
+	}
+	CheckTexturePipeline(files);
+	UINT file_cnt = static_cast<UINT>(files.size());
+
+	// What the loader does, one file after another: read it whole, find the
+	// subresources, and hand them to the same backend.
+	std::vector<uint8_t> data;
+	bench.Run("tex/serial", file_cnt, [&]() {
+		NullTextureBackend backend;
+		TexturePipeline::Texture texture;
+		for (UINT i = 0; i < file_cnt; ++i) {
+			texture.handle = i;
+			texture.filename = &files[i];
+			if (ReadFile(files[i], data) &&
+				SUCCEEDED(TexturePipeline::FindSubresources(data.data(), data.size(), texture)))
+				backend.Create(texture);
+		}
+		Benchmark::DoNotOptimize(backend.Checksum());
+	});
+
+	TexturePipeline::Stats stats;
+	bench.Run("tex/pipeline", file_cnt, [&]() {
+		NullTextureBackend backend;
+		TexturePipeline pipeline(TexturePipeline::Desc(), backend);
+		for (const std::string &file : files)
+			pipeline.Load(file);
+		pipeline.WaitAll();
+		stats = pipeline.GetStats();
+		Benchmark::DoNotOptimize(backend.Checksum());
+	});
+
+	std::cerr << "tex/pipeline: " << stats.textures << " files, " << stats.bytes << " bytes; read "
+		<< stats.read_ms << " ms, parse " << stats.parse_ms << " ms, create " << stats.create_ms
+		<< " ms summed over the files, " << stats.wall_ms << " ms wall\n";
+}
+
+// The top mip of a DDS file, as RGBA8 texels when it is not block-compressed.
+struct TopMip {
+	std::vector<uint8_t> data;
+	DDS_TEXTURE_INFO info;
+	const uint8_t *texels = nullptr;
+	UINT pitch = 0;
+};
+
+bool LoadTopMip(const std::string &filename, TopMip &mip) {
+	TexturePipeline::Texture texture;
+	if (!ReadFile(filename, mip.data) ||
+		FAILED(TexturePipeline::FindSubresources(mip.data.data(), mip.data.size(), texture)))
+		return false;
+	mip.info = texture.info;
+	mip.texels = texture.subresources[0].data;
+	mip.pitch = texture.subresources[0].row_pitch;
+	if (mip.info.format == DXGI_FORMAT_B8G8R8A8_UNORM) {
+		uint8_t *texels = mip.data.data() + (mip.texels - mip.data.data());
+		for (size_t i = 0; i < static_cast<size_t>(mip.pitch)*mip.info.height; i += 4)
+			std::swap(texels[i], texels[i + 2]);
+		mip.info.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+	return true;
+}
+
+// Decodes hand-made blocks against their palettes worked out by hand, and
+// reports how far a round trip through the encoder moves each surface.  The
+// encoder has to give the same blocks with and without a pool.
+void CheckBlockCompression(const std::vector<std::pair<std::string, TopMip*>> &surfaces) {
+	UINT failures = 0;
+
+	// Red and blue endpoints, texel i taking index i % 4.
+	const uint8_t bc1[8] = { 0x00, 0xF8, 0x1F, 0x00, 0xE4, 0xE4, 0xE4, 0xE4 };
+	const uint8_t bc1_expected[4][4] = { { 255, 0, 0, 255 }, { 0, 0, 255, 255 }, { 170, 0, 85, 255 }, { 85, 0, 170, 255 } };
+	uint8_t rgba[64];
+	BlockCompression::DecodeBC1(bc1, rgba);
+	for (int i = 0; i < 16; ++i)
+		failures += memcmp(rgba + 4*i, bc1_expected[i % 4], 4) != 0;
+
+	// 255 and 0, texel i taking index i % 8.
+	const uint8_t bc4[8] = { 255, 0, 0x88, 0xC6, 0xFA, 0x88, 0xC6, 0xFA };
+	const uint8_t bc4_expected[8] = { 255, 0, 219, 182, 146, 109, 73, 36 };
+	BlockCompression::DecodeBC4(bc4, rgba);
+	for (int i = 0; i < 16; ++i)
+		failures += rgba[4*i] != bc4_expected[i % 8] || rgba[4*i + 1] != 0 || rgba[4*i + 3] != 255;
+
+	// Flat blocks keep their colour to within one step.
+	UINT flat_error = 0;
+	for (int v = 0; v < 256; ++v) {
+		uint8_t flat[64], block[16], decoded[64];
+		for (int i = 0; i < 16; ++i) {
+			flat[4*i] = static_cast<uint8_t>(v);
+			flat[4*i + 1] = static_cast<uint8_t>(255 - v);
+			flat[4*i + 2] = static_cast<uint8_t>(v / 2);
+			flat[4*i + 3] = 255;
+		}
+		BlockCompression::EncodeBC1(flat, block);
+		BlockCompression::DecodeBC1(block, decoded);
+		flat_error = std::max(flat_error, BlockCompression::MeasureError(flat, 16, decoded, 16, 4, 4).max);
+	}
+	failures += flat_error > 1;
+	if (failures != 0)
+		CheckFailed() << "BlockCompression: " << failures << " texels decode wrongly, flat blocks off by "
+			<< flat_error << "\n";
+
+	ThreadPool pool(4);
+	for (const auto &surface : surfaces) {
+		const TopMip &mip = *surface.second;
+		UINT width = mip.info.width, height = mip.info.height;
+		std::vector<uint8_t> source(4*width*height), decoded(4*width*height);
+		if (BlockCompression::BlockBytes(mip.info.format) != 0)
+			BlockCompression::Decode(mip.info.format, mip.texels, mip.pitch, width, height, source.data(), 4*width);
+		else
+			for (UINT y = 0; y < height; ++y)
+				memcpy(source.data() + 4*width*y, mip.texels + y*mip.pitch, 4*width);
+
+		const DXGI_FORMAT formats[] = { DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC3_UNORM };
+		for (DXGI_FORMAT format : formats) {
+			size_t block_pitch = BlockCompression::BlockBytes(format)*((width + 3) / 4);
+			std::vector<uint8_t> blocks(block_pitch*((height + 3) / 4)), blocks_mt(blocks.size());
+			BlockCompression::Encode(format, source.data(), 4*width, width, height, blocks.data(), block_pitch);
+			BlockCompression::Encode(format, source.data(), 4*width, width, height, blocks_mt.data(), block_pitch, &pool);
+			BlockCompression::Decode(format, blocks.data(), block_pitch, width, height, decoded.data(), 4*width, &pool);
+
+			BlockCompression::Error error = BlockCompression::MeasureError(source.data(), 4*width, decoded.data(),
+				4*width, width, height);
+			if (blocks != blocks_mt)
+				CheckFailed() << "BlockCompression: " << surface.first << " encodes differently on a pool\n";
+			std::cerr << surface.first << (format == DXGI_FORMAT_BC1_UNORM ? " as BC1" : " as BC3") << ": "
+				<< mip.pitch*height << " -> " << blocks.size() << " bytes, rms error rgb " << error.rgb_rms
+				<< ", alpha " << error.alpha_rms << ", max " << error.max << "\n";
+		}
+	}
+}
+
+// items are 4x4 blocks.
+void BenchBlockCompression(Benchmark &bench, const Options &options) {
+	if (!bench.Selected("bc/"))
+		return;
+
+	TopMip grass, water, fire;
+	if (!LoadTopMip(options.textures + "/grass.dds", grass) || !LoadTopMip(options.textures + "/water2.dds", water) ||
+		!LoadTopMip(options.fire + "/Fire001.DDS", fire) || fire.info.format != DXGI_FORMAT_R8G8B8A8_UNORM) {
+		std::cerr << "Skipping bc/: cannot read grass.dds, water2.dds or an RGBA8 Fire001.DDS\n";
+		return;
+	}
+	CheckBlockCompression({ { "bc/grass", &grass }, { "bc/water2", &water }, { "bc/fire", &fire } });
+
+	UINT width = grass.info.width, height = grass.info.height;
+	double block_cnt = ((width + 3) / 4)*((height + 3) / 4);
+	std::vector<uint8_t> rgba(4*width*height);
+	BlockCompression::Decode(grass.info.format, grass.texels, grass.pitch, width, height, rgba.data(), 4*width);
+	std::vector<uint8_t> water_rgba(4*water.info.width*water.info.height);
+	bench.Run("bc/decode_bc1_water2", water.info.width*water.info.height / 16.0, [&]() {
+		BlockCompression::Decode(water.info.format, water.texels, water.pitch, water.info.width, water.info.height,
+			water_rgba.data(), 4*water.info.width);
+		Benchmark::DoNotOptimize(water_rgba[0]);
+	});
+	std::vector<uint8_t> grass_rgba(rgba.size());
+	bench.Run("bc/decode_bc3_grass", block_cnt, [&]() {
+		BlockCompression::Decode(grass.info.format, grass.texels, grass.pitch, width, height, grass_rgba.data(), 4*width);
+		Benchmark::DoNotOptimize(grass_rgba[0]);
+	});
+
+	// Re-encoding the decoded grass, and compressing the fire.
+	std::vector<uint8_t> blocks(static_cast<size_t>(16*block_cnt));
+	bench.Run("bc/encode_bc1_grass", block_cnt, [&]() {
+		BlockCompression::Encode(DXGI_FORMAT_BC1_UNORM, rgba.data(), 4*width, width, height, blocks.data(), 8*(width / 4));
+		Benchmark::DoNotOptimize(blocks[0]);
+	});
+	bench.Run("bc/encode_bc3_grass", block_cnt, [&]() {
+		BlockCompression::Encode(DXGI_FORMAT_BC3_UNORM, rgba.data(), 4*width, width, height, blocks.data(), 16*(width / 4));
+		Benchmark::DoNotOptimize(blocks[0]);
+	});
+	ThreadPool pool;
+	bench.Run("bc/encode_bc3_grass_pool", block_cnt, [&]() {
+		BlockCompression::Encode(DXGI_FORMAT_BC3_UNORM, rgba.data(), 4*width, width, height, blocks.data(), 16*(width / 4),
+			&pool);
+		Benchmark::DoNotOptimize(blocks[0]);
+	});
+	bench.Run("bc/encode_bc3_fire", fire.info.width*fire.info.height / 16.0, [&]() {
+		BlockCompression::Encode(DXGI_FORMAT_BC3_UNORM, fire.texels, fire.pitch, fire.info.width, fire.info.height,
+			blocks.data(), 16*(fire.info.width / 4));
+		Benchmark::DoNotOptimize(blocks[0]);
+	});
+}
+
+// Checks the box filter against 2x2 averages, that it keeps the mean of a
+// surface whose sizes do not halve evenly, and that sRGB grey is filtered
+// in linear light.  Then rebuilds grass.dds's chain from its top level alone,
+// and compares it with the chain it ships with.
+void CheckMipGenerator(const std::vector<uint8_t> &grass_dds) {
+	UINT failures = 0;
+	MipGenerator::Desc linear;
+	linear.srgb = false;
+
+	std::vector<uint8_t> image(4*8*8);
+	for (size_t i = 0; i < image.size(); ++i)
+		image[i] = static_cast<uint8_t>((i*7919 + 13) % 251);
+	std::vector<MipGenerator::Level> levels;
+	MipGenerator::Generate(image.data(), 4*8, 8, 8, linear, levels);
+	failures += levels.size() != 4 || levels[3].width != 1 || levels[3].height != 1;
+	for (UINT y = 0; y < 4; ++y) {
+		for (UINT x = 0; x < 4; ++x) {
+			for (UINT c = 0; c < 4; ++c) {
+				const uint8_t *quad = &image[4*(16*y + 2*x) + c];
+				int sum = quad[0] + quad[4] + quad[32] + quad[36];
+				failures += std::abs(levels[1].rgba[4*(4*y + x) + c] - (sum + 2) / 4) > 1;
+			}
+		}
+	}
+
+	image.resize(4*7*5);
+	MipGenerator::Generate(image.data(), 4*7, 7, 5, linear, levels);
+	double top_mean = 0.0;
+	for (size_t l = 0; l < levels.size(); ++l) {
+		double mean = 0.0;
+		for (size_t i = 0; i < levels[l].rgba.size(); ++i)
+			mean += levels[l].rgba[i];
+		mean /= levels[l].rgba.size();
+		if (l == 0)
+			top_mean = mean;
+		failures += std::fabs(mean - top_mean) > 1.0;
+	}
+	failures += levels.size() != 3 || levels[1].width != 3 || levels[1].height != 2 || levels[2].width != 1;
+
+	// Black and white average to linear 0.5, which is 188 in sRGB.
+	const uint8_t black_white[8] = { 0, 0, 0, 255, 255, 255, 255, 255 };
+	MipGenerator::Generate(black_white, 8, 2, 1, MipGenerator::Desc(), levels);
+	failures += levels[1].rgba[0] != 188 || levels[1].rgba[3] != 255;
+	MipGenerator::Generate(black_white, 8, 2, 1, linear, levels);
+	failures += levels[1].rgba[0] != 128;
+	if (failures != 0)
+		CheckFailed() << "MipGenerator: " << failures << " checks failed\n";
+
+	// grass.dds cut down to its top level.
+	const DDS_HEADER *header = nullptr;
+	size_t offset = 0;
+	DDS_TEXTURE_INFO info;
+	ParseDDSHeader(grass_dds.data(), grass_dds.size(), &header, &offset);
+	GetDDSTextureInfo(header, &info);
+	size_t top_bytes = 0, top_pitch = 0;
+	GetSurfaceInfo(info.width, info.height, info.format, &top_bytes, &top_pitch, nullptr);
+	std::vector<uint8_t> single(grass_dds.begin(), grass_dds.begin() + offset + top_bytes);
+	DDS_HEADER single_header = *header;
+	single_header.mipMapCount = 1;
+	memcpy(single.data() + sizeof(uint32_t), &single_header, sizeof(single_header));
+
+	MipGenerator::Desc desc;
+	desc.wrap = true;
+	desc.mark_srgb = true;
+	std::vector<uint8_t> rebuilt;
+	const DDS_HEADER *rebuilt_header = nullptr;
+	size_t rebuilt_offset = 0;
+	DDS_TEXTURE_INFO rebuilt_info;
+	if (FAILED(MipGenerator::GenerateDDS(single.data(), single.size(), desc, rebuilt)) ||
+		FAILED(ParseDDSHeader(rebuilt.data(), rebuilt.size(), &rebuilt_header, &rebuilt_offset)) ||
+		FAILED(GetDDSTextureInfo(rebuilt_header, &rebuilt_info)) || rebuilt_info.mipCount != info.mipCount ||
+		rebuilt_info.format != MakeSRGB(info.format) || rebuilt.size() - rebuilt_offset != grass_dds.size() - offset ||
+		memcmp(rebuilt.data() + rebuilt_offset, grass_dds.data() + offset, top_bytes) != 0) {
+		CheckFailed() << "MipGenerator: grass.dds does not rebuild to a full sRGB chain\n";
+		return;
+	}
+
+	// Level 1 as shipped, against level 1 rebuilt.
+	UINT width = info.width / 2, height = info.height / 2;
+	size_t level1_pitch = 0;
+	GetSurfaceInfo(width, height, info.format, nullptr, &level1_pitch, nullptr);
+	std::vector<uint8_t> shipped(4*width*height), ours(4*width*height);
+	BlockCompression::Decode(info.format, grass_dds.data() + offset + top_bytes, level1_pitch, width, height,
+		shipped.data(), 4*width);
+	BlockCompression::Decode(info.format, rebuilt.data() + rebuilt_offset + top_bytes, level1_pitch, width, height,
+		ours.data(), 4*width);
+	BlockCompression::Error error = BlockCompression::MeasureError(shipped.data(), 4*width, ours.data(), 4*width,
+		width, height);
+	std::cerr << "mip/grass: " << rebuilt_info.mipCount << " levels rebuilt from " << info.width << "x" << info.height
+		<< ", level 1 rms " << error.rgb_rms << " from the shipped one\n";
+
+	// The pipeline builds the chain of the cut-down file as it loads it.
+	const std::string single_filename = "mip_check_single.dds";
+	{
+		std::ofstream fout(single_filename, std::ios::binary);
+		fout.write(reinterpret_cast<const char*>(single.data()), single.size());
+	}
+	TexturePipeline::Desc pipeline_desc;
+	pipeline_desc.generate_mips = true;
+	NullTextureBackend backend;
+	TexturePipeline pipeline(pipeline_desc, backend);
+	DDS_TEXTURE_INFO loaded;
+	if (FAILED(pipeline.Wait(pipeline.Load(single_filename))) || !backend.GetInfo(0, loaded) ||
+		loaded.mipCount != info.mipCount)
+		CheckFailed() << "TexturePipeline: generate_mips does not give " << single_filename << " a full chain\n";
+	std::remove(single_filename.c_str());
+}
+
+// items are texels of the top level.
+void BenchMipGenerator(Benchmark &bench, const Options &options) {
+	if (!bench.Selected("mip/"))
+		return;
+
+	TopMip grass;
+	std::vector<uint8_t> grass_dds;
+	if (!LoadTopMip(options.textures + "/grass.dds", grass) || !ReadFile(options.textures + "/grass.dds", grass_dds)) {
+		std::cerr << "Skipping mip/: cannot read grass.dds\n";
+		return;
+	}
+	CheckMipGenerator(grass_dds);
+
+	UINT width = grass.info.width, height = grass.info.height;
+	std::vector<uint8_t> rgba(4*width*height);
+	BlockCompression::Decode(grass.info.format, grass.texels, grass.pitch, width, height, rgba.data(), 4*width);
+
+	double texel_cnt = static_cast<double>(width)*height;
+	std::vector<MipGenerator::Level> levels;
+	MipGenerator::Desc desc;
+	desc.wrap = true;
+	bench.Run("mip/box_grass", texel_cnt, [&]() {
+		MipGenerator::Generate(rgba.data(), 4*width, width, height, desc, levels);
+		Benchmark::DoNotOptimize(levels.back().rgba[0]);
+	});
+	MipGenerator::Desc linear = desc;
+	linear.srgb = false;
+	bench.Run("mip/box_grass_linear", texel_cnt, [&]() {
+		MipGenerator::Generate(rgba.data(), 4*width, width, height, linear, levels);
+		Benchmark::DoNotOptimize(levels.back().rgba[0]);
+	});
+	MipGenerator::Desc kaiser = desc;
+	kaiser.filter = MipGenerator::kKaiser;
+	bench.Run("mip/kaiser_grass", texel_cnt, [&]() {
+		MipGenerator::Generate(rgba.data(), 4*width, width, height, kaiser, levels);
+		Benchmark::DoNotOptimize(levels.back().rgba[0]);
+	});
+
+	// The whole file, BC3 levels and all.
+	std::vector<uint8_t> out;
+	bench.Run("mip/dds_grass", texel_cnt, [&]() {
+		MipGenerator::GenerateDDS(grass_dds.data(), grass_dds.size(), desc, out);
+		Benchmark::DoNotOptimize(out[0]);
+	});
+	ThreadPool pool;
+	bench.Run("mip/dds_grass_pool", texel_cnt, [&]() {
+		MipGenerator::GenerateDDS(grass_dds.data(), grass_dds.size(), desc, out, &pool);
+		Benchmark::DoNotOptimize(out[0]);
+	});
+}
+
+// Level l of a packed or source texture as RGBA8.
+bool DecodeLevel(const TexturePipeline::Texture &texture, UINT level, std::vector<uint8_t> &rgba) {
+	UINT width = std::max(texture.info.width >> level, 1u), height = std::max(texture.info.height >> level, 1u);
+	const TexturePipeline::Subresource &subresource = texture.subresources[level];
+	rgba.resize(4*static_cast<size_t>(width)*height);
+	return MipGenerator::DecodeLevel(texture.info.format, subresource.data, subresource.row_pitch, width, height,
+		rgba.data(), 4*width);
+}
+
+// Checks that the tree array holds the trees' blocks untouched, and that
+// every level of an RGBA8 atlas holds the same level of each input exactly,
+// with its gutter repeating the input's edges or wrapping around them.  A
+// BC3 atlas is reported against its inputs.
+void CheckTexturePacker(const std::vector<std::vector<uint8_t>> &trees, const std::vector<TexturePacker::Source> &atlas_sources) {
+	UINT failures = 0;
+
+	std::vector<TexturePacker::Source> tree_sources;
+	for (const std::vector<uint8_t> &tree : trees) {
+		TexturePacker::Source source = { tree.data(), tree.size() };
+		tree_sources.push_back(source);
+	}
+	std::vector<uint8_t> packed;
+	TexturePipeline::Texture array;
+	if (FAILED(TexturePacker::PackArray(tree_sources, packed)) ||
+		FAILED(TexturePipeline::FindSubresources(packed.data(), packed.size(), array)) ||
+		array.info.arraySize != trees.size()) {
+		CheckFailed() << "TexturePacker: the trees do not pack into an array\n";
+		return;
+	}
+	for (size_t i = 0; i < trees.size(); ++i) {
+		TexturePipeline::Texture tree;
+		TexturePipeline::FindSubresources(trees[i].data(), trees[i].size(), tree);
+		failures += tree.info.mipCount != array.info.mipCount || tree.info.format != array.info.format;
+		for (UINT level = 0; level < tree.info.mipCount && level < array.info.mipCount; ++level) {
+			const TexturePipeline::Subresource &a = tree.subresources[level];
+			const TexturePipeline::Subresource &b = array.subresources[i*array.info.mipCount + level];
+			failures += a.slice_pitch != b.slice_pitch || memcmp(a.data, b.data, a.slice_pitch) != 0;
+		}
+	}
+	// grass.dds and water2.dds differ in size.
+	failures += SUCCEEDED(TexturePacker::PackArray(atlas_sources, packed));
+
+	std::vector<TexturePipeline::Texture> inputs(atlas_sources.size());
+	for (size_t i = 0; i < atlas_sources.size(); ++i)
+		TexturePipeline::FindSubresources(atlas_sources[i].data, atlas_sources[i].size, inputs[i]);
+
+	TexturePacker::AtlasDesc desc;
+	desc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	std::vector<TexturePacker::Entry> entries;
+	std::vector<uint8_t> atlas_rgba, input_rgba;
+	for (int wrap = 0; wrap < 2; ++wrap) {
+		desc.wrap = wrap != 0;
+		TexturePipeline::Texture atlas;
+		if (FAILED(TexturePacker::PackAtlas(atlas_sources, desc, packed, entries)) ||
+			FAILED(TexturePipeline::FindSubresources(packed.data(), packed.size(), atlas)) || atlas.info.mipCount != 4) {
+			CheckFailed() << "TexturePacker: the RGBA8 atlas does not pack with a 4-level chain\n";
+			return;
+		}
+
+		for (UINT level = 0; level < atlas.info.mipCount; ++level) {
+			DecodeLevel(atlas, level, atlas_rgba);
+			UINT atlas_width = atlas.info.width >> level;
+			UINT gutter = desc.gutter >> level;
+			for (size_t i = 0; i < entries.size(); ++i) {
+				DecodeLevel(inputs[i], level, input_rgba);
+				UINT x0 = entries[i].x >> level, y0 = entries[i].y >> level;
+				UINT width = entries[i].width >> level, height = entries[i].height >> level;
+				for (UINT y = 0; y < height; ++y)
+					failures += memcmp(&atlas_rgba[4*(static_cast<size_t>(y0 + y)*atlas_width + x0)],
+						&input_rgba[4*static_cast<size_t>(y)*width], 4*width) != 0;
+
+				// The texel a gutter's width up and to the left of the input.
+				UINT sx = wrap ? width - gutter : 0, sy = wrap ? height - gutter : 0;
+				failures += memcmp(&atlas_rgba[4*(static_cast<size_t>(y0 - gutter)*atlas_width + x0 - gutter)],
+					&input_rgba[4*(static_cast<size_t>(sy)*width + sx)], 4) != 0;
+			}
+		}
+	}
+
+	// No two inputs and their gutters overlap.
+	for (size_t i = 0; i < entries.size(); ++i) {
+		for (size_t j = i + 1; j < entries.size(); ++j) {
+			const TexturePacker::Entry &a = entries[i], &b = entries[j];
+			failures += a.x < b.x + b.width + 2*desc.gutter && b.x < a.x + a.width + 2*desc.gutter &&
+				a.y < b.y + b.height + 2*desc.gutter && b.y < a.y + a.height + 2*desc.gutter;
+		}
+	}
+	if (failures != 0)
+		CheckFailed() << "TexturePacker: " << failures << " checks failed\n";
+
+	// In the first input's format, here BC3.
+	desc = TexturePacker::AtlasDesc();
+	TexturePipeline::Texture atlas;
+	if (FAILED(TexturePacker::PackAtlas(atlas_sources, desc, packed, entries)) ||
+		FAILED(TexturePipeline::FindSubresources(packed.data(), packed.size(), atlas))) {
+		CheckFailed() << "TexturePacker: the BC3 atlas does not pack\n";
+		return;
+	}
+	DecodeLevel(atlas, 0, atlas_rgba);
+	double worst_rms = 0.0;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		DecodeLevel(inputs[i], 0, input_rgba);
+		BlockCompression::Error error = BlockCompression::MeasureError(
+			&atlas_rgba[4*(static_cast<size_t>(entries[i].y)*atlas.info.width + entries[i].x)], 4*atlas.info.width,
+			input_rgba.data(), 4*entries[i].width, entries[i].width, entries[i].height);
+		worst_rms = std::max(worst_rms, error.rgb_rms);
+	}
+	std::cerr << "pack/atlas: " << entries.size() << " inputs in " << atlas.info.width << "x" << atlas.info.height
+		<< " with " << atlas.info.mipCount << " levels, " << packed.size() << " bytes; top level rms "
+		<< worst_rms << " at worst from the inputs\n";
+}
+
+// items are texels of the inputs' top levels.
+void BenchTexturePacker(Benchmark &bench, const Options &options) {
+	if (!bench.Selected("pack/"))
+		return;
+
+	std::vector<std::vector<uint8_t>> trees(4);
+	for (size_t i = 0; i < trees.size(); ++i) {
+		if (!ReadFile(options.trees + "/tree" + std::to_string(i) + ".dds", trees[i])) {
+			std::cerr << "Skipping pack/: cannot read the trees\n";
+			return;
+		}
+	}
+	const char *atlas_names[] = { "grass.dds", "water2.dds", "WoodCrate01.dds" };
+	std::vector<std::vector<uint8_t>> atlas_files(3);
+	std::vector<TexturePacker::Source> atlas_sources;
+	double atlas_texels = 0.0;
+	for (size_t i = 0; i < atlas_files.size(); ++i) {
+		TexturePipeline::Texture texture;
+		if (!ReadFile(options.textures + "/" + atlas_names[i], atlas_files[i]) ||
+			FAILED(TexturePipeline::FindSubresources(atlas_files[i].data(), atlas_files[i].size(), texture))) {
+			std::cerr << "Skipping pack/: cannot read " << atlas_names[i] << "\n";
+			return;
+		}
+		TexturePacker::Source source = { atlas_files[i].data(), atlas_files[i].size() };
+		atlas_sources.push_back(source);
+		atlas_texels += static_cast<double>(texture.info.width)*texture.info.height;
+	}
+	CheckTexturePacker(trees, atlas_sources);
+
+	std::vector<TexturePacker::Source> tree_sources;
+	for (const std::vector<uint8_t> &tree : trees) {
+		TexturePacker::Source source = { tree.data(), tree.size() };
+		tree_sources.push_back(source);
+	}
+	std::vector<uint8_t> out;
+	bench.Run("pack/array_trees", 4*512.0*512.0, [&]() {
+		TexturePacker::PackArray(tree_sources, out);
+		Benchmark::DoNotOptimize(out[0]);
+	});
+
+	TexturePacker::AtlasDesc rgba;
+	rgba.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	std::vector<TexturePacker::Entry> entries;
+	bench.Run("pack/atlas_rgba", atlas_texels, [&]() {
+		TexturePacker::PackAtlas(atlas_sources, rgba, out, entries);
+		Benchmark::DoNotOptimize(out[0]);
+	});
+	TexturePacker::AtlasDesc bc3;
+	bench.Run("pack/atlas_bc3", atlas_texels, [&]() {
+		TexturePacker::PackAtlas(atlas_sources, bc3, out, entries);
+		Benchmark::DoNotOptimize(out[0]);
+	});
+	ThreadPool pool;
+	bench.Run("pack/atlas_bc3_pool", atlas_texels, [&]() {
+		TexturePacker::PackAtlas(atlas_sources, bc3, out, entries, &pool);
+		Benchmark::DoNotOptimize(out[0]);
+	});
+}
+
+void CheckFrameStats() {
+	// 60 Hz with a lone 100 ms stall, then a lasting drop to 25 Hz: the stall
+	// and the first frames of the drop are hitches, the rest of it is not.
+	FrameStats stats;
+	float total = 0.0f;
+	UINT late_hitches = 0;
+	for (UINT i = 0; i < 400; ++i) {
+		float dt = i == 100 ? 0.1f : (i < 200 ? 1.0f / 60.0f : 0.04f);
+		total += dt;
+		uint64_t hitches = stats.HitchCount();
+		stats.AddFrame(dt, total);
+		if (i == 100 && stats.HitchCount() == hitches)
+			CheckFailed() << "FrameStats does not report a lone 100 ms frame as a hitch\n";
+		if (i == 200 && stats.HitchCount() == hitches)
+			CheckFailed() << "FrameStats does not report the start of a slowdown as a hitch\n";
+		if (i > 101 && i < 200 && stats.HitchCount() != hitches)
+			CheckFailed() << "FrameStats reports a 60 Hz frame after a stall as a hitch\n";
+		if (i >= 200 + FrameStats::kRecentFrames && stats.HitchCount() != hitches)
+			++late_hitches;
+	}
+	if (late_hitches != 0)
+		CheckFailed() << "FrameStats still reports " << late_hitches << " frames of a lasting slowdown as hitches\n";
+}
+
+// items are frames.
+void BenchFrameStats(Benchmark &bench) {
+	if (!bench.Selected("frames/"))
+		return;
+	CheckFrameStats();
+
+	FrameStats stats;
+	float total = 0.0f;
+	bench.Run("frames/add_frame", 1024, [&]() {
+		for (UINT i = 0; i < 1024; ++i) {
+			float dt = (i & 63) == 0 ? 0.05f : 1.0f / 60.0f;
+			total += dt;
+			stats.AddFrame(dt, total);
+		}
+		Benchmark::DoNotOptimize(stats.HitchCount());
+	});
+}
+
+const Profiler::ZoneNode* FindZone(const Profiler::ZoneNode &parent, const std::string &name) {
+	for (const Profiler::ZoneNode &child : parent.children) {
+		if (child.name == name)
+			return &child;
+	}
+	return nullptr;
+}
+
+size_t CountOccurrences(const std::string &text, const std::string &pattern) {
+	size_t cnt = 0;
+	for (size_t pos = text.find(pattern); pos != std::string::npos; pos = text.find(pattern, pos + 1))
+		++cnt;
+	return cnt;
+}
+
+// Nested zones on this thread and one on a thread that exits before the
+// frame ends must come out of EndFrame() as a tree and out of the capture as
+// a Chrome trace.  The zones are opened with ProfileZone, which is what
+// PROFILE_ZONE expands to where ENABLE_PROFILER is defined.
+void CheckProfiler() {
+	Profiler &profiler = Profiler::Instance();
+	profiler.EndFrame();
+	uint64_t dropped = profiler.DroppedCount();
+
+	profiler.StartCapture();
+	{
+		ProfileZone outer("check/outer");
+		for (int k = 0; k < 2; ++k)
+			ProfileZone inner("check/inner");
+	}
+	std::thread([]() { ProfileZone worker("check/worker"); }).join();
+	profiler.EndFrame();
+	profiler.StopCapture();
+
+	const Profiler::ZoneNode &frame = profiler.LastFrame();
+	const Profiler::ZoneNode *main_thread = FindZone(frame, "main");
+	const Profiler::ZoneNode *outer = main_thread ? FindZone(*main_thread, "check/outer") : nullptr;
+	const Profiler::ZoneNode *inner = outer ? FindZone(*outer, "check/inner") : nullptr;
+	const Profiler::ZoneNode *worker = nullptr;
+	for (const Profiler::ZoneNode &thread : frame.children) {
+		if (&thread != main_thread && !worker)
+			worker = FindZone(thread, "check/worker");
+	}
+	if (frame.children.size() != 2 || !outer || outer->call_cnt != 1 || !inner || inner->call_cnt != 2 ||
+		inner->total_ns > outer->total_ns || outer->self_ns != outer->total_ns - inner->total_ns ||
+		!worker || worker->call_cnt != 1) {
+		std::ostringstream tree;
+		profiler.WriteFrameTree(tree);
+		CheckFailed() << "Profiler: the frame tree is not the zones recorded:\n" << tree.str();
+	}
+
+	// The four zones and the frame, with the threads named.
+	std::ostringstream trace;
+	profiler.WriteChromeTrace(trace);
+	std::string json = trace.str();
+	if (json.compare(0, 39, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") != 0 ||
+		json.compare(json.size() - 4, 4, "\n]}\n") != 0 ||
+		CountOccurrences(json, "\"ph\":\"X\"") != 5 ||
+		CountOccurrences(json, "{\"name\":\"check/inner\",\"ph\":\"X\"") != 2 ||
+		CountOccurrences(json, "\"ph\":\"M\"") != 2 ||
+		CountOccurrences(json, "\"args\":{\"name\":\"main\"}") != 1)
+		CheckFailed() << "Profiler: the Chrome trace is not the zones captured:\n" << json;
+
+	if (profiler.DroppedCount() != dropped)
+		CheckFailed() << "Profiler: " << profiler.DroppedCount() - dropped << " zones dropped from a frame of five\n";
+}
+
+// items are zones.
+void BenchProfiler(Benchmark &bench) {
+	if (!bench.Selected("profiler/"))
+		return;
+	CheckProfiler();
+
+	// Enter and leave, which every zone costs the thread it is on; the ring
+	// wraps without a frame to gather it.
+	Profiler &profiler = Profiler::Instance();
+	bench.Run("profiler/zone", 1024, [&]() {
+		for (UINT i = 0; i < 1024; ++i)
+			ProfileZone zone("bench/zone");
+	});
+	bench.Run("profiler/zone_nested", 1024, [&]() {
+		for (UINT i = 0; i < 256; ++i) {
+			ProfileZone a("bench/a");
+			ProfileZone b("bench/b");
+			ProfileZone c("bench/c");
+			ProfileZone d("bench/d");
+		}
+	});
+	// The same zones gathered into a frame tree.
+	bench.Run("profiler/zone_and_end_frame", 1024, [&]() {
+		for (UINT i = 0; i < 1024; ++i)
+			ProfileZone zone("bench/zone");
+		profiler.EndFrame();
+	});
+}
+
+bool ParseOptions(int argc, char *argv[], Options &options) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			std::cerr << "Missing value for " << arg << "\n";
+			return false;
+		}
+
+		if (arg == "--out")
+			options.out = argv[++i];
+		else if (arg == "--filter")
+			options.filter = argv[++i];
+		else if (arg == "--min-time")
+			options.min_time_s = atof(argv[++i]);
+		else if (arg == "--models")
+			options.models = argv[++i];
+		else if (arg == "--textures")
+			options.textures = argv[++i];
+		else if (arg == "--fire")
+			options.fire = argv[++i];
+		else if (arg == "--trees")
+			options.trees = argv[++i];
+		else {
+			std::cerr << "Unknown option " << arg << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+	Options options;
+	if (!ParseOptions(argc, argv, options)) {
+		std::cerr << "Usage: Benchmarks [--out file] [--filter substring] [--min-time seconds]"
+			" [--models dir] [--textures dir] [--fire dir] [--trees dir]\n";
+		return 1;
+	}
+
+	srand(1);
+
+	Benchmark bench(options.min_time_s);
+	bench.SetFilter(options.filter);
+
+	BenchWaves(bench);
+	BenchGeometry(bench);
+	BenchMath(bench);
+	BenchModels(bench, options);
+	BenchMeshOptimizer(bench, options);
+	BenchMeshSimplifier(bench, options);
+	BenchVertexQuantizer(bench, options);
+	BenchIndexPacker(bench);
+	BenchTerrain(bench);
+	BenchTerrainQuadtree(bench);
+	BenchDDS(bench, options);
+	BenchFlipbook(bench, options);
+	BenchTexturePipeline(bench, options);
+	BenchBlockCompression(bench, options);
+	BenchMipGenerator(bench, options);
+	BenchTexturePacker(bench, options);
+	BenchFrameStats(bench);
+	BenchProfiler(bench);
+
+	for (const Benchmark::Result &r : bench.Results())
+		std::cerr << r.name << ": mean " << r.mean_ns << " ns, p50 " << r.p50_ns
+			<< " ns, p99 " << r.p99_ns << " ns, " << r.items_per_sec << " items/s\n";
+
+	if (options.out.empty()) {
+		bench.WriteJson(std::cout);
+	} else {
+		std::ofstream fout(options.out);
+		if (!fout) {
+			std::cerr << "Cannot write " << options.out << "\n";
+			return 1;
+		}
+		bench.WriteJson(fout);
+	}
+
+	if (failed_checks != 0) {
+		std::cerr << "Failed checks: " << failed_checks << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -21,6 +21,7 @@
 #include "geometrygenerator.h"
 #include "mathhelper.h"
 #include "lighthelper.h"
+#include "meshfile.h"
 #include "effects.h"
 #include "vertex.h"
 #include "renderStates.h"
@@ -60,6 +61,7 @@ private:
 
 	ID3D11Buffer* SkullVB_ = nullptr;
 	ID3D11Buffer* SkullIB_ = nullptr;
+	DXGI_FORMAT SkullIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11ShaderResourceView* floorDiffuseMapSRV_ = nullptr;
 	ID3D11ShaderResourceView* wallDiffuseMapSRV_ = nullptr;
@@ -337,7 +339,7 @@ void MirrorApp::DrawScene()
 		ID3DX11EffectPass* pass = activeSkullTech->GetPassByIndex( p );
 
 		immediate_context_->IASetVertexBuffers(0, 1, &SkullVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(SkullIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(SkullIB_, SkullIndexFormat_, 0);
 
 		XMMATRIX world = XMLoadFloat4x4(&skullWorld_);
 		XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
@@ -407,7 +409,7 @@ void MirrorApp::DrawScene()
 		ID3DX11EffectPass* pass = activeSkullTech->GetPassByIndex( p );
 
 		immediate_context_->IASetVertexBuffers(0, 1, &SkullVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(SkullIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(SkullIB_, SkullIndexFormat_, 0);
 
 		XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane (px, py, pz, d) where d = -p0*n
 		XMMATRIX R = XMMatrixReflect(mirrorPlane);
@@ -498,7 +500,7 @@ void MirrorApp::DrawScene()
 		ID3DX11EffectPass* pass = activeSkullTech->GetPassByIndex( p );
 
 		immediate_context_->IASetVertexBuffers(0, 1, &SkullVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(SkullIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(SkullIB_, SkullIndexFormat_, 0);
 
 		XMVECTOR shadowPlane = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f); // xz plane
 		XMVECTOR toMainLight = -XMLoadFloat3(&dirLights_[0].direction);
@@ -585,7 +587,7 @@ void MirrorApp::DrawScene()
 		ID3DX11EffectPass* pass = activeSkullTech->GetPassByIndex(p);
 
 		immediate_context_->IASetVertexBuffers(0, 1, &SkullVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(SkullIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(SkullIB_, SkullIndexFormat_, 0);
 
 		XMVECTOR mirrorPlane = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f); // xy plane (px, py, pz, d) where d = -p0*n
 		XMMATRIX R = XMMatrixReflect(mirrorPlane);
@@ -770,42 +772,24 @@ void MirrorApp::BuildRoomGeometryBuffers()
 
 void MirrorApp::BuildSkullGeometryBuffers()
 {
-	std::ifstream fin("Models/skull.txt");
-	
-	if(!fin)
+	MeshFile skull;
+	if(!skull.OpenOrConvert("Models/skull.mesh", "Models/skull.txt"))
 	{
 		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
-
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
+	UINT vcount = skull.VertexCount();
+	skullIndexCnt_ = skull.IndexCount();
 	
+	const MeshFile::Vertex *skullVertices = skull.Vertices();
 	std::vector<Vertex::Basic32> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+		vertices[i].Pos    = skullVertices[i].position;
+		vertices[i].Normal = skullVertices[i].normal;
 	}
 
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	skullIndexCnt_ = 3*tcount;
-	std::vector<UINT> indices(skullIndexCnt_);
-	for(UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i*3+0] >> indices[i*3+1] >> indices[i*3+2];
-	}
-
-	fin.close();
-
     D3D11_BUFFER_DESC vbd;
     vbd.Usage = D3D11_USAGE_IMMUTABLE;
 	vbd.ByteWidth = sizeof(Vertex::Basic32) * vcount;
@@ -820,13 +804,5 @@ void MirrorApp::BuildSkullGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * skullIndexCnt_;
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &SkullIB_));
+	SkullIndexFormat_ = CreateIndexBuffer(device_, skull.Indices(), skull.IndexCount(), &SkullIB_);
 }
\ No newline at end of file
@@ -16,6 +16,7 @@
 //***************************************************************************************
 
 #include "d3dapp.h"
+#include "d3dtexturearray.h"
 #include "d3dx11Effect.h"
 #include "geometrygenerator.h"
 #include "mathhelper.h"
@@ -59,12 +60,15 @@ private:
 private:
 	ID3D11Buffer* mLandVB;
 	ID3D11Buffer* mLandIB;
+	DXGI_FORMAT mLandIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* mWavesVB;
 	ID3D11Buffer* mWavesIB;
+	DXGI_FORMAT mWavesIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* mBoxVB;
 	ID3D11Buffer* mBoxIB;
+	DXGI_FORMAT mBoxIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* mTreeSpritesVB;
 
@@ -202,6 +206,8 @@ bool TreeBillboardApp::Init()
 		return false;
 
 	mWaves.Init(160, 160, 1.0f, 0.03f, 5.0f, 0.3f);
+	// Normals are derived while the vertices are streamed, see UpdateScene().
+	mWaves.SetDeferredNormals(true);
 
 	// Must init Effects first since InputLayouts depend on shader signatures.
 	Effects::InitAll(device_);
@@ -219,10 +225,8 @@ bool TreeBillboardApp::Init()
 	treeFilenames.push_back(L"Textures/tree1.dds");
 	treeFilenames.push_back(L"Textures/tree2.dds");
 	treeFilenames.push_back(L"Textures/tree3.dds");
-	
 
-	mTreeTextureMapArraySRV = d3dHelper::CreateTexture2DArraySRV(
-		device_, immediate_context_, treeFilenames);
+	CreateDDSTextureArraySRVFromFiles(device_, treeFilenames, &mTreeTextureMapArraySRV);
 
 	BuildLandGeometryBuffers();
 	BuildWaveGeometryBuffers();
@@ -282,16 +286,11 @@ void TreeBillboardApp::UpdateScene(float dt)
 	D3D11_MAPPED_SUBRESOURCE mappedData;
 	HR(immediate_context_->Map(mWavesVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
 
-	Vertex::Basic32* v = reinterpret_cast<Vertex::Basic32*>(mappedData.pData);
-	for(UINT i = 0; i < mWaves.VertexCount(); ++i)
-	{
-		v[i].Pos    = mWaves[i];
-		v[i].Normal = mWaves.Normal(i);
-
-		// Derive tex-coords in [0,1] from position.
-		v[i].Tex.x  = 0.5f + mWaves[i].x / mWaves.Width();
-		v[i].Tex.y  = 0.5f - mWaves[i].z / mWaves.Depth();
-	}
+	// Positions, normals and tex-coords are written straight into the mapped buffer.
+	static const Waves::VertexLayout layout = {
+		sizeof(Vertex::Basic32), offsetof(Vertex::Basic32, Pos), offsetof(Vertex::Basic32, Normal), offsetof(Vertex::Basic32, Tex) };
+	// The simulation runs at its own fixed rate; draw it between its last two steps.
+	mWaves.WriteVertices(mappedData.pData, layout, mWaves.InterpolationAlpha());
 
 	immediate_context_->Unmap(mWavesVB, 0);
 
@@ -401,7 +400,7 @@ void TreeBillboardApp::DrawScene()
 	for(UINT p = 0; p < techDesc.Passes; ++p)
     {
 		immediate_context_->IASetVertexBuffers(0, 1, &mBoxVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mBoxIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mBoxIB, mBoxIndexFormat, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&mBoxWorld);
@@ -435,7 +434,7 @@ void TreeBillboardApp::DrawScene()
 		// Draw the hills.
 		//
 		immediate_context_->IASetVertexBuffers(0, 1, &mLandVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mLandIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mLandIB, mLandIndexFormat, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&mLandWorld);
@@ -456,7 +455,7 @@ void TreeBillboardApp::DrawScene()
 		// Draw the waves.
 		//
 		immediate_context_->IASetVertexBuffers(0, 1, &mWavesVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mWavesIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mWavesIB, mWavesIndexFormat, 0);
 
 		// Set per object constants.
 		world = XMLoadFloat4x4(&mWavesWorld);
@@ -586,15 +585,7 @@ void TreeBillboardApp::BuildLandGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * mLandIndexCount;
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &grid.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mLandIB));
+	mLandIndexFormat = CreateIndexBuffer(device_, grid.indices, &mLandIB);
 }
 
 void TreeBillboardApp::BuildWaveGeometryBuffers()
@@ -636,15 +627,7 @@ void TreeBillboardApp::BuildWaveGeometryBuffers()
 		}
 	}
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mWavesIB));
+	mWavesIndexFormat = CreateIndexBuffer(device_, indices, &mWavesIB);
 }
 
 void TreeBillboardApp::BuildCrateGeometryBuffers()
@@ -682,15 +665,7 @@ void TreeBillboardApp::BuildCrateGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * box.indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &box.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mBoxIB));
+	mBoxIndexFormat = CreateIndexBuffer(device_, box.indices, &mBoxIB);
 }
 
 void TreeBillboardApp::BuildTreeSpritesBuffer()
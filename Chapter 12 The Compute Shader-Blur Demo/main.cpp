@@ -62,15 +62,19 @@ private:
 private:
 	ID3D11Buffer* mLandVB;
 	ID3D11Buffer* mLandIB;
+	DXGI_FORMAT mLandIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* mWavesVB;
 	ID3D11Buffer* mWavesIB;
+	DXGI_FORMAT mWavesIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* mBoxVB;
 	ID3D11Buffer* mBoxIB;
+	DXGI_FORMAT mBoxIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* mScreenQuadVB;
 	ID3D11Buffer* mScreenQuadIB;
+	DXGI_FORMAT mScreenQuadIndexFormat = DXGI_FORMAT_R32_UINT;
 
 	ID3D11ShaderResourceView* mGrassMapSRV;
 	ID3D11ShaderResourceView* mWavesMapSRV;
@@ -227,6 +231,8 @@ bool BlurApp::Init()
 	CreateDDSShaderResourceViewFromFile(device_, L"Textures/WireFence.dds", &mCrateSRV);
 
 	mWaves.Init(160, 160, 1.0f, 0.03f, 5.0f, 0.3f);
+	// Normals are derived while the vertices are streamed, see UpdateScene().
+	mWaves.SetDeferredNormals(true);
 
 	BuildLandGeometryBuffers();
 	BuildWaveGeometryBuffers();
@@ -291,16 +297,11 @@ void BlurApp::UpdateScene(float dt)
 	D3D11_MAPPED_SUBRESOURCE mappedData;
 	HR(immediate_context_->Map(mWavesVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
 
-	Vertex::Basic32* v = reinterpret_cast<Vertex::Basic32*>(mappedData.pData);
-	for(UINT i = 0; i < mWaves.VertexCount(); ++i)
-	{
-		v[i].Pos    = mWaves[i];
-		v[i].Normal = mWaves.Normal(i);
-
-		// Derive tex-coords in [0,1] from position.
-		v[i].Tex.x  = 0.5f + mWaves[i].x / mWaves.Width();
-		v[i].Tex.y  = 0.5f - mWaves[i].z / mWaves.Depth();
-	}
+	// Positions, normals and tex-coords are written straight into the mapped buffer.
+	static const Waves::VertexLayout layout = {
+		sizeof(Vertex::Basic32), offsetof(Vertex::Basic32, Pos), offsetof(Vertex::Basic32, Normal), offsetof(Vertex::Basic32, Tex) };
+	// The simulation runs at its own fixed rate; draw it between its last two steps.
+	mWaves.WriteVertices(mappedData.pData, layout, mWaves.InterpolationAlpha());
 
 	immediate_context_->Unmap(mWavesVB, 0);
 	
@@ -471,7 +472,7 @@ void BlurApp::DrawWrapper()
 	for(UINT p = 0; p < techDesc.Passes; ++p)
     {
 		immediate_context_->IASetVertexBuffers(0, 1, &mBoxVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mBoxIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mBoxIB, mBoxIndexFormat, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&mBoxWorld);
@@ -504,7 +505,7 @@ void BlurApp::DrawWrapper()
 		// Draw the hills.
 		//
 		immediate_context_->IASetVertexBuffers(0, 1, &mLandVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mLandIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mLandIB, mLandIndexFormat, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&mLandWorld);
@@ -525,7 +526,7 @@ void BlurApp::DrawWrapper()
 		// Draw the waves.
 		//
 		immediate_context_->IASetVertexBuffers(0, 1, &mWavesVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mWavesIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mWavesIB, mWavesIndexFormat, 0);
 
 		// Set per object constants.
 		world = XMLoadFloat4x4(&mWavesWorld);
@@ -565,7 +566,7 @@ void BlurApp::DrawScreenQuad()
 	for(UINT p = 0; p < techDesc.Passes; ++p)
     {
 		immediate_context_->IASetVertexBuffers(0, 1, &mScreenQuadVB, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(mScreenQuadIB, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(mScreenQuadIB, mScreenQuadIndexFormat, 0);
 
 		Effects::BasicFX->SetWorld(identity);
 		Effects::BasicFX->SetWorldInvTranspose(identity);
@@ -638,15 +639,7 @@ void BlurApp::BuildLandGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * mLandIndexCount;
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &grid.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mLandIB));
+	mLandIndexFormat = CreateIndexBuffer(device_, grid.indices, &mLandIB);
 }
 
 void BlurApp::BuildWaveGeometryBuffers()
@@ -688,15 +681,7 @@ void BlurApp::BuildWaveGeometryBuffers()
 		}
 	}
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mWavesIB));
+	mWavesIndexFormat = CreateIndexBuffer(device_, indices, &mWavesIB);
 }
 
 void BlurApp::BuildCrateGeometryBuffers()
@@ -734,15 +719,7 @@ void BlurApp::BuildCrateGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * box.indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &box.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mBoxIB));
+	mBoxIndexFormat = CreateIndexBuffer(device_, box.indices, &mBoxIB);
 }
 
 void BlurApp::BuildScreenQuadGeometryBuffers()
@@ -780,15 +757,7 @@ void BlurApp::BuildScreenQuadGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * quad.indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &quad.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &mScreenQuadIB));
+	mScreenQuadIndexFormat = CreateIndexBuffer(device_, quad.indices, &mScreenQuadIB);
 }
 
 void BlurApp::BuildOffscreenViews()
@@ -42,6 +42,7 @@ private:
 	// Buffer 0 for position, Buffer 1 for color.
 	ID3D11Buffer *vertex_buffers_[2] = { NULL, NULL };
 	ID3D11Buffer *index_buffer_ = NULL;
+	DXGI_FORMAT index_format_ = DXGI_FORMAT_R32_UINT;
 
 	ID3DX11Effect *fx_ = NULL;
 	ID3DX11EffectTechnique *fx_tech_ = NULL;
@@ -115,7 +116,7 @@ void BoxApp::DrawScene() {
 	UINT strides[2] = { sizeof(Pos), sizeof(Color) };
 	UINT offsets[2] = { 0, 0 };
 	immediate_context_->IASetVertexBuffers(0, 2, vertex_buffers_, strides, offsets);
-	immediate_context_->IASetIndexBuffer(index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+	immediate_context_->IASetIndexBuffer(index_buffer_, index_format_, 0);
 
 	
 
@@ -306,21 +307,7 @@ void BoxApp::CreateBuffers() {
 		
 	};
 
-	D3D11_BUFFER_DESC index_buffer_desc;
-	index_buffer_desc = {
-		sizeof(indices),
-		D3D11_USAGE_IMMUTABLE,
-		D3D11_BIND_INDEX_BUFFER,
-		0,
-		0,
-		0
-	};
-	
-
-	D3D11_SUBRESOURCE_DATA index_init_data;
-	index_init_data.pSysMem = indices;
-
-	HR(device_->CreateBuffer(&index_buffer_desc, &index_init_data, &index_buffer_));
+	index_format_ = CreateIndexBuffer(device_, indices, sizeof(indices) / sizeof(indices[0]), &index_buffer_);
 
 
 }
@@ -36,6 +36,7 @@ private:
 private:
 	ID3D11Buffer *vertex_buffer_ = NULL;
 	ID3D11Buffer *index_buffer_ = NULL;
+	DXGI_FORMAT index_format_ = DXGI_FORMAT_R32_UINT;
 
 	ID3DX11Effect *fx_ = NULL;
 	ID3DX11EffectTechnique *fx_tech_ = NULL;
@@ -162,7 +163,7 @@ void ShapesApp::DrawScene() {
 	UINT strides[1] = { sizeof(Vertex) };
 	UINT offsets[1] = { 0 };
 	immediate_context_->IASetVertexBuffers(0, 1, &vertex_buffer_, strides, offsets);
-	immediate_context_->IASetIndexBuffer(index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+	immediate_context_->IASetIndexBuffer(index_buffer_, index_format_, 0);
 
 
 	XMMATRIX view = XMLoadFloat4x4(&view_);
@@ -371,18 +372,7 @@ void ShapesApp::CreateBuffers() {
 	HR(device_->CreateBuffer(&vertex_buffer_desc, &vertex_init_data, &vertex_buffer_));
 
 
-	D3D11_BUFFER_DESC index_buffer_desc;
-	index_buffer_desc = {
-		sizeof(UINT)*indices.size(),
-		D3D11_USAGE_IMMUTABLE,
-		D3D11_BIND_INDEX_BUFFER,
-		0,
-		0,
-		0
-	};
-	D3D11_SUBRESOURCE_DATA index_init_data;
-	index_init_data.pSysMem = &indices[0];
-	HR(device_->CreateBuffer(&index_buffer_desc, &index_init_data, &index_buffer_));
+	index_format_ = CreateIndexBuffer(device_, indices, &index_buffer_);
 }
 
 void ShapesApp::CreateFX() {
@@ -1,8 +1,8 @@
 #include"d3dapp.h"
-#include<fstream>
 #include<vector>
 #include"d3dx11effect.h"
 #include"geometrygenerator.h"
+#include"meshfile.h"
 
 using namespace DirectX;
 
@@ -34,6 +34,7 @@ private:
 private:
 	ID3D11Buffer *vertex_buffer_ = NULL;
 	ID3D11Buffer *index_buffer_ = NULL;
+	DXGI_FORMAT index_format_ = DXGI_FORMAT_R32_UINT;
 
 	ID3DX11Effect *fx_ = NULL;
 	ID3DX11EffectTechnique *fx_tech_ = NULL;
@@ -109,7 +110,7 @@ void SkullApp::DrawScene() {
 	UINT strides[1] = { sizeof(Vertex) };
 	UINT offsets[1] = { 0 };
 	immediate_context_->IASetVertexBuffers(0, 1, &vertex_buffer_, strides, offsets);
-	immediate_context_->IASetIndexBuffer(index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+	immediate_context_->IASetIndexBuffer(index_buffer_, index_format_, 0);
 
 	XMMATRIX world = XMLoadFloat4x4(&world_);
 	XMMATRIX view = XMLoadFloat4x4(&view_);
@@ -209,51 +210,26 @@ bool SkullApp::Init() {
 
 
 void SkullApp::CreateBuffers() {
-	std::ifstream ifs("models/skull.txt");
-
-	if (!ifs)
+	MeshFile skull;
+	if (!skull.OpenOrConvert("models/skull.mesh", "models/skull.txt"))
 	{
 		MessageBox(0, L"models/skull.txt not found.", 0, 0);
 		return;
 	}
 
-	UINT vertex_cnt = 0;
-	UINT tri_cnt = 0;
-	std::string ignore;
-
-	ifs >> ignore >> vertex_cnt;
-	ifs >> ignore >> tri_cnt;
-	ifs >> ignore; // "VertexList"
-	ifs	>> ignore; // "(pos,"
-	ifs >> ignore; // "normal)"
-	ifs	>> ignore; // "{"
-
-	float nx, ny, nz;
+	UINT vertex_cnt = skull.VertexCount();
 	XMFLOAT4 black(0.0f, 0.0f, 0.0f, 1.0f);
 
+	// Normal not used in this demo.
+	const MeshFile::Vertex *skull_vertices = skull.Vertices();
 	std::vector<Vertex> vertices(vertex_cnt);
 	for (UINT i = 0; i < vertex_cnt; ++i)
 	{
-		ifs >> vertices[i].pos.x >> vertices[i].pos.y >> vertices[i].pos.z;
-
+		vertices[i].pos = skull_vertices[i].position;
 		vertices[i].color = black;
-
-		// Normal not used in this demo.
-		ifs >> nx >> ny >> nz;
 	}
 
-	ifs >> ignore;
-	ifs >> ignore;
-	ifs >> ignore;
-
-	skull_index_cnt_ = 3 * tri_cnt;
-	std::vector<UINT> indices(skull_index_cnt_);
-	for (UINT i = 0; i < tri_cnt; ++i)
-	{
-		ifs >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-	}
-
-	ifs.close();
+	skull_index_cnt_ = skull.IndexCount();
 
 	D3D11_BUFFER_DESC vertex_buffer_desc;
 	vertex_buffer_desc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -269,15 +245,7 @@ void SkullApp::CreateBuffers() {
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC index_buffer_desc;
-	index_buffer_desc.Usage = D3D11_USAGE_IMMUTABLE;
-	index_buffer_desc.ByteWidth = sizeof(UINT) * skull_index_cnt_;
-	index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	index_buffer_desc.CPUAccessFlags = 0;
-	index_buffer_desc.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA index_init_data;
-	index_init_data.pSysMem = &indices[0];
-	HR(device_->CreateBuffer(&index_buffer_desc, &index_init_data, &index_buffer_));
+	index_format_ = CreateIndexBuffer(device_, skull.Indices(), skull.IndexCount(), &index_buffer_);
 }
 
 void SkullApp::CreateFX() {
@@ -37,8 +37,10 @@ private:
 private:
 	ID3D11Buffer *waves_vertex_buffer_ = NULL;
 	ID3D11Buffer *waves_index_buffer_ = NULL;
+	DXGI_FORMAT waves_index_format_ = DXGI_FORMAT_R32_UINT;
 	ID3D11Buffer *land_vertex_buffer_ = NULL;
 	ID3D11Buffer *land_index_buffer_ = NULL;
+	DXGI_FORMAT land_index_format_ = DXGI_FORMAT_R32_UINT;
 
 	ID3DX11Effect *fx_ = NULL;
 	ID3DX11EffectTechnique *fx_tech_ = NULL;
@@ -165,7 +167,7 @@ void WavesApp::DrawScene() {
 		// Draw the land.
 		/****************************/
 		immediate_context_->IASetVertexBuffers(0, 1, &land_vertex_buffer_, strides, offsets);
-		immediate_context_->IASetIndexBuffer(land_index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(land_index_buffer_, land_index_format_, 0);
 
 		XMMATRIX world = XMLoadFloat4x4(&world_);
 		XMMATRIX world_view_proj = world*view*proj;
@@ -180,7 +182,7 @@ void WavesApp::DrawScene() {
 		immediate_context_->RSSetState(rs_wireframe_);
 
 		immediate_context_->IASetVertexBuffers(0, 1, &waves_vertex_buffer_, strides, offsets);
-		immediate_context_->IASetIndexBuffer(waves_index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(waves_index_buffer_, waves_index_format_, 0);
 
 		world = XMLoadFloat4x4(&world_);
 		world_view_proj = world*view*proj;
@@ -334,15 +336,7 @@ void WavesApp::CreateBuffers() {
 	HR(device_->CreateBuffer(&vertex_buffer_desc, &vertex_init_data, &land_vertex_buffer_));
 
 
-	D3D11_BUFFER_DESC index_buffer_desc;
-	index_buffer_desc.Usage = D3D11_USAGE_IMMUTABLE;
-	index_buffer_desc.ByteWidth = sizeof(UINT) * num_land_indices_;
-	index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	index_buffer_desc.CPUAccessFlags = 0;
-	index_buffer_desc.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA index_init_data;
-	index_init_data.pSysMem = &mesh_data.indices[0];
-	HR(device_->CreateBuffer(&index_buffer_desc, &index_init_data, &land_index_buffer_));
+	land_index_format_ = CreateIndexBuffer(device_, mesh_data.indices, &land_index_buffer_);
 
 
 	/*****************************************/
@@ -375,14 +369,7 @@ void WavesApp::CreateBuffers() {
 		}
 	}
 
-	index_buffer_desc.Usage = D3D11_USAGE_IMMUTABLE;
-	index_buffer_desc.ByteWidth = sizeof(UINT)*indices.size();
-	index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	index_buffer_desc.CPUAccessFlags = 0;
-	index_buffer_desc.MiscFlags = 0;
-
-	index_init_data.pSysMem = &indices[0];
-	HR(device_->CreateBuffer(&index_buffer_desc, &index_init_data, &waves_index_buffer_));
+	waves_index_format_ = CreateIndexBuffer(device_, indices, &waves_index_buffer_);
 
 }
 
@@ -62,9 +62,11 @@ private:
 private:
 	ID3D11Buffer* land_vertex_buffer_ = nullptr;
 	ID3D11Buffer* land_index_buffer_ = nullptr;
+	DXGI_FORMAT land_index_format_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* waves_vertex_buffer_ = nullptr;
 	ID3D11Buffer* waves_index_buffer_ = nullptr;
+	DXGI_FORMAT waves_index_format_ = DXGI_FORMAT_R32_UINT;
 
 	Waves waves_;
 	DirectionalLight dir_light_;
@@ -201,6 +203,8 @@ bool LightingApp::Init()
 		return false;
 
 	waves_.Init(160, 160, 1.0f, 0.03f, 3.25f, 0.4f);
+	// Normals are derived while the vertices are streamed, see UpdateScene().
+	waves_.SetDeferredNormals(true);
 
 	BuildLandGeometryBuffers();
 	BuildWaveGeometryBuffers();
@@ -260,12 +264,11 @@ void LightingApp::UpdateScene(float dt)
 	D3D11_MAPPED_SUBRESOURCE mapped_data_;
 	HR(immediate_context_->Map(waves_vertex_buffer_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_data_));
 
-	Vertex* v = reinterpret_cast<Vertex*>(mapped_data_.pData);
-	for(UINT i = 0; i < waves_.VertexCount(); ++i)
-	{
-		v[i].pos    = waves_[i];
-		v[i].normal = waves_.Normal(i);
-	}
+	// Positions and normals are written straight into the mapped buffer.
+	static const Waves::VertexLayout layout = {
+		sizeof(Vertex), offsetof(Vertex, pos), offsetof(Vertex, normal), Waves::VertexLayout::NoAttribute };
+	// The simulation runs at its own fixed rate; draw it between its last two steps.
+	waves_.WriteVertices(mapped_data_.pData, layout, waves_.InterpolationAlpha());
 
 	immediate_context_->Unmap(waves_vertex_buffer_, 0);
 
@@ -326,7 +329,7 @@ void LightingApp::DrawScene()
 		// Draw the hills.
 		/***********************/
 		immediate_context_->IASetVertexBuffers(0, 1, &land_vertex_buffer_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(land_index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(land_index_buffer_, land_index_format_, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&land_world_);
@@ -345,7 +348,7 @@ void LightingApp::DrawScene()
 		// Draw the waves.
 		/***********************************/
 		immediate_context_->IASetVertexBuffers(0, 1, &waves_vertex_buffer_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(waves_index_buffer_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(waves_index_buffer_, waves_index_format_, 0);
 
 		// Set per object constants.
 		world = XMLoadFloat4x4(&waves_world_);
@@ -475,15 +478,7 @@ void LightingApp::BuildLandGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * land_index_cnt_;
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA index_init_data;
-	index_init_data.pSysMem = &grid.indices[0];
-    HR(device_->CreateBuffer(&ibd, &index_init_data, &land_index_buffer_));
+	land_index_format_ = CreateIndexBuffer(device_, grid.indices, &land_index_buffer_);
 }
 
 void LightingApp::BuildWaveGeometryBuffers()
@@ -525,15 +520,7 @@ void LightingApp::BuildWaveGeometryBuffers()
 		}
 	}
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA index_init_data;
-    index_init_data.pSysMem = &indices[0];
-    HR(device_->CreateBuffer(&ibd, &index_init_data, &waves_index_buffer_));
+	waves_index_format_ = CreateIndexBuffer(device_, indices, &waves_index_buffer_);
 }
 
 void LightingApp::BuildFX()
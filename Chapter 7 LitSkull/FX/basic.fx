@@ -64,6 +64,31 @@ VertexOut VS(VertexIn vin)
 	return vout;
 }
  
+// Vertices packed by VertexQuantizer: positions are R16G16B16A16_UNORM in the
+// mesh's bounding box, with the decode transform folded into gWorld, and
+// normals are octahedral R16G16_SNORM.
+struct QuantizedVertexIn
+{
+	float3 PosL    : POSITION;
+	float2 NormalL : NORMAL;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+VertexOut QuantizedVS(QuantizedVertexIn vin)
+{
+	VertexIn v;
+	v.PosL    = vin.PosL;
+	v.NormalL = DecodeOctahedral(vin.NormalL);
+	return VS(v);
+}
+ 
 float4 PS(VertexOut pin, uniform int gLightCount) : SV_Target
 {
 	// Interpolating normal can unnormalize it, so normalize it.
@@ -138,3 +163,33 @@ technique11 Light3
         SetPixelShader( CompileShader( ps_5_0, PS(3) ) );
     }
 }
+
+technique11 Light1Quantized
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, QuantizedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(1) ) );
+    }
+}
+
+technique11 Light2Quantized
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, QuantizedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(2) ) );
+    }
+}
+
+technique11 Light3Quantized
+{
+    pass P0
+    {
+        SetVertexShader( CompileShader( vs_5_0, QuantizedVS() ) );
+		SetGeometryShader( NULL );
+        SetPixelShader( CompileShader( ps_5_0, PS(3) ) );
+    }
+}
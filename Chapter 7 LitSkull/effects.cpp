@@ -43,6 +43,9 @@ BasicEffect::BasicEffect(ID3D11Device *device, std::wstring compiledFileName)
 	light1Tech = fx_->GetTechniqueByName("Light1");
 	light2Tech = fx_->GetTechniqueByName("Light2");
 	light3Tech = fx_->GetTechniqueByName("Light3");
+	light1QuantizedTech = fx_->GetTechniqueByName("Light1Quantized");
+	light2QuantizedTech = fx_->GetTechniqueByName("Light2Quantized");
+	light3QuantizedTech = fx_->GetTechniqueByName("Light3Quantized");
 	worldViewProj= fx_->GetVariableByName("gWorldViewProj")->AsMatrix();
 	world = fx_->GetVariableByName("gWorld")->AsMatrix();
 	worldInvTranspose = fx_->GetVariableByName("gWorldInvTranspose")->AsMatrix();
@@ -33,6 +33,11 @@ public:
 	ID3DX11EffectTechnique *light2Tech = nullptr;
 	ID3DX11EffectTechnique *light3Tech = nullptr;
 
+	// For VertexQuantizer::PosNormal vertices.
+	ID3DX11EffectTechnique *light1QuantizedTech = nullptr;
+	ID3DX11EffectTechnique *light2QuantizedTech = nullptr;
+	ID3DX11EffectTechnique *light3QuantizedTech = nullptr;
+
 	inline void SetWorldViewProj(CXMMATRIX M) { worldViewProj->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	inline void SetWorld(CXMMATRIX M) { world->SetMatrix(reinterpret_cast<const float*>(&M)); }
 	inline void SetWorldInvTranspose(CXMMATRIX M) { worldInvTranspose->SetMatrix(reinterpret_cast<const float*>(&M)); }
@@ -4,10 +4,12 @@
 #include"geometrygenerator.h"
 #include"mathhelper.h"
 #include"lighthelper.h"
+#include"meshfile.h"
+#include"meshsimplifier.h"
+#include"vertexquantizer.h"
 #include"effects.h"
 #include"vertex.h"
 #include<string>
-#include<fstream>
 
 class LitSkullApp : public D3DApp {
 
@@ -40,9 +42,11 @@ private:
 	/***************************/
 	ID3D11Buffer *shapesVB_ = nullptr;
 	ID3D11Buffer *shapesIB_ = nullptr;
+	DXGI_FORMAT shapesIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer *skullVB_ = nullptr;
 	ID3D11Buffer *skullIB_ = nullptr;
+	DXGI_FORMAT skullIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	INT boxVertexOffset_;
 	INT gridVertexOffset_;
@@ -59,7 +63,9 @@ private:
 	UINT sphereIndexCnt_;
 	UINT cylinderIndexCnt_;
 
-	UINT skullIndexCnt_;
+	// Without a LOD table the whole skull is drawn.
+	std::vector<MeshSimplifier::Lod> skullLods_;
+	UINT skullIndexCnt_ = 0;
 
 
 	/****************************/
@@ -79,6 +85,7 @@ private:
 	XMFLOAT4X4 boxWorld_;
 	XMFLOAT4X4 gridWorld_;
 	XMFLOAT4X4 skullWorld_;
+	XMFLOAT4X4 skullDecode_;	// from the quantized vertices to model space
 
 	XMFLOAT4X4 view_ = MathHelper::XMFloat4x4Identity();
 	XMFLOAT4X4 proj_ = MathHelper::XMFloat4x4Identity();
@@ -262,15 +269,19 @@ void LitSkullApp::DrawScene() {
 
 	// Pick out the tech to use.
 	ID3DX11EffectTechnique *activeTech = Effects::basicFX->light1Tech;
+	ID3DX11EffectTechnique *activeSkullTech = Effects::basicFX->light1QuantizedTech;
 	switch (lightCnt_) {
 	case 1:
 		activeTech = Effects::basicFX->light1Tech;
+		activeSkullTech = Effects::basicFX->light1QuantizedTech;
 		break;
 	case 2:
 		activeTech = Effects::basicFX->light2Tech;
+		activeSkullTech = Effects::basicFX->light2QuantizedTech;
 		break;
 	case 3:
 		activeTech = Effects::basicFX->light3Tech;
+		activeSkullTech = Effects::basicFX->light3QuantizedTech;
 		break;
 
 	}
@@ -286,7 +297,7 @@ void LitSkullApp::DrawScene() {
 
 
 		immediate_context_->IASetVertexBuffers(0, 1, &shapesVB_, strides, offsets);
-		immediate_context_->IASetIndexBuffer(shapesIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(shapesIB_, shapesIndexFormat_, 0);
 
 		// Draw the grid.
 		XMMATRIX world = XMLoadFloat4x4(&gridWorld_);
@@ -347,13 +358,18 @@ void LitSkullApp::DrawScene() {
 			immediate_context_->DrawIndexed(sphereIndexCnt_, sphereIndexOffset_, sphereVertexOffset_);
 		}
 
-		// Draw the skull.
+		// Draw the skull.  Its positions are quantized to its bounding box, so
+		// the decode transform goes in front of the world matrix; its normals
+		// are unpacked by the shader and only see the world matrix.
 
-		immediate_context_->IASetVertexBuffers(0, 1, &skullVB_, strides, offsets);
-		immediate_context_->IASetIndexBuffer(skullIB_, DXGI_FORMAT_R32_UINT, 0);
+		UINT skullStrides[1] = { sizeof(VertexQuantizer::PosNormal) };
+		immediate_context_->IASetInputLayout(InputLayouts::quantizedPosNormal);
+		immediate_context_->IASetVertexBuffers(0, 1, &skullVB_, skullStrides, offsets);
+		immediate_context_->IASetIndexBuffer(skullIB_, skullIndexFormat_, 0);
 
-		world = XMLoadFloat4x4(&skullWorld_);
-		worldInvTranspose = MathHelper::InverseTranspose(world);
+		XMMATRIX skullWorld = XMLoadFloat4x4(&skullWorld_);
+		world = XMLoadFloat4x4(&skullDecode_)*skullWorld;
+		worldInvTranspose = MathHelper::InverseTranspose(skullWorld);
 		worldViewProj = world*view*proj;
 
 		Effects::basicFX->SetWorld(world);
@@ -361,8 +377,22 @@ void LitSkullApp::DrawScene() {
 		Effects::basicFX->SetWorldViewProj(worldViewProj);
 		Effects::basicFX->SetMaterial(skullMaterial_);
 
-		activeTech->GetPassByIndex(p)->Apply(0, immediate_context_);
-		immediate_context_->DrawIndexed(skullIndexCnt_, 0, 0);
+		// Draw the coarsest level whose error stays within a pixel.  The
+		// distance is in model units, so it is divided by the skull's scale.
+		if (!skullLods_.empty())
+		{
+			float skullDistance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&eyeposInWorld_) - skullWorld.r[3])) /
+				XMVectorGetX(XMVector3Length(skullWorld.r[0]));
+			UINT lod = MeshSimplifier::SelectLod(skullLods_, skullDistance, 0.25f*MathHelper::Pi, static_cast<float>(client_height_));
+
+			activeSkullTech->GetPassByIndex(p)->Apply(0, immediate_context_);
+			immediate_context_->DrawIndexed(skullLods_[lod].index_cnt, skullLods_[lod].index_offset, 0);
+		}
+		else
+		{
+			activeSkullTech->GetPassByIndex(p)->Apply(0, immediate_context_);
+			immediate_context_->DrawIndexed(skullIndexCnt_, 0, 0);
+		}
 	}
 
 	HR(swap_chain_->Present(0, 0));
@@ -457,12 +487,6 @@ void LitSkullApp::BuildShapeGeometryBuffers()
 		sphere.vertices.size() +
 		cylinder.vertices.size();
 
-	UINT totalIndexCount =
-		boxIndexCnt_ +
-		gridIndexCnt_ +
-		sphereIndexCnt_ +
-		cylinderIndexCnt_;
-
 	//
 	// Extractnthe vertex elements we are interested in and pack the
 	// vertices of all the meshes into one vertex buffer.
@@ -515,58 +539,33 @@ void LitSkullApp::BuildShapeGeometryBuffers()
 	indices.insert(indices.end(), sphere.indices.begin(), sphere.indices.end());
 	indices.insert(indices.end(), cylinder.indices.begin(), cylinder.indices.end());
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * totalIndexCount;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &indices[0];
-	HR(device_->CreateBuffer(&ibd, &iinitData, &shapesIB_));
+	shapesIndexFormat_ = CreateIndexBuffer(device_, indices, &shapesIB_);
 }
 
 void LitSkullApp::BuildSkullGeometryBuffers()
 {
-	std::ifstream fin("Models/skull.txt");
-
-	if (!fin)
+	// The first run converts skull.txt to skull.mesh, LOD chain and all;
+	// later runs map the .mesh and build the 12-byte vertices straight from it.
+	MeshFile skull;
+	if (!skull.OpenOrConvert("Models/skull.mesh", "Models/skull.txt"))
 	{
 		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
 		return;
 	}
+	UINT vcount = skull.VertexCount();
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
+	std::vector<VertexQuantizer::PosNormal> vertices;
+	VertexQuantizer::Bounds bounds = VertexQuantizer::Quantize(&skull.Vertices()->position, &skull.Vertices()->normal,
+		sizeof(MeshFile::Vertex), vcount, vertices);
+	XMStoreFloat4x4(&skullDecode_, VertexQuantizer::DecodeTransform(bounds));
 
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
-
-	std::vector<Vertex::PosNormal> vertices(vcount);
-	for (UINT i = 0; i < vcount; ++i)
-	{
-		fin >> vertices[i].pos.x >> vertices[i].pos.y >> vertices[i].pos.z;
-		fin >> vertices[i].normal.x >> vertices[i].normal.y >> vertices[i].normal.z;
-	}
-
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	skullIndexCnt_ = 3 * tcount;
-	std::vector<UINT> indices(skullIndexCnt_);
-	for (UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-	}
-
-	fin.close();
+	// All the levels index the same vertices.
+	skullLods_.assign(skull.Lods(), skull.Lods() + skull.LodCount());
+	skullIndexCnt_ = skull.IndexCount();
 
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex::PosNormal) * vcount;
+	vbd.ByteWidth = sizeof(VertexQuantizer::PosNormal) * vcount;
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
@@ -575,17 +574,9 @@ void LitSkullApp::BuildSkullGeometryBuffers()
 	HR(device_->CreateBuffer(&vbd, &vinitData, &skullVB_));
 
 	//
-	// Pack the indices of all the meshes into one index buffer.
+	// Pack the indices of all the levels into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * skullIndexCnt_;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &indices[0];
-	HR(device_->CreateBuffer(&ibd, &iinitData, &skullIB_));
+	skullIndexFormat_ = CreateIndexBuffer(device_, skull.Indices(), skull.LodIndexCount(), &skullIB_);
 }
 
@@ -6,8 +6,14 @@ const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::desc[2] = {
 	{ "NORMAL",    0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 };
 
+const D3D11_INPUT_ELEMENT_DESC InputLayoutDesc::quantizedPosNormal[2] = {
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL",    0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+};
+
 
 ID3D11InputLayout *InputLayouts::posNormal = nullptr;
+ID3D11InputLayout *InputLayouts::quantizedPosNormal = nullptr;
 
 void InputLayouts::InitAll(ID3D11Device *device) {
 
@@ -16,7 +22,12 @@ void InputLayouts::InitAll(ID3D11Device *device) {
 	HR(device->CreateInputLayout(InputLayoutDesc::desc, 2, passDesc.pIAInputSignature, passDesc.IAInputSignatureSize,
 		&posNormal));
 
+	Effects::basicFX->light1QuantizedTech->GetPassByIndex(0)->GetDesc(&passDesc);
+	HR(device->CreateInputLayout(InputLayoutDesc::quantizedPosNormal, 2, passDesc.pIAInputSignature, passDesc.IAInputSignatureSize,
+		&quantizedPosNormal));
+
 }
 void InputLayouts::DestroyAll() {
 	ReleaseCOM(posNormal);
+	ReleaseCOM(quantizedPosNormal);
 }
\ No newline at end of file
@@ -15,6 +15,9 @@ namespace Vertex {
 class InputLayoutDesc {
 public:
 	static const D3D11_INPUT_ELEMENT_DESC desc[2];
+
+	// VertexQuantizer::PosNormal
+	static const D3D11_INPUT_ELEMENT_DESC quantizedPosNormal[2];
 };
 
 
@@ -25,6 +28,7 @@ public:
 	static void DestroyAll();
 	
 	static ID3D11InputLayout *posNormal;
+	static ID3D11InputLayout *quantizedPosNormal;
 };
 
 #endif
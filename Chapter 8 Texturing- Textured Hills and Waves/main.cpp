@@ -6,17 +6,20 @@
 // Controls:
 //		Hold the left mouse button down and move the mouse to rotate.
 //      Hold the right mouse button down to zoom in and out.
+//      W/A/S/D moves over the hills, which stream in around the camera.
 //
 //***************************************************************************************
 
 #include "d3dapp.h"
 #include "d3dx11Effect.h"
+#include "chunkedterrain.h"
 #include "geometrygenerator.h"
 #include "mathhelper.h"
 #include "lighthelper.h"
 #include "effects.h"
 #include "vertex.h"
 #include "waves.h"
+#include <memory>
 
 class TexturedHillsAndWavesApp : public D3DApp
 {
@@ -35,17 +38,23 @@ public:
 	void OnMouseWheel(WPARAM wParam, LPARAM lParam);;
 
 private:
-	float GetHillHeight(float x, float z)const;
-	XMFLOAT3 GetHillNormal(float x, float z)const;
 	void BuildLandGeometryBuffers();
+	void UpdateLandChunks();
 	void BuildWaveGeometryBuffers();
 
 private:
-	ID3D11Buffer* landVB_ = nullptr;
+	// One vertex buffer per terrain cache slot, refilled when the slot's
+	// generation changes.
+	std::unique_ptr<ChunkedTerrain> terrain_;
+	std::vector<ID3D11Buffer*> landChunkVBs_;
+	std::vector<UINT> landChunkGenerations_;
+	std::vector<ChunkedTerrain::Chunk> landChunks_;
 	ID3D11Buffer* landIB_ = nullptr;
+	DXGI_FORMAT landIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* wavesVB_ = nullptr;
 	ID3D11Buffer* wavesIB_ = nullptr;
+	DXGI_FORMAT wavesIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11ShaderResourceView* grassMapSRV_ = nullptr;
 	ID3D11ShaderResourceView* wavesMapSRV_ = nullptr;
@@ -71,6 +80,8 @@ private:
 	XMFLOAT2 waterTexOffset_ = XMFLOAT2(0.0f, 0.0f);
 
 	XMFLOAT3 eyePosW_ = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	// The point the camera orbits.
+	XMFLOAT3 focus_ = XMFLOAT3(0.0f, 0.0f, 0.0f);
 
 	float theta_ = 1.5f*MathHelper::Pi;
 	float phi_ = 0.5f*MathHelper::Pi;
@@ -130,7 +141,8 @@ TexturedHillsAndWavesApp::TexturedHillsAndWavesApp(HINSTANCE hInstance)
 
 TexturedHillsAndWavesApp::~TexturedHillsAndWavesApp()
 {
-	ReleaseCOM(landVB_);
+	for (ID3D11Buffer*& vb : landChunkVBs_)
+		ReleaseCOM(vb);
 	ReleaseCOM(landIB_);
 	ReleaseCOM(wavesVB_);
 	ReleaseCOM(wavesIB_);
@@ -147,6 +159,8 @@ bool TexturedHillsAndWavesApp::Init()
 		return false;
 
 	waves_.Init(160, 160, 1.0f, 0.03f, 3.25f, 0.4f);
+	// Normals are derived while the vertices are streamed, see UpdateScene().
+	waves_.SetDeferredNormals(true);
 
 	// Must init Effects first since InputLayouts depend on shader signatures.
 	Effects::InitAll(device_);
@@ -172,16 +186,30 @@ void TexturedHillsAndWavesApp::OnResize()
 
 void TexturedHillsAndWavesApp::UpdateScene(float dt)
 {
+	// Move the focus over the hills and keep it on the ground.
+	const float speed = 100.0f;
+	if (GetAsyncKeyState('W') & 0x8000)
+		focus_.z += speed*dt;
+	if (GetAsyncKeyState('S') & 0x8000)
+		focus_.z -= speed*dt;
+	if (GetAsyncKeyState('A') & 0x8000)
+		focus_.x -= speed*dt;
+	if (GetAsyncKeyState('D') & 0x8000)
+		focus_.x += speed*dt;
+	focus_.y = ChunkedTerrain::HillHeight(focus_.x, focus_.z);
+
+	UpdateLandChunks();
+
 	// Convert Spherical to Cartesian coordinates.
-	float x = radius_*sinf(phi_)*cosf(theta_);
-	float z = radius_*sinf(phi_)*sinf(theta_);
-	float y = radius_*cosf(phi_);
+	float x = focus_.x + radius_*sinf(phi_)*cosf(theta_);
+	float z = focus_.z + radius_*sinf(phi_)*sinf(theta_);
+	float y = focus_.y + radius_*cosf(phi_);
 
 	eyePosW_ = XMFLOAT3(x, y, z);
 
 	// Build the view matrix.
 	XMVECTOR pos = XMVectorSet(x, y, z, 1.0f);
-	XMVECTOR target = XMVectorZero();
+	XMVECTOR target = XMLoadFloat3(&focus_);
 	XMVECTOR up = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
 
 	XMMATRIX V = XMMatrixLookAtLH(pos, target, up);
@@ -212,16 +240,11 @@ void TexturedHillsAndWavesApp::UpdateScene(float dt)
 	D3D11_MAPPED_SUBRESOURCE mappedData;
 	HR(immediate_context_->Map(wavesVB_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
 
-	Vertex::Basic32* v = reinterpret_cast<Vertex::Basic32*>(mappedData.pData);
-	for (UINT i = 0; i < waves_.VertexCount(); ++i)
-	{
-		v[i].pos = waves_[i];
-		v[i].normal = waves_.Normal(i);
-
-		// Derive tex-coords in [0,1] from position.
-		v[i].tex.x = 0.5f + waves_[i].x / waves_.Width();
-		v[i].tex.y = 0.5f - waves_[i].z / waves_.Depth();
-	}
+	// Positions, normals and tex-coords are written straight into the mapped buffer.
+	static const Waves::VertexLayout layout = {
+		sizeof(Vertex::Basic32), offsetof(Vertex::Basic32, pos), offsetof(Vertex::Basic32, normal), offsetof(Vertex::Basic32, tex) };
+	// The simulation runs at its own fixed rate; draw it between its last two steps.
+	waves_.WriteVertices(mappedData.pData, layout, waves_.InterpolationAlpha());
 
 	immediate_context_->Unmap(wavesVB_, 0);
 
@@ -267,10 +290,9 @@ void TexturedHillsAndWavesApp::DrawScene()
 	for (UINT p = 0; p < techDesc.Passes; ++p)
 	{
 		//
-		// Draw the hills.
+		// Draw the hills, a chunk at a time; they all share the index buffer.
 		//
-		immediate_context_->IASetVertexBuffers(0, 1, &landVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(landIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(landIB_, landIndexFormat_, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&landWorld_);
@@ -285,13 +307,17 @@ void TexturedHillsAndWavesApp::DrawScene()
 		Effects::basicFX->SetDiffuseMap(grassMapSRV_);
 
 		activeTech->GetPassByIndex(p)->Apply(0, immediate_context_);
-		immediate_context_->DrawIndexed(landIndexCnt_, 0, 0);
+		for (const ChunkedTerrain::Chunk& chunk : landChunks_)
+		{
+			immediate_context_->IASetVertexBuffers(0, 1, &landChunkVBs_[chunk.slot], &stride, &offset);
+			immediate_context_->DrawIndexed(landIndexCnt_, 0, 0);
+		}
 
 		//
 		// Draw the waves.
 		//
 		immediate_context_->IASetVertexBuffers(0, 1, &wavesVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(wavesIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(wavesIB_, wavesIndexFormat_, 0);
 
 		// Set per object constants.
 		world = XMLoadFloat4x4(&wavesWorld_);
@@ -365,75 +391,50 @@ void TexturedHillsAndWavesApp::OnMouseMove(WPARAM btnState, int x, int y)
 	lastMousePos_.y = y;
 }
 
-float TexturedHillsAndWavesApp::GetHillHeight(float x, float z)const
-{
-	return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
-}
-
-XMFLOAT3 TexturedHillsAndWavesApp::GetHillNormal(float x, float z)const
-{
-	// n = (-df/dx, 1, -df/dz)
-	XMFLOAT3 n(
-		-0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z),
-		1.0f,
-		-0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z));
-
-	XMVECTOR unitNormal = XMVector3Normalize(XMLoadFloat3(&n));
-	XMStoreFloat3(&n, unitNormal);
-
-	return n;
-}
-
 void TexturedHillsAndWavesApp::BuildLandGeometryBuffers()
 {
-	GeometryGenerator::MeshData grid;
-
-	GeometryGenerator geoGen;
-
-	geoGen.CreateGrid(160.0f, 160.0f, 50, 50, grid);
-
-	landIndexCnt_ = grid.indices.size();
-
-	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  
-	//
-
-	std::vector<Vertex::Basic32> vertices(grid.vertices.size());
-	for (size_t i = 0; i < grid.vertices.size(); ++i)
-	{
-		XMFLOAT3 p = grid.vertices[i].position;
-
-		p.y = GetHillHeight(p.x, p.z);
-
-		vertices[i].pos = p;
-		vertices[i].normal = GetHillNormal(p.x, p.z);
-		vertices[i].tex = grid.vertices[i].texcoord;
-	}
-
+	// Chunks as big as the single 160x160 grid this demo used to draw,
+	// streamed in two chunks around the focus.
+	ChunkedTerrain::Desc desc;
+	desc.chunk_size = 160.0f;
+	desc.chunk_vertices = 50;
+	desc.load_radius = 2;
+	terrain_.reset(new ChunkedTerrain(desc));
+
+	// The slots are refilled in place, so their buffers are created once.
 	D3D11_BUFFER_DESC vbd;
-	vbd.Usage = D3D11_USAGE_IMMUTABLE;
-	vbd.ByteWidth = sizeof(Vertex::Basic32) * grid.vertices.size();
+	vbd.Usage = D3D11_USAGE_DEFAULT;
+	vbd.ByteWidth = sizeof(Vertex::Basic32) * terrain_->VertexCount();
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = 0;
 	vbd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA vertexInitData;
-	vertexInitData.pSysMem = &vertices[0];
-	HR(device_->CreateBuffer(&vbd, &vertexInitData, &landVB_));
+	landChunkVBs_.assign(terrain_->SlotCount(), nullptr);
+	landChunkGenerations_.assign(terrain_->SlotCount(), 0);
+	for (ID3D11Buffer*& vb : landChunkVBs_)
+		HR(device_->CreateBuffer(&vbd, 0, &vb));
+
+	landIndexCnt_ = terrain_->Indices().size();
+	landIndexFormat_ = CreateIndexBuffer(device_, terrain_->Indices(), &landIB_);
+
+	// Start with the chunks under the camera rather than pop them in.
+	terrain_->Update(focus_.x, focus_.z);
+	terrain_->Flush();
+	UpdateLandChunks();
+}
 
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
+void TexturedHillsAndWavesApp::UpdateLandChunks()
+{
+	static_assert(sizeof(ChunkedTerrain::Vertex) == sizeof(Vertex::Basic32), "chunk vertices are uploaded as they are");
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * landIndexCnt_;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA indexInitData;
-	indexInitData.pSysMem = &grid.indices[0];
-	HR(device_->CreateBuffer(&ibd, &indexInitData, &landIB_));
+	terrain_->Update(focus_.x, focus_.z);
+	terrain_->ReadyChunks(landChunks_);
+	for (const ChunkedTerrain::Chunk& chunk : landChunks_)
+	{
+		if (landChunkGenerations_[chunk.slot] == chunk.generation)
+			continue;
+		immediate_context_->UpdateSubresource(landChunkVBs_[chunk.slot], 0, 0, chunk.vertices, 0, 0);
+		landChunkGenerations_[chunk.slot] = chunk.generation;
+	}
 }
 
 void TexturedHillsAndWavesApp::BuildWaveGeometryBuffers()
@@ -475,13 +476,5 @@ void TexturedHillsAndWavesApp::BuildWaveGeometryBuffers()
 		}
 	}
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * indices.size();
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA indexInitData;
-	indexInitData.pSysMem = &indices[0];
-	HR(device_->CreateBuffer(&ibd, &indexInitData, &wavesIB_));
+	wavesIndexFormat_ = CreateIndexBuffer(device_, indices, &wavesIB_);
 }
\ No newline at end of file
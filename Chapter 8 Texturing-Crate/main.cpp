@@ -6,7 +6,9 @@
 #include"effects.h"
 #include"vertex.h"
 #include"geometrygenerator.h"
-#include<sstream>
+#include"flipbookstreamer.h"
+#include<cstdio>
+#include<vector>
 
 /************************************************************/
 // Exercise 1: Try different address modes and filters.
@@ -40,11 +42,13 @@ public:
 
 private:
 	void BuildGeometryBuffers();
-
+	void BuildFireTextures();
+	void UpdateFire(float totalTime);
 
 private:
 	ID3D11Buffer *boxVB_ = nullptr;
 	ID3D11Buffer *boxIB_ = nullptr;
+	DXGI_FORMAT boxIndexFormat_ = DXGI_FORMAT_R32_UINT;
 	int boxVertexOffset_ = 0;
 	UINT boxIndexOffset_ = 0;
 	UINT boxIndexCnt_ = 0;
@@ -55,8 +59,15 @@ private:
 	ID3D11ShaderResourceView *flareAlpha_ = nullptr;
 	// For exercise 2.
 	ID3D11ShaderResourceView *mipMap_ = nullptr;
-	// For exercise 5.
-	ID3D11ShaderResourceView *fires_[120] = { nullptr };
+	// For exercise 5.  The frames are streamed in, with one texture per
+	// streamer slot, refilled when the slot's generation changes.
+	FlipbookStreamer fire_;
+	std::vector<ID3D11Texture2D*> fireTextures_;
+	std::vector<ID3D11ShaderResourceView*> fireSRVs_;
+	std::vector<UINT> fireGenerations_;
+	ID3D11ShaderResourceView *fireShown_ = nullptr;
+	UINT fireIndex_ = 0;
+	float fireBaseTime_ = 0.0f;
 
 	DirectionalLight dirLights_[3];
 	Material boxMaterial_;
@@ -135,8 +146,10 @@ CrateApp::~CrateApp() {
 	ReleaseCOM(flareAlpha_);
 	ReleaseCOM(mipMap_);
 	// For exercise 5.
-	for (UINT i = 0; i < 120; ++i)
-		ReleaseCOM(fires_[i]);
+	for (ID3D11ShaderResourceView *&srv : fireSRVs_)
+		ReleaseCOM(srv);
+	for (ID3D11Texture2D *&texture : fireTextures_)
+		ReleaseCOM(texture);
 
 	Effects::DestroyAll();
 	InputLayouts::DestroyAll();
@@ -156,21 +169,7 @@ bool CrateApp::Init() {
 	// For exercise 2.
 	CreateDDSShaderResourceViewFromFile(device_, L"Textures/mipmaps.dds", &mipMap_);
 	// For exercise 5.
-	std::wstring fileName;
-	std::wstringstream ss;
-
-	// To convert bmp to DDS,
-	// See https://github.com/Microsoft/DirectXTex/wiki/Texconv
-	for (UINT i = 0; i < 120; ++i) {
-		ss << L"FireAnim/DDS/Fire";
-		ss.fill('0');
-		ss.width(3); // .width() is only effective for next output
-		ss << i + 1 << ".DDS";
-		ss >> fileName;
-		ss.clear();
-		CreateDDSShaderResourceViewFromFile(device_, fileName.c_str(), fires_ + i);
-	}
-
+	BuildFireTextures();
 
 	BuildGeometryBuffers();
 
@@ -202,6 +201,9 @@ void CrateApp::UpdateScene(float dt) {
 
 	eyePosInWorld_ = XMFLOAT3(x, y, z);
 
+	// For exercise 5.
+	UpdateFire(timer_.TotalTime());
+
 	/*
 	// For exercise 4.
 
@@ -248,7 +250,7 @@ void CrateApp::DrawScene() {
 
 	for (UINT p = 0; p < techDesc.Passes; ++p) {
 		immediate_context_->IASetVertexBuffers(0, 1, &boxVB_, strides, offsets);
-		immediate_context_->IASetIndexBuffer(boxIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(boxIB_, boxIndexFormat_, 0);
 
 		XMMATRIX world = XMLoadFloat4x4(&boxWorld_);
 		XMMATRIX worldInvTranspose = MathHelper::InverseTranspose(world);
@@ -275,18 +277,7 @@ void CrateApp::DrawScene() {
 		Effects::basicFX->SetFlareMap(flare_);
 		Effects::basicFX->SetFlareAlphaMap(flareAlpha_);
 		// For exercise 5.
-		static UINT fireIndex = 0;
-		static float baseTime = 0.0f;
-		// 30 FPS
-		const static float timePerFrame = 1.0f / 30.0f;
-		if (timer_.TotalTime() - baseTime >= timePerFrame) {
-			baseTime += timePerFrame;
-			fireIndex = (fireIndex + 1) % 120;
-		}
-
-		Effects::basicFX->SetFireMap(fires_[fireIndex]);
-		
-		
+		Effects::basicFX->SetFireMap(fireShown_);
 
 		activeTech->GetPassByIndex(p)->Apply(0, immediate_context_);
 		immediate_context_->DrawIndexed(boxIndexCnt_, boxIndexOffset_, boxVertexOffset_);
@@ -355,7 +346,6 @@ void CrateApp::BuildGeometryBuffers() {
 	boxIndexCnt_ = box.indices.size();
 
 	UINT totalVertexCnt = box.vertices.size();
-	UINT totalIndexCnt = boxIndexCnt_;
 
 	std::vector<Vertex::Basic32> vertices(totalVertexCnt);
 
@@ -376,14 +366,74 @@ void CrateApp::BuildGeometryBuffers() {
 	HR(device_->CreateBuffer(&vbd, &vertexInitData, &boxVB_));
 
 
-	D3D11_BUFFER_DESC ibd;
-	ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT)*totalIndexCnt;
-	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	ibd.CPUAccessFlags = 0;
-	ibd.MiscFlags = 0;
-	D3D11_SUBRESOURCE_DATA indexInitData;
-	indexInitData.pSysMem = &box.indices[0];
-	HR(device_->CreateBuffer(&ibd, &indexInitData, &boxIB_));
+	boxIndexFormat_ = CreateIndexBuffer(device_, box.indices, &boxIB_);
+
+}
 
-}
\ No newline at end of file
+void CrateApp::BuildFireTextures() {
+	// To convert bmp to DDS,
+	// See https://github.com/Microsoft/DirectXTex/wiki/Texconv
+	FlipbookStreamer::Desc desc;
+	for (UINT i = 0; i < 120; ++i) {
+		char fileName[32];
+		sprintf_s(fileName, "FireAnim/DDS/Fire%03u.DDS", i + 1);
+		desc.filenames.push_back(fileName);
+	}
+	desc.window = 8;
+
+	// Only the first frame is read here; the rest arrive on the streamer's
+	// thread while the demo runs.
+	if (!fire_.Open(desc))
+		return;
+
+	const DDS_TEXTURE_INFO &info = fire_.Info();
+	D3D11_TEXTURE2D_DESC texDesc;
+	texDesc.Width = info.width;
+	texDesc.Height = info.height;
+	texDesc.MipLevels = info.mipCount;
+	texDesc.ArraySize = 1;
+	texDesc.Format = info.format;
+	texDesc.SampleDesc.Count = 1;
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = 0;
+
+	fireTextures_.assign(fire_.SlotCount(), nullptr);
+	fireSRVs_.assign(fire_.SlotCount(), nullptr);
+	fireGenerations_.assign(fire_.SlotCount(), 0);
+	for (UINT i = 0; i < fire_.SlotCount(); ++i) {
+		HR(device_->CreateTexture2D(&texDesc, nullptr, &fireTextures_[i]));
+		HR(device_->CreateShaderResourceView(fireTextures_[i], nullptr, &fireSRVs_[i]));
+	}
+}
+
+void CrateApp::UpdateFire(float totalTime) {
+	if (!fire_.IsOpen())
+		return;
+
+	// 30 FPS
+	const float timePerFrame = 1.0f / 30.0f;
+	while (totalTime - fireBaseTime_ >= timePerFrame) {
+		fireBaseTime_ += timePerFrame;
+		fireIndex_ = (fireIndex_ + 1) % fire_.FrameCount();
+	}
+
+	// A frame not read in time leaves the last one up rather than stall.
+	fire_.Update(fireIndex_);
+	FlipbookStreamer::Frame frame;
+	if (!fire_.GetFrame(fireIndex_, frame))
+		return;
+
+	if (fireGenerations_[frame.slot] != frame.generation) {
+		const std::vector<FlipbookStreamer::Subresource> &subresources = fire_.Subresources();
+		for (UINT mip = 0; mip < subresources.size(); ++mip) {
+			const FlipbookStreamer::Subresource &sub = subresources[mip];
+			immediate_context_->UpdateSubresource(fireTextures_[frame.slot], mip, nullptr,
+				frame.data + sub.offset, sub.row_pitch, sub.slice_pitch);
+		}
+		fireGenerations_[frame.slot] = frame.generation;
+	}
+	fireShown_ = fireSRVs_[frame.slot];
+}
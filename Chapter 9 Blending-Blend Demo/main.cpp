@@ -32,6 +32,8 @@
 #include "vertex.h"
 #include "renderstates.h"
 #include "waves.h"
+#include "texturepipeline.h"
+#include "d3dtexturebackend.h"
 
 using namespace DirectX;
 
@@ -67,12 +69,15 @@ private:
 private:
 	ID3D11Buffer* landVB_ = nullptr;
 	ID3D11Buffer* landIB_ = nullptr;
+	DXGI_FORMAT landIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* wavesVB_ = nullptr;
 	ID3D11Buffer* wavesIB_ = nullptr;
+	DXGI_FORMAT wavesIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11Buffer* boxVB_ = nullptr;
 	ID3D11Buffer* boxIB_ = nullptr;
+	DXGI_FORMAT boxIndexFormat_ = DXGI_FORMAT_R32_UINT;
 
 	ID3D11ShaderResourceView* grassMapSRV_ = nullptr;
 	ID3D11ShaderResourceView* wavesMapSRV_ = nullptr;
@@ -192,21 +197,33 @@ bool BlendApp::Init()
 		return false;
 
 	waves_.Init(160, 160, 1.0f, 0.03f, 5.0f, 0.3f);
+	// Normals are derived while the vertices are streamed, see UpdateScene().
+	waves_.SetDeferredNormals(true);
+
+	// The textures load in the background while the effects compile and the
+	// geometry is built.
+	D3DTextureBackend textures(device_);
+	TexturePipeline pipeline(TexturePipeline::Desc(), textures);
+	UINT grass = pipeline.Load("Textures/grass.dds");
+	UINT water = pipeline.Load("Textures/water2.dds");
+	UINT fence = pipeline.Load("Textures/WireFence.dds");
 
 	// Must init Effects first since InputLayouts depend on shader signatures.
 	Effects::InitAll(device_);
 	InputLayouts::InitAll(device_);
 	RenderStates::InitAll(device_);
 
-	
-	CreateDDSShaderResourceViewFromFile(device_, L"Textures/grass.dds", &grassMapSRV_);
-	CreateDDSShaderResourceViewFromFile(device_, L"Textures/water2.dds", &wavesMapSRV_);
-	CreateDDSShaderResourceViewFromFile(device_, L"Textures/WireFence.dds", &boxMapSRV_);
-
 	BuildLandGeometryBuffers();
 	BuildWaveGeometryBuffers();
 	BuildCrateGeometryBuffers();
 
+	HR(pipeline.Wait(grass));
+	HR(pipeline.Wait(water));
+	HR(pipeline.Wait(fence));
+	grassMapSRV_ = textures.TakeView(grass);
+	wavesMapSRV_ = textures.TakeView(water);
+	boxMapSRV_ = textures.TakeView(fence);
+
 	return true;
 }
 
@@ -260,16 +277,11 @@ void BlendApp::UpdateScene(float dt)
 	D3D11_MAPPED_SUBRESOURCE mappedData;
 	HR(immediate_context_->Map(wavesVB_, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData));
 
-	Vertex::Basic32* v = reinterpret_cast<Vertex::Basic32*>(mappedData.pData);
-	for(UINT i = 0; i < waves_.VertexCount(); ++i)
-	{
-		v[i].Pos    = waves_[i];
-		v[i].Normal = waves_.Normal(i);
-
-		// Derive tex-coords in [0,1] from position.
-		v[i].Tex.x  = 0.5f + waves_[i].x / waves_.Width();
-		v[i].Tex.y  = 0.5f - waves_[i].z / waves_.Depth();
-	}
+	// Positions, normals and tex-coords are written straight into the mapped buffer.
+	static const Waves::VertexLayout layout = {
+		sizeof(Vertex::Basic32), offsetof(Vertex::Basic32, Pos), offsetof(Vertex::Basic32, Normal), offsetof(Vertex::Basic32, Tex) };
+	// The simulation runs at its own fixed rate; draw it between its last two steps.
+	waves_.WriteVertices(mappedData.pData, layout, waves_.InterpolationAlpha());
 
 	immediate_context_->Unmap(wavesVB_, 0);
 
@@ -355,7 +367,7 @@ void BlendApp::DrawScene()
 	for(UINT p = 0; p < techDesc.Passes; ++p)
     {
 		immediate_context_->IASetVertexBuffers(0, 1, &boxVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(boxIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(boxIB_, boxIndexFormat_, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&boxWorld_);
@@ -389,7 +401,7 @@ void BlendApp::DrawScene()
 		// Draw the hills.
 		//
 		immediate_context_->IASetVertexBuffers(0, 1, &landVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(landIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(landIB_, landIndexFormat_, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&landWorld_);
@@ -413,7 +425,7 @@ void BlendApp::DrawScene()
 	
 
 		immediate_context_->IASetVertexBuffers(0, 1, &wavesVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(wavesIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(wavesIB_, wavesIndexFormat_, 0);
 
 		// Set per object constants.
 		world = XMLoadFloat4x4(&wavesWorld_);
@@ -459,7 +471,7 @@ void BlendApp::DrawScene()
 
 
 		immediate_context_->IASetVertexBuffers(0, 1, &wavesVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(wavesIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(wavesIB_, wavesIndexFormat_, 0);
 
 		// Set per object constants.
 		XMMATRIX world = XMLoadFloat4x4(&wavesWorld_);
@@ -488,7 +500,7 @@ void BlendApp::DrawScene()
 
 
 		immediate_context_->IASetVertexBuffers(0, 1, &landVB_, &stride, &offset);
-		immediate_context_->IASetIndexBuffer(landIB_, DXGI_FORMAT_R32_UINT, 0);
+		immediate_context_->IASetIndexBuffer(landIB_, landIndexFormat_, 0);
 
 		// Set per object constants.
 		world = XMLoadFloat4x4(&landWorld_);
@@ -617,15 +629,7 @@ void BlendApp::BuildLandGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * landIndexCnt_;
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-	iinitData.pSysMem = &grid.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &landIB_));
+	landIndexFormat_ = CreateIndexBuffer(device_, grid.indices, &landIB_);
 }
 
 void BlendApp::BuildWaveGeometryBuffers()
@@ -667,15 +671,7 @@ void BlendApp::BuildWaveGeometryBuffers()
 		}
 	}
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &wavesIB_));
+	wavesIndexFormat_ = CreateIndexBuffer(device_, indices, &wavesIB_);
 }
 
 void BlendApp::BuildCrateGeometryBuffers()
@@ -713,13 +709,5 @@ void BlendApp::BuildCrateGeometryBuffers()
 	// Pack the indices of all the meshes into one index buffer.
 	//
 
-	D3D11_BUFFER_DESC ibd;
-    ibd.Usage = D3D11_USAGE_IMMUTABLE;
-	ibd.ByteWidth = sizeof(UINT) * box.indices.size();
-    ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    ibd.CPUAccessFlags = 0;
-    ibd.MiscFlags = 0;
-    D3D11_SUBRESOURCE_DATA iinitData;
-    iinitData.pSysMem = &box.indices[0];
-    HR(device_->CreateBuffer(&ibd, &iinitData, &boxIB_));
+	boxIndexFormat_ = CreateIndexBuffer(device_, box.indices, &boxIB_);
 }
\ No newline at end of file
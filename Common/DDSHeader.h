@@ -0,0 +1,186 @@
+//--------------------------------------------------------------------------------------
+// File: DDSHeader.h
+//
+// DDS file structures and the header parsing of DDSTextureLoader, which need no
+// Direct3D device, so tools and benchmarks can read DDS metadata as well.
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// http://go.microsoft.com/fwlink/?LinkId=248926
+// http://go.microsoft.com/fwlink/?LinkId=248929
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#include <Windows.h>
+#include <dxgiformat.h>
+
+#pragma warning(push)
+#pragma warning(disable : 4005)
+#include <stdint.h>
+#pragma warning(pop)
+
+#ifndef _Use_decl_annotations_
+#define _Use_decl_annotations_
+#endif
+
+//--------------------------------------------------------------------------------------
+// Macros
+//--------------------------------------------------------------------------------------
+#ifndef MAKEFOURCC
+    #define MAKEFOURCC(ch0, ch1, ch2, ch3)                              \
+                ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) |       \
+                ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24 ))
+#endif /* defined(MAKEFOURCC) */
+
+//--------------------------------------------------------------------------------------
+// DDS file structure definitions
+//
+// See DDS.h in the 'Texconv' sample and the 'DirectXTex' library
+//--------------------------------------------------------------------------------------
+#pragma pack(push,1)
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+struct DDS_PIXELFORMAT
+{
+    uint32_t    size;
+    uint32_t    flags;
+    uint32_t    fourCC;
+    uint32_t    RGBBitCount;
+    uint32_t    RBitMask;
+    uint32_t    GBitMask;
+    uint32_t    BBitMask;
+    uint32_t    ABitMask;
+};
+
+#define DDS_FOURCC      0x00000004  // DDPF_FOURCC
+#define DDS_RGB         0x00000040  // DDPF_RGB
+#define DDS_LUMINANCE   0x00020000  // DDPF_LUMINANCE
+#define DDS_ALPHA       0x00000002  // DDPF_ALPHA
+#define DDS_BUMPDUDV    0x00080000  // DDPF_BUMPDUDV
+
+#define DDS_HEADER_FLAGS_VOLUME         0x00800000  // DDSD_DEPTH
+
+#define DDS_HEIGHT 0x00000002 // DDSD_HEIGHT
+#define DDS_WIDTH  0x00000004 // DDSD_WIDTH
+
+#define DDS_CUBEMAP_POSITIVEX 0x00000600 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX
+#define DDS_CUBEMAP_NEGATIVEX 0x00000a00 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEX
+#define DDS_CUBEMAP_POSITIVEY 0x00001200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEY
+#define DDS_CUBEMAP_NEGATIVEY 0x00002200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEY
+#define DDS_CUBEMAP_POSITIVEZ 0x00004200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEZ
+#define DDS_CUBEMAP_NEGATIVEZ 0x00008200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEZ
+
+#define DDS_CUBEMAP_ALLFACES ( DDS_CUBEMAP_POSITIVEX | DDS_CUBEMAP_NEGATIVEX |\
+                               DDS_CUBEMAP_POSITIVEY | DDS_CUBEMAP_NEGATIVEY |\
+                               DDS_CUBEMAP_POSITIVEZ | DDS_CUBEMAP_NEGATIVEZ )
+
+#define DDS_CUBEMAP 0x00000200 // DDSCAPS2_CUBEMAP
+
+enum DDS_MISC_FLAGS2
+{
+    DDS_MISC_FLAGS2_ALPHA_MODE_MASK = 0x7L,
+};
+
+struct DDS_HEADER
+{
+    uint32_t        size;
+    uint32_t        flags;
+    uint32_t        height;
+    uint32_t        width;
+    uint32_t        pitchOrLinearSize;
+    uint32_t        depth; // only if DDS_HEADER_FLAGS_VOLUME is set in flags
+    uint32_t        mipMapCount;
+    uint32_t        reserved1[11];
+    DDS_PIXELFORMAT ddspf;
+    uint32_t        caps;
+    uint32_t        caps2;
+    uint32_t        caps3;
+    uint32_t        caps4;
+    uint32_t        reserved2;
+};
+
+struct DDS_HEADER_DXT10
+{
+    DXGI_FORMAT     dxgiFormat;
+    uint32_t        resourceDimension;
+    uint32_t        miscFlag; // see D3D11_RESOURCE_MISC_FLAG
+    uint32_t        arraySize;
+    uint32_t        miscFlags2;
+};
+
+#pragma pack(pop)
+
+namespace DirectX
+{
+    // Same values as D3D11_RESOURCE_DIMENSION and D3D11_RESOURCE_MISC_TEXTURECUBE
+    enum DDS_RESOURCE_DIMENSION
+    {
+        DDS_DIMENSION_TEXTURE1D = 2,
+        DDS_DIMENSION_TEXTURE2D = 3,
+        DDS_DIMENSION_TEXTURE3D = 4,
+    };
+
+    enum DDS_RESOURCE_MISC_FLAG
+    {
+        DDS_RESOURCE_MISC_TEXTURECUBE = 0x4L,
+    };
+
+    struct DDS_TEXTURE_INFO
+    {
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    depth;
+        uint32_t    arraySize;          // 6 per cube for cube maps
+        uint32_t    mipCount;
+        DXGI_FORMAT format;
+        uint32_t    resourceDimension;  // DDS_RESOURCE_DIMENSION
+        bool        isCubeMap;
+    };
+
+    // Validates the magic number and headers of a DDS file in memory.  header points
+    // into ddsData, and the texel data starts bitOffset bytes into it.
+    HRESULT ParseDDSHeader( _In_reads_bytes_(ddsDataSize) const uint8_t* ddsData,
+                            _In_ size_t ddsDataSize,
+                            _Outptr_ const DDS_HEADER** header,
+                            _Out_ size_t* bitOffset
+                          );
+
+    // Describes the texture a validated header (and its DX10 extension, which must
+    // follow it in memory) defines.  Limits of the Direct3D hardware are not checked.
+    HRESULT GetDDSTextureInfo( _In_ const DDS_HEADER* header,
+                               _Out_ DDS_TEXTURE_INFO* info
+                             );
+
+    // Describes the texture in a DDS file from its headers alone, without reading any
+    // of the texel data.
+    HRESULT GetDDSTextureInfoFromFile( _In_z_ const char* fileName,
+                                       _Out_ DDS_TEXTURE_INFO* info
+                                     );
+#if defined(_WIN32)
+    HRESULT GetDDSTextureInfoFromFile( _In_z_ const wchar_t* fileName,
+                                       _Out_ DDS_TEXTURE_INFO* info
+                                     );
+#endif
+
+    size_t BitsPerPixel( _In_ DXGI_FORMAT fmt );
+
+    void GetSurfaceInfo( _In_ size_t width,
+                         _In_ size_t height,
+                         _In_ DXGI_FORMAT fmt,
+                         _Out_opt_ size_t* outNumBytes,
+                         _Out_opt_ size_t* outRowBytes,
+                         _Out_opt_ size_t* outNumRows
+                       );
+
+    DXGI_FORMAT GetDXGIFormat( const DDS_PIXELFORMAT& ddpf );
+
+    // The _SRGB variant of a format, or the format itself if it has none.
+    DXGI_FORMAT MakeSRGB( _In_ DXGI_FORMAT format );
+}
@@ -0,0 +1,650 @@
+#include"blockcompression.h"
+#include"threadpool.h"
+#include<DirectXMath.h>
+#include<algorithm>
+#include<cfloat>
+#include<cmath>
+#include<cstring>
+#include<functional>
+
+namespace {
+
+// A block's texels channel by channel, as the fitting reads them.
+struct Texels {
+	float r[16];
+	float g[16];
+	float b[16];
+	float a[16];
+};
+
+void LoadTexels(const uint8_t *rgba, Texels &t) {
+	for (int i = 0; i < 16; ++i) {
+		t.r[i] = rgba[4*i];
+		t.g[i] = rgba[4*i + 1];
+		t.b[i] = rgba[4*i + 2];
+		t.a[i] = rgba[4*i + 3];
+	}
+}
+
+uint16_t ReadU16(const uint8_t *p) {
+	return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+void WriteU16(uint8_t *p, uint16_t v) {
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+// 5:6:5 to 8 bits a channel by repeating the top bits, as the hardware does.
+void Unpack565(uint16_t c, int *rgb) {
+	int r = c >> 11, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = r << 3 | r >> 2;
+	rgb[1] = g << 2 | g >> 4;
+	rgb[2] = b << 3 | b >> 2;
+}
+
+uint16_t Pack565(const float *rgb) {
+	int r = std::min(std::max(static_cast<int>(rgb[0]*(31.0f/255.0f) + 0.5f), 0), 31);
+	int g = std::min(std::max(static_cast<int>(rgb[1]*(63.0f/255.0f) + 0.5f), 0), 63);
+	int b = std::min(std::max(static_cast<int>(rgb[2]*(31.0f/255.0f) + 0.5f), 0), 31);
+	return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+// The four RGBA8 colours of a colour block: two interpolated ones, or one and
+// transparent black.
+void ColorPalette(uint16_t c0, uint16_t c1, bool four_colors, uint8_t palette[4][4]) {
+	int p0[3], p1[3];
+	Unpack565(c0, p0);
+	Unpack565(c1, p1);
+	for (int k = 0; k < 3; ++k) {
+		palette[0][k] = static_cast<uint8_t>(p0[k]);
+		palette[1][k] = static_cast<uint8_t>(p1[k]);
+		if (four_colors) {
+			palette[2][k] = static_cast<uint8_t>((2*p0[k] + p1[k] + 1) / 3);
+			palette[3][k] = static_cast<uint8_t>((p0[k] + 2*p1[k] + 1) / 3);
+		} else {
+			palette[2][k] = static_cast<uint8_t>((p0[k] + p1[k] + 1) / 2);
+			palette[3][k] = 0;
+		}
+	}
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	palette[3][3] = four_colors ? 255 : 0;
+}
+
+// The eight values of a BC4 block: six interpolated ones, or four and 0 and
+// 255.
+void AlphaPalette(int a0, int a1, int palette[8]) {
+	palette[0] = a0;
+	palette[1] = a1;
+	if (a0 > a1) {
+		for (int i = 2; i < 8; ++i)
+			palette[i] = ((8 - i)*a0 + (i - 1)*a1 + 3) / 7;
+	} else {
+		for (int i = 2; i < 6; ++i)
+			palette[i] = ((6 - i)*a0 + (i - 1)*a1 + 2) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+void DecodeColor(const uint8_t *block, bool force_four_colors, uint8_t *rgba) {
+	uint16_t c0 = ReadU16(block), c1 = ReadU16(block + 2);
+	uint8_t palette[4][4];
+	ColorPalette(c0, c1, force_four_colors || c0 > c1, palette);
+
+	uint32_t indices = ReadU16(block + 4) | static_cast<uint32_t>(ReadU16(block + 6)) << 16;
+	for (int i = 0; i < 16; ++i, indices >>= 2)
+		memcpy(rgba + 4*i, palette[indices & 3], 4);
+}
+
+// Writes the 16 values stride bytes apart.
+void DecodeAlpha(const uint8_t *block, uint8_t *out, size_t stride) {
+	int palette[8];
+	AlphaPalette(block[0], block[1], palette);
+
+	uint64_t indices = 0;
+	for (int i = 7; i >= 2; --i)
+		indices = indices << 8 | block[i];
+	for (int i = 0; i < 16; ++i, indices >>= 3)
+		out[i*stride] = static_cast<uint8_t>(palette[indices & 7]);
+}
+
+// Gives each texel the index of its nearest palette entry, and returns the
+// summed squared distance weighted per texel.  The SSE and scalar paths do
+// the same operations in the same order, so they pick the same indices.
+float FitColorIndices(const Texels &t, const float *weight, const float palette[4][3], uint8_t *indices) {
+	float lane_error[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+#if defined(_XM_SSE_INTRINSICS_)
+	__m128 Error = _mm_setzero_ps();
+	for (int q = 0; q < 16; q += 4) {
+		__m128 R = _mm_loadu_ps(t.r + q);
+		__m128 G = _mm_loadu_ps(t.g + q);
+		__m128 B = _mm_loadu_ps(t.b + q);
+		__m128 Best = _mm_set1_ps(FLT_MAX);
+		__m128 BestIndex = _mm_setzero_ps();
+		for (int k = 0; k < 4; ++k) {
+			__m128 dr = _mm_sub_ps(R, _mm_set1_ps(palette[k][0]));
+			__m128 dg = _mm_sub_ps(G, _mm_set1_ps(palette[k][1]));
+			__m128 db = _mm_sub_ps(B, _mm_set1_ps(palette[k][2]));
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			__m128 closer = _mm_cmplt_ps(d, Best);
+			Best = _mm_min_ps(d, Best);
+			BestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(static_cast<float>(k))),
+				_mm_andnot_ps(closer, BestIndex));
+		}
+		Error = _mm_add_ps(Error, _mm_mul_ps(Best, _mm_loadu_ps(weight + q)));
+
+		__m128i Index = _mm_cvttps_epi32(BestIndex);
+		Index = _mm_packs_epi32(Index, Index);
+		Index = _mm_packus_epi16(Index, Index);
+		int packed = _mm_cvtsi128_si32(Index);
+		memcpy(indices + q, &packed, 4);
+	}
+	_mm_storeu_ps(lane_error, Error);
+#else
+	for (int i = 0; i < 16; ++i) {
+		float best = FLT_MAX;
+		int best_index = 0;
+		for (int k = 0; k < 4; ++k) {
+			float dr = t.r[i] - palette[k][0], dg = t.g[i] - palette[k][1], db = t.b[i] - palette[k][2];
+			float d = (dr*dr + dg*dg) + db*db;
+			if (d < best)
+				best_index = k;
+			best = std::min(d, best);
+		}
+		lane_error[i & 3] += best*weight[i];
+		indices[i] = static_cast<uint8_t>(best_index);
+	}
+#endif
+	return (lane_error[0] + lane_error[1]) + (lane_error[2] + lane_error[3]);
+}
+
+float FitAlphaIndices(const float *values, const int palette[8], uint8_t *indices) {
+	float lane_error[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+#if defined(_XM_SSE_INTRINSICS_)
+	__m128 Error = _mm_setzero_ps();
+	for (int q = 0; q < 16; q += 4) {
+		__m128 V = _mm_loadu_ps(values + q);
+		__m128 Best = _mm_set1_ps(FLT_MAX);
+		__m128 BestIndex = _mm_setzero_ps();
+		for (int k = 0; k < 8; ++k) {
+			__m128 dv = _mm_sub_ps(V, _mm_set1_ps(static_cast<float>(palette[k])));
+			__m128 d = _mm_mul_ps(dv, dv);
+			__m128 closer = _mm_cmplt_ps(d, Best);
+			Best = _mm_min_ps(d, Best);
+			BestIndex = _mm_or_ps(_mm_and_ps(closer, _mm_set1_ps(static_cast<float>(k))),
+				_mm_andnot_ps(closer, BestIndex));
+		}
+		Error = _mm_add_ps(Error, Best);
+
+		__m128i Index = _mm_cvttps_epi32(BestIndex);
+		Index = _mm_packs_epi32(Index, Index);
+		Index = _mm_packus_epi16(Index, Index);
+		int packed = _mm_cvtsi128_si32(Index);
+		memcpy(indices + q, &packed, 4);
+	}
+	_mm_storeu_ps(lane_error, Error);
+#else
+	for (int i = 0; i < 16; ++i) {
+		float best = FLT_MAX;
+		int best_index = 0;
+		for (int k = 0; k < 8; ++k) {
+			float dv = values[i] - palette[k];
+			float d = dv*dv;
+			if (d < best)
+				best_index = k;
+			best = std::min(d, best);
+		}
+		lane_error[i & 3] += best;
+		indices[i] = static_cast<uint8_t>(best_index);
+	}
+#endif
+	return (lane_error[0] + lane_error[1]) + (lane_error[2] + lane_error[3]);
+}
+
+// For each 8-bit value, the pair of endpoints whose first interpolated
+// colour comes closest to it, so a flat block keeps its exact colour rather
+// than the nearest 5:6:5 one.
+struct SingleColorTable {
+	uint8_t r[256][2];	// 5 bits; blue uses the same
+	uint8_t g[256][2];	// 6 bits
+
+	SingleColorTable() {
+		Build(5, r);
+		Build(6, g);
+	}
+
+	static void Build(int bits, uint8_t table[256][2]) {
+		int levels = 1 << bits;
+		for (int v = 0; v < 256; ++v) {
+			int best = 256;
+			for (int hi = 0; hi < levels; ++hi) {
+				for (int lo = 0; lo < levels; ++lo) {
+					int e0 = bits == 5 ? (hi << 3 | hi >> 2) : (hi << 2 | hi >> 4);
+					int e1 = bits == 5 ? (lo << 3 | lo >> 2) : (lo << 2 | lo >> 4);
+					int error = std::abs((2*e0 + e1 + 1) / 3 - v);
+					if (error < best) {
+						best = error;
+						table[v][0] = static_cast<uint8_t>(hi);
+						table[v][1] = static_cast<uint8_t>(lo);
+					}
+				}
+			}
+		}
+	}
+};
+
+const SingleColorTable &GetSingleColorTable() {
+	static const SingleColorTable table;
+	return table;
+}
+
+struct ColorFit {
+	uint16_t c0;
+	uint16_t c1;
+	uint8_t indices[16];
+	float error;
+};
+
+void EvaluateColor(const Texels &t, const float *weight, uint16_t c0, uint16_t c1, bool four_colors, ColorFit &fit) {
+	uint8_t palette8[4][4];
+	ColorPalette(c0, c1, four_colors, palette8);
+	float palette[4][3];
+	for (int k = 0; k < 4; ++k) {
+		for (int c = 0; c < 3; ++c)
+			palette[k][c] = palette8[k][c];
+	}
+	// Transparent black is for transparent texels only.
+	if (!four_colors)
+		palette[3][0] = palette[3][1] = palette[3][2] = 1e6f;
+
+	fit.c0 = c0;
+	fit.c1 = c1;
+	fit.error = FitColorIndices(t, weight, palette, fit.indices);
+}
+
+// Least-squares endpoints for the indices of fit, over the texels with
+// weight; false if the indices do not pin them down.
+bool SolveEndpoints(const Texels &t, const float *weight, const ColorFit &fit, bool four_colors, float *e0, float *e1) {
+	static const float kFourWeights[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f };
+	static const float kThreeWeights[4] = { 1.0f, 0.0f, 0.5f, 0.0f };
+	const float *weights = four_colors ? kFourWeights : kThreeWeights;
+
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; ++i) {
+		if (weight[i] == 0.0f)
+			continue;
+		float alpha = weights[fit.indices[i]], beta = 1.0f - alpha;
+		aa += alpha*alpha;
+		bb += beta*beta;
+		ab += alpha*beta;
+		ax[0] += alpha*t.r[i];
+		ax[1] += alpha*t.g[i];
+		ax[2] += alpha*t.b[i];
+		bx[0] += beta*t.r[i];
+		bx[1] += beta*t.g[i];
+		bx[2] += beta*t.b[i];
+	}
+	float det = aa*bb - ab*ab;
+	if (std::fabs(det) < 1e-4f)
+		return false;
+	for (int c = 0; c < 3; ++c) {
+		e0[c] = std::min(std::max((ax[c]*bb - bx[c]*ab) / det, 0.0f), 255.0f);
+		e1[c] = std::min(std::max((bx[c]*aa - ax[c]*ab) / det, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+void WriteColorBlock(const ColorFit &fit, bool four_colors, const float *weight, uint8_t *block) {
+	uint16_t c0 = fit.c0, c1 = fit.c1;
+	uint8_t indices[16];
+	memcpy(indices, fit.indices, 16);
+
+	// The order of the endpoints selects the mode, so swap them, and the
+	// indices with them, to match the mode fitted.
+	if (four_colors ? c0 < c1 : c0 > c1) {
+		std::swap(c0, c1);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = four_colors ? indices[i] ^ 1 : (indices[i] < 2 ? indices[i] ^ 1 : indices[i]);
+	}
+	if (four_colors && c0 == c1)
+		memset(indices, 0, 16);
+	if (!four_colors) {
+		for (int i = 0; i < 16; ++i) {
+			if (weight[i] == 0.0f)
+				indices[i] = 3;
+		}
+	}
+
+	uint32_t packed = 0;
+	for (int i = 15; i >= 0; --i)
+		packed = packed << 2 | indices[i];
+	WriteU16(block, c0);
+	WriteU16(block + 2, c1);
+	WriteU16(block + 4, static_cast<uint16_t>(packed));
+	WriteU16(block + 6, static_cast<uint16_t>(packed >> 16));
+}
+
+void EncodeColor(const uint8_t *rgba, bool allow_transparent, uint8_t *block) {
+	Texels t;
+	LoadTexels(rgba, t);
+
+	float weight[16];
+	int opaque_cnt = 0;
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	float lo[3] = { 255.0f, 255.0f, 255.0f }, hi[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; ++i) {
+		weight[i] = allow_transparent && t.a[i] < 128.0f ? 0.0f : 1.0f;
+		if (weight[i] == 0.0f)
+			continue;
+		++opaque_cnt;
+		float rgb[3] = { t.r[i], t.g[i], t.b[i] };
+		for (int c = 0; c < 3; ++c) {
+			mean[c] += rgb[c];
+			lo[c] = std::min(lo[c], rgb[c]);
+			hi[c] = std::max(hi[c], rgb[c]);
+		}
+	}
+	if (opaque_cnt == 0) {
+		memset(block, 0, 4);
+		memset(block + 4, 0xFF, 4);
+		return;
+	}
+	bool four_colors = opaque_cnt == 16;
+
+	ColorFit best;
+	if (four_colors && lo[0] == hi[0] && lo[1] == hi[1] && lo[2] == hi[2]) {
+		const SingleColorTable &table = GetSingleColorTable();
+		int r = static_cast<int>(lo[0]), g = static_cast<int>(lo[1]), b = static_cast<int>(lo[2]);
+		best.c0 = static_cast<uint16_t>(table.r[r][0] << 11 | table.g[g][0] << 5 | table.r[b][0]);
+		best.c1 = static_cast<uint16_t>(table.r[r][1] << 11 | table.g[g][1] << 5 | table.r[b][1]);
+		memset(best.indices, 2, 16);
+		WriteColorBlock(best, true, weight, block);
+		return;
+	}
+
+	// The principal axis of the opaque texels, by a few power iterations
+	// from the diagonal of their bounding box.
+	for (int c = 0; c < 3; ++c)
+		mean[c] /= opaque_cnt;
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; ++i) {
+		if (weight[i] == 0.0f)
+			continue;
+		float r = t.r[i] - mean[0], g = t.g[i] - mean[1], b = t.b[i] - mean[2];
+		cov[0] += r*r;
+		cov[1] += r*g;
+		cov[2] += r*b;
+		cov[3] += g*g;
+		cov[4] += g*b;
+		cov[5] += b*b;
+	}
+	float axis[3] = { hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] };
+	for (int iteration = 0; iteration < 4; ++iteration) {
+		float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+		float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+		float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+		float scale = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+		if (scale == 0.0f)
+			break;
+		axis[0] = x / scale;
+		axis[1] = y / scale;
+		axis[2] = z / scale;
+	}
+
+	// The texels furthest along it are the first endpoints.
+	int min_i = 0, max_i = 0;
+	float min_d = FLT_MAX, max_d = -FLT_MAX;
+	for (int i = 0; i < 16; ++i) {
+		if (weight[i] == 0.0f)
+			continue;
+		float d = t.r[i]*axis[0] + t.g[i]*axis[1] + t.b[i]*axis[2];
+		if (d < min_d) {
+			min_d = d;
+			min_i = i;
+		}
+		if (d > max_d) {
+			max_d = d;
+			max_i = i;
+		}
+	}
+	float e0[3] = { t.r[max_i], t.g[max_i], t.b[max_i] };
+	float e1[3] = { t.r[min_i], t.g[min_i], t.b[min_i] };
+	EvaluateColor(t, weight, Pack565(e0), Pack565(e1), four_colors, best);
+
+	for (int iteration = 0; iteration < 2; ++iteration) {
+		if (!SolveEndpoints(t, weight, best, four_colors, e0, e1))
+			break;
+		uint16_t c0 = Pack565(e0), c1 = Pack565(e1);
+		if (c0 == best.c0 && c1 == best.c1)
+			break;
+		ColorFit refined;
+		EvaluateColor(t, weight, c0, c1, four_colors, refined);
+		if (refined.error >= best.error)
+			break;
+		best = refined;
+	}
+	WriteColorBlock(best, four_colors, weight, block);
+}
+
+void WriteAlphaBlock(int a0, int a1, const uint8_t *indices, uint8_t *block) {
+	block[0] = static_cast<uint8_t>(a0);
+	block[1] = static_cast<uint8_t>(a1);
+	uint64_t packed = 0;
+	for (int i = 15; i >= 0; --i)
+		packed = packed << 3 | indices[i];
+	for (int i = 2; i < 8; ++i, packed >>= 8)
+		block[i] = static_cast<uint8_t>(packed);
+}
+
+// Reads the 16 values stride bytes apart.  Tries six interpolated values
+// between the extremes, and four between the extremes other than 0 and 255,
+// which then have their own indices.
+void EncodeAlpha(const uint8_t *in, size_t stride, uint8_t *block) {
+	float values[16];
+	int lo = 255, hi = 0, lo_inner = 255, hi_inner = 0;
+	for (int i = 0; i < 16; ++i) {
+		int v = in[i*stride];
+		values[i] = static_cast<float>(v);
+		lo = std::min(lo, v);
+		hi = std::max(hi, v);
+		if (v != 0 && v != 255) {
+			lo_inner = std::min(lo_inner, v);
+			hi_inner = std::max(hi_inner, v);
+		}
+	}
+	uint8_t indices[16];
+	if (lo == hi) {
+		memset(indices, 0, 16);
+		WriteAlphaBlock(lo, hi, indices, block);
+		return;
+	}
+
+	int palette[8];
+	AlphaPalette(hi, lo, palette);
+	float error = FitAlphaIndices(values, palette, indices);
+
+	if (lo_inner > hi_inner)
+		lo_inner = hi_inner = 0;
+	uint8_t indices6[16];
+	AlphaPalette(lo_inner, hi_inner, palette);
+	if (FitAlphaIndices(values, palette, indices6) < error) {
+		WriteAlphaBlock(lo_inner, hi_inner, indices6, block);
+		return;
+	}
+	WriteAlphaBlock(hi, lo, indices, block);
+}
+
+typedef void (*BlockFunction)(const uint8_t*, uint8_t*);
+
+struct BlockFormat {
+	BlockFunction decode;
+	BlockFunction encode;
+	size_t bytes;
+};
+
+bool GetBlockFormat(DXGI_FORMAT format, BlockFormat &out) {
+	switch (format) {
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+		out.decode = BlockCompression::DecodeBC1;
+		out.encode = BlockCompression::EncodeBC1;
+		out.bytes = 8;
+		return true;
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+		out.decode = BlockCompression::DecodeBC3;
+		out.encode = BlockCompression::EncodeBC3;
+		out.bytes = 16;
+		return true;
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+		out.decode = BlockCompression::DecodeBC4;
+		out.encode = BlockCompression::EncodeBC4;
+		out.bytes = 8;
+		return true;
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+		out.decode = BlockCompression::DecodeBC5;
+		out.encode = BlockCompression::EncodeBC5;
+		out.bytes = 16;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Calls rows(first, last) over bands of [0, row_cnt), on the pool if there
+// is one.
+void ForEachRowBand(UINT row_cnt, ThreadPool *pool, const std::function<void(UINT, UINT)> &rows) {
+	if (!pool || pool->ThreadCount() == 1 || row_cnt < 2) {
+		rows(0, row_cnt);
+		return;
+	}
+
+	// A few bands per thread, so one slow band does not hold up the rest.
+	UINT band_cnt = std::min(row_cnt, pool->ThreadCount() * 4);
+	UINT rows_per_band = (row_cnt + band_cnt - 1) / band_cnt;
+	pool->ParallelFor(band_cnt, [&](UINT band) {
+		UINT first = band * rows_per_band;
+		UINT last = std::min(row_cnt, first + rows_per_band);
+		if (first < last)
+			rows(first, last);
+	});
+}
+
+}
+
+void BlockCompression::DecodeBC1(const uint8_t *block, uint8_t *rgba) {
+	DecodeColor(block, false, rgba);
+}
+
+void BlockCompression::DecodeBC3(const uint8_t *block, uint8_t *rgba) {
+	DecodeColor(block + 8, true, rgba);
+	DecodeAlpha(block, rgba + 3, 4);
+}
+
+void BlockCompression::DecodeBC4(const uint8_t *block, uint8_t *rgba) {
+	static const uint8_t kBlack[4] = { 0, 0, 0, 255 };
+	for (int i = 0; i < 16; ++i)
+		memcpy(rgba + 4*i, kBlack, 4);
+	DecodeAlpha(block, rgba, 4);
+}
+
+void BlockCompression::DecodeBC5(const uint8_t *block, uint8_t *rgba) {
+	DecodeBC4(block, rgba);
+	DecodeAlpha(block + 8, rgba + 1, 4);
+}
+
+void BlockCompression::EncodeBC1(const uint8_t *rgba, uint8_t *block) {
+	EncodeColor(rgba, true, block);
+}
+
+void BlockCompression::EncodeBC3(const uint8_t *rgba, uint8_t *block) {
+	EncodeAlpha(rgba + 3, 4, block);
+	EncodeColor(rgba, false, block + 8);
+}
+
+void BlockCompression::EncodeBC4(const uint8_t *rgba, uint8_t *block) {
+	EncodeAlpha(rgba, 4, block);
+}
+
+void BlockCompression::EncodeBC5(const uint8_t *rgba, uint8_t *block) {
+	EncodeAlpha(rgba, 4, block);
+	EncodeAlpha(rgba + 1, 4, block + 8);
+}
+
+size_t BlockCompression::BlockBytes(DXGI_FORMAT format) {
+	BlockFormat block;
+	return GetBlockFormat(format, block) ? block.bytes : 0;
+}
+
+bool BlockCompression::Decode(DXGI_FORMAT format, const uint8_t *blocks, size_t block_pitch, UINT width, UINT height,
+	uint8_t *rgba, size_t rgba_pitch, ThreadPool *pool) {
+	BlockFormat block;
+	if (!GetBlockFormat(format, block))
+		return false;
+
+	UINT blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	ForEachRowBand(blocks_y, pool, [&](UINT first, UINT last) {
+		uint8_t texels[64];
+		for (UINT by = first; by < last; ++by) {
+			UINT rows = std::min(4u, height - 4*by);
+			for (UINT bx = 0; bx < blocks_x; ++bx) {
+				block.decode(blocks + by*block_pitch + bx*block.bytes, texels);
+				UINT columns = std::min(4u, width - 4*bx);
+				for (UINT y = 0; y < rows; ++y)
+					memcpy(rgba + (4*by + y)*rgba_pitch + 16*bx, texels + 16*y, 4*columns);
+			}
+		}
+	});
+	return true;
+}
+
+bool BlockCompression::Encode(DXGI_FORMAT format, const uint8_t *rgba, size_t rgba_pitch, UINT width, UINT height,
+	uint8_t *blocks, size_t block_pitch, ThreadPool *pool) {
+	BlockFormat block;
+	if (!GetBlockFormat(format, block))
+		return false;
+
+	UINT blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+	ForEachRowBand(blocks_y, pool, [&](UINT first, UINT last) {
+		uint8_t texels[64];
+		for (UINT by = first; by < last; ++by) {
+			for (UINT bx = 0; bx < blocks_x; ++bx) {
+				for (UINT y = 0; y < 4; ++y) {
+					const uint8_t *row = rgba + std::min(4*by + y, height - 1)*rgba_pitch;
+					for (UINT x = 0; x < 4; ++x)
+						memcpy(texels + 16*y + 4*x, row + 4*std::min(4*bx + x, width - 1), 4);
+				}
+				block.encode(texels, blocks + by*block_pitch + bx*block.bytes);
+			}
+		}
+	});
+	return true;
+}
+
+BlockCompression::Error BlockCompression::MeasureError(const uint8_t *a, size_t a_pitch, const uint8_t *b,
+	size_t b_pitch, UINT width, UINT height) {
+	Error error;
+	uint64_t rgb_sum = 0, alpha_sum = 0;
+	for (UINT y = 0; y < height; ++y) {
+		const uint8_t *row_a = a + y*a_pitch;
+		const uint8_t *row_b = b + y*b_pitch;
+		for (UINT x = 0; x < 4*width; ++x) {
+			int d = std::abs(row_a[x] - row_b[x]);
+			error.max = std::max(error.max, static_cast<UINT>(d));
+			if ((x & 3) == 3)
+				alpha_sum += d*d;
+			else
+				rgb_sum += d*d;
+		}
+	}
+	double texel_cnt = std::max(1.0, static_cast<double>(width)*height);
+	error.rgb_rms = std::sqrt(rgb_sum / (3.0*texel_cnt));
+	error.alpha_rms = std::sqrt(alpha_sum / texel_cnt);
+	return error;
+}
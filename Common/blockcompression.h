@@ -0,0 +1,66 @@
+#ifndef BLOCKCOMPRESSION_H
+#define BLOCKCOMPRESSION_H
+
+#include<Windows.h>
+#include<dxgiformat.h>
+#include<cstddef>
+#include<cstdint>
+
+class ThreadPool;
+
+// Decodes and encodes the block-compressed formats the demos' textures use,
+// without a GPU, so assets can be checked, diffed and recompressed on a build
+// machine.  Each 4x4 block decodes to RGBA8 the way Direct3D samples it:
+//
+//   BC1   5:6:5 endpoints and two interpolated colours, or one and
+//         transparent black when the first endpoint is not the larger
+//   BC3   a BC4 block for alpha in front of a BC1 block that always has the
+//         two interpolated colours
+//   BC4   8-bit red endpoints and six interpolated values, or four and 0 and
+//         255; green and blue decode as 0 and alpha as 255
+//   BC5   a BC4 block for red and one for green
+//
+// The interpolated values are rounded to nearest in integers, as the D3D10
+// reference rasterizer does; hardware may differ by one.  Only the UNORM,
+// UNORM_SRGB and TYPELESS variants are handled.
+//
+// The encoder fits the colour endpoints to the principal axis of the block,
+// refines them by least squares and picks each texel's index with SSE.  BC1
+// takes the transparent index for texels with alpha below 128.
+class BlockCompression {
+public:
+	// The largest and root-mean-square differences between two RGBA8 surfaces.
+	struct Error {
+		double rgb_rms = 0.0;
+		double alpha_rms = 0.0;
+		UINT max = 0;
+	};
+
+	// Single blocks: 16 RGBA8 texels, row after row.
+	static void DecodeBC1(const uint8_t *block, uint8_t *rgba);
+	static void DecodeBC3(const uint8_t *block, uint8_t *rgba);
+	static void DecodeBC4(const uint8_t *block, uint8_t *rgba);
+	static void DecodeBC5(const uint8_t *block, uint8_t *rgba);
+
+	static void EncodeBC1(const uint8_t *rgba, uint8_t *block);
+	static void EncodeBC3(const uint8_t *rgba, uint8_t *block);
+	static void EncodeBC4(const uint8_t *rgba, uint8_t *block);
+	static void EncodeBC5(const uint8_t *rgba, uint8_t *block);
+
+	// Bytes per 4x4 block, or 0 for a format not handled here.
+	static size_t BlockBytes(DXGI_FORMAT format);
+
+	// Whole surfaces.  Blocks past the right and bottom edges are decoded
+	// only as far as the surface goes, and encoded with the edge texels
+	// repeated.  With a pool, bands of block rows run on all its threads.
+	// Both return false for a format not handled here.
+	static bool Decode(DXGI_FORMAT format, const uint8_t *blocks, size_t block_pitch, UINT width, UINT height,
+		uint8_t *rgba, size_t rgba_pitch, ThreadPool *pool = nullptr);
+	static bool Encode(DXGI_FORMAT format, const uint8_t *rgba, size_t rgba_pitch, UINT width, UINT height,
+		uint8_t *blocks, size_t block_pitch, ThreadPool *pool = nullptr);
+
+	static Error MeasureError(const uint8_t *a, size_t a_pitch, const uint8_t *b, size_t b_pitch,
+		UINT width, UINT height);
+};
+
+#endif
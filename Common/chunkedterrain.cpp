@@ -0,0 +1,231 @@
+#include"chunkedterrain.h"
+#include"profiler.h"
+#include"threadpool.h"
+#include<algorithm>
+#include<cmath>
+using namespace DirectX;
+
+namespace {
+
+const UINT kNoSlot = ~0u;
+
+// One row of the height field at z, whose sine and cosine terms are the same
+// across the row, from per-column x, sin(0.1x) and cos(0.1x).  Writes
+// [j, end) as far as full vectors go, doing the scalar operations of
+// ChunkedTerrain::HillNormal() in the same order, and returns the first
+// column left for the scalar tail.
+#if defined(_XM_SSE_INTRINSICS_)
+UINT HillRow4(const float *x, const float *sin_x, const float *cos_x, float z, float sin_z, float cos_z,
+	float *heights, float *nx, float *ny, float *nz, UINT j, UINT end) {
+	__m128 Z = _mm_set1_ps(z);
+	__m128 CosZ = _mm_set1_ps(cos_z);
+	__m128 SinZ = _mm_set1_ps(sin_z);
+	__m128 NxZ = _mm_set1_ps(-0.03f*z);
+	__m128 NxC = _mm_set1_ps(0.3f*cos_z);
+	__m128 K = _mm_set1_ps(0.3f);
+	__m128 NegK = _mm_set1_ps(-0.3f);
+	__m128 K2 = _mm_set1_ps(0.03f);
+	__m128 One = _mm_set1_ps(1.0f);
+	for (; j + 4 <= end; j += 4) {
+		__m128 X = _mm_loadu_ps(x + j);
+		__m128 SinX = _mm_loadu_ps(sin_x + j);
+		__m128 CosX = _mm_loadu_ps(cos_x + j);
+
+		__m128 h = _mm_add_ps(_mm_mul_ps(Z, SinX), _mm_mul_ps(X, CosZ));
+		_mm_storeu_ps(heights + j, _mm_mul_ps(K, h));
+
+		__m128 a = _mm_sub_ps(_mm_mul_ps(NxZ, CosX), NxC);
+		__m128 c = _mm_add_ps(_mm_mul_ps(NegK, SinX), _mm_mul_ps(_mm_mul_ps(K2, X), SinZ));
+		__m128 len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, a), One), _mm_mul_ps(c, c));
+		len = _mm_sqrt_ps(len);
+		_mm_storeu_ps(nx + j, _mm_div_ps(a, len));
+		_mm_storeu_ps(ny + j, _mm_div_ps(One, len));
+		_mm_storeu_ps(nz + j, _mm_div_ps(c, len));
+	}
+	return j;
+}
+#endif
+
+}
+
+ChunkedTerrain::ChunkedTerrain(const Desc &desc)
+	: desc_(desc) {
+	desc_.chunk_vertices = std::max(desc_.chunk_vertices, 2u);
+	desc_.load_radius = std::max(desc_.load_radius, 0);
+	UINT n = desc_.chunk_vertices;
+
+	// The grid's index list serves every chunk.
+	GeometryGenerator::MeshData grid;
+	GeometryGenerator(1).CreateGrid(desc_.chunk_size, desc_.chunk_size, n, n, grid);
+	indices_.swap(grid.indices);
+
+	// A disc of chunks, and by default slots for one more ring of them, so
+	// walking back a step finds the chunks it just left still cached.
+	int r = desc_.load_radius;
+	float load_r2 = (r + 0.5f)*(r + 0.5f), cache_r2 = (r + 1.5f)*(r + 1.5f);
+	UINT cache_cnt = 0;
+	for (int dz = -r - 1; dz <= r + 1; ++dz) {
+		for (int dx = -r - 1; dx <= r + 1; ++dx) {
+			float d2 = static_cast<float>(dx*dx + dz*dz);
+			if (d2 <= load_r2)
+				offsets_.push_back(std::make_pair(dx, dz));
+			if (d2 <= cache_r2)
+				++cache_cnt;
+		}
+	}
+	std::stable_sort(offsets_.begin(), offsets_.end(), [](const std::pair<int, int> &a, const std::pair<int, int> &b) {
+		return a.first*a.first + a.second*a.second < b.first*b.first + b.second*b.second;
+	});
+
+	slot_cnt_ = desc_.max_chunks ? desc_.max_chunks : cache_cnt;
+	desc_.max_chunks = slot_cnt_;
+	slots_.reset(new Slot[slot_cnt_]);
+	for (UINT i = 0; i < slot_cnt_; ++i)
+		slots_[i].vertices.resize(VertexCount());
+	slot_of_chunk_.reserve(slot_cnt_);
+	wanted_.reserve(offsets_.size());
+
+	pool_.reset(new ThreadPool(std::max(desc_.thread_cnt, 1u)));
+}
+
+ChunkedTerrain::~ChunkedTerrain() {
+	// The pool's workers finish the chunks still queued before it goes.
+	pool_.reset();
+}
+
+XMFLOAT3 ChunkedTerrain::HillNormal(float x, float z) {
+	// n = (-df/dx, 1, -df/dz)
+	float nx = -0.03f*z*cosf(0.1f*x) - 0.3f*cosf(0.1f*z);
+	float nz = -0.3f*sinf(0.1f*x) + 0.03f*x*sinf(0.1f*z);
+	float len = sqrtf(nx*nx + 1.0f + nz*nz);
+	return XMFLOAT3(nx / len, 1.0f / len, nz / len);
+}
+
+void ChunkedTerrain::BuildChunk(int x, int z, Vertex *vertices) const {
+	PROFILE_ZONE("ChunkedTerrain::BuildChunk");
+
+	// Rows go from the chunk's maximum z down.  The texture repeats once per
+	// chunk, as it would on a CreateGrid grid of the chunk's size.
+	int n = static_cast<int>(desc_.chunk_vertices);
+	BuildPatch(x*(n - 1), (z + 1)*(n - 1), desc_.chunk_size / (n - 1), desc_.chunk_vertices, desc_.chunk_size, vertices);
+}
+
+void ChunkedTerrain::BuildPatch(int first_col, int first_row, float step, UINT n, float tex_period, Vertex *vertices) {
+	// The height field is separable: only the row's z and the column's x go
+	// into the sines and cosines.
+	std::vector<float> scratch(7 * n);
+	float *xs = scratch.data(), *sin_x = xs + n, *cos_x = sin_x + n;
+	float *heights = cos_x + n, *nx = heights + n, *ny = nx + n, *nz = ny + n;
+	for (UINT j = 0; j < n; ++j) {
+		xs[j] = static_cast<float>(first_col + static_cast<int>(j))*step;
+		sin_x[j] = sinf(0.1f*xs[j]);
+		cos_x[j] = cosf(0.1f*xs[j]);
+	}
+	float tex_scale = 1.0f / tex_period;
+
+	for (UINT i = 0; i < n; ++i) {
+		float row_z = static_cast<float>(first_row - static_cast<int>(i))*step;
+		float sin_z = sinf(0.1f*row_z), cos_z = cosf(0.1f*row_z);
+
+		UINT j = 0;
+#if defined(_XM_SSE_INTRINSICS_)
+		j = HillRow4(xs, sin_x, cos_x, row_z, sin_z, cos_z, heights, nx, ny, nz, j, n);
+#endif
+		for (; j < n; ++j) {
+			heights[j] = 0.3f*(row_z*sin_x[j] + xs[j]*cos_z);
+			float a = -0.03f*row_z*cos_x[j] - 0.3f*cos_z;
+			float c = -0.3f*sin_x[j] + 0.03f*xs[j]*sin_z;
+			float len = sqrtf(a*a + 1.0f + c*c);
+			nx[j] = a / len;
+			ny[j] = 1.0f / len;
+			nz[j] = c / len;
+		}
+
+		Vertex *row = vertices + static_cast<size_t>(i)*n;
+		for (j = 0; j < n; ++j) {
+			row[j].pos = XMFLOAT3(xs[j], heights[j], row_z);
+			row[j].normal = XMFLOAT3(nx[j], ny[j], nz[j]);
+			row[j].tex = XMFLOAT2(xs[j]*tex_scale, -row_z*tex_scale);
+		}
+	}
+}
+
+UINT ChunkedTerrain::FindFreeSlot() const {
+	UINT lru = kNoSlot;
+	for (UINT i = 0; i < slot_cnt_; ++i) {
+		const Slot &slot = slots_[i];
+		int state = slot.state.load(std::memory_order_acquire);
+		if (state == kEmpty)
+			return i;
+		if (state == kReady && slot.last_used < frame_ && (lru == kNoSlot || slot.last_used < slots_[lru].last_used))
+			lru = i;
+	}
+	return lru;
+}
+
+void ChunkedTerrain::Update(float focus_x, float focus_z) {
+	PROFILE_ZONE("ChunkedTerrain::Update");
+
+	++frame_;
+	wanted_.clear();
+	int focus_col = static_cast<int>(floorf(focus_x / desc_.chunk_size));
+	int focus_row = static_cast<int>(floorf(focus_z / desc_.chunk_size));
+
+	for (const std::pair<int, int> &offset : offsets_) {
+		int x = focus_col + offset.first, z = focus_row + offset.second;
+		uint64_t key = ChunkKey(x, z);
+		auto it = slot_of_chunk_.find(key);
+		if (it != slot_of_chunk_.end()) {
+			slots_[it->second].last_used = frame_;
+			wanted_.push_back(it->second);
+			continue;
+		}
+
+		UINT index = FindFreeSlot();
+		if (index == kNoSlot)
+			continue;
+
+		// Only empty and built slots are reused, so no worker is writing this
+		// one.
+		Slot &slot = slots_[index];
+		if (slot.state.load(std::memory_order_relaxed) != kEmpty)
+			slot_of_chunk_.erase(ChunkKey(slot.x, slot.z));
+		slot.x = x;
+		slot.z = z;
+		++slot.generation;
+		slot.last_used = frame_;
+		slot.state.store(kLoading, std::memory_order_relaxed);
+		slot_of_chunk_[key] = index;
+		wanted_.push_back(index);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			++jobs_running_;
+		}
+		pool_->Submit([this, index]() {
+			Slot &slot = slots_[index];
+			BuildChunk(slot.x, slot.z, slot.vertices.data());
+			slot.state.store(kReady, std::memory_order_release);
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (--jobs_running_ == 0)
+				idle_cv_.notify_all();
+		});
+	}
+}
+
+void ChunkedTerrain::ReadyChunks(std::vector<Chunk> &chunks) const {
+	chunks.clear();
+	for (UINT index : wanted_) {
+		const Slot &slot = slots_[index];
+		if (slot.state.load(std::memory_order_acquire) != kReady)
+			continue;
+		Chunk chunk = { slot.x, slot.z, index, slot.generation, slot.vertices.data() };
+		chunks.push_back(chunk);
+	}
+}
+
+void ChunkedTerrain::Flush() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	idle_cv_.wait(lock, [this] { return jobs_running_ == 0; });
+}
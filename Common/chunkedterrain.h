@@ -0,0 +1,148 @@
+#ifndef CHUNKEDTERRAIN_H
+#define CHUNKEDTERRAIN_H
+
+#include"geometrygenerator.h"
+#include<atomic>
+#include<condition_variable>
+#include<cstdint>
+#include<memory>
+#include<mutex>
+#include<unordered_map>
+#include<utility>
+#include<vector>
+
+class ThreadPool;
+
+// The hills of the Chapter 7-12 demos, without edges: square chunks of the
+// height field are built on worker threads as a focus point moves over it,
+// into a fixed set of cache slots that are reused least recently used first.
+// Memory is set by max_chunks alone, however far the focus travels.
+//
+// Every chunk is the same grid, so one index list (from CreateGrid) draws
+// them all.  Vertex positions come from a lattice shared by all the chunks,
+// so neighbouring chunks meet without cracks.
+class ChunkedTerrain {
+public:
+	// Laid out as the demos' Vertex::Basic32.
+	struct Vertex {
+		DirectX::XMFLOAT3 pos;
+		DirectX::XMFLOAT3 normal;
+		DirectX::XMFLOAT2 tex;
+	};
+
+	struct Desc {
+		float chunk_size = 160.0f;		// world units along a side
+		UINT chunk_vertices = 33;		// along a side
+		int load_radius = 2;			// in chunks around the focus chunk
+		UINT max_chunks = 0;			// cache slots; 0 leaves room for a ring past load_radius
+		UINT thread_cnt = 2;			// counts the calling thread, as for ThreadPool
+	};
+
+	// A chunk ready to draw.  Chunk (x, z) covers [x, x + 1) * chunk_size by
+	// [z, z + 1) * chunk_size.  The generation changes whenever the slot is
+	// refilled, so a renderer keeping a vertex buffer per slot knows when to
+	// upload it again.
+	struct Chunk {
+		int x;
+		int z;
+		UINT slot;
+		UINT generation;
+		const Vertex *vertices;
+	};
+
+	explicit ChunkedTerrain(const Desc &desc);
+	~ChunkedTerrain();
+
+	const Desc &GetDesc() const {
+		return desc_;
+	}
+
+	UINT SlotCount() const {
+		return slot_cnt_;
+	}
+
+	UINT VertexCount() const {
+		return desc_.chunk_vertices*desc_.chunk_vertices;
+	}
+
+	const std::vector<UINT> &Indices() const {
+		return indices_;
+	}
+
+	// Queues the chunks within load_radius of the focus that are not cached,
+	// nearest first, while there are slots not in use by this call's chunks.
+	void Update(float focus_x, float focus_z);
+
+	// The chunks wanted by the last Update() that are built.
+	void ReadyChunks(std::vector<Chunk> &chunks) const;
+
+	// Waits for every queued chunk to be built.
+	void Flush();
+
+	// The height field, and its normal from the analytic derivatives.
+	static float HillHeight(float x, float z) {
+		return 0.3f*(z*sinf(0.1f*x) + x*cosf(0.1f*z));
+	}
+	static DirectX::XMFLOAT3 HillNormal(float x, float z);
+
+	// Fills the VertexCount() vertices of chunk (x, z).  Called on the workers;
+	// safe on any thread.
+	void BuildChunk(int x, int z, Vertex *vertices) const;
+
+	// Fills an n x n patch of the height field on the lattice (col, row) *
+	// step, from (first_col, first_row) towards +x and -z, rows first as in
+	// CreateGrid.  Patches on lattices whose steps differ by powers of two
+	// agree exactly where their vertices meet.  Texture coordinates repeat
+	// every tex_period units.
+	static void BuildPatch(int first_col, int first_row, float step, UINT n, float tex_period, Vertex *vertices);
+
+private:
+	ChunkedTerrain(const ChunkedTerrain&) = delete;
+	ChunkedTerrain& operator=(const ChunkedTerrain&) = delete;
+
+	enum SlotState {
+		kEmpty,
+		kLoading,
+		kReady
+	};
+
+	struct Slot {
+		int x = 0;
+		int z = 0;
+		UINT generation = 0;
+		uint64_t last_used = 0;
+		std::atomic<int> state;
+		std::vector<Vertex> vertices;
+
+		Slot() : state(kEmpty) {}
+	};
+
+	static uint64_t ChunkKey(int x, int z) {
+		return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(z);
+	}
+
+	// An empty slot, or else the least recently used built one that the
+	// current Update() does not want; ~0u when every slot is taken.
+	UINT FindFreeSlot() const;
+
+private:
+	Desc desc_;
+	std::vector<UINT> indices_;
+	// Chunks within load_radius of the focus chunk, nearest first.
+	std::vector<std::pair<int, int>> offsets_;
+
+	std::unique_ptr<Slot[]> slots_;
+	UINT slot_cnt_ = 0;
+	std::unordered_map<uint64_t, UINT> slot_of_chunk_;
+	std::vector<UINT> wanted_;
+	uint64_t frame_ = 0;
+
+	std::mutex mutex_;
+	std::condition_variable idle_cv_;
+	UINT jobs_running_ = 0;
+
+	// Last, so its workers finish before anything they use goes away.
+	std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif
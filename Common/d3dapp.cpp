@@ -3,7 +3,9 @@
 //***************************************************************************************
 
 #include"d3dapp.h"
+#include"profiler.h"
 #include<Windows.h>
+#include<fstream>
 #include<sstream>
 #include<vector>
 #include<memory>
@@ -108,9 +110,17 @@ int D3DApp::Run()
 
 			if( !is_paused_ )
 			{
+				frame_stats_.AddFrame(timer_.DeltaTime(), timer_.TotalTime());
 				CalculateFrameStats();
-				UpdateScene(timer_.DeltaTime());	
-				DrawScene();
+				{
+					PROFILE_ZONE("UpdateScene");
+					UpdateScene(timer_.DeltaTime());
+				}
+				{
+					PROFILE_ZONE("DrawScene");
+					DrawScene();
+				}
+				PROFILE_FRAME();
 			}
 			else
 			{
@@ -345,6 +355,39 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 		OnMouseWheel(wParam, lParam);
 		return 0;
 
+	// F2 saves the recent frame times for a closer look at the hitches.
+	case WM_KEYUP:
+		if( wParam == VK_F2 )
+		{
+			frame_stats_.WriteCsv("frame_times.csv");
+			return 0;
+		}
+#if defined(ENABLE_PROFILER)
+		// F3 starts a profiler capture and, pressed again, saves it as a
+		// Chrome trace.  F4 saves the zone tree of the last frame.
+		if( wParam == VK_F3 )
+		{
+			Profiler& profiler = Profiler::Instance();
+			if( !profiler.Capturing() )
+			{
+				profiler.StartCapture();
+			}
+			else
+			{
+				profiler.StopCapture();
+				profiler.WriteChromeTrace("profile.json");
+			}
+			return 0;
+		}
+		if( wParam == VK_F4 )
+		{
+			ofstream fout("frame_zones.txt");
+			Profiler::Instance().WriteFrameTree(fout);
+			return 0;
+		}
+#endif
+		return DefWindowProc(hwnd, msg, wParam, lParam);
+
 	default:
 		return DefWindowProc(hwnd, msg, wParam, lParam);
 	}
@@ -550,7 +593,8 @@ void D3DApp::CalculateFrameStats()
 {
 	// Code computes the average frames per second, and also the 
 	// average time it takes to render one frame.  These stats 
-	// are appended to the window caption bar.
+	// are appended to the window caption bar, together with the
+	// slow end of the recent frame times and the hitch count.
 
 	static int frame_cnt = 0;
 	static float time_elapsed = 0.0f;
@@ -562,12 +606,16 @@ void D3DApp::CalculateFrameStats()
 	{
 		float fps = (float)frame_cnt; // fps = frameCnt / 1
 		float mspf = 1000.0f / fps;
+		FrameStats::Summary stats = frame_stats_.Summarize();
 
 		wostringstream outs;   
 		outs.precision(6);
 		outs << main_wnd_caption_ << L"    "
 			 << L"FPS: " << fps << L"    " 
-			 << L"Frame Time: " << mspf << L" (ms)";
+			 << L"Frame Time: " << mspf << L" (ms)    "
+			 << L"p99: " << stats.p99_ms << L"    "
+			 << L"Max: " << stats.max_ms << L"    "
+			 << L"Hitches: " << frame_stats_.HitchCount();
 		SetWindowText(main_wnd_, outs.str().c_str());
 		
 		// Reset for next average.
@@ -13,6 +13,7 @@
 
 #include "d3dutility.h"
 #include "d3dtimer.h"
+#include "framestats.h"
 #include <string>
 
 class D3DApp
@@ -69,6 +70,7 @@ protected:
 	UINT      quality_msaa4x_;
 
 	D3DTimer timer_;
+	FrameStats frame_stats_;
 	
 	
 
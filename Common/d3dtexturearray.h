@@ -0,0 +1,34 @@
+#ifndef D3DTEXTUREARRAY_H
+#define D3DTEXTUREARRAY_H
+
+#include"d3dutility.h"
+#include"DDSTextureLoader.h"
+#include"mappedfile.h"
+#include"texturepacker.h"
+#include<memory>
+#include<string>
+#include<vector>
+
+// Packs DDS files of one size and format into the slices of a Texture2DArray,
+// in order, and views all of it.
+inline void CreateDDSTextureArraySRVFromFiles(ID3D11Device *device, const std::vector<std::wstring> &fileNames, ID3D11ShaderResourceView **pShaderResourceView) {
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<TexturePacker::Source> sources;
+	for (const std::wstring &fileName : fileNames) {
+		files.emplace_back(new MappedFile);
+		if (!files.back()->Open(fileName)) {
+			HR(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+			return;
+		}
+		TexturePacker::Source source = { files.back()->Data(), files.back()->Size() };
+		sources.push_back(source);
+	}
+
+	std::vector<uint8_t> packed;
+	HR(TexturePacker::PackArray(sources, packed));
+	ID3D11Resource *texResource = nullptr;
+	HR(DirectX::CreateDDSTextureFromMemory(device, packed.data(), packed.size(), &texResource, pShaderResourceView));
+	ReleaseCOM(texResource);
+}
+
+#endif
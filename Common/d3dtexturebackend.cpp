@@ -0,0 +1,114 @@
+#include"d3dtexturebackend.h"
+using namespace DirectX;
+
+D3DTextureBackend::D3DTextureBackend(ID3D11Device *device)
+	: device_(device) {
+}
+
+D3DTextureBackend::~D3DTextureBackend() {
+	for (ID3D11ShaderResourceView *view : views_) {
+		if (view)
+			view->Release();
+	}
+}
+
+bool D3DTextureBackend::FreeThreaded() const {
+	return (device_->GetCreationFlags() & D3D11_CREATE_DEVICE_SINGLETHREADED) == 0;
+}
+
+HRESULT D3DTextureBackend::Create(const TexturePipeline::Texture &texture) {
+	const DDS_TEXTURE_INFO &info = texture.info;
+	std::vector<D3D11_SUBRESOURCE_DATA> init_data(texture.subresources.size());
+	for (size_t i = 0; i < init_data.size(); ++i) {
+		init_data[i].pSysMem = texture.subresources[i].data;
+		init_data[i].SysMemPitch = texture.subresources[i].row_pitch;
+		init_data[i].SysMemSlicePitch = texture.subresources[i].slice_pitch;
+	}
+
+	HRESULT hr = E_FAIL;
+	ID3D11Resource *resource = nullptr;
+	D3D11_SHADER_RESOURCE_VIEW_DESC view_desc = {};
+	const D3D11_SHADER_RESOURCE_VIEW_DESC *view_desc_ptr = nullptr;
+	switch (info.resourceDimension) {
+	case DDS_DIMENSION_TEXTURE1D: {
+		D3D11_TEXTURE1D_DESC desc = {};
+		desc.Width = info.width;
+		desc.MipLevels = info.mipCount;
+		desc.ArraySize = info.arraySize;
+		desc.Format = info.format;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		ID3D11Texture1D *tex = nullptr;
+		hr = device_->CreateTexture1D(&desc, init_data.data(), &tex);
+		resource = tex;
+		break;
+	}
+	case DDS_DIMENSION_TEXTURE2D: {
+		D3D11_TEXTURE2D_DESC desc = {};
+		desc.Width = info.width;
+		desc.Height = info.height;
+		desc.MipLevels = info.mipCount;
+		desc.ArraySize = info.arraySize;
+		desc.Format = info.format;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		// A cube's default view would be a 2D array, so ask for a cube.
+		if (info.isCubeMap) {
+			desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+			view_desc.Format = info.format;
+			if (info.arraySize > 6) {
+				view_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBEARRAY;
+				view_desc.TextureCubeArray.MipLevels = info.mipCount;
+				view_desc.TextureCubeArray.NumCubes = info.arraySize / 6;
+			} else {
+				view_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+				view_desc.TextureCube.MipLevels = info.mipCount;
+			}
+			view_desc_ptr = &view_desc;
+		}
+		ID3D11Texture2D *tex = nullptr;
+		hr = device_->CreateTexture2D(&desc, init_data.data(), &tex);
+		resource = tex;
+		break;
+	}
+	case DDS_DIMENSION_TEXTURE3D: {
+		D3D11_TEXTURE3D_DESC desc = {};
+		desc.Width = info.width;
+		desc.Height = info.height;
+		desc.Depth = info.depth;
+		desc.MipLevels = info.mipCount;
+		desc.Format = info.format;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		ID3D11Texture3D *tex = nullptr;
+		hr = device_->CreateTexture3D(&desc, init_data.data(), &tex);
+		resource = tex;
+		break;
+	}
+	}
+	if (FAILED(hr))
+		return hr;
+
+	ID3D11ShaderResourceView *view = nullptr;
+	hr = device_->CreateShaderResourceView(resource, view_desc_ptr, &view);
+	// The view holds on to the texture.
+	resource->Release();
+	if (FAILED(hr))
+		return hr;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (texture.handle >= views_.size())
+		views_.resize(texture.handle + 1, nullptr);
+	views_[texture.handle] = view;
+	return S_OK;
+}
+
+ID3D11ShaderResourceView *D3DTextureBackend::TakeView(UINT handle) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (handle >= views_.size())
+		return nullptr;
+	ID3D11ShaderResourceView *view = views_[handle];
+	views_[handle] = nullptr;
+	return view;
+}
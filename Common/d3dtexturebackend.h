@@ -0,0 +1,35 @@
+#ifndef D3DTEXTUREBACKEND_H
+#define D3DTEXTUREBACKEND_H
+
+#include"texturepipeline.h"
+#include<d3d11.h>
+#include<mutex>
+#include<vector>
+
+// The Direct3D 11 end of a TexturePipeline: an immutable texture and a view of
+// all of it per file, as CreateDDSTextureFromFile makes.  Creation runs on the
+// pipeline's threads unless the device is single-threaded.
+class D3DTextureBackend : public TexturePipeline::Backend {
+public:
+	explicit D3DTextureBackend(ID3D11Device *device);
+	// Releases the views no one took.
+	~D3DTextureBackend();
+
+	bool FreeThreaded() const override;
+	HRESULT Create(const TexturePipeline::Texture &texture) override;
+
+	// Hands over the view of a handle, for the caller to release; nullptr if
+	// it failed or was taken already.
+	ID3D11ShaderResourceView *TakeView(UINT handle);
+
+private:
+	D3DTextureBackend(const D3DTextureBackend&) = delete;
+	D3DTextureBackend& operator=(const D3DTextureBackend&) = delete;
+
+private:
+	ID3D11Device *device_;
+	std::mutex mutex_;
+	std::vector<ID3D11ShaderResourceView*> views_;
+};
+
+#endif
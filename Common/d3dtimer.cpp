@@ -1,9 +1,18 @@
 #include"d3dtimer.h"
+#include<chrono>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+int64_t Now() {
+	return static_cast<int64_t>(Clock::now().time_since_epoch().count());
+}
+
+}
 
 D3DTimer::D3DTimer(){
-	INT64 counts_per_second;
-	QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&counts_per_second));
-	seconds_per_count_ = 1.0 / static_cast<double>(counts_per_second);
+	seconds_per_count_ = static_cast<double>(Clock::period::num) / static_cast<double>(Clock::period::den);
 }
 
 float D3DTimer::DeltaTime() {
@@ -23,7 +32,7 @@ void D3DTimer::Tick() {
 		return;
 	}
 
-	QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&time_curr_));
+	time_curr_ = Now();
 
 	delta_time_ = (time_curr_ - time_prev_) * seconds_per_count_;
 	time_prev_ = time_curr_;
@@ -38,7 +47,7 @@ void D3DTimer::Tick() {
 
 
 void D3DTimer::Reset() {
-	QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&time_reset_));
+	time_reset_ = Now();
 	time_prev_ = time_reset_;
 	time_pause_total_ = 0;
 	is_paused_ = false; // After reseting, the timing is started
@@ -48,14 +57,14 @@ void D3DTimer::Reset() {
 void D3DTimer::Pause() {
 	if (!is_paused_) {
 		is_paused_ = true;
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&time_pause_));
+		time_pause_ = Now();
 	}
 
 }
 
 void D3DTimer::Continue() {
 	if (is_paused_) {
-		QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&time_continue_));
+		time_continue_ = Now();
 		time_pause_total_ += time_continue_ - time_pause_;
 		time_prev_ = time_continue_;
 		is_paused_ = false;
@@ -1,7 +1,9 @@
 #ifndef D3DTIMER_H
 #define D3DTIMER_H
-#include<Windows.h>
+#include<cstdint>
 
+// Measures time with std::chrono::steady_clock, which is QueryPerformanceCounter
+// on Windows and clock_gettime(CLOCK_MONOTONIC) on Linux.
 class D3DTimer {
 public:
 	D3DTimer();
@@ -15,14 +17,14 @@ public:
 	void Tick();
 
 private:
-	INT64 time_reset_ = 0;
-	INT64 time_pause_ = 0;
-	INT64 time_continue_ = 0;
+	int64_t time_reset_ = 0;
+	int64_t time_pause_ = 0;
+	int64_t time_continue_ = 0;
 	
-	INT64 time_pause_total_ = 0;
+	int64_t time_pause_total_ = 0;
 
-	INT64 time_curr_ = 0;
-	INT64 time_prev_ = 0;
+	int64_t time_curr_ = 0;
+	int64_t time_prev_ = 0;
 
 	double seconds_per_count_ = 0.0;
 	double delta_time_ = 0.0;
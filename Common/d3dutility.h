@@ -3,6 +3,7 @@
 
 #include<d3d11.h>
 #include<dxgi.h>
+#include"indexpacker.h"
 #include"mathhelper.h"
 
 //-----------------------------------------
@@ -83,6 +84,29 @@ inline void CreateDDSShaderResourceViewFromFile(ID3D11Device *device, const wcha
 
 }
 
+// Creates an immutable index buffer, 16-bit when every index fits, and
+// returns the format to pass to IASetIndexBuffer().
+inline DXGI_FORMAT CreateIndexBuffer(ID3D11Device *device, const UINT *indices, size_t index_cnt, ID3D11Buffer **buffer) {
+	std::vector<uint16_t> narrow;
+	bool is_16bit = IndexPacker::Narrow(indices, index_cnt, narrow);
+
+	D3D11_BUFFER_DESC ibd;
+	ibd.Usage = D3D11_USAGE_IMMUTABLE;
+	ibd.ByteWidth = static_cast<UINT>(index_cnt * (is_16bit ? sizeof(uint16_t) : sizeof(UINT)));
+	ibd.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	ibd.CPUAccessFlags = 0;
+	ibd.MiscFlags = 0;
+	ibd.StructureByteStride = 0;
+	D3D11_SUBRESOURCE_DATA iinitData;
+	iinitData.pSysMem = is_16bit ? static_cast<const void *>(narrow.data()) : indices;
+	HR(device->CreateBuffer(&ibd, &iinitData, buffer));
+	return is_16bit ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+inline DXGI_FORMAT CreateIndexBuffer(ID3D11Device *device, const std::vector<UINT> &indices, ID3D11Buffer **buffer) {
+	return CreateIndexBuffer(device, indices.data(), indices.size(), buffer);
+}
+
 
 #include<fstream>
 #include<string>
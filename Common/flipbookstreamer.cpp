@@ -0,0 +1,175 @@
+#include"flipbookstreamer.h"
+#include"mappedfile.h"
+#include"profiler.h"
+#include"threadpool.h"
+#include<algorithm>
+#include<cstring>
+using namespace DirectX;
+
+namespace {
+
+// Reads the headers of a DDS file in memory; false if they are not valid.
+bool ReadInfo(const MappedFile &file, DDS_TEXTURE_INFO &info, size_t &texel_offset) {
+	const DDS_HEADER *header = nullptr;
+	return SUCCEEDED(ParseDDSHeader(file.Data(), file.Size(), &header, &texel_offset)) &&
+		SUCCEEDED(GetDDSTextureInfo(header, &info));
+}
+
+}
+
+FlipbookStreamer::FlipbookStreamer() = default;
+
+FlipbookStreamer::~FlipbookStreamer() {
+	Close();
+}
+
+bool FlipbookStreamer::Open(const Desc &desc) {
+	PROFILE_ZONE("FlipbookStreamer::Open");
+
+	Close();
+	if (desc.filenames.empty())
+		return false;
+
+	// The first frame alone is read here; it decides the size of the blob.
+	MappedFile file;
+	DDS_TEXTURE_INFO info;
+	size_t texel_offset = 0;
+	if (!file.Open(desc.filenames[0]) || !ReadInfo(file, info, texel_offset))
+		return false;
+	if (info.resourceDimension != DDS_DIMENSION_TEXTURE2D || info.arraySize != 1 || info.isCubeMap)
+		return false;
+
+	// Mip after mip, as a DDS file and a texture array slice both lay them out.
+	std::vector<Subresource> subresources;
+	size_t frame_bytes = 0;
+	size_t width = info.width, height = info.height;
+	for (uint32_t level = 0; level < info.mipCount; ++level) {
+		size_t num_bytes = 0, row_bytes = 0;
+		GetSurfaceInfo(width, height, info.format, &num_bytes, &row_bytes, nullptr);
+		Subresource subresource = { frame_bytes, static_cast<UINT>(row_bytes), static_cast<UINT>(num_bytes) };
+		subresources.push_back(subresource);
+		frame_bytes += num_bytes;
+		width = std::max<size_t>(width / 2, 1);
+		height = std::max<size_t>(height / 2, 1);
+	}
+	if (frame_bytes == 0 || file.Size() - texel_offset < frame_bytes)
+		return false;
+
+	desc_ = desc;
+	desc_.window = std::min(std::max(desc_.window, 1u), FrameCount());
+	info_ = info;
+	subresources_.swap(subresources);
+	frame_bytes_ = frame_bytes;
+
+	blob_.reset(new uint8_t[frame_bytes_*desc_.window]);
+	slots_.reset(new Slot[desc_.window]);
+	first_frame_ = 0;
+	failed_loads_.store(0, std::memory_order_relaxed);
+	pool_.reset(new ThreadPool(desc_.thread_cnt));
+
+	Update(0);
+	return true;
+}
+
+void FlipbookStreamer::Close() {
+	// The pool runs the jobs still queued before its workers exit.
+	pool_.reset();
+
+	desc_ = Desc();
+	info_ = DDS_TEXTURE_INFO();
+	subresources_.clear();
+	frame_bytes_ = 0;
+	blob_.reset();
+	slots_.reset();
+	first_frame_ = 0;
+}
+
+bool FlipbookStreamer::LoadFrame(UINT frame, uint8_t *texels) const {
+	PROFILE_ZONE("FlipbookStreamer::LoadFrame");
+
+	MappedFile file;
+	DDS_TEXTURE_INFO info;
+	size_t texel_offset = 0;
+	if (!file.Open(desc_.filenames[frame]) || !ReadInfo(file, info, texel_offset))
+		return false;
+	if (info.width != info_.width || info.height != info_.height || info.mipCount != info_.mipCount ||
+		info.format != info_.format || info.arraySize != 1 || info.resourceDimension != info_.resourceDimension)
+		return false;
+	if (file.Size() - texel_offset < frame_bytes_)
+		return false;
+
+	memcpy(texels, file.Data() + texel_offset, frame_bytes_);
+	return true;
+}
+
+void FlipbookStreamer::Update(UINT frame) {
+	if (!IsOpen())
+		return;
+	PROFILE_ZONE("FlipbookStreamer::Update");
+
+	UINT frame_cnt = FrameCount(), window = desc_.window;
+	first_frame_ = frame % frame_cnt;
+
+	for (UINT k = 0; k < window; ++k) {
+		UINT wanted = (first_frame_ + k) % frame_cnt;
+
+		// Frames that failed stay failed until the window has passed them,
+		// rather than being read again every frame.
+		UINT free_slot = window;
+		bool resident = false;
+		for (UINT i = 0; i < window && !resident; ++i) {
+			const Slot &slot = slots_[i];
+			int state = slot.state.load(std::memory_order_acquire);
+			if (state != kEmpty && slot.frame == wanted)
+				resident = true;
+			else if (free_slot == window && state != kLoading &&
+				(state == kEmpty || (slot.frame + frame_cnt - first_frame_) % frame_cnt >= window))
+				free_slot = i;
+		}
+		// With no free slot, a frame that left the window is still being read;
+		// the next Update() queues this one.
+		if (resident || free_slot == window)
+			continue;
+
+		// Only slots no worker is writing are reused.
+		Slot &slot = slots_[free_slot];
+		slot.frame = wanted;
+		++slot.generation;
+		slot.state.store(kLoading, std::memory_order_relaxed);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			++jobs_running_;
+		}
+		uint8_t *texels = blob_.get() + frame_bytes_*free_slot;
+		pool_->Submit([this, free_slot, wanted, texels]() {
+			bool loaded = LoadFrame(wanted, texels);
+			if (!loaded)
+				failed_loads_.fetch_add(1, std::memory_order_relaxed);
+			slots_[free_slot].state.store(loaded ? kReady : kFailed, std::memory_order_release);
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (--jobs_running_ == 0)
+				idle_cv_.notify_all();
+		});
+	}
+}
+
+bool FlipbookStreamer::GetFrame(UINT frame, Frame &out) const {
+	for (UINT i = 0; i < desc_.window; ++i) {
+		const Slot &slot = slots_[i];
+		if (slot.frame != frame || slot.state.load(std::memory_order_acquire) != kReady)
+			continue;
+		out.index = frame;
+		out.slot = i;
+		out.generation = slot.generation;
+		out.data = blob_.get() + frame_bytes_*i;
+		return true;
+	}
+	return false;
+}
+
+void FlipbookStreamer::Flush() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	idle_cv_.wait(lock, [this] { return jobs_running_ == 0; });
+}
@@ -0,0 +1,135 @@
+#ifndef FLIPBOOKSTREAMER_H
+#define FLIPBOOKSTREAMER_H
+
+#include"DDSHeader.h"
+#include<atomic>
+#include<condition_variable>
+#include<cstddef>
+#include<cstdint>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<vector>
+
+class ThreadPool;
+
+// Plays a looping sequence of DDS frames of one size and format, such as the
+// Crate demo's fire, without keeping the whole sequence in memory: only the
+// window of frames from the one shown onwards is resident, and frames are
+// read in on a background thread ahead of being shown.
+//
+// The window is one blob laid out as the subresources of a texture array,
+// one slice per slot, so a slot's frame can be uploaded mip by mip as it is.
+class FlipbookStreamer {
+public:
+	struct Desc {
+		std::vector<std::string> filenames;
+		UINT window = 8;		// frames resident, counting the one shown
+		UINT thread_cnt = 2;	// counts the calling thread, as for ThreadPool
+	};
+
+	// Where a mip of a frame lies in the frame's slot.
+	struct Subresource {
+		size_t offset;
+		UINT row_pitch;
+		UINT slice_pitch;
+	};
+
+	// A frame ready to show.  The generation changes whenever the slot is
+	// refilled, so a renderer keeping a texture per slot knows when to upload
+	// it again.
+	struct Frame {
+		UINT index;
+		UINT slot;
+		UINT generation;
+		const uint8_t *data;	// FrameBytes(), mip after mip
+	};
+
+	FlipbookStreamer();
+	~FlipbookStreamer();
+
+	// Reads the first frame's header, which every other frame has to match,
+	// and starts loading the window from frame 0.  Returns false if the
+	// first frame cannot be read or is not a single 2D texture.
+	bool Open(const Desc &desc);
+	void Close();
+
+	bool IsOpen() const {
+		return frame_bytes_ != 0;
+	}
+
+	UINT FrameCount() const {
+		return static_cast<UINT>(desc_.filenames.size());
+	}
+	UINT SlotCount() const {
+		return desc_.window;
+	}
+	const DirectX::DDS_TEXTURE_INFO &Info() const {
+		return info_;
+	}
+	const std::vector<Subresource> &Subresources() const {
+		return subresources_;
+	}
+	size_t FrameBytes() const {
+		return frame_bytes_;
+	}
+
+	// Makes frame the first of the window, and queues the frames of the
+	// window that are not resident, nearest first.
+	void Update(UINT frame);
+
+	// Fills in frame if it is loaded; false while it is still being read, or
+	// if it could not be.
+	bool GetFrame(UINT frame, Frame &out) const;
+
+	// Waits for every queued frame to be read.
+	void Flush();
+
+	// Frames that could not be read or did not match the first, so far.
+	UINT FailedLoads() const {
+		return failed_loads_.load(std::memory_order_relaxed);
+	}
+
+private:
+	FlipbookStreamer(const FlipbookStreamer&) = delete;
+	FlipbookStreamer& operator=(const FlipbookStreamer&) = delete;
+
+	enum SlotState {
+		kEmpty,
+		kLoading,
+		kReady,
+		kFailed
+	};
+
+	struct Slot {
+		UINT frame = 0;
+		UINT generation = 0;
+		std::atomic<int> state;
+
+		Slot() : state(kEmpty) {}
+	};
+
+	// Copies the frame's texels into its slot.  Called on the workers.
+	bool LoadFrame(UINT frame, uint8_t *texels) const;
+
+private:
+	Desc desc_;
+	DirectX::DDS_TEXTURE_INFO info_ = {};
+	std::vector<Subresource> subresources_;
+	size_t frame_bytes_ = 0;
+
+	std::unique_ptr<uint8_t[]> blob_;
+	std::unique_ptr<Slot[]> slots_;
+	UINT first_frame_ = 0;
+
+	std::atomic<UINT> failed_loads_{0};
+
+	std::mutex mutex_;
+	std::condition_variable idle_cv_;
+	UINT jobs_running_ = 0;
+
+	// Last, so its workers finish before anything they use goes away.
+	std::unique_ptr<ThreadPool> pool_;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include"framestats.h"
+#include<algorithm>
+#include<fstream>
+
+namespace {
+
+// Nearest-rank percentile of sorted values.
+float Percentile(const std::vector<float> &sorted, float p) {
+	size_t rank = static_cast<size_t>(p * sorted.size() + 0.5f);
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+}
+
+FrameStats::FrameStats(uint32_t window) : window_(std::max(window, 1u)) {
+	frames_.reserve(window_);
+}
+
+void FrameStats::AddFrame(float dt, float total) {
+	Frame frame;
+	frame.index = frame_cnt_++;
+	frame.time = total;
+	frame.ms = dt * 1000.0f;
+
+	// The first frames only set the typical frame time, so a slow start is
+	// not reported as a hitch.
+	frame.hitch = frame_cnt_ > 8 && frame.ms >= min_hitch_ms_ && frame.ms > hitch_factor_ * typical_ms_;
+	if (frame.hitch)
+		++hitch_cnt_;
+
+	recent_ms_[frame.index % kRecentFrames] = frame.ms;
+	size_t recent_cnt = static_cast<size_t>(std::min<uint64_t>(frame_cnt_, kRecentFrames));
+	float sorted[kRecentFrames];
+	std::copy(recent_ms_, recent_ms_ + recent_cnt, sorted);
+	std::nth_element(sorted, sorted + recent_cnt / 2, sorted + recent_cnt);
+	typical_ms_ = sorted[recent_cnt / 2];
+
+	if (frames_.size() < window_) {
+		frames_.push_back(frame);
+	} else {
+		frames_[next_] = frame;
+		next_ = (next_ + 1) % window_;
+	}
+}
+
+void FrameStats::Clear() {
+	frames_.clear();
+	next_ = 0;
+	frame_cnt_ = 0;
+	hitch_cnt_ = 0;
+	typical_ms_ = 0.0f;
+}
+
+void FrameStats::SetHitchThreshold(float hitch_factor, float min_hitch_ms) {
+	hitch_factor_ = hitch_factor;
+	min_hitch_ms_ = min_hitch_ms;
+}
+
+FrameStats::Summary FrameStats::Summarize() const {
+	Summary summary = {};
+	if (frames_.empty())
+		return summary;
+
+	std::vector<float> sorted;
+	sorted.reserve(frames_.size());
+	double total_ms = 0.0;
+	for (const Frame &frame : frames_) {
+		sorted.push_back(frame.ms);
+		total_ms += frame.ms;
+		if (frame.hitch)
+			++summary.hitch_cnt;
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	summary.frame_cnt = static_cast<uint32_t>(sorted.size());
+	summary.mean_ms = static_cast<float>(total_ms / sorted.size());
+	summary.p50_ms = Percentile(sorted, 0.50f);
+	summary.p95_ms = Percentile(sorted, 0.95f);
+	summary.p99_ms = Percentile(sorted, 0.99f);
+	summary.max_ms = sorted.back();
+	return summary;
+}
+
+void FrameStats::Histogram(float bucket_ms, uint32_t bucket_cnt, std::vector<uint32_t> &counts) const {
+	counts.assign(bucket_cnt, 0);
+	if (bucket_cnt == 0 || bucket_ms <= 0.0f)
+		return;
+
+	for (const Frame &frame : frames_) {
+		uint32_t bucket = static_cast<uint32_t>(std::min(frame.ms / bucket_ms, static_cast<float>(bucket_cnt - 1)));
+		++counts[bucket];
+	}
+}
+
+void FrameStats::WriteCsv(std::ostream &out) const {
+	out << "frame,time_s,frame_ms,hitch\n";
+	ForEachFrame([&](const Frame &frame) {
+		out << frame.index << ',' << frame.time << ',' << frame.ms << ',' << (frame.hitch ? 1 : 0) << '\n';
+	});
+}
+
+bool FrameStats::WriteCsv(const std::string &filename) const {
+	std::ofstream fout(filename);
+	if (!fout)
+		return false;
+
+	WriteCsv(fout);
+	return !fout.fail();
+}
@@ -0,0 +1,91 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include<cstdint>
+#include<ostream>
+#include<string>
+#include<vector>
+
+// Keeps the times of the last frames so that stutter shows up, which an
+// average frame rate hides.  A frame is a hitch when it takes hitch_factor
+// times as long as the recent typical frame, and at least min_hitch_ms.  The
+// typical frame is the median of the last kRecentFrames, hitches included,
+// so a lone long frame does not move it but a lasting slowdown becomes the
+// new typical within half as many frames.
+class FrameStats {
+public:
+	struct Summary {
+		uint32_t frame_cnt;	// frames in the window
+		uint32_t hitch_cnt;	// hitches in the window
+		float mean_ms;
+		float p50_ms;
+		float p95_ms;
+		float p99_ms;
+		float max_ms;
+	};
+
+	static const uint32_t kRecentFrames = 15;
+
+	// window is the number of most recent frames kept.
+	explicit FrameStats(uint32_t window = 1024);
+
+	// dt is the frame time and total the time at the end of the frame, both in
+	// seconds, e.g. D3DTimer::DeltaTime() and D3DTimer::TotalTime().
+	void AddFrame(float dt, float total);
+	void Clear();
+
+	void SetHitchThreshold(float hitch_factor, float min_hitch_ms);
+
+	Summary Summarize() const;
+
+	// Frames counted since the last Clear(), also those that left the window.
+	uint64_t FrameCount() const {
+		return frame_cnt_;
+	}
+	uint64_t HitchCount() const {
+		return hitch_cnt_;
+	}
+
+	// counts[i] is the number of frames in the window that took between
+	// i*bucket_ms and (i+1)*bucket_ms; the last bucket also takes everything
+	// slower.
+	void Histogram(float bucket_ms, uint32_t bucket_cnt, std::vector<uint32_t> &counts) const;
+
+	// One line per frame in the window, oldest first:
+	// frame,time_s,frame_ms,hitch
+	void WriteCsv(std::ostream &out) const;
+	bool WriteCsv(const std::string &filename) const;
+
+private:
+	struct Frame {
+		uint64_t index;
+		float time;
+		float ms;
+		bool hitch;
+	};
+
+	// Visits the frames in the window from the oldest to the newest.
+	template<typename F>
+	void ForEachFrame(F f) const {
+		size_t oldest = frames_.size() < window_ ? 0 : next_;
+		for (size_t i = 0; i < frames_.size(); ++i)
+			f(frames_[(oldest + i) % frames_.size()]);
+	}
+
+private:
+	uint32_t window_;
+	std::vector<Frame> frames_;
+	size_t next_ = 0;
+
+	uint64_t frame_cnt_ = 0;
+	uint64_t hitch_cnt_ = 0;
+
+	// The last kRecentFrames frame times, by frame index, and their median.
+	float recent_ms_[kRecentFrames];
+	float typical_ms_ = 0.0f;
+
+	float hitch_factor_ = 2.0f;
+	float min_hitch_ms_ = 8.0f;
+};
+
+#endif
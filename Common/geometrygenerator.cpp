@@ -1,53 +1,140 @@
 #include"geometrygenerator.h"
+#include"profiler.h"
+#include"threadpool.h"
+#include<algorithm>
 using namespace DirectX;
 
+namespace {
+
+const float kIcosahedronX = 0.525731f;
+const float kIcosahedronZ = 0.850651f;
+
+const XMFLOAT3 kIcosahedronPositions[12] =
+{
+	XMFLOAT3(-kIcosahedronX, 0.0f, kIcosahedronZ),  XMFLOAT3(kIcosahedronX, 0.0f, kIcosahedronZ),
+	XMFLOAT3(-kIcosahedronX, 0.0f, -kIcosahedronZ), XMFLOAT3(kIcosahedronX, 0.0f, -kIcosahedronZ),
+	XMFLOAT3(0.0f, kIcosahedronZ, kIcosahedronX),   XMFLOAT3(0.0f, kIcosahedronZ, -kIcosahedronX),
+	XMFLOAT3(0.0f, -kIcosahedronZ, kIcosahedronX),  XMFLOAT3(0.0f, -kIcosahedronZ, -kIcosahedronX),
+	XMFLOAT3(kIcosahedronZ, kIcosahedronX, 0.0f),   XMFLOAT3(-kIcosahedronZ, kIcosahedronX, 0.0f),
+	XMFLOAT3(kIcosahedronZ, -kIcosahedronX, 0.0f),  XMFLOAT3(-kIcosahedronZ, -kIcosahedronX, 0.0f)
+};
+
+const UINT kIcosahedronIndices[60] =
+{
+	1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,
+	1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,
+	3,10,7, 10,6,7, 6,11,7, 6,0,11, 6,1,0,
+	10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7
+};
+
+XMFLOAT3 Midpoint(const XMFLOAT3 &a, const XMFLOAT3 &b) {
+	return XMFLOAT3(0.5f*(a.x + b.x), 0.5f*(a.y + b.y), 0.5f*(a.z + b.z));
+}
+
+const uint64_t kNoEdge = ~0ull;
+
+uint64_t EdgeKey(UINT a, UINT b) {
+	return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+}
+
+}
+
+const UINT GeometryGenerator::kParallelMinVertices;
+const UINT GeometryGenerator::kMaxGeosphereSubdivisions;
+
+GeometryGenerator::GeometryGenerator(UINT thread_cnt)
+	: thread_cnt_(thread_cnt ? thread_cnt : std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+GeometryGenerator::~GeometryGenerator() {
+}
+
+void GeometryGenerator::ForEachRowBand(UINT row_cnt, size_t vertex_cnt, const std::function<void(UINT, UINT)> &rows) {
+	if (thread_cnt_ == 1 || vertex_cnt < kParallelMinVertices || row_cnt < 2) {
+		rows(0, row_cnt);
+		return;
+	}
+
+	if (!pool_)
+		pool_.reset(new ThreadPool(thread_cnt_));
+
+	// A few bands per thread, so one slow band does not hold up the rest.
+	UINT band_cnt = std::min(row_cnt, pool_->ThreadCount() * 4);
+	UINT rows_per_band = (row_cnt + band_cnt - 1) / band_cnt;
+	pool_->ParallelFor(band_cnt, [&](UINT band) {
+		UINT first = band * rows_per_band;
+		UINT last = std::min(row_cnt, first + rows_per_band);
+		if (first < last)
+			rows(first, last);
+	});
+}
+
+const std::vector<XMFLOAT2> &GeometryGenerator::RingTable(UINT slice_cnt) {
+	if (ring_slice_cnt_ != slice_cnt || ring_.empty()) {
+		float dtheta = 2.0f*XM_PI / slice_cnt;
+		ring_.resize(slice_cnt + 1);
+		for (UINT j = 0; j <= slice_cnt; ++j)
+			ring_[j] = XMFLOAT2(cosf(j*dtheta), sinf(j*dtheta));
+		ring_slice_cnt_ = slice_cnt;
+	}
+	return ring_;
+}
+
+void GeometryGenerator::GridSize(UINT num_x, UINT num_z, UINT &vertex_cnt, UINT &index_cnt) {
+	vertex_cnt = num_x*num_z;
+	index_cnt = num_x > 0 && num_z > 0 ? (num_x - 1)*(num_z - 1)*6 : 0; // Triangles X2, vertices X3
+}
+
 void GeometryGenerator::CreateGrid(float length_x, float length_z, UINT num_x, UINT num_z, MeshData &mesh_data) {
 	if (num_x == 0 || num_z == 0) return;
 
-	mesh_data.clear();
+	UINT vertex_cnt, index_cnt;
+	GridSize(num_x, num_z, vertex_cnt, index_cnt);
+	mesh_data.vertices.resize(vertex_cnt);
+	mesh_data.indices.resize(index_cnt);
+	CreateGrid(length_x, length_z, num_x, num_z, mesh_data.vertices.data(), mesh_data.indices.data());
+}
+
+void GeometryGenerator::CreateGrid(float length_x, float length_z, UINT num_x, UINT num_z, Vertex *vertices, UINT *indices) {
+	PROFILE_ZONE("GeometryGenerator::CreateGrid");
 
-	UINT vertex_count = num_x*num_z;
-	mesh_data.vertices.reserve(vertex_count);
-	UINT face_count = (num_x - 1)*(num_z - 1)*2;
-	mesh_data.indices.reserve(face_count*6); // Triangles X2, vertices X3
+	if (num_x == 0 || num_z == 0) return;
 
 	float x_by2 = length_x / 2.0f, z_by2 = length_z / 2.0f;
 	float dx = length_x / (num_x - 1), dz = length_z / (num_z - 1);
 	float du = 1.0f / (num_x - 1), dv = 1.0f / (num_z - 1);
 
-	float x, z, u, v;
-	
-	// Add vertices, from top-left (with maximun z and minimum x) to bottom-right
-	for (UINT iz = 0; iz < num_z; ++iz) {
-		z = z_by2 - iz*dz;
-		v = iz*dv;
-		for (UINT ix = 0; ix < num_x; ++ix) {
-			x = -x_by2 + ix*dx;
-			u = ix*du;
-
-			Vertex v(XMFLOAT3(x, 0.0f, z), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(u, v));
-			mesh_data.vertices.push_back(v);
-		}
-	}
-
-
-	// Add indices
-	
-	for (UINT iz = 0; iz < num_z - 1; ++iz) {
-		
-		for (UINT ix = 0; ix < num_x - 1; ++ix) {
-			mesh_data.indices.push_back(iz*num_x+ ix);
-			mesh_data.indices.push_back(iz*num_x + ix + 1);
-			mesh_data.indices.push_back((iz + 1)*num_x + ix);
-
-			mesh_data.indices.push_back((iz + 1)*num_x + ix);
-			mesh_data.indices.push_back(iz*num_x + ix + 1);
-			mesh_data.indices.push_back((iz + 1)*num_x + ix + 1);
+	// Vertices go from top-left (with maximun z and minimum x) to bottom-right;
+	// each row also writes the quads between it and the next one.
+	ForEachRowBand(num_z, static_cast<size_t>(num_x)*num_z, [&](UINT first, UINT last) {
+		for (UINT iz = first; iz < last; ++iz) {
+			float z = z_by2 - iz*dz;
+			float v = iz*dv;
+			Vertex *row = vertices + static_cast<size_t>(iz)*num_x;
+			for (UINT ix = 0; ix < num_x; ++ix) {
+				row[ix] = Vertex(XMFLOAT3(-x_by2 + ix*dx, 0.0f, z), XMFLOAT3(0.0f, 1.0f, 0.0f),
+					XMFLOAT3(1.0f, 0.0f, 0.0f), XMFLOAT2(ix*du, v));
+			}
+
+			if (iz + 1 == num_z)
+				continue;
+			UINT *quad = indices + static_cast<size_t>(iz)*(num_x - 1)*6;
+			for (UINT ix = 0; ix < num_x - 1; ++ix, quad += 6) {
+				quad[0] = iz*num_x + ix;
+				quad[1] = iz*num_x + ix + 1;
+				quad[2] = (iz + 1)*num_x + ix;
+
+				quad[3] = (iz + 1)*num_x + ix;
+				quad[4] = iz*num_x + ix + 1;
+				quad[5] = (iz + 1)*num_x + ix + 1;
+			}
 		}
-	}
-
+	});
 }
+
 void GeometryGenerator::CreateBox(float length_x, float length_y, float length_z, MeshData &mesh_data) {
+	PROFILE_ZONE("GeometryGenerator::CreateBox");
+
 	Vertex v[24];
 
 	// Coordinate origin at the geometry center
@@ -128,137 +215,172 @@ void GeometryGenerator::CreateBox(float length_x, float length_y, float length_z
 }
 
 
+void GeometryGenerator::CylinderSize(UINT stack_cnt, UINT slice_cnt, UINT &vertex_cnt, UINT &index_cnt) {
+	// The rings, then each cap's ring and center.
+	vertex_cnt = (stack_cnt + 1)*(slice_cnt + 1) + 2*(slice_cnt + 2);
+	index_cnt = stack_cnt*slice_cnt*6 + 2*slice_cnt*3;
+}
+
 void GeometryGenerator::CreateCylinder(float radius_top, float radius_bottom, float height, UINT stack_cnt, UINT slice_cnt, MeshData &mesh_data) {
-	mesh_data.clear();
+	UINT vertex_cnt, index_cnt;
+	CylinderSize(stack_cnt, slice_cnt, vertex_cnt, index_cnt);
+	mesh_data.vertices.resize(vertex_cnt);
+	mesh_data.indices.resize(index_cnt);
+	CreateCylinder(radius_top, radius_bottom, height, stack_cnt, slice_cnt, mesh_data.vertices.data(), mesh_data.indices.data());
+}
+
+void GeometryGenerator::CreateCylinder(float radius_top, float radius_bottom, float height, UINT stack_cnt, UINT slice_cnt,
+	Vertex *vertices, UINT *indices) {
+	PROFILE_ZONE("GeometryGenerator::CreateCylinder");
 
 	float dr = (radius_top - radius_bottom) / stack_cnt;
 	float dy = height / stack_cnt;
-	float dtheta = 2.0f*XM_PI / slice_cnt;
+	const std::vector<XMFLOAT2> &ring = RingTable(slice_cnt);
 	
 	UINT ring_cnt = stack_cnt + 1;
 	UINT vertices_per_ring = slice_cnt + 1;
 
-	// Generate vertex data
-	for (UINT i = 0; i < ring_cnt; ++i) {
-		float y = -0.5f*height + dy*i;
-		float r = radius_bottom + dr*i;
-		for (UINT j = 0; j < vertices_per_ring; ++j) {
-			// Note that the first and last vertices share common position but different UV
-			float cos = cosf(j*dtheta), sin = sinf(j*dtheta);
-			Vertex v;
-			v.position = XMFLOAT3(r*cos, y, r*sin);
-			v.texcoord = XMFLOAT2(j *1.0f / slice_cnt, 1.0f - i * 1.0f / stack_cnt);
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(u, v) = r(v)*cos(2*pi*u)
-			//   y(u, v) = h - hv
-			//   z(u, v) = r(v)*sin(2*pi*u)
-			// 
-			//  dx/du = -2*pi*r(v)*sin(2*pi*u)
-			//  dy/du = 0
-			//  dz/du = +2*pi*r(v)*cos(2*pi*u)
-			//
-			//  dx/dv = (r0-r1)*cos(2*pi*u)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(2*pi*u)
-
-			float r_diff = radius_bottom - radius_top;
-			// dp/du as tangent, length scaled
-			v.tangent = XMFLOAT3(-r*sin, 0.0f, r*cos);
-			// dp/dv as bitangent
-			XMFLOAT3 bitangent(r_diff*cos, -height, r_diff*sin);
-
-			XMVECTOR T = XMLoadFloat3(&v.tangent);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-
-			XMStoreFloat3(&v.normal, N);
-
-			mesh_data.vertices.push_back(v);
+	// Generate vertex data, and the quads between each ring and the next.
+	ForEachRowBand(ring_cnt, static_cast<size_t>(ring_cnt)*vertices_per_ring, [&](UINT first, UINT last) {
+		for (UINT i = first; i < last; ++i) {
+			float y = -0.5f*height + dy*i;
+			float r = radius_bottom + dr*i;
+			Vertex *v = vertices + static_cast<size_t>(i)*vertices_per_ring;
+			for (UINT j = 0; j < vertices_per_ring; ++j) {
+				// Note that the first and last vertices share common position but different UV
+				float cos = ring[j].x, sin = ring[j].y;
+				v[j].position = XMFLOAT3(r*cos, y, r*sin);
+				v[j].texcoord = XMFLOAT2(j *1.0f / slice_cnt, 1.0f - i * 1.0f / stack_cnt);
+				// Cylinder can be parameterized as follows, where we introduce v
+				// parameter that goes in the same direction as the v tex-coord
+				// so that the bitangent goes in the same direction as the v tex-coord.
+				//   Let r0 be the bottom radius and let r1 be the top radius.
+				//   y(v) = h - hv for v in [0,1].
+				//   r(v) = r1 + (r0-r1)v
+				//
+				//   x(u, v) = r(v)*cos(2*pi*u)
+				//   y(u, v) = h - hv
+				//   z(u, v) = r(v)*sin(2*pi*u)
+				// 
+				//  dx/du = -2*pi*r(v)*sin(2*pi*u)
+				//  dy/du = 0
+				//  dz/du = +2*pi*r(v)*cos(2*pi*u)
+				//
+				//  dx/dv = (r0-r1)*cos(2*pi*u)
+				//  dy/dv = -h
+				//  dz/dv = (r0-r1)*sin(2*pi*u)
+
+				float r_diff = radius_bottom - radius_top;
+				// dp/du as tangent, length scaled
+				v[j].tangent = XMFLOAT3(-r*sin, 0.0f, r*cos);
+				// dp/dv as bitangent
+				XMFLOAT3 bitangent(r_diff*cos, -height, r_diff*sin);
+
+				XMVECTOR T = XMLoadFloat3(&v[j].tangent);
+				XMVECTOR B = XMLoadFloat3(&bitangent);
+				XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
+
+				XMStoreFloat3(&v[j].normal, N);
+			}
+
+			if (i == stack_cnt)
+				continue;
+			UINT *quad = indices + static_cast<size_t>(i)*slice_cnt*6;
+			for (UINT j = 0; j < slice_cnt; ++j, quad += 6) {
+				quad[0] = i*vertices_per_ring + j;
+				quad[1] = (i + 1)*vertices_per_ring + j;
+				quad[2] = (i + 1)*vertices_per_ring + j + 1;
+				quad[3] = i*vertices_per_ring + j;
+				quad[4] = (i + 1)*vertices_per_ring + j + 1;
+				quad[5] = i*vertices_per_ring + j + 1;
+			}
 		}
-	}
+	});
 
-	// Generate index data
-	for (UINT i = 0; i < stack_cnt; ++i) {
-		for (UINT j = 0; j < slice_cnt; ++j) {
-			mesh_data.indices.push_back(i*vertices_per_ring + j);
-			mesh_data.indices.push_back((i + 1)*vertices_per_ring + j);
-			mesh_data.indices.push_back((i + 1)*vertices_per_ring + j + 1);
-			mesh_data.indices.push_back(i*vertices_per_ring + j);
-			mesh_data.indices.push_back((i + 1)*vertices_per_ring + j + 1);
-			mesh_data.indices.push_back(i*vertices_per_ring + j + 1);
-		}
-	}
+	UINT vertex_cnt = ring_cnt*vertices_per_ring;
+	UINT *cap = indices + static_cast<size_t>(stack_cnt)*slice_cnt*6;
 
 	// Construct top cap
 
 	// Duplicate the cap ring vertices
-	UINT base_index = mesh_data.vertices.size();
+	UINT base_index = vertex_cnt;
 	float y = 0.5f*height;
 	for (UINT j = 0; j < vertices_per_ring; ++j) {
-		float cos = cosf(j*dtheta), sin = sinf(j*dtheta);
-		float x = radius_top*cos, z = radius_top*sin;
+		float x = radius_top*ring[j].x, z = radius_top*ring[j].y;
 		float u = x / height + 0.5f, v = y / height + 0.5f; // ????
-		mesh_data.vertices.push_back(Vertex(
+		vertices[vertex_cnt++] = Vertex(
 			XMFLOAT3(x, y, z), 
 			XMFLOAT3(0.0f, 1.0f, 0.0f), 
 			XMFLOAT3(1.0f, 0.0f, 0.0f), 
-			XMFLOAT2(u, v)));
+			XMFLOAT2(u, v));
 	}
 	// Top center vertex
-	mesh_data.vertices.push_back(Vertex(
+	vertices[vertex_cnt++] = Vertex(
 		XMFLOAT3(0.0f, y, 0.0f),
 		XMFLOAT3(0.0f, 1.0f, 0.0f),
 		XMFLOAT3(1.0f, 0.0f, 0.0f),
-		XMFLOAT2(0.5f, 0.5f)));
+		XMFLOAT2(0.5f, 0.5f));
 
-	UINT center_index = mesh_data.vertices.size() - 1;
-	for (UINT j = 0; j < slice_cnt; ++j) {
-		mesh_data.indices.push_back(center_index);
-		mesh_data.indices.push_back(base_index + j + 1);
-		mesh_data.indices.push_back(base_index + j);
+	UINT center_index = vertex_cnt - 1;
+	for (UINT j = 0; j < slice_cnt; ++j, cap += 3) {
+		cap[0] = center_index;
+		cap[1] = base_index + j + 1;
+		cap[2] = base_index + j;
 	}
 
 
 	// Construct bottom cap
 
-	base_index = mesh_data.vertices.size();
+	base_index = vertex_cnt;
 	y = -0.5f*height;
 	for (UINT j = 0; j < vertices_per_ring; ++j) {
-		float cos = cosf(j*dtheta), sin = sinf(j*dtheta);
-		float x = radius_bottom*cos, z = radius_bottom*sin;
+		float x = radius_bottom*ring[j].x, z = radius_bottom*ring[j].y;
 		float u = x / height + 0.5f, v = y / height + 0.5f; // ????
-		mesh_data.vertices.push_back(Vertex(
+		vertices[vertex_cnt++] = Vertex(
 			XMFLOAT3(x, y, z),
 			XMFLOAT3(0.0f, -1.0f, 0.0f),
 			XMFLOAT3(1.0f, 0.0f, 0.0f),
-			XMFLOAT2(u, v)));
+			XMFLOAT2(u, v));
 	}
 	// Bottom center vertex
-	mesh_data.vertices.push_back(Vertex(
+	vertices[vertex_cnt++] = Vertex(
 		XMFLOAT3(0.0f, y, 0.0f),
 		XMFLOAT3(0.0f, -1.0f, 0.0f),
 		XMFLOAT3(1.0f, 0.0f, 0.0f),
-		XMFLOAT2(0.5f, 0.5f)));
+		XMFLOAT2(0.5f, 0.5f));
 
-	center_index = mesh_data.vertices.size() - 1;
-	for (UINT j = 0; j < slice_cnt; ++j) {
-		mesh_data.indices.push_back(center_index);
-		mesh_data.indices.push_back(base_index + j); // Note the difference
-		mesh_data.indices.push_back(base_index + j + 1);
+	center_index = vertex_cnt - 1;
+	for (UINT j = 0; j < slice_cnt; ++j, cap += 3) {
+		cap[0] = center_index;
+		cap[1] = base_index + j; // Note the difference
+		cap[2] = base_index + j + 1;
 	}
 
 }
 
+void GeometryGenerator::SphereSize(UINT sliceCount, UINT stackCount, UINT &vertex_cnt, UINT &index_cnt)
+{
+	// The poles and the stackCount - 1 rings between them; a fan at each pole
+	// and quads between the rings.
+	vertex_cnt = 2 + (stackCount - 1)*(sliceCount + 1);
+	index_cnt = 2*sliceCount*3 + (stackCount - 2)*sliceCount*6;
+}
+
 void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCount, MeshData& meshData)
 {
-	meshData.vertices.clear();
-	meshData.indices.clear();
+	UINT vertex_cnt, index_cnt;
+	SphereSize(sliceCount, stackCount, vertex_cnt, index_cnt);
+	meshData.vertices.resize(vertex_cnt);
+	meshData.indices.resize(index_cnt);
+	CreateSphere(radius, sliceCount, stackCount, meshData.vertices.data(), meshData.indices.data());
+}
+
+void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCount, Vertex *vertices, UINT *indices)
+{
+	PROFILE_ZONE("GeometryGenerator::CreateSphere");
+
+	UINT vertex_cnt, index_cnt;
+	SphereSize(sliceCount, stackCount, vertex_cnt, index_cnt);
 
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
@@ -267,83 +389,83 @@ void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCo
 	// Poles: note that there will be texture coordinate distortion as there is
 	// not a unique point on the texture map to assign to the pole when mapping
 	// a rectangular texture onto a sphere.
-	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-
-	meshData.vertices.push_back(topVertex);
+	vertices[0] = Vertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+	vertices[vertex_cnt - 1] = Vertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
 	float phiStep = XM_PI / stackCount;
 	float thetaStep = 2.0f*XM_PI / sliceCount;
+	const std::vector<XMFLOAT2> &ring = RingTable(sliceCount);
 
-	// Compute vertices for each stack ring (do not count the poles as rings).
-	for (UINT i = 1; i <= stackCount - 1; ++i)
-	{
-		float phi = i*phiStep;
+	// Offset the indices to the index of the first vertex in the first ring.
+	// This is just skipping the top pole vertex.
+	UINT baseIndex = 1;
+	UINT ringVertexCount = sliceCount + 1;
 
-		// vertices of ring.
-		for (UINT j = 0; j <= sliceCount; ++j)
+	// Compute vertices for each stack ring (do not count the poles as rings),
+	// and the quads between each ring and the next.
+	ForEachRowBand(stackCount - 1, vertex_cnt, [&](UINT first, UINT last)
+	{
+		for (UINT i = first; i < last; ++i)
 		{
-			float theta = j*thetaStep;
-			
-			Vertex v;
+			float phi = (i + 1)*phiStep;
+			float sinPhi = sinf(phi), cosPhi = cosf(phi);
+			Vertex *v = vertices + baseIndex + static_cast<size_t>(i)*ringVertexCount;
 
-			// spherical to cartesian
-			v.position.x = radius*sinf(phi)*cosf(theta);
-			v.position.y = radius*cosf(phi);
-			v.position.z = radius*sinf(phi)*sinf(theta);
+			// vertices of ring.
+			for (UINT j = 0; j <= sliceCount; ++j)
+			{
+				float theta = j*thetaStep;
 
-			// Partial derivative of P with respect to theta
-			v.tangent.x = -radius*sinf(phi)*sinf(theta);
-			v.tangent.y = 0.0f;
-			v.tangent.z = +radius*sinf(phi)*cosf(theta);
+				// spherical to cartesian
+				v[j].position.x = radius*sinPhi*ring[j].x;
+				v[j].position.y = radius*cosPhi;
+				v[j].position.z = radius*sinPhi*ring[j].y;
 
-			XMVECTOR T = XMLoadFloat3(&v.tangent);
-			XMStoreFloat3(&v.tangent, XMVector3Normalize(T));
+				// Partial derivative of P with respect to theta
+				v[j].tangent.x = -radius*sinPhi*ring[j].y;
+				v[j].tangent.y = 0.0f;
+				v[j].tangent.z = +radius*sinPhi*ring[j].x;
 
-			XMVECTOR p = XMLoadFloat3(&v.position);
-			XMStoreFloat3(&v.normal, XMVector3Normalize(p));
+				XMVECTOR T = XMLoadFloat3(&v[j].tangent);
+				XMStoreFloat3(&v[j].tangent, XMVector3Normalize(T));
 
-			v.texcoord.x = theta / XM_2PI;
-			v.texcoord.y = phi / XM_PI;
+				XMVECTOR p = XMLoadFloat3(&v[j].position);
+				XMStoreFloat3(&v[j].normal, XMVector3Normalize(p));
 
-			meshData.vertices.push_back(v);
-		}
-	}
+				v[j].texcoord.x = theta / XM_2PI;
+				v[j].texcoord.y = phi / XM_PI;
+			}
 
-	meshData.vertices.push_back(bottomVertex);
+			//
+			// Compute indices for inner stacks (not connected to poles).  They
+			// follow the top stack's sliceCount triangles.
+			//
+			if (i + 2 >= stackCount)
+				continue;
+			UINT *quad = indices + sliceCount*3 + static_cast<size_t>(i)*sliceCount*6;
+			for (UINT j = 0; j < sliceCount; ++j, quad += 6)
+			{
+				quad[0] = baseIndex + i*ringVertexCount + j;
+				quad[1] = baseIndex + i*ringVertexCount + j + 1;
+				quad[2] = baseIndex + (i + 1)*ringVertexCount + j;
+
+				quad[3] = baseIndex + (i + 1)*ringVertexCount + j;
+				quad[4] = baseIndex + i*ringVertexCount + j + 1;
+				quad[5] = baseIndex + (i + 1)*ringVertexCount + j + 1;
+			}
+		}
+	});
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
 	// and connects the top pole to the first ring.
 	//
 
-	for (UINT i = 1; i <= sliceCount; ++i)
+	for (UINT i = 1; i <= sliceCount; ++i, indices += 3)
 	{
-		meshData.indices.push_back(0);
-		meshData.indices.push_back(i + 1);
-		meshData.indices.push_back(i);
-	}
-
-	//
-	// Compute indices for inner stacks (not connected to poles).
-	//
-
-	// Offset the indices to the index of the first vertex in the first ring.
-	// This is just skipping the top pole vertex.
-	UINT baseIndex = 1;
-	UINT ringVertexCount = sliceCount + 1;
-	for (UINT i = 0; i < stackCount - 2; ++i)
-	{
-		for (UINT j = 0; j < sliceCount; ++j)
-		{
-			meshData.indices.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.indices.push_back(baseIndex + i*ringVertexCount + j + 1);
-			meshData.indices.push_back(baseIndex + (i + 1)*ringVertexCount + j);
-
-			meshData.indices.push_back(baseIndex + (i + 1)*ringVertexCount + j);
-			meshData.indices.push_back(baseIndex + i*ringVertexCount + j + 1);
-			meshData.indices.push_back(baseIndex + (i + 1)*ringVertexCount + j + 1);
-		}
+		indices[0] = 0;
+		indices[1] = i + 1;
+		indices[2] = i;
 	}
 
 	//
@@ -351,154 +473,152 @@ void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCo
 	// and connects the bottom pole to the bottom ring.
 	//
 
+	indices += static_cast<size_t>(stackCount - 2)*sliceCount*6;
+
 	// South pole vertex was added last.
-	UINT southPoleIndex = (UINT)meshData.vertices.size() - 1;
+	UINT southPoleIndex = vertex_cnt - 1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 
-	for (UINT i = 0; i < sliceCount; ++i)
+	for (UINT i = 0; i < sliceCount; ++i, indices += 3)
 	{
-		meshData.indices.push_back(southPoleIndex);
-		meshData.indices.push_back(baseIndex + i);
-		meshData.indices.push_back(baseIndex + i + 1);
+		indices[0] = southPoleIndex;
+		indices[1] = baseIndex + i;
+		indices[2] = baseIndex + i + 1;
 	}
 }
 
-
+void GeometryGenerator::GeosphereSize(UINT num_subdiv, UINT &vertex_cnt, UINT &index_cnt) {
+	// Each subdivision adds a vertex per edge and splits every triangle in
+	// four; the icosahedron has 12 vertices, 30 edges and 20 triangles, so
+	// after n of them V = 10*4^n + 2 and E = 30*4^n.
+	num_subdiv = std::min(num_subdiv, kMaxGeosphereSubdivisions);
+	vertex_cnt = (10u << (2*num_subdiv)) + 2;
+	index_cnt = 60u << (2*num_subdiv);
+}
 
 void GeometryGenerator::CreateGeosphere(float radius, UINT num_subdiv, MeshData &mesh_data) {
-	mesh_data.clear();
-
-	const float x = 0.525731f;
-	const float z = 0.850651f;
-
-	XMFLOAT3 pos[12] = 
-	{
-		XMFLOAT3(-x, 0.0f, z),  XMFLOAT3(x, 0.0f, z),  
-		XMFLOAT3(-x, 0.0f, -z), XMFLOAT3(x, 0.0f, -z),    
-		XMFLOAT3(0.0f, z, x),   XMFLOAT3(0.0f, z, -x), 
-		XMFLOAT3(0.0f, -z, x),  XMFLOAT3(0.0f, -z, -x),    
-		XMFLOAT3(z, x, 0.0f),   XMFLOAT3(-z, x, 0.0f), 
-		XMFLOAT3(z, -x, 0.0f),  XMFLOAT3(-z, -x, 0.0f)
-	};
+	UINT vertex_cnt, index_cnt;
+	GeosphereSize(num_subdiv, vertex_cnt, index_cnt);
+	mesh_data.vertices.resize(vertex_cnt);
+	mesh_data.indices.resize(index_cnt);
+	CreateGeosphere(radius, num_subdiv, mesh_data.vertices.data(), mesh_data.indices.data());
+}
 
-	DWORD idx[60] = 
-	{
-		1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,    
-		1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,    
-		3,10,7, 10,6,7, 6,11,7, 6,0,11, 6,1,0, 
-		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7 
-	};
+void GeometryGenerator::CreateGeosphere(float radius, UINT num_subdiv, Vertex *vertices, UINT *indices) {
+	PROFILE_ZONE("GeometryGenerator::CreateGeosphere");
 
-	mesh_data.vertices.resize(12);
-	mesh_data.indices.resize(60);
+	num_subdiv = std::min(num_subdiv, kMaxGeosphereSubdivisions);
+	UINT vertex_cnt, index_cnt;
+	GeosphereSize(num_subdiv, vertex_cnt, index_cnt);
 
 	for (UINT i = 0; i < 12; ++i)
-		mesh_data.vertices[i].position = pos[i];
-
-	for (UINT i = 0; i < 60; ++i)
-		mesh_data.indices[i] = idx[i];
-
-	for (UINT i = 0; i < num_subdiv; ++i)
-		Subdivide(mesh_data);
-
-	for (UINT i = 0; i < mesh_data.vertices.size(); ++i) {
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mesh_data.vertices[i].position));
-		XMStoreFloat3(&mesh_data.vertices[i].normal, n);
-		// Project subdivided vertices to the sphere
-		XMStoreFloat3(&mesh_data.vertices[i].position, n*radius);
-
-		float phi = acosf(mesh_data.vertices[i].position.y / radius);
-		float theta = MathHelper::AngleFromXY(
-			mesh_data.vertices[i].position.x, 
-			mesh_data.vertices[i].position.z);
-
-		// Use theta and phi to parameterize sphere
-		mesh_data.vertices[i].texcoord = XMFLOAT2(theta / (2.0f*XM_PI), phi / XM_PI);
-		// Tangent is parallel to dp/du
-		mesh_data.vertices[i].tangent = XMFLOAT3(-sinf(theta), 0.0f, cosf(theta));
+		vertices[i].position = kIcosahedronPositions[i];
+
+	// Each level only appends vertices, so they all build up in place.  The
+	// index lists alternate between the output and a scratch list a quarter
+	// its size, starting on whichever makes the last level land in the output.
+	if (num_subdiv > 0)
+		index_scratch_.resize(index_cnt / 4);
+	UINT *level = num_subdiv % 2 == 0 ? indices : index_scratch_.data();
+	std::copy(kIcosahedronIndices, kIcosahedronIndices + 60, level);
+
+	UINT level_vertex_cnt = 12;
+	size_t level_index_cnt = 60;
+	for (UINT i = 0; i < num_subdiv; ++i) {
+		UINT *next = level == indices ? index_scratch_.data() : indices;
+		level_vertex_cnt = SplitEdges(vertices, level_vertex_cnt, level, level_index_cnt, next);
+		level_index_cnt *= 4;
+		level = next;
 	}
 
+	ForEachRowBand(vertex_cnt, vertex_cnt, [&](UINT first, UINT last) {
+		for (UINT i = first; i < last; ++i) {
+			XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertices[i].position));
+			XMStoreFloat3(&vertices[i].normal, n);
+			// Project subdivided vertices to the sphere
+			XMStoreFloat3(&vertices[i].position, n*radius);
+
+			float phi = acosf(vertices[i].position.y / radius);
+			float theta = MathHelper::AngleFromXY(
+				vertices[i].position.x, 
+				vertices[i].position.z);
+
+			// Use theta and phi to parameterize sphere
+			vertices[i].texcoord = XMFLOAT2(theta / (2.0f*XM_PI), phi / XM_PI);
+			// Tangent is parallel to dp/du
+			vertices[i].tangent = XMFLOAT3(-sinf(theta), 0.0f, cosf(theta));
+		}
+	});
+
 }
 
 void GeometryGenerator::Subdivide(MeshData& mesh_data)
 {
-	// Save a copy of the input geometry.
-	MeshData input_copy = mesh_data;
-
-	mesh_data.clear();
-	mesh_data.vertices.reserve(input_copy.vertices.size() * 2);
-	mesh_data.indices.reserve(input_copy.indices.size() * 4);
-	//       1
-	//       v1
-	//       *
-	//      / \
-	//  3  /   \ 4
-	//  m0*-----*m1
-	//   / \   / \
-	//  /   \ /   \
-	// *-----*-----*
-	// v0    m2    v2
-	// 0     5     2
-	UINT tris_cnt = input_copy.indices.size() / 3;
-	for (UINT i = 0; i < tris_cnt; ++i)
-	{
-		Vertex v0 = input_copy.vertices[input_copy.indices[i * 3 + 0]];
-		Vertex v1 = input_copy.vertices[input_copy.indices[i * 3 + 1]];
-		Vertex v2 = input_copy.vertices[input_copy.indices[i * 3 + 2]];
-
-		//
-		// Generate the midpoints.
-		//
-
-		Vertex m0, m1, m2;
-
-		// For subdivision, we just care about the position component.  We derive the other
-		// vertex components in CreateGeosphere.
-
-		m0.position = XMFLOAT3(
-			0.5f*(v0.position.x + v1.position.x),
-			0.5f*(v0.position.y + v1.position.y),
-			0.5f*(v0.position.z + v1.position.z));
-
-		m1.position = XMFLOAT3(
-			0.5f*(v1.position.x + v2.position.x),
-			0.5f*(v1.position.y + v2.position.y),
-			0.5f*(v1.position.z + v2.position.z));
-
-		m2.position = XMFLOAT3(
-			0.5f*(v0.position.x + v2.position.x),
-			0.5f*(v0.position.y + v2.position.y),
-			0.5f*(v0.position.z + v2.position.z));
-
-		//
-		// Add new geometry.
-		//
-
-		mesh_data.vertices.push_back(v0); // 0
-		mesh_data.vertices.push_back(v1); // 1
-		mesh_data.vertices.push_back(v2); // 2
-		mesh_data.vertices.push_back(m0); // 3
-		mesh_data.vertices.push_back(m1); // 4
-		mesh_data.vertices.push_back(m2); // 5
-
-		mesh_data.indices.push_back(i * 6 + 0);
-		mesh_data.indices.push_back(i * 6 + 3);
-		mesh_data.indices.push_back(i * 6 + 5);
-
-		mesh_data.indices.push_back(i * 6 + 3);
-		mesh_data.indices.push_back(i * 6 + 4);
-		mesh_data.indices.push_back(i * 6 + 5);
-
-		mesh_data.indices.push_back(i * 6 + 5);
-		mesh_data.indices.push_back(i * 6 + 4);
-		mesh_data.indices.push_back(i * 6 + 2);
-
-		mesh_data.indices.push_back(i * 6 + 3);
-		mesh_data.indices.push_back(i * 6 + 1);
-		mesh_data.indices.push_back(i * 6 + 4);
+	std::vector<UINT> input;
+	input.swap(mesh_data.indices);
+
+	// At most one new vertex per edge, and at most one edge per index.
+	UINT vertex_cnt = static_cast<UINT>(mesh_data.vertices.size());
+	mesh_data.vertices.resize(vertex_cnt + input.size());
+	mesh_data.indices.resize(input.size() / 3 * 12);
+	vertex_cnt = SplitEdges(mesh_data.vertices.data(), vertex_cnt, input.data(), input.size(), mesh_data.indices.data());
+	mesh_data.vertices.resize(vertex_cnt);
+}
+
+//       1
+//       v1
+//       *
+//      / \
+//  3  /   \ 4
+//  m0*-----*m1
+//   / \   / \
+//  /   \ /   \
+// *-----*-----*
+// v0    m2    v2
+// 0     5     2
+//
+// Triangle t becomes triangles 4t to 4t + 3: (v0, m0, m2), (m0, m1, m2),
+// (m2, m1, v2) and (m0, v1, m1).  The first triangle to reach an edge appends
+// its midpoint (position only; CreateGeosphere derives the rest) and files it
+// in an open-addressed table keyed by the edge's two vertices, so the other
+// triangle on the edge finds it there.
+UINT GeometryGenerator::SplitEdges(Vertex *vertices, UINT vertex_cnt, const UINT *indices, size_t index_cnt,
+	UINT *out_indices) {
+	size_t table_size = 64;
+	while (table_size < 2 * index_cnt)
+		table_size *= 2;
+	edge_keys_.assign(table_size, kNoEdge);
+	edge_midpoints_.resize(table_size);
+	int shift = 64;
+	for (size_t size = table_size; size > 1; size /= 2)
+		--shift;
+
+	auto midpoint = [&](UINT a, UINT b) {
+		uint64_t key = EdgeKey(a, b);
+		size_t slot = static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> shift);
+		while (edge_keys_[slot] != kNoEdge) {
+			if (edge_keys_[slot] == key)
+				return edge_midpoints_[slot];
+			slot = (slot + 1) & (table_size - 1);
+		}
+		edge_keys_[slot] = key;
+		edge_midpoints_[slot] = vertex_cnt;
+		vertices[vertex_cnt].position = Midpoint(vertices[a].position, vertices[b].position);
+		return vertex_cnt++;
+	};
+
+	for (size_t i = 0; i + 2 < index_cnt; i += 3) {
+		UINT v0 = indices[i], v1 = indices[i + 1], v2 = indices[i + 2];
+		UINT m0 = midpoint(v0, v1);
+		UINT m1 = midpoint(v1, v2);
+		UINT m2 = midpoint(v0, v2);
+
+		const UINT split[12] = { v0, m0, m2,  m0, m1, m2,  m2, m1, v2,  m0, v1, m1 };
+		std::copy(split, split + 12, out_indices + i * 4);
 	}
+	return vertex_cnt;
 }
 
 void GeometryGenerator::CreateFullscreenQuad(MeshData& meshData)
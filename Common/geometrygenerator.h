@@ -1,11 +1,28 @@
 #ifndef GEOMETRYGENERATOR_H
 #define GEOMETRYGENERATOR_H
 
-#include"d3dutility.h"
+#include"mathhelper.h"
+#include<cstdint>
+#include<functional>
+#include<memory>
 #include<vector>
 
+class ThreadPool;
+
+// The MeshData versions of the Create functions size their output once and
+// fill it in place.  The pointer versions write the same mesh into arrays
+// the caller owns (a mapped buffer, say), sized with the matching *Size()
+// function.  Meshes of kParallelMinVertices or more are built by several
+// threads; a generator is not meant to be used by two threads at once.
 class GeometryGenerator {
 public:
+	static const UINT kParallelMinVertices = 1 << 16;
+
+	// thread_cnt 1 builds everything on the calling thread; 0 picks the
+	// hardware thread count.  The threads start with the first large mesh.
+	explicit GeometryGenerator(UINT thread_cnt = 0);
+	~GeometryGenerator();
+
 	struct Vertex {
 		DirectX::XMFLOAT3 position;
 		DirectX::XMFLOAT3 normal;
@@ -41,15 +58,31 @@ public:
 	};
 
 	void CreateGrid(float length_x, float length_z, UINT num_x, UINT num_z, MeshData &meshData);
+	void CreateGrid(float length_x, float length_z, UINT num_x, UINT num_z, Vertex *vertices, UINT *indices);
+	static void GridSize(UINT num_x, UINT num_z, UINT &vertex_cnt, UINT &index_cnt);
 
 	void CreateBox(float length_x, float length_y, float length_z, MeshData &mesh_data);
 
+	// Deeper subdivisions are clamped to this, the most whose 60*4^n indices
+	// still fit in a UINT.
+	static const UINT kMaxGeosphereSubdivisions = 13;
 	void CreateGeosphere(float radius, UINT num_subdiv, MeshData &mesh_data);
+	void CreateGeosphere(float radius, UINT num_subdiv, Vertex *vertices, UINT *indices);
+	static void GeosphereSize(UINT num_subdiv, UINT &vertex_cnt, UINT &index_cnt);
 
+	// stack_count must be at least 2.
 	void CreateSphere(float radius, UINT slice_count, UINT stack_count, MeshData &mesh_data);
+	void CreateSphere(float radius, UINT slice_count, UINT stack_count, Vertex *vertices, UINT *indices);
+	static void SphereSize(UINT slice_count, UINT stack_count, UINT &vertex_cnt, UINT &index_cnt);
 
 	void CreateCylinder(float radius_top, float radius_bottom, float height, UINT stack_cnt, UINT slice_cnt, MeshData &mesh_data);
+	void CreateCylinder(float radius_top, float radius_bottom, float height, UINT stack_cnt, UINT slice_cnt,
+		Vertex *vertices, UINT *indices);
+	static void CylinderSize(UINT stack_cnt, UINT slice_cnt, UINT &vertex_cnt, UINT &index_cnt);
 
+	// Splits every triangle in four.  Triangles that share an edge share its
+	// midpoint, so a closed mesh grows by one vertex per edge; only the new
+	// vertices' positions are set.
 	void Subdivide(MeshData &mesh_data);
 
 	
@@ -57,7 +90,32 @@ public:
 	// postprocessing effects.
 	void CreateFullscreenQuad(MeshData& meshData);
 
+private:
+	GeometryGenerator(const GeometryGenerator&) = delete;
+	GeometryGenerator& operator=(const GeometryGenerator&) = delete;
+
+	// Calls rows(first, last) over bands of [0, row_cnt), on the pool when
+	// the mesh has enough vertices.
+	void ForEachRowBand(UINT row_cnt, size_t vertex_cnt, const std::function<void(UINT, UINT)> &rows);
+
+	// cos and sin of i * 2pi / slice_cnt for i in [0, slice_cnt].
+	const std::vector<DirectX::XMFLOAT2> &RingTable(UINT slice_cnt);
+
+	// Splits every triangle in four, appending one vertex per edge after
+	// vertices[vertex_cnt - 1]; returns the new vertex count.  out_indices
+	// takes 4 * index_cnt indices.
+	UINT SplitEdges(Vertex *vertices, UINT vertex_cnt, const UINT *indices, size_t index_cnt, UINT *out_indices);
+
+private:
+	UINT thread_cnt_;
+	std::unique_ptr<ThreadPool> pool_;
+
+	UINT ring_slice_cnt_ = 0;
+	std::vector<DirectX::XMFLOAT2> ring_;
 
+	std::vector<UINT> index_scratch_;
+	std::vector<uint64_t> edge_keys_;
+	std::vector<UINT> edge_midpoints_;
 	};
 
 
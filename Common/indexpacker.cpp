@@ -0,0 +1,68 @@
+#include"indexpacker.h"
+#include"profiler.h"
+
+namespace {
+
+const UINT kNoSubMesh = 0xffffffff;
+
+}
+
+const UINT IndexPacker::kMaxVertices16;
+
+void IndexPacker::Split(const UINT *indices, size_t index_cnt, UINT vertex_cnt, std::vector<uint16_t> &out_indices,
+	std::vector<UINT> &vertex_remap, std::vector<SubMesh> &submeshes) {
+	PROFILE_ZONE("IndexPacker::Split");
+
+	out_indices.resize(index_cnt - index_cnt % 3);
+	vertex_remap.clear();
+	submeshes.clear();
+
+	// Which sub-mesh last took each vertex, and where it went in it; stamping
+	// with the sub-mesh saves clearing the map between them.
+	std::vector<UINT> owner(vertex_cnt, kNoSubMesh);
+	std::vector<uint16_t> local(vertex_cnt);
+
+	SubMesh current;
+	UINT id = 0;
+	for (size_t i = 0; i + 2 < index_cnt; i += 3) {
+		const UINT *tri = indices + i;
+		UINT new_cnt = 0;
+		for (int k = 0; k < 3; ++k) {
+			bool repeated = (k > 0 && tri[k] == tri[0]) || (k == 2 && tri[k] == tri[1]);
+			if (owner[tri[k]] != id && !repeated)
+				++new_cnt;
+		}
+
+		if (current.vertex_cnt + new_cnt > kMaxVertices16) {
+			submeshes.push_back(current);
+			current = SubMesh();
+			current.index_offset = static_cast<UINT>(i);
+			current.base_vertex = static_cast<INT>(vertex_remap.size());
+			++id;
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			UINT v = tri[k];
+			if (owner[v] != id) {
+				owner[v] = id;
+				local[v] = static_cast<uint16_t>(current.vertex_cnt++);
+				vertex_remap.push_back(v);
+			}
+			out_indices[i + k] = local[v];
+		}
+		current.index_cnt += 3;
+	}
+	if (current.index_cnt > 0)
+		submeshes.push_back(current);
+}
+
+void IndexPacker::Expand(const uint16_t *indices, const std::vector<SubMesh> &submeshes,
+	const std::vector<UINT> &vertex_remap, std::vector<UINT> &out) {
+	out.clear();
+	for (const SubMesh &submesh : submeshes) {
+		for (UINT i = 0; i < submesh.index_cnt; ++i) {
+			UINT v = submesh.base_vertex + indices[submesh.index_offset + i];
+			out.push_back(vertex_remap.empty() ? v : vertex_remap[v]);
+		}
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef INDEXPACKER_H
+#define INDEXPACKER_H
+
+#include"geometrygenerator.h"
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+// Turns 32-bit index lists into DXGI_FORMAT_R16_UINT ones.  Meshes with at
+// most 65536 vertices narrow as they are; bigger ones are split into
+// sub-meshes that each reach no more than 65536 vertices from their base
+// vertex, which halves index memory and bandwidth at the cost of a draw per
+// sub-mesh and a few shared vertices copied into more than one of them.
+class IndexPacker {
+public:
+	static const UINT kMaxVertices16 = 65536;
+
+	// DrawIndexed(index_cnt, index_offset, base_vertex).
+	struct SubMesh {
+		UINT index_offset = 0;
+		UINT index_cnt = 0;
+		INT base_vertex = 0;
+		UINT vertex_cnt = 0;
+	};
+
+	// Narrows indices that all fit in 16 bits; returns false, leaving out
+	// empty, if one does not.
+	static bool Narrow(const UINT *indices, size_t index_cnt, std::vector<uint16_t> &out) {
+		out.resize(index_cnt);
+		for (size_t i = 0; i < index_cnt; ++i) {
+			if (indices[i] >= kMaxVertices16) {
+				out.clear();
+				return false;
+			}
+			out[i] = static_cast<uint16_t>(indices[i]);
+		}
+		return true;
+	}
+
+	// Splits a triangle list of any size.  Each sub-mesh's vertices are
+	// vertex_remap[base_vertex, base_vertex + vertex_cnt), in the order its
+	// triangles first use them; vertex_remap[i] is the input vertex that goes
+	// at i in the new vertex buffer.  Triangles keep their order.
+	static void Split(const UINT *indices, size_t index_cnt, UINT vertex_cnt, std::vector<uint16_t> &out_indices,
+		std::vector<UINT> &vertex_remap, std::vector<SubMesh> &submeshes);
+
+	// Narrows when the mesh is small enough and splits otherwise, rewriting
+	// the vertices only in the second case.
+	template<class Vertex>
+	static void Pack(std::vector<Vertex> &vertices, const std::vector<UINT> &indices, std::vector<uint16_t> &out_indices,
+		std::vector<SubMesh> &submeshes) {
+		submeshes.clear();
+		if (vertices.size() <= kMaxVertices16 && Narrow(indices.data(), indices.size(), out_indices)) {
+			SubMesh submesh;
+			submesh.index_cnt = static_cast<UINT>(indices.size());
+			submesh.vertex_cnt = static_cast<UINT>(vertices.size());
+			submeshes.push_back(submesh);
+			return;
+		}
+
+		std::vector<UINT> remap;
+		Split(indices.data(), indices.size(), static_cast<UINT>(vertices.size()), out_indices, remap, submeshes);
+		std::vector<Vertex> split(remap.size());
+		for (size_t i = 0; i < remap.size(); ++i)
+			split[i] = vertices[remap[i]];
+		vertices.swap(split);
+	}
+
+	static void Pack(GeometryGenerator::MeshData &mesh_data, std::vector<uint16_t> &out_indices,
+		std::vector<SubMesh> &submeshes) {
+		Pack(mesh_data.vertices, mesh_data.indices, out_indices, submeshes);
+	}
+
+	// Re-expands the sub-meshes into one 32-bit list, through vertex_remap
+	// when it is not empty, to check a split against the original.
+	static void Expand(const uint16_t *indices, const std::vector<SubMesh> &submeshes,
+		const std::vector<UINT> &vertex_remap, std::vector<UINT> &out);
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include"mappedfile.h"
+
+#if defined(_WIN32)
+#include<Windows.h>
+#else
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string &filename) {
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	return file != INVALID_HANDLE_VALUE && Map(file);
+}
+
+bool MappedFile::Open(const std::wstring &filename) {
+	Close();
+
+	HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	return file != INVALID_HANDLE_VALUE && Map(file);
+}
+
+bool MappedFile::Map(void *file) {
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 ||
+		static_cast<unsigned long long>(size.QuadPart) > SIZE_MAX) {
+		CloseHandle(file);
+		return false;
+	}
+
+	// The mapping keeps the file open, so the handle is not needed any more.
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(file);
+	if (!mapping)
+		return false;
+
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		CloseHandle(mapping);
+		return false;
+	}
+
+	mapping_ = mapping;
+	data_ = static_cast<const uint8_t*>(data);
+	size_ = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data_)
+		UnmapViewOfFile(data_);
+	if (mapping_)
+		CloseHandle(mapping_);
+
+	data_ = nullptr;
+	size_ = 0;
+	mapping_ = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::string &filename) {
+	Close();
+
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	// The mapping keeps the file open, so the descriptor is not needed any more.
+	void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+
+	data_ = static_cast<const uint8_t*>(data);
+	size_ = static_cast<size_t>(st.st_size);
+	return true;
+}
+
+void MappedFile::Close() {
+	if (data_)
+		munmap(const_cast<uint8_t*>(data_), size_);
+
+	data_ = nullptr;
+	size_ = 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include<cstddef>
+#include<cstdint>
+#include<string>
+
+// Maps a whole file read-only into memory, so it can be used in place
+// without being copied.  The pages are read in by the OS as they are touched.
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile() {
+		Close();
+	}
+
+	// Returns false if the file cannot be opened or is empty.
+	bool Open(const std::string &filename);
+#if defined(_WIN32)
+	bool Open(const std::wstring &filename);
+#endif
+	void Close();
+
+	bool IsOpen() const {
+		return data_ != nullptr;
+	}
+	const uint8_t* Data() const {
+		return data_;
+	}
+	size_t Size() const {
+		return size_;
+	}
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+#if defined(_WIN32)
+	// Maps an open file handle, and closes it.
+	bool Map(void *file);
+#endif
+
+private:
+	const uint8_t *data_ = nullptr;
+	size_t size_ = 0;
+
+#if defined(_WIN32)
+	void *mapping_ = nullptr;
+#endif
+};
+
+#endif
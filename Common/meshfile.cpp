@@ -0,0 +1,224 @@
+#include"meshfile.h"
+#include"meshoptimizer.h"
+#include"profiler.h"
+#include<algorithm>
+#include<cfloat>
+#include<fstream>
+
+#if defined(_WIN32)
+#include<Windows.h>
+#else
+#include<sys/stat.h>
+#endif
+
+namespace {
+
+const uint32_t kStreamAlignment = 16;
+
+uint32_t AlignUp(uint32_t offset) {
+	return (offset + kStreamAlignment - 1) & ~(kStreamAlignment - 1);
+}
+
+void WritePadding(std::ofstream &fout, uint32_t from, uint32_t to) {
+	static const char zeros[kStreamAlignment] = {};
+	fout.write(zeros, to - from);
+}
+
+// The time a file was last written, at the file system's full resolution
+// (100 ns on NTFS), or 0 if it cannot be found.
+uint64_t LastWriteTime(const std::string &filename) {
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &data))
+		return 0;
+	return (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0)
+		return 0;
+#if defined(__APPLE__)
+	const struct timespec &mtime = st.st_mtimespec;
+#else
+	const struct timespec &mtime = st.st_mtim;
+#endif
+	return static_cast<uint64_t>(mtime.tv_sec) * 1000000000 + static_cast<uint64_t>(mtime.tv_nsec);
+#endif
+}
+
+}
+
+const std::vector<float> MeshFile::kLodRatios = { 1.0f, 0.5f, 0.25f, 0.1f };
+
+bool MeshFile::Open(const std::string &filename) {
+	PROFILE_ZONE("MeshFile::Open");
+
+	Close();
+	if (!file_.Open(filename))
+		return false;
+
+	const uint8_t *data = file_.Data();
+	uint64_t size = file_.Size();
+	if (size < sizeof(Header)) {
+		Close();
+		return false;
+	}
+
+	const Header *header = reinterpret_cast<const Header*>(data);
+	uint64_t vertex_bytes = static_cast<uint64_t>(header->vertex_cnt) * sizeof(Vertex);
+	uint64_t index_bytes = static_cast<uint64_t>(header->lod_index_cnt) * sizeof(uint32_t);
+	uint64_t lod_bytes = static_cast<uint64_t>(header->lod_cnt) * sizeof(Lod);
+	if (header->magic != kMagic || header->version != kVersion ||
+		header->vertex_stride != sizeof(Vertex) || header->index_size != sizeof(uint32_t) ||
+		header->vertex_offset % kStreamAlignment != 0 || header->index_offset % kStreamAlignment != 0 ||
+		header->vertex_offset < sizeof(Header) || header->vertex_offset + vertex_bytes > size ||
+		header->index_offset < sizeof(Header) || header->index_offset + index_bytes > size ||
+		header->index_cnt % 3 != 0 || header->index_cnt > header->lod_index_cnt ||
+		(header->lod_cnt != 0 && (header->lod_offset % kStreamAlignment != 0 ||
+			header->lod_offset < sizeof(Header) || header->lod_offset + lod_bytes > size))) {
+		Close();
+		return false;
+	}
+
+	const Lod *lods = reinterpret_cast<const Lod*>(data + header->lod_offset);
+	for (uint32_t i = 0; i < header->lod_cnt; ++i) {
+		if (lods[i].index_cnt % 3 != 0 || lods[i].index_offset > header->lod_index_cnt ||
+			lods[i].index_cnt > header->lod_index_cnt - lods[i].index_offset) {
+			Close();
+			return false;
+		}
+	}
+
+	// An index past the vertices would have the GPU read outside the vertex
+	// buffer.  The indices are about to be copied into the index buffer, so
+	// reading them once more costs little.
+	const uint32_t *indices = reinterpret_cast<const uint32_t*>(data + header->index_offset);
+	uint32_t max_index = 0;
+	for (uint32_t i = 0; i < header->lod_index_cnt; ++i)
+		max_index = std::max(max_index, indices[i]);
+	if (header->lod_index_cnt != 0 && max_index >= header->vertex_cnt) {
+		Close();
+		return false;
+	}
+
+	vertices_ = reinterpret_cast<const Vertex*>(data + header->vertex_offset);
+	indices_ = indices;
+	lods_ = header->lod_cnt != 0 ? lods : nullptr;
+	vertex_cnt_ = header->vertex_cnt;
+	index_cnt_ = header->index_cnt;
+	lod_cnt_ = header->lod_cnt;
+	lod_index_cnt_ = header->lod_index_cnt;
+	return true;
+}
+
+bool MeshFile::OpenOrConvert(const std::string &mesh_filename, const std::string &text_filename) {
+	// A text model edited since the conversion is converted again, also one
+	// written in the same clock tick as the .mesh; a missing one leaves the
+	// .mesh as it is.
+	if (LastWriteTime(text_filename) < LastWriteTime(mesh_filename) && Open(mesh_filename))
+		return true;
+
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	if (!ModelLoader::LoadTextModel(text_filename, vertices, indices))
+		return false;
+	MeshOptimizer::Optimize(vertices, indices);
+	std::vector<Lod> lods;
+	BuildLods(vertices, indices, lods);
+
+	if (Write(mesh_filename, vertices, indices, lods) && Open(mesh_filename))
+		return true;
+
+	owned_vertices_.swap(vertices);
+	owned_indices_.swap(indices);
+	owned_lods_.swap(lods);
+	vertices_ = owned_vertices_.data();
+	indices_ = owned_indices_.data();
+	lods_ = owned_lods_.data();
+	vertex_cnt_ = static_cast<uint32_t>(owned_vertices_.size());
+	index_cnt_ = owned_lods_[0].index_cnt;
+	lod_cnt_ = static_cast<uint32_t>(owned_lods_.size());
+	lod_index_cnt_ = static_cast<uint32_t>(owned_indices_.size());
+	return true;
+}
+
+void MeshFile::Close() {
+	file_.Close();
+	owned_vertices_.clear();
+	owned_indices_.clear();
+	owned_lods_.clear();
+
+	vertices_ = nullptr;
+	indices_ = nullptr;
+	lods_ = nullptr;
+	vertex_cnt_ = 0;
+	index_cnt_ = 0;
+	lod_cnt_ = 0;
+	lod_index_cnt_ = 0;
+}
+
+bool MeshFile::Write(const std::string &filename, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+	const std::vector<Lod> &lods) {
+	uint64_t vertex_bytes = static_cast<uint64_t>(vertices.size()) * sizeof(Vertex);
+	uint64_t index_bytes = static_cast<uint64_t>(indices.size()) * sizeof(uint32_t);
+	uint64_t lod_bytes = static_cast<uint64_t>(lods.size()) * sizeof(Lod);
+	if (sizeof(Header) + vertex_bytes + index_bytes + lod_bytes + 3 * kStreamAlignment > UINT32_MAX)
+		return false;
+
+	Header header = {};
+	header.magic = kMagic;
+	header.version = kVersion;
+	header.vertex_cnt = static_cast<uint32_t>(vertices.size());
+	header.index_cnt = lods.empty() ? static_cast<uint32_t>(indices.size()) : lods[0].index_cnt;
+	header.vertex_stride = sizeof(Vertex);
+	header.index_size = sizeof(uint32_t);
+	header.vertex_offset = AlignUp(sizeof(Header));
+	header.index_offset = AlignUp(header.vertex_offset + static_cast<uint32_t>(vertex_bytes));
+	header.lod_cnt = static_cast<uint32_t>(lods.size());
+	header.lod_index_cnt = static_cast<uint32_t>(indices.size());
+	header.lod_offset = lods.empty() ? 0 : AlignUp(header.index_offset + static_cast<uint32_t>(index_bytes));
+
+	for (int k = 0; k < 3; ++k) {
+		header.bounds_min[k] = vertices.empty() ? 0.0f : FLT_MAX;
+		header.bounds_max[k] = vertices.empty() ? 0.0f : -FLT_MAX;
+	}
+	for (const Vertex &v : vertices) {
+		const float p[3] = { v.position.x, v.position.y, v.position.z };
+		for (int k = 0; k < 3; ++k) {
+			header.bounds_min[k] = std::min(header.bounds_min[k], p[k]);
+			header.bounds_max[k] = std::max(header.bounds_max[k], p[k]);
+		}
+	}
+
+	std::ofstream fout(filename, std::ios::binary);
+	if (!fout)
+		return false;
+
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	WritePadding(fout, sizeof(header), header.vertex_offset);
+	fout.write(reinterpret_cast<const char*>(vertices.data()), vertex_bytes);
+	WritePadding(fout, header.vertex_offset + static_cast<uint32_t>(vertex_bytes), header.index_offset);
+	fout.write(reinterpret_cast<const char*>(indices.data()), index_bytes);
+	if (!lods.empty()) {
+		WritePadding(fout, header.index_offset + static_cast<uint32_t>(index_bytes), header.lod_offset);
+		fout.write(reinterpret_cast<const char*>(lods.data()), lod_bytes);
+	}
+	return !fout.fail();
+}
+
+void MeshFile::BuildLods(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, std::vector<Lod> &lods) {
+	std::vector<uint32_t> lod_indices;
+	MeshSimplifier::BuildLodChain(vertices, indices, kLodRatios, lod_indices, lods);
+	indices.swap(lod_indices);
+}
+
+bool MeshFile::ConvertTextModel(const std::string &text_filename, const std::string &mesh_filename) {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	if (!ModelLoader::LoadTextModel(text_filename, vertices, indices))
+		return false;
+	MeshOptimizer::Optimize(vertices, indices);
+	std::vector<Lod> lods;
+	BuildLods(vertices, indices, lods);
+
+	return Write(mesh_filename, vertices, indices, lods);
+}
@@ -0,0 +1,122 @@
+#ifndef MESHFILE_H
+#define MESHFILE_H
+
+#include"mappedfile.h"
+#include"meshsimplifier.h"
+#include"modelloader.h"
+#include<cstdint>
+#include<string>
+#include<vector>
+
+// A binary mesh container (.mesh) that is used in place: a header, then the
+// vertices and the 32-bit indices, each stream 16-byte aligned and laid out
+// exactly as the vertex and index buffers want them.  Open() maps the file,
+// checks the header and that every index names a vertex; nothing is copied.
+// Files are little-endian.
+//
+// Converted meshes also carry a LOD chain built by MeshSimplifier: the
+// indices of the coarser levels follow the mesh's own in the index stream,
+// and a table after them says where each level starts, so the whole chain
+// goes into one index buffer without being simplified again at load time.
+class MeshFile {
+public:
+	typedef ModelLoader::Vertex Vertex;
+	typedef MeshSimplifier::Lod Lod;
+
+	static const uint32_t kMagic = 0x4853454d;	// "MESH"
+	static const uint32_t kVersion = 2;
+
+	// The levels ConvertTextModel() and OpenOrConvert() build; the first is
+	// the mesh itself.
+	static const std::vector<float> kLodRatios;
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vertex_cnt;
+		uint32_t index_cnt;
+		uint32_t vertex_stride;		// sizeof(Vertex)
+		uint32_t index_size;		// sizeof(uint32_t)
+		uint32_t vertex_offset;		// from the start of the file
+		uint32_t index_offset;
+		float bounds_min[3];
+		float bounds_max[3];
+		uint32_t lod_cnt;			// 0 when the file has no chain
+		uint32_t lod_index_cnt;		// all levels, from index_offset; index_cnt when there is no chain
+		uint32_t lod_offset;		// of the Lod table
+		uint32_t reserved[3];
+	};
+
+	MeshFile() = default;
+
+	// Returns false if the file is missing, its header does not describe a
+	// mesh that fits in it, or its indices, or any level's, are not whole
+	// triangles of its vertices.
+	bool Open(const std::string &filename);
+
+	// Opens mesh_filename, and if that fails or the text model was not
+	// written before it, loads the text model, optimizes it with
+	// MeshOptimizer and writes it to mesh_filename for the next run.
+	// If the write fails the mesh is kept in memory instead.
+	bool OpenOrConvert(const std::string &mesh_filename, const std::string &text_filename);
+
+	void Close();
+
+	const Vertex* Vertices() const {
+		return vertices_;
+	}
+	const uint32_t* Indices() const {
+		return indices_;
+	}
+	uint32_t VertexCount() const {
+		return vertex_cnt_;
+	}
+	uint32_t IndexCount() const {
+		return index_cnt_;
+	}
+
+	// The LOD chain; every level's range is of the LodIndexCount() indices
+	// that start at Indices().  Empty for files written without one.
+	const Lod* Lods() const {
+		return lods_;
+	}
+	uint32_t LodCount() const {
+		return lod_cnt_;
+	}
+	uint32_t LodIndexCount() const {
+		return lod_index_cnt_;
+	}
+
+	// With lods, indices is the chain's index list and lods[0] is the mesh
+	// itself, as BuildLods() leaves them.
+	static bool Write(const std::string &filename, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices,
+		const std::vector<Lod> &lods = std::vector<Lod>());
+
+	// Replaces the indices of an optimized mesh with its kLodRatios chain.
+	static void BuildLods(const std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, std::vector<Lod> &lods);
+
+	// Converts a text model (skull.txt, car.txt) to an optimized .mesh file.
+	static bool ConvertTextModel(const std::string &text_filename, const std::string &mesh_filename);
+
+private:
+	MeshFile(const MeshFile&) = delete;
+	MeshFile& operator=(const MeshFile&) = delete;
+
+private:
+	MappedFile file_;
+
+	// Used when the mesh could not be written out by OpenOrConvert().
+	std::vector<Vertex> owned_vertices_;
+	std::vector<uint32_t> owned_indices_;
+	std::vector<Lod> owned_lods_;
+
+	const Vertex *vertices_ = nullptr;
+	const uint32_t *indices_ = nullptr;
+	const Lod *lods_ = nullptr;
+	uint32_t vertex_cnt_ = 0;
+	uint32_t index_cnt_ = 0;
+	uint32_t lod_cnt_ = 0;
+	uint32_t lod_index_cnt_ = 0;
+};
+
+#endif
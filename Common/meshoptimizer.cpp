@@ -0,0 +1,222 @@
+#include"meshoptimizer.h"
+#include"profiler.h"
+#include<algorithm>
+#include<cmath>
+
+namespace {
+
+// Forsyth's scoring, with the constants from his paper.  The scores assume a
+// 32-entry LRU cache, which also does well on smaller FIFO caches.
+const int kScoreCacheSize = 32;
+const float kCacheDecayPower = 1.5f;
+const float kLastTriScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+const UINT kMaxTableValence = 64;
+
+const UINT kNoTriangle = 0xffffffff;
+
+class ScoreTable {
+public:
+	ScoreTable() {
+		for (int i = 0; i < kScoreCacheSize; ++i) {
+			// The last triangle's vertices get a fixed score, so that the
+			// next triangle does not simply reuse two of them.
+			if (i < 3)
+				cache_[i] = kLastTriScore;
+			else
+				cache_[i] = std::pow(1.0f - (i - 3) * (1.0f / (kScoreCacheSize - 3)), kCacheDecayPower);
+		}
+		for (UINT i = 0; i < kMaxTableValence; ++i)
+			valence_[i] = i == 0 ? 0.0f : kValenceBoostScale * std::pow(static_cast<float>(i), -kValenceBoostPower);
+	}
+
+	// A vertex with no triangles left scores nothing, so it does not pull
+	// any triangle forward.
+	float Score(int cache_pos, UINT remaining) const {
+		if (remaining == 0)
+			return 0.0f;
+		float score = cache_pos >= 0 ? cache_[cache_pos] : 0.0f;
+		if (remaining < kMaxTableValence)
+			return score + valence_[remaining];
+		return score + kValenceBoostScale * std::pow(static_cast<float>(remaining), -kValenceBoostPower);
+	}
+
+private:
+	float cache_[kScoreCacheSize];
+	float valence_[kMaxTableValence];
+};
+
+}
+
+const UINT MeshOptimizer::kDefaultCacheSize;
+const UINT MeshOptimizer::kUnused;
+
+MeshOptimizer::CacheStats MeshOptimizer::SimulateCache(const UINT *indices, size_t index_cnt, UINT vertex_cnt, UINT cache_size, CacheModel model) {
+	CacheStats stats;
+	if (index_cnt == 0 || cache_size == 0)
+		return stats;
+
+	if (model == kFifo) {
+		// A vertex is in the cache if fewer than cache_size vertices were
+		// loaded after it.
+		std::vector<UINT> loaded_at(vertex_cnt, 0);
+		UINT time = cache_size + 1;
+		for (size_t i = 0; i < index_cnt; ++i) {
+			UINT v = indices[i];
+			if (time - loaded_at[v] > cache_size) {
+				loaded_at[v] = time++;
+				++stats.transform_cnt;
+			}
+		}
+	}
+	else {
+		std::vector<UINT> cache;
+		cache.reserve(cache_size + 1);
+		for (size_t i = 0; i < index_cnt; ++i) {
+			UINT v = indices[i];
+			std::vector<UINT>::iterator it = std::find(cache.begin(), cache.end(), v);
+			if (it != cache.end()) {
+				cache.erase(it);
+			}
+			else {
+				++stats.transform_cnt;
+				if (cache.size() == cache_size)
+					cache.pop_back();
+			}
+			cache.insert(cache.begin(), v);
+		}
+	}
+
+	stats.acmr = static_cast<float>(stats.transform_cnt) / static_cast<float>(index_cnt / 3);
+	stats.atvr = vertex_cnt ? static_cast<float>(stats.transform_cnt) / static_cast<float>(vertex_cnt) : 0.0f;
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(UINT *indices, size_t index_cnt, UINT vertex_cnt) {
+	PROFILE_ZONE("MeshOptimizer::OptimizeVertexCache");
+
+	static const ScoreTable score_table;
+	UINT tri_cnt = static_cast<UINT>(index_cnt / 3);
+	if (tri_cnt == 0)
+		return;
+
+	// The triangles still to be emitted around each vertex, packed into one
+	// array; an emitted triangle is swapped past the end of its vertices' lists.
+	std::vector<UINT> remaining(vertex_cnt, 0);
+	for (size_t i = 0; i < 3 * static_cast<size_t>(tri_cnt); ++i)
+		++remaining[indices[i]];
+
+	std::vector<UINT> first_adjacent(vertex_cnt + 1, 0);
+	for (UINT v = 0; v < vertex_cnt; ++v)
+		first_adjacent[v + 1] = first_adjacent[v] + remaining[v];
+
+	std::vector<UINT> adjacency(3 * static_cast<size_t>(tri_cnt));
+	std::vector<UINT> fill(first_adjacent.begin(), first_adjacent.end() - 1);
+	for (UINT t = 0; t < tri_cnt; ++t) {
+		for (int k = 0; k < 3; ++k)
+			adjacency[fill[indices[3 * t + k]]++] = t;
+	}
+
+	std::vector<int> cache_pos(vertex_cnt, -1);
+	std::vector<float> vertex_score(vertex_cnt);
+	for (UINT v = 0; v < vertex_cnt; ++v)
+		vertex_score[v] = score_table.Score(-1, remaining[v]);
+
+	std::vector<float> tri_score(tri_cnt);
+	std::vector<char> emitted(tri_cnt, 0);
+	UINT best = 0;
+	for (UINT t = 0; t < tri_cnt; ++t) {
+		tri_score[t] = vertex_score[indices[3 * t]] + vertex_score[indices[3 * t + 1]] + vertex_score[indices[3 * t + 2]];
+		if (tri_score[t] > tri_score[best])
+			best = t;
+	}
+
+	std::vector<UINT> output(3 * static_cast<size_t>(tri_cnt));
+	UINT cache[kScoreCacheSize + 3];
+	UINT cache_cnt = 0;
+	UINT next_unemitted = 0;
+
+	for (UINT n = 0; n < tri_cnt; ++n) {
+		if (best == kNoTriangle) {
+			// Nothing in the cache has triangles left: start again from the
+			// first triangle not yet emitted.
+			while (emitted[next_unemitted])
+				++next_unemitted;
+			best = next_unemitted;
+		}
+
+		const UINT *tri = indices + 3 * static_cast<size_t>(best);
+		output[3 * n + 0] = tri[0];
+		output[3 * n + 1] = tri[1];
+		output[3 * n + 2] = tri[2];
+		emitted[best] = 1;
+
+		for (int k = 0; k < 3; ++k) {
+			UINT v = tri[k];
+			UINT *list = &adjacency[first_adjacent[v]];
+			UINT last = --remaining[v];
+			for (UINT i = 0; i <= last; ++i) {
+				if (list[i] == best) {
+					std::swap(list[i], list[last]);
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front of the cache; whatever
+		// falls off the end leaves it.
+		UINT new_cache[kScoreCacheSize + 3];
+		UINT new_cnt = 0;
+		for (int k = 0; k < 3; ++k) {
+			if (k > 0 && (tri[k] == tri[0] || (k == 2 && tri[k] == tri[1])))
+				continue;
+			new_cache[new_cnt++] = tri[k];
+		}
+		for (UINT i = 0; i < cache_cnt; ++i) {
+			UINT v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				new_cache[new_cnt++] = v;
+		}
+
+		for (UINT i = 0; i < new_cnt; ++i) {
+			UINT v = new_cache[i];
+			cache_pos[v] = i < kScoreCacheSize ? static_cast<int>(i) : -1;
+			float score = score_table.Score(cache_pos[v], remaining[v]);
+			float delta = score - vertex_score[v];
+			vertex_score[v] = score;
+			const UINT *list = &adjacency[first_adjacent[v]];
+			for (UINT j = 0; j < remaining[v]; ++j)
+				tri_score[list[j]] += delta;
+		}
+		cache_cnt = std::min<UINT>(new_cnt, kScoreCacheSize);
+		std::copy(new_cache, new_cache + cache_cnt, cache);
+
+		best = kNoTriangle;
+		float best_score = -1.0f;
+		for (UINT i = 0; i < cache_cnt; ++i) {
+			UINT v = cache[i];
+			const UINT *list = &adjacency[first_adjacent[v]];
+			for (UINT j = 0; j < remaining[v]; ++j) {
+				if (tri_score[list[j]] > best_score) {
+					best_score = tri_score[list[j]];
+					best = list[j];
+				}
+			}
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+UINT MeshOptimizer::RemapVertexFetch(UINT *indices, size_t index_cnt, UINT vertex_cnt, std::vector<UINT> &remap) {
+	remap.assign(vertex_cnt, kUnused);
+	UINT next = 0;
+	for (size_t i = 0; i < index_cnt; ++i) {
+		UINT &v = remap[indices[i]];
+		if (v == kUnused)
+			v = next++;
+		indices[i] = v;
+	}
+	return next;
+}
@@ -0,0 +1,86 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include"geometrygenerator.h"
+#include<cstddef>
+#include<vector>
+
+// Reorders indexed triangle lists for the GPU.  OptimizeVertexCache() sorts
+// the triangles for the post-transform vertex cache with Tom Forsyth's
+// linear-speed algorithm; OptimizeVertexFetch() then renumbers the vertices
+// in the order the triangles first use them, so vertex fetches walk memory
+// forwards.  Neither changes what is drawn.
+class MeshOptimizer {
+public:
+	enum CacheModel {
+		kFifo,
+		kLru
+	};
+
+	struct CacheStats {
+		UINT transform_cnt = 0;	// cache misses
+		float acmr = 0.0f;		// transforms per triangle; 0.5 at best, 3 at worst
+		float atvr = 0.0f;		// transforms per vertex; 1 at best
+	};
+
+	struct Report {
+		CacheStats before;
+		CacheStats after;
+	};
+
+	// The cache SimulateCache() assumes unless told otherwise; in the range of
+	// what current hardware keeps per batch.
+	static const UINT kDefaultCacheSize = 16;
+
+	// Runs the index list through a post-transform cache of cache_size entries.
+	static CacheStats SimulateCache(const UINT *indices, size_t index_cnt, UINT vertex_cnt,
+		UINT cache_size = kDefaultCacheSize, CacheModel model = kFifo);
+
+	// Reorders the triangles in place.
+	static void OptimizeVertexCache(UINT *indices, size_t index_cnt, UINT vertex_cnt);
+
+	// Renumbers the indices in first-use order and sets remap[old] = new, or
+	// kUnused for vertices no triangle uses.  Returns the number of vertices
+	// left.
+	static const UINT kUnused = 0xffffffff;
+	static UINT RemapVertexFetch(UINT *indices, size_t index_cnt, UINT vertex_cnt, std::vector<UINT> &remap);
+
+	// Moves the vertices to match RemapVertexFetch() and drops unused ones.
+	template<class Vertex>
+	static void OptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<UINT> &indices) {
+		std::vector<UINT> remap;
+		UINT used_cnt = RemapVertexFetch(indices.data(), indices.size(), static_cast<UINT>(vertices.size()), remap);
+
+		std::vector<Vertex> reordered(used_cnt);
+		for (size_t i = 0; i < vertices.size(); ++i) {
+			if (remap[i] != kUnused)
+				reordered[remap[i]] = vertices[i];
+		}
+		vertices.swap(reordered);
+	}
+
+	// Both passes, with the cache statistics before and after.  Meshes that
+	// were already ordered for a FIFO cache (skull.txt is) can come out of
+	// OptimizeVertexCache() slightly worse on one, so they keep their order.
+	template<class Vertex>
+	static Report Optimize(std::vector<Vertex> &vertices, std::vector<UINT> &indices) {
+		UINT vertex_cnt = static_cast<UINT>(vertices.size());
+		Report report;
+		report.before = SimulateCache(indices.data(), indices.size(), vertex_cnt);
+
+		std::vector<UINT> original(indices);
+		OptimizeVertexCache(indices.data(), indices.size(), vertex_cnt);
+		if (SimulateCache(indices.data(), indices.size(), vertex_cnt).transform_cnt > report.before.transform_cnt)
+			indices.swap(original);
+
+		OptimizeVertexFetch(vertices, indices);
+		report.after = SimulateCache(indices.data(), indices.size(), static_cast<UINT>(vertices.size()));
+		return report;
+	}
+
+	static Report Optimize(GeometryGenerator::MeshData &mesh_data) {
+		return Optimize(mesh_data.vertices, mesh_data.indices);
+	}
+};
+
+#endif
@@ -0,0 +1,370 @@
+#include"meshsimplifier.h"
+#include"meshoptimizer.h"
+#include"profiler.h"
+#include<algorithm>
+#include<cfloat>
+#include<cmath>
+#include<cstdint>
+#include<cstring>
+#include<functional>
+
+namespace {
+
+// The sum of the squared distances to a set of planes, each weighted by the
+// area of its triangle.
+struct Quadric {
+	double a2 = 0, ab = 0, ac = 0, ad = 0;
+	double b2 = 0, bc = 0, bd = 0;
+	double c2 = 0, cd = 0;
+	double d2 = 0;
+	double weight = 0;
+
+	void AddPlane(double a, double b, double c, double d, double w) {
+		a2 += w * a * a; ab += w * a * b; ac += w * a * c; ad += w * a * d;
+		b2 += w * b * b; bc += w * b * c; bd += w * b * d;
+		c2 += w * c * c; cd += w * c * d;
+		d2 += w * d * d;
+		weight += w;
+	}
+
+	void Add(const Quadric &q) {
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+		weight += q.weight;
+	}
+
+	double Evaluate(const DirectX::XMFLOAT3 &p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double e = a2 * x * x + b2 * y * y + c2 * z * z + d2
+			+ 2 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+		return std::max(e, 0.0);
+	}
+};
+
+struct Collapse {
+	UINT from;
+	UINT to;
+	float error;
+};
+
+struct Vec3 {
+	double x, y, z;
+};
+
+Vec3 Sub(const DirectX::XMFLOAT3 &a, const DirectX::XMFLOAT3 &b) {
+	Vec3 v = { double(a.x) - b.x, double(a.y) - b.y, double(a.z) - b.z };
+	return v;
+}
+
+Vec3 Cross(const Vec3 &a, const Vec3 &b) {
+	Vec3 v = { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+	return v;
+}
+
+double Dot(const Vec3 &a, const Vec3 &b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+class Positions {
+public:
+	Positions(const DirectX::XMFLOAT3 *first, size_t stride) :
+		first_(reinterpret_cast<const char*>(first)), stride_(stride) {}
+
+	const DirectX::XMFLOAT3& operator[](UINT i) const {
+		return *reinterpret_cast<const DirectX::XMFLOAT3*>(first_ + i * stride_);
+	}
+
+private:
+	const char *first_;
+	size_t stride_;
+};
+
+Vec3 Normal(const Positions &positions, UINT i0, UINT i1, UINT i2) {
+	return Cross(Sub(positions[i1], positions[i0]), Sub(positions[i2], positions[i0]));
+}
+
+// Maps every vertex to the lowest-numbered vertex at the same position.
+void BuildPositionIds(const Positions &positions, UINT vertex_cnt, std::vector<UINT> &position_id) {
+	std::vector<UINT> order(vertex_cnt);
+	for (UINT i = 0; i < vertex_cnt; ++i)
+		order[i] = i;
+	auto less = [&](UINT a, UINT b) {
+		int c = std::memcmp(&positions[a], &positions[b], sizeof(DirectX::XMFLOAT3));
+		return c != 0 ? c < 0 : a < b;
+	};
+	std::sort(order.begin(), order.end(), less);
+
+	position_id.resize(vertex_cnt);
+	for (UINT i = 0; i < vertex_cnt; ++i) {
+		bool same = i > 0 && std::memcmp(&positions[order[i]], &positions[order[i - 1]], sizeof(DirectX::XMFLOAT3)) == 0;
+		position_id[order[i]] = same ? position_id[order[i - 1]] : order[i];
+	}
+}
+
+// Locks seam vertices, and the vertices of edges that do not have exactly two
+// triangles: the border of an open mesh and non-manifold edges.
+void FindLockedVertices(const std::vector<UINT> &indices, const std::vector<UINT> &position_id, std::vector<char> &locked) {
+	UINT vertex_cnt = static_cast<UINT>(position_id.size());
+	std::vector<UINT> group_size(vertex_cnt, 0);
+	for (UINT v = 0; v < vertex_cnt; ++v)
+		++group_size[position_id[v]];
+
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		for (int k = 0; k < 3; ++k) {
+			uint64_t a = position_id[indices[t + k]];
+			uint64_t b = position_id[indices[t + (k + 1) % 3]];
+			edges.push_back(a < b ? (a << 32) | b : (b << 32) | a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+
+	std::vector<char> locked_position(vertex_cnt, 0);
+	for (size_t i = 0; i < edges.size();) {
+		size_t j = i;
+		while (j < edges.size() && edges[j] == edges[i])
+			++j;
+		if (j - i != 2) {
+			locked_position[edges[i] >> 32] = 1;
+			locked_position[edges[i] & 0xffffffff] = 1;
+		}
+		i = j;
+	}
+
+	locked.resize(vertex_cnt);
+	for (UINT v = 0; v < vertex_cnt; ++v)
+		locked[v] = group_size[position_id[v]] > 1 || locked_position[position_id[v]];
+}
+
+// Holds a mesh being simplified, so that a LOD chain can take snapshots of
+// one run on its way down instead of starting over for every level.
+class EdgeCollapser {
+public:
+	EdgeCollapser(const DirectX::XMFLOAT3 *first_position, size_t stride, UINT vertex_cnt, const UINT *indices, size_t index_cnt);
+
+	// Collapses until at most target_index_cnt indices are left or no
+	// collapse within max_error remains.  Returns the largest error so far.
+	float CollapseTo(size_t target_index_cnt, float max_error);
+
+	const std::vector<UINT>& Indices() const {
+		return indices_;
+	}
+
+private:
+	// Collapses an independent set of vertices (no two collapses share a
+	// triangle), cheapest first, then rebuilds the index list.  Returns the
+	// number of triangles removed.
+	size_t CollapsePass(size_t needed_cnt, float max_error);
+
+private:
+	Positions positions_;
+	UINT vertex_cnt_;
+	std::vector<UINT> indices_;
+	std::vector<UINT> position_id_;
+	std::vector<char> locked_;
+	std::vector<Quadric> quadrics_;	// on the first vertex at each position
+	float max_error_made_ = 0.0f;
+
+	std::vector<Collapse> best_;
+	std::vector<Collapse> collapses_;
+	std::vector<UINT> first_adjacent_;
+	std::vector<UINT> adjacency_;
+	std::vector<UINT> remap_;
+	std::vector<char> touched_;
+};
+
+EdgeCollapser::EdgeCollapser(const DirectX::XMFLOAT3 *first_position, size_t stride, UINT vertex_cnt, const UINT *indices, size_t index_cnt) :
+	positions_(first_position, stride), vertex_cnt_(vertex_cnt) {
+	for (size_t t = 0; t + 2 < index_cnt; t += 3) {
+		if (indices[t] != indices[t + 1] && indices[t] != indices[t + 2] && indices[t + 1] != indices[t + 2])
+			indices_.insert(indices_.end(), indices + t, indices + t + 3);
+	}
+
+	BuildPositionIds(positions_, vertex_cnt, position_id_);
+	FindLockedVertices(indices_, position_id_, locked_);
+
+	quadrics_.resize(vertex_cnt);
+	for (size_t t = 0; t < indices_.size(); t += 3) {
+		const UINT *tri = &indices_[t];
+		Vec3 n = Normal(positions_, tri[0], tri[1], tri[2]);
+		double length = std::sqrt(Dot(n, n));
+		if (length == 0.0)
+			continue;
+		double a = n.x / length, b = n.y / length, c = n.z / length;
+		const DirectX::XMFLOAT3 &p = positions_[tri[0]];
+		double d = -(a * p.x + b * p.y + c * p.z);
+		for (int k = 0; k < 3; ++k)
+			quadrics_[position_id_[tri[k]]].AddPlane(a, b, c, d, 0.5 * length);
+	}
+
+	best_.resize(vertex_cnt);
+	first_adjacent_.resize(vertex_cnt + 1);
+	remap_.resize(vertex_cnt);
+	touched_.resize(vertex_cnt);
+}
+
+float EdgeCollapser::CollapseTo(size_t target_index_cnt, float max_error) {
+	while (indices_.size() > target_index_cnt) {
+		if (CollapsePass((indices_.size() - target_index_cnt + 2) / 3, max_error) == 0)
+			break;
+	}
+	return max_error_made_;
+}
+
+size_t EdgeCollapser::CollapsePass(size_t needed_cnt, float max_error) {
+	for (UINT v = 0; v < vertex_cnt_; ++v) {
+		best_[v].from = v;
+		best_[v].to = v;
+		best_[v].error = FLT_MAX;
+	}
+	for (size_t t = 0; t < indices_.size(); t += 3) {
+		for (int k = 0; k < 6; ++k) {
+			UINT from = indices_[t + k % 3];
+			UINT to = indices_[t + (k < 3 ? (k + 1) % 3 : (k + 2) % 3)];
+			if (locked_[from])
+				continue;
+			Quadric q = quadrics_[from];
+			q.Add(quadrics_[position_id_[to]]);
+			float error = static_cast<float>(std::sqrt(q.Evaluate(positions_[to]) / std::max(q.weight, DBL_MIN)));
+			if (error < best_[from].error) {
+				best_[from].to = to;
+				best_[from].error = error;
+			}
+		}
+	}
+
+	collapses_.clear();
+	for (UINT v = 0; v < vertex_cnt_; ++v) {
+		if (best_[v].to != v && best_[v].error <= max_error)
+			collapses_.push_back(best_[v]);
+	}
+	if (collapses_.empty())
+		return 0;
+	std::sort(collapses_.begin(), collapses_.end(), [](const Collapse &a, const Collapse &b) {
+		return a.error < b.error;
+	});
+
+	std::fill(first_adjacent_.begin(), first_adjacent_.end(), 0);
+	for (UINT v : indices_)
+		++first_adjacent_[v + 1];
+	for (UINT v = 0; v < vertex_cnt_; ++v)
+		first_adjacent_[v + 1] += first_adjacent_[v];
+	adjacency_.resize(indices_.size());
+	std::vector<UINT> fill(first_adjacent_.begin(), first_adjacent_.end() - 1);
+	for (size_t i = 0; i < indices_.size(); ++i)
+		adjacency_[fill[indices_[i]]++] = static_cast<UINT>(i / 3);
+
+	for (UINT v = 0; v < vertex_cnt_; ++v)
+		remap_[v] = v;
+	std::fill(touched_.begin(), touched_.end(), 0);
+
+	// Only the cheapest quarter is tried: further down, a collapse is more
+	// often allowed only because a cheaper neighbour was blocked this pass.
+	size_t tried_cnt = std::max<size_t>(collapses_.size() / 4, 1);
+	size_t removed_cnt = 0;
+	for (size_t c = 0; c < tried_cnt && removed_cnt < needed_cnt; ++c) {
+		const Collapse &collapse = collapses_[c];
+		if (touched_[collapse.from] || touched_[collapse.to])
+			continue;
+
+		// Moving from onto to must not turn any remaining triangle over.
+		bool flips = false;
+		size_t dying_cnt = 0;
+		for (UINT i = first_adjacent_[collapse.from]; i < first_adjacent_[collapse.from + 1] && !flips; ++i) {
+			const UINT *tri = &indices_[3 * static_cast<size_t>(adjacency_[i])];
+			if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+				++dying_cnt;
+				continue;
+			}
+			UINT moved[3];
+			for (int k = 0; k < 3; ++k)
+				moved[k] = tri[k] == collapse.from ? collapse.to : tri[k];
+			flips = Dot(Normal(positions_, tri[0], tri[1], tri[2]), Normal(positions_, moved[0], moved[1], moved[2])) <= 0.0;
+		}
+		if (flips)
+			continue;
+
+		remap_[collapse.from] = collapse.to;
+		quadrics_[position_id_[collapse.to]].Add(quadrics_[collapse.from]);
+		for (UINT i = first_adjacent_[collapse.from]; i < first_adjacent_[collapse.from + 1]; ++i) {
+			const UINT *tri = &indices_[3 * static_cast<size_t>(adjacency_[i])];
+			touched_[tri[0]] = touched_[tri[1]] = touched_[tri[2]] = 1;
+		}
+		max_error_made_ = std::max(max_error_made_, collapse.error);
+		removed_cnt += dying_cnt;
+	}
+	if (removed_cnt == 0)
+		return 0;
+
+	size_t kept = 0;
+	for (size_t t = 0; t < indices_.size(); t += 3) {
+		UINT a = remap_[indices_[t]], b = remap_[indices_[t + 1]], c = remap_[indices_[t + 2]];
+		if (a == b || a == c || b == c)
+			continue;
+		indices_[kept++] = a;
+		indices_[kept++] = b;
+		indices_[kept++] = c;
+	}
+	indices_.resize(kept);
+	return removed_cnt;
+}
+
+}
+
+float MeshSimplifier::Simplify(const DirectX::XMFLOAT3 *positions, size_t stride, UINT vertex_cnt,
+	const UINT *indices, size_t index_cnt, size_t target_index_cnt, float max_error,
+	std::vector<UINT> &out_indices) {
+	PROFILE_ZONE("MeshSimplifier::Simplify");
+
+	EdgeCollapser collapser(positions, stride, vertex_cnt, indices, index_cnt);
+	float error = collapser.CollapseTo(target_index_cnt, max_error);
+	out_indices = collapser.Indices();
+	return error;
+}
+
+void MeshSimplifier::BuildLodChain(const DirectX::XMFLOAT3 *positions, size_t stride, UINT vertex_cnt,
+	const UINT *indices, size_t index_cnt, const std::vector<float> &ratios,
+	std::vector<UINT> &lod_indices, std::vector<Lod> &lods) {
+	PROFILE_ZONE("MeshSimplifier::BuildLodChain");
+
+	// One run down to the smallest ratio, taking each level on the way.
+	std::vector<float> sorted(ratios);
+	std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+
+	lod_indices.clear();
+	lods.clear();
+	EdgeCollapser collapser(positions, stride, vertex_cnt, indices, index_cnt);
+	std::vector<UINT> level;
+	for (float ratio : sorted) {
+		size_t target = 3 * static_cast<size_t>(index_cnt / 3 * std::min(std::max(ratio, 0.0f), 1.0f));
+		Lod lod;
+		lod.ratio = ratio;
+		lod.error = collapser.CollapseTo(target, FLT_MAX);
+
+		// As in MeshOptimizer::Optimize(), a level that comes out of
+		// OptimizeVertexCache() worse keeps its order.
+		level = collapser.Indices();
+		MeshOptimizer::OptimizeVertexCache(level.data(), level.size(), vertex_cnt);
+		if (MeshOptimizer::SimulateCache(level.data(), level.size(), vertex_cnt).transform_cnt >
+			MeshOptimizer::SimulateCache(collapser.Indices().data(), level.size(), vertex_cnt).transform_cnt)
+			level = collapser.Indices();
+		lod.index_offset = static_cast<UINT>(lod_indices.size());
+		lod.index_cnt = static_cast<UINT>(level.size());
+		lod_indices.insert(lod_indices.end(), level.begin(), level.end());
+		lods.push_back(lod);
+	}
+}
+
+UINT MeshSimplifier::SelectLod(const std::vector<Lod> &lods, float distance, float fov_y, float screen_height,
+	float max_error_pixels) {
+	// Pixels covered by one model unit at that distance.
+	float pixels_per_unit = screen_height / (2.0f * std::tan(0.5f * fov_y) * std::max(distance, FLT_MIN));
+
+	UINT selected = 0;
+	while (selected + 1 < lods.size() && lods[selected + 1].error * pixels_per_unit <= max_error_pixels)
+		++selected;
+	return selected;
+}
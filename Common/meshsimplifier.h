@@ -0,0 +1,63 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include"geometrygenerator.h"
+#include<cstddef>
+#include<vector>
+
+// Reduces triangle meshes with Garland and Heckbert's quadric error metric.
+// Each step collapses a vertex onto a neighbour (a half-edge collapse), so a
+// simplified mesh only drops triangles and uses a subset of the original
+// vertices: every level of a LOD chain can share one vertex buffer.
+//
+// Vertices on a border of the mesh or on a seam (several vertices at one
+// position with different normals or texture coordinates) never move, so
+// seams stay closed at every level.
+class MeshSimplifier {
+public:
+	// One level of a LOD chain: a range of the chain's index list.
+	struct Lod {
+		UINT index_offset = 0;
+		UINT index_cnt = 0;
+		float ratio = 1.0f;		// of the original triangles asked for
+		float error = 0.0f;		// in model units; see Simplify()
+	};
+
+	// Collapses edges, cheapest first, until at most target_index_cnt indices
+	// are left or the next collapse would cost more than max_error.  The
+	// error of a collapse is the area-weighted RMS distance of the new
+	// position from the planes of the original triangles around it; the
+	// return value is the largest error of any collapse made.  The output
+	// indexes the input vertices; positions points at the first vertex's
+	// position and stride is the size of a vertex.
+	static float Simplify(const DirectX::XMFLOAT3 *positions, size_t stride, UINT vertex_cnt,
+		const UINT *indices, size_t index_cnt, size_t target_index_cnt, float max_error,
+		std::vector<UINT> &out_indices);
+
+	// Builds a level for each ratio (1 is the mesh itself), largest first,
+	// and appends its indices, ordered for the vertex cache unless that makes
+	// them worse, to lod_indices.
+	static void BuildLodChain(const DirectX::XMFLOAT3 *positions, size_t stride, UINT vertex_cnt,
+		const UINT *indices, size_t index_cnt, const std::vector<float> &ratios,
+		std::vector<UINT> &lod_indices, std::vector<Lod> &lods);
+
+	template<class Vertex>
+	static void BuildLodChain(const std::vector<Vertex> &vertices, const std::vector<UINT> &indices,
+		const std::vector<float> &ratios, std::vector<UINT> &lod_indices, std::vector<Lod> &lods) {
+		BuildLodChain(vertices.empty() ? nullptr : &vertices[0].position, sizeof(Vertex), static_cast<UINT>(vertices.size()),
+			indices.data(), indices.size(), ratios, lod_indices, lods);
+	}
+
+	static void BuildLodChain(const GeometryGenerator::MeshData &mesh_data, const std::vector<float> &ratios,
+		std::vector<UINT> &lod_indices, std::vector<Lod> &lods) {
+		BuildLodChain(mesh_data.vertices, mesh_data.indices, ratios, lod_indices, lods);
+	}
+
+	// Picks the coarsest level whose error covers at most max_error_pixels on
+	// a screen screen_height pixels high, seen from distance (in model units)
+	// through a vertical field of view of fov_y radians.
+	static UINT SelectLod(const std::vector<Lod> &lods, float distance, float fov_y, float screen_height,
+		float max_error_pixels = 1.0f);
+};
+
+#endif
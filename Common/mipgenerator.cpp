@@ -0,0 +1,428 @@
+#include"mipgenerator.h"
+#include"blockcompression.h"
+#include"mappedfile.h"
+#include"threadpool.h"
+#include<DirectXMath.h>
+#include<algorithm>
+#include<cmath>
+#include<cstring>
+#include<fstream>
+#include<functional>
+using namespace DirectX;
+
+namespace {
+
+const uint32_t kFourCCDX10 = MAKEFOURCC('D', 'X', '1', '0');
+const uint32_t kFlagsMipMapCount = 0x00020000;	// DDSD_MIPMAPCOUNT
+const uint32_t kCapsComplex = 0x00000008;		// DDSCAPS_COMPLEX
+const uint32_t kCapsTexture = 0x00001000;		// DDSCAPS_TEXTURE
+const uint32_t kCapsMipMap = 0x00400000;		// DDSCAPS_MIPMAP
+
+// 8-bit sRGB to linear, and linear in 1/65535 steps back to 8-bit sRGB; the
+// darkest sRGB step is still twenty of those.
+struct SRGBTables {
+	float to_linear[256];
+	uint8_t from_linear[65536];
+
+	SRGBTables() {
+		for (int i = 0; i < 256; ++i) {
+			float s = i / 255.0f;
+			to_linear[i] = s <= 0.04045f ? s / 12.92f : std::pow((s + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i < 65536; ++i) {
+			float l = i / 65535.0f;
+			float s = l <= 0.0031308f ? l*12.92f : 1.055f*std::pow(l, 1.0f/2.4f) - 0.055f;
+			from_linear[i] = static_cast<uint8_t>(std::min(std::max(s*255.0f + 0.5f, 0.0f), 255.0f));
+		}
+	}
+};
+
+const SRGBTables &GetSRGBTables() {
+	static const SRGBTables tables;
+	return tables;
+}
+
+bool IsSRGB(DXGI_FORMAT format) {
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// How a format's texels are stored.
+enum Layout {
+	kUnsupported,
+	kRGBA,
+	kBGRA,
+	kBGRX,
+	kBlocks
+};
+
+Layout GetLayout(DXGI_FORMAT format) {
+	switch (format) {
+	case DXGI_FORMAT_R8G8B8A8_UNORM:
+	case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+		return kRGBA;
+	case DXGI_FORMAT_B8G8R8A8_UNORM:
+	case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+		return kBGRA;
+	case DXGI_FORMAT_B8G8R8X8_UNORM:
+	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+		return kBGRX;
+	default:
+		return BlockCompression::BlockBytes(format) != 0 ? kBlocks : kUnsupported;
+	}
+}
+
+// The source texels and weights of each texel of the smaller level, along
+// one axis.
+struct Taps {
+	std::vector<UINT> first;	// texel i's taps are [first[i], first[i + 1])
+	std::vector<UINT> source;
+	std::vector<float> weight;
+};
+
+float BesselI0(float x) {
+	float sum = 1.0f, term = 1.0f;
+	for (int k = 1; k < 32 && term > 1e-7f*sum; ++k) {
+		float t = x / (2.0f*k);
+		term *= t*t;
+		sum += term;
+	}
+	return sum;
+}
+
+// x in texels of the smaller level.
+float KaiserSinc(float x, const MipGenerator::Desc &desc) {
+	if (std::fabs(x) >= desc.kaiser_radius)
+		return 0.0f;
+	float t = x / desc.kaiser_radius;
+	float window = BesselI0(desc.kaiser_alpha*std::sqrt(1.0f - t*t)) / BesselI0(desc.kaiser_alpha);
+	float sinc = x == 0.0f ? 1.0f : std::sin(XM_PI*x) / (XM_PI*x);
+	return sinc*window;
+}
+
+void BuildTaps(UINT src_n, UINT dst_n, const MipGenerator::Desc &desc, Taps &taps) {
+	float scale = static_cast<float>(src_n) / dst_n;
+	int n = static_cast<int>(src_n);
+	taps.first.assign(1, 0);
+	taps.source.clear();
+	taps.weight.clear();
+	for (UINT i = 0; i < dst_n; ++i) {
+		// Source texel j covers [j, j + 1).
+		float center = (i + 0.5f)*scale;
+		float lo = i*scale, hi = (i + 1)*scale;
+		if (desc.filter == MipGenerator::kKaiser) {
+			lo = center - desc.kaiser_radius*scale;
+			hi = center + desc.kaiser_radius*scale;
+		}
+
+		size_t start = taps.weight.size();
+		float sum = 0.0f;
+		for (int j = static_cast<int>(std::floor(lo)); j < static_cast<int>(std::ceil(hi)); ++j) {
+			float w = desc.filter == MipGenerator::kKaiser ? KaiserSinc((j + 0.5f - center) / scale, desc) :
+				std::min(hi, j + 1.0f) - std::max(lo, static_cast<float>(j));
+			if (w == 0.0f)
+				continue;
+			int s = desc.wrap ? ((j % n) + n) % n : std::min(std::max(j, 0), n - 1);
+			taps.source.push_back(static_cast<UINT>(s));
+			taps.weight.push_back(w);
+			sum += w;
+		}
+		for (size_t k = start; k < taps.weight.size(); ++k)
+			taps.weight[k] /= sum;
+		taps.first.push_back(static_cast<UINT>(taps.weight.size()));
+	}
+}
+
+// Filters a row of RGBA floats along x.
+void FilterRow(const float *src, const Taps &taps, UINT dst_w, float *dst) {
+	for (UINT x = 0; x < dst_w; ++x) {
+#if defined(_XM_SSE_INTRINSICS_)
+		__m128 sum = _mm_setzero_ps();
+		for (UINT k = taps.first[x]; k < taps.first[x + 1]; ++k)
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + 4*taps.source[k]), _mm_set1_ps(taps.weight[k])));
+		_mm_storeu_ps(dst + 4*x, sum);
+#else
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (UINT k = taps.first[x]; k < taps.first[x + 1]; ++k) {
+			for (int c = 0; c < 4; ++c)
+				sum[c] += src[4*taps.source[k] + c]*taps.weight[k];
+		}
+		memcpy(dst + 4*x, sum, sizeof(sum));
+#endif
+	}
+}
+
+// dst[i] += src[i]*w for i in [0, cnt), cnt a multiple of 4.
+void AddScaledRow(const float *src, float w, size_t cnt, float *dst) {
+	size_t i = 0;
+#if defined(_XM_SSE_INTRINSICS_)
+	__m128 W = _mm_set1_ps(w);
+	for (; i < cnt; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), W)));
+#endif
+	for (; i < cnt; ++i)
+		dst[i] += src[i]*w;
+}
+
+// Calls rows(first, last) over bands of [0, row_cnt), on the pool if there
+// is one.
+void ForEachRowBand(UINT row_cnt, ThreadPool *pool, const std::function<void(UINT, UINT)> &rows) {
+	if (!pool || pool->ThreadCount() == 1 || row_cnt < 2) {
+		rows(0, row_cnt);
+		return;
+	}
+
+	// A few bands per thread, so one slow band does not hold up the rest.
+	UINT band_cnt = std::min(row_cnt, pool->ThreadCount() * 4);
+	UINT rows_per_band = (row_cnt + band_cnt - 1) / band_cnt;
+	pool->ParallelFor(band_cnt, [&](UINT band) {
+		UINT first = band * rows_per_band;
+		UINT last = std::min(row_cnt, first + rows_per_band);
+		if (first < last)
+			rows(first, last);
+	});
+}
+
+// Filters a level of linear RGBA floats into the next, along x and then y.
+void Downsample(const std::vector<float> &src, UINT src_w, UINT src_h, UINT dst_w, UINT dst_h,
+	const MipGenerator::Desc &desc, ThreadPool *pool, std::vector<float> &scratch, std::vector<float> &dst) {
+	Taps taps_x, taps_y;
+	BuildTaps(src_w, dst_w, desc, taps_x);
+	BuildTaps(src_h, dst_h, desc, taps_y);
+
+	scratch.resize(4*static_cast<size_t>(dst_w)*src_h);
+	ForEachRowBand(src_h, pool, [&](UINT first, UINT last) {
+		for (UINT y = first; y < last; ++y)
+			FilterRow(src.data() + 4*static_cast<size_t>(src_w)*y, taps_x, dst_w, scratch.data() + 4*static_cast<size_t>(dst_w)*y);
+	});
+
+	size_t row_floats = 4*static_cast<size_t>(dst_w);
+	dst.assign(row_floats*dst_h, 0.0f);
+	ForEachRowBand(dst_h, pool, [&](UINT first, UINT last) {
+		for (UINT y = first; y < last; ++y) {
+			for (UINT k = taps_y.first[y]; k < taps_y.first[y + 1]; ++k)
+				AddScaledRow(scratch.data() + row_floats*taps_y.source[k], taps_y.weight[k], row_floats, dst.data() + row_floats*y);
+		}
+	});
+}
+
+uint8_t ToUnorm8(float v) {
+	return static_cast<uint8_t>(std::min(std::max(v, 0.0f), 1.0f)*255.0f + 0.5f);
+}
+
+// Copies rows of 4-byte texels between pitches, swapping red and blue if
+// asked, and making alpha opaque if asked.
+void CopyTexels(const uint8_t *src, size_t src_pitch, UINT width, UINT height, bool swap_red_blue, bool opaque,
+	uint8_t *dst, size_t dst_pitch) {
+	for (UINT y = 0; y < height; ++y) {
+		const uint8_t *in = src + y*src_pitch;
+		uint8_t *out = dst + y*dst_pitch;
+		memcpy(out, in, 4*static_cast<size_t>(width));
+		if (!swap_red_blue && !opaque)
+			continue;
+		for (UINT x = 0; x < width; ++x) {
+			if (swap_red_blue)
+				std::swap(out[4*x], out[4*x + 2]);
+			if (opaque)
+				out[4*x + 3] = 255;
+		}
+	}
+}
+
+}
+
+UINT MipGenerator::LevelCount(UINT width, UINT height) {
+	UINT cnt = 1;
+	for (UINT size = std::max(width, height); size > 1; size /= 2)
+		++cnt;
+	return cnt;
+}
+
+void MipGenerator::Generate(const uint8_t *rgba, size_t pitch, UINT width, UINT height, const Desc &desc,
+	std::vector<Level> &levels, ThreadPool *pool) {
+	const SRGBTables &tables = GetSRGBTables();
+	levels.resize(LevelCount(width, height));
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].rgba.resize(4*static_cast<size_t>(width)*height);
+	CopyTexels(rgba, pitch, width, height, false, false, levels[0].rgba.data(), 4*static_cast<size_t>(width));
+
+	std::vector<float> curr(levels[0].rgba.size()), next, scratch;
+	ForEachRowBand(height, pool, [&](UINT first, UINT last) {
+		for (size_t i = 4*static_cast<size_t>(width)*first; i < 4*static_cast<size_t>(width)*last; i += 4) {
+			const uint8_t *texel = &levels[0].rgba[i];
+			for (int c = 0; c < 3; ++c)
+				curr[i + c] = desc.srgb ? tables.to_linear[texel[c]] : texel[c] / 255.0f;
+			curr[i + 3] = texel[3] / 255.0f;
+		}
+	});
+
+	for (size_t l = 1; l < levels.size(); ++l) {
+		const Level &above = levels[l - 1];
+		Level &level = levels[l];
+		level.width = std::max(above.width / 2, 1u);
+		level.height = std::max(above.height / 2, 1u);
+		Downsample(curr, above.width, above.height, level.width, level.height, desc, pool, scratch, next);
+
+		level.rgba.resize(4*static_cast<size_t>(level.width)*level.height);
+		ForEachRowBand(level.height, pool, [&](UINT first, UINT last) {
+			for (size_t i = 4*static_cast<size_t>(level.width)*first; i < 4*static_cast<size_t>(level.width)*last; i += 4) {
+				uint8_t *texel = &level.rgba[i];
+				for (int c = 0; c < 3; ++c) {
+					texel[c] = desc.srgb ?
+						tables.from_linear[static_cast<int>(std::min(std::max(next[i + c], 0.0f), 1.0f)*65535.0f + 0.5f)] :
+						ToUnorm8(next[i + c]);
+				}
+				texel[3] = ToUnorm8(next[i + 3]);
+			}
+		});
+		curr.swap(next);
+	}
+}
+
+HRESULT MipGenerator::GenerateDDS(const uint8_t *dds, size_t size, const Desc &desc, std::vector<uint8_t> &out,
+	ThreadPool *pool) {
+	const DDS_HEADER *header = nullptr;
+	size_t offset = 0;
+	HRESULT hr = ParseDDSHeader(dds, size, &header, &offset);
+	DDS_TEXTURE_INFO info;
+	if (SUCCEEDED(hr))
+		hr = GetDDSTextureInfo(header, &info);
+	if (FAILED(hr))
+		return hr;
+
+	Layout layout = GetLayout(info.format);
+	if (info.resourceDimension != DDS_DIMENSION_TEXTURE2D || layout == kUnsupported)
+		return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+	DXGI_FORMAT out_format = desc.mark_srgb ? MakeSRGB(info.format) : info.format;
+	Desc level_desc = desc;
+	level_desc.srgb = (desc.srgb || IsSRGB(info.format) || IsSRGB(out_format)) &&
+		info.format != DXGI_FORMAT_BC4_UNORM && info.format != DXGI_FORMAT_BC4_TYPELESS &&
+		info.format != DXGI_FORMAT_BC5_UNORM && info.format != DXGI_FORMAT_BC5_TYPELESS;
+
+	// The slices of the input one after the other, each with its chain.
+	size_t in_slice_bytes = 0;
+	size_t width = info.width, height = info.height;
+	for (uint32_t level = 0; level < info.mipCount; ++level) {
+		size_t num_bytes = 0;
+		GetSurfaceInfo(width, height, info.format, &num_bytes, nullptr, nullptr);
+		in_slice_bytes += num_bytes;
+		width = std::max<size_t>(width / 2, 1);
+		height = std::max<size_t>(height / 2, 1);
+	}
+	if ((size - offset) / info.arraySize < in_slice_bytes)
+		return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+
+	UINT level_cnt = LevelCount(info.width, info.height);
+	std::vector<size_t> level_bytes(level_cnt), row_bytes(level_cnt);
+	size_t out_slice_bytes = 0;
+	width = info.width;
+	height = info.height;
+	for (UINT level = 0; level < level_cnt; ++level) {
+		GetSurfaceInfo(width, height, info.format, &level_bytes[level], &row_bytes[level], nullptr);
+		out_slice_bytes += level_bytes[level];
+		width = std::max<size_t>(width / 2, 1);
+		height = std::max<size_t>(height / 2, 1);
+	}
+
+	// The headers, with the DX10 one added when the format has no other way
+	// of saying it is sRGB.
+	DDS_HEADER out_header = *header;
+	out_header.flags |= kFlagsMipMapCount;
+	out_header.mipMapCount = level_cnt;
+	out_header.caps |= kCapsComplex | kCapsTexture | kCapsMipMap;
+
+	bool has_dx10 = (header->ddspf.flags & DDS_FOURCC) && header->ddspf.fourCC == kFourCCDX10;
+	DDS_HEADER_DXT10 dx10;
+	memset(&dx10, 0, sizeof(dx10));
+	if (has_dx10) {
+		memcpy(&dx10, dds + sizeof(uint32_t) + sizeof(DDS_HEADER), sizeof(dx10));
+	} else if (out_format != info.format) {
+		memset(&out_header.ddspf, 0, sizeof(out_header.ddspf));
+		out_header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+		out_header.ddspf.flags = DDS_FOURCC;
+		out_header.ddspf.fourCC = kFourCCDX10;
+		dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+		dx10.miscFlag = info.isCubeMap ? DDS_RESOURCE_MISC_TEXTURECUBE : 0;
+		dx10.arraySize = info.isCubeMap ? info.arraySize / 6 : info.arraySize;
+		has_dx10 = true;
+	}
+	dx10.dxgiFormat = out_format;
+
+	size_t header_bytes = sizeof(uint32_t) + sizeof(DDS_HEADER) + (has_dx10 ? sizeof(DDS_HEADER_DXT10) : 0);
+	out.resize(header_bytes + out_slice_bytes*info.arraySize);
+	memcpy(out.data(), &DDS_MAGIC, sizeof(uint32_t));
+	memcpy(out.data() + sizeof(uint32_t), &out_header, sizeof(DDS_HEADER));
+	if (has_dx10)
+		memcpy(out.data() + sizeof(uint32_t) + sizeof(DDS_HEADER), &dx10, sizeof(dx10));
+
+	std::vector<uint8_t> top(4*static_cast<size_t>(info.width)*info.height);
+	std::vector<Level> levels;
+	for (uint32_t slice = 0; slice < info.arraySize; ++slice) {
+		const uint8_t *in = dds + offset + in_slice_bytes*slice;
+		uint8_t *bits = out.data() + header_bytes + out_slice_bytes*slice;
+
+		// The top level is kept as it was, and the rest made from it.
+		memcpy(bits, in, level_bytes[0]);
+		DecodeLevel(info.format, in, row_bytes[0], info.width, info.height, top.data(), 4*info.width, pool);
+		Generate(top.data(), 4*info.width, info.width, info.height, level_desc, levels, pool);
+
+		bits += level_bytes[0];
+		for (UINT l = 1; l < level_cnt; ++l) {
+			const Level &level = levels[l];
+			EncodeLevel(info.format, level.rgba.data(), 4*level.width, level.width, level.height, bits, row_bytes[l], pool);
+			bits += level_bytes[l];
+		}
+	}
+	return S_OK;
+}
+
+HRESULT MipGenerator::GenerateDDSFile(const std::string &in_filename, const std::string &out_filename,
+	const Desc &desc, ThreadPool *pool) {
+	MappedFile in;
+	if (!in.Open(in_filename))
+		return E_FAIL;
+	std::vector<uint8_t> out;
+	HRESULT hr = GenerateDDS(in.Data(), in.Size(), desc, out, pool);
+	// Closed first, so the output may replace the input.
+	in.Close();
+	if (FAILED(hr))
+		return hr;
+
+	std::ofstream fout(out_filename, std::ios::binary);
+	fout.write(reinterpret_cast<const char*>(out.data()), out.size());
+	return fout ? S_OK : E_FAIL;
+}
+
+bool MipGenerator::DecodeLevel(DXGI_FORMAT format, const uint8_t *bits, size_t pitch, UINT width, UINT height,
+	uint8_t *rgba, size_t rgba_pitch, ThreadPool *pool) {
+	Layout layout = GetLayout(format);
+	if (layout == kBlocks)
+		return BlockCompression::Decode(format, bits, pitch, width, height, rgba, rgba_pitch, pool);
+	if (layout == kUnsupported)
+		return false;
+	CopyTexels(bits, pitch, width, height, layout != kRGBA, layout == kBGRX, rgba, rgba_pitch);
+	return true;
+}
+
+bool MipGenerator::EncodeLevel(DXGI_FORMAT format, const uint8_t *rgba, size_t rgba_pitch, UINT width, UINT height,
+	uint8_t *bits, size_t pitch, ThreadPool *pool) {
+	Layout layout = GetLayout(format);
+	if (layout == kBlocks)
+		return BlockCompression::Encode(format, rgba, rgba_pitch, width, height, bits, pitch, pool);
+	if (layout == kUnsupported)
+		return false;
+	CopyTexels(rgba, rgba_pitch, width, height, layout != kRGBA, false, bits, pitch);
+	return true;
+}
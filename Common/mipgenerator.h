@@ -0,0 +1,69 @@
+#ifndef MIPGENERATOR_H
+#define MIPGENERATOR_H
+
+#include"DDSHeader.h"
+#include<cstddef>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+class ThreadPool;
+
+// Builds full mip chains on the CPU, for textures that ship with one level
+// and are loaded where the device context cannot GenerateMips() them.
+//
+// Each level is filtered from the one above it in float, so the error of
+// 8-bit levels does not build up down the chain.  Sizes need not be powers of
+// two: a level is half the one above, rounded down, and each of its texels
+// weighs the source texels under its footprint, however they fall.  Colour
+// is filtered in linear light when it is sRGB-encoded, which keeps the
+// smaller levels from darkening; alpha always is linear.
+class MipGenerator {
+public:
+	enum Filter {
+		kBox,		// the average of the texels covered, in part or whole
+		kKaiser		// a Kaiser-windowed sinc: sharper, at a little ringing
+	};
+
+	struct Desc {
+		Filter filter = kBox;
+		bool srgb = true;			// colour is sRGB-encoded; _SRGB formats always are, BC4 and BC5 never
+		bool mark_srgb = false;		// write GenerateDDS()'s output with the _SRGB format
+		bool wrap = false;			// the texture tiles, so filters wrap around its edges
+		float kaiser_alpha = 4.0f;
+		float kaiser_radius = 2.0f;	// in texels of the smaller level
+	};
+
+	// An RGBA8 level, rows 4*width bytes apart.
+	struct Level {
+		UINT width;
+		UINT height;
+		std::vector<uint8_t> rgba;
+	};
+
+	// Levels down to 1x1, counting the top one.
+	static UINT LevelCount(UINT width, UINT height);
+
+	// Fills levels with the whole chain of an RGBA8 image, starting with a
+	// copy of it.  With a pool, bands of rows run on all its threads.
+	static void Generate(const uint8_t *rgba, size_t pitch, UINT width, UINT height, const Desc &desc,
+		std::vector<Level> &levels, ThreadPool *pool = nullptr);
+
+	// Rewrites a DDS file in memory with the full chain under each array
+	// slice's top level, which is kept as it is.  2D textures, arrays and cubes
+	// of R8G8B8A8, B8G8R8A8 and the formats BlockCompression handles are
+	// supported; the levels under the top one in the input are replaced.
+	static HRESULT GenerateDDS(const uint8_t *dds, size_t size, const Desc &desc, std::vector<uint8_t> &out,
+		ThreadPool *pool = nullptr);
+	static HRESULT GenerateDDSFile(const std::string &in_filename, const std::string &out_filename, const Desc &desc,
+		ThreadPool *pool = nullptr);
+
+	// Convert one level of a format GenerateDDS() handles to RGBA8 and back.
+	// Both return false for any other format.
+	static bool DecodeLevel(DXGI_FORMAT format, const uint8_t *bits, size_t pitch, UINT width, UINT height,
+		uint8_t *rgba, size_t rgba_pitch, ThreadPool *pool = nullptr);
+	static bool EncodeLevel(DXGI_FORMAT format, const uint8_t *rgba, size_t rgba_pitch, UINT width, UINT height,
+		uint8_t *bits, size_t pitch, ThreadPool *pool = nullptr);
+};
+
+#endif
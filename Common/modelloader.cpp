@@ -0,0 +1,320 @@
+#include"modelloader.h"
+#include"threadpool.h"
+#include"profiler.h"
+#include<algorithm>
+#include<cerrno>
+#include<cmath>
+#include<cstdint>
+#include<cstdlib>
+#include<cstring>
+#include<fstream>
+#include<memory>
+#include<sstream>
+#if defined(_MSC_VER)
+#include<intrin.h>
+#endif
+
+namespace {
+
+static_assert(sizeof(ModelLoader::Vertex) == 6 * sizeof(float), "Vertices are parsed as a flat array of floats.");
+
+// Powers of ten that are exact in a float.
+const float kPow10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+const int kMaxExactPow10 = 10;
+const uint64_t kMaxExactMantissa = 1 << 24;
+
+// Whitespace as isspace() sees it in the "C" locale.
+inline bool IsSpace(char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool IsDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+#if defined(_XM_SSE_INTRINSICS_)
+// Bit i is set if p[i] is whitespace.
+inline uint32_t SpaceMask(const char *p) {
+	__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+	__m128i space = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+	__m128i control = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('\r' + 1)));
+	return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(space, control)));
+}
+
+inline uint32_t FirstSetBit(uint32_t mask) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+}
+
+inline uint32_t PopCount(uint32_t mask) {
+	mask = mask - ((mask >> 1) & 0x55555555);
+	mask = (mask & 0x33333333) + ((mask >> 2) & 0x33333333);
+	return (((mask + (mask >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+#endif
+
+const char* SkipSpace(const char *p, const char *end) {
+#if defined(_XM_SSE_INTRINSICS_)
+	for (; end - p >= 16; p += 16) {
+		uint32_t mask = ~SpaceMask(p) & 0xffff;
+		if (mask)
+			return p + FirstSetBit(mask);
+	}
+#endif
+	while (p != end && IsSpace(*p))
+		++p;
+	return p;
+}
+
+const char* SkipToken(const char *p, const char *end) {
+#if defined(_XM_SSE_INTRINSICS_)
+	for (; end - p >= 16; p += 16) {
+		uint32_t mask = SpaceMask(p);
+		if (mask)
+			return p + FirstSetBit(mask);
+	}
+#endif
+	while (p != end && !IsSpace(*p))
+		++p;
+	return p;
+}
+
+// Counts the tokens in [p, end); p must start a token or be whitespace.
+size_t CountTokens(const char *p, const char *end) {
+	size_t count = 0;
+	bool after_space = true;
+#if defined(_XM_SSE_INTRINSICS_)
+	// A token starts at every non-space byte that follows a space.
+	uint32_t prev_space = 1;
+	for (; end - p >= 16; p += 16) {
+		uint32_t space = SpaceMask(p);
+		count += PopCount(~space & ((space << 1) | prev_space) & 0xffff);
+		prev_space = space >> 15;
+	}
+	after_space = prev_space != 0;
+#endif
+	for (; p != end; ++p) {
+		bool space = IsSpace(*p);
+		if (!space && after_space)
+			++count;
+		after_space = space;
+	}
+	return count;
+}
+
+// Returns the next token in [p, end) and moves p past it.
+std::string NextToken(const char *&p, const char *end) {
+	const char *begin = SkipSpace(p, end);
+	p = SkipToken(begin, end);
+	return std::string(begin, p);
+}
+
+bool ParseFloatSlow(const char *begin, const char *end, float &value) {
+	char buffer[64];
+	size_t length = end - begin;
+	if (length >= sizeof(buffer))
+		return false;
+
+	std::memcpy(buffer, begin, length);
+	buffer[length] = '\0';
+	char *parsed_end = nullptr;
+	errno = 0;
+	value = std::strtof(buffer, &parsed_end);
+	// Like operator>>, fail on overflow but keep denormals.
+	return parsed_end == buffer + length && !(errno == ERANGE && std::fabs(value) == HUGE_VALF);
+}
+
+// Parses the token [begin, end) the way operator>> parses a float.  A decimal
+// with at most 24 bits of digits and a power of ten up to 10 is a single
+// correctly rounded float multiply or divide; everything else is rare and
+// goes through strtof.
+bool ParseFloat(const char *begin, const char *end, float &value) {
+	const char *p = begin;
+	bool negative = false;
+	if (p != end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int exponent = 0;
+	int digit_cnt = 0;
+	for (; p != end && IsDigit(*p); ++p, ++digit_cnt)
+		mantissa = mantissa * 10 + (*p - '0');
+	if (p != end && *p == '.') {
+		for (++p; p != end && IsDigit(*p); ++p, ++digit_cnt, --exponent)
+			mantissa = mantissa * 10 + (*p - '0');
+	}
+	if (digit_cnt == 0 || digit_cnt > 18)
+		return ParseFloatSlow(begin, end, value);
+
+	if (p != end && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negative_exponent = false;
+		if (p != end && (*p == '-' || *p == '+'))
+			negative_exponent = *p++ == '-';
+		if (p == end || !IsDigit(*p))
+			return ParseFloatSlow(begin, end, value);
+
+		int e = 0;
+		for (; p != end && IsDigit(*p); ++p) {
+			if (e > 1000)
+				return ParseFloatSlow(begin, end, value);
+			e = e * 10 + (*p - '0');
+		}
+		exponent += negative_exponent ? -e : e;
+	}
+	if (p != end || mantissa > kMaxExactMantissa || exponent < -kMaxExactPow10 || exponent > kMaxExactPow10)
+		return ParseFloatSlow(begin, end, value);
+
+	float f = static_cast<float>(mantissa);
+	f = exponent < 0 ? f / kPow10[-exponent] : f * kPow10[exponent];
+	value = negative ? -f : f;
+	return true;
+}
+
+bool ParseUint(const char *begin, const char *end, UINT &value) {
+	const char *p = begin;
+	if (p != end && *p == '+')
+		++p;
+	if (p == end)
+		return false;
+
+	uint64_t v = 0;
+	for (; p != end; ++p) {
+		if (!IsDigit(*p))
+			return false;
+		v = v * 10 + (*p - '0');
+		if (v > UINT32_MAX)
+			return false;
+	}
+	value = static_cast<UINT>(v);
+	return true;
+}
+
+bool NextUint(const char *&p, const char *end, UINT &value) {
+	const char *begin = SkipSpace(p, end);
+	p = SkipToken(begin, end);
+	return ParseUint(begin, p, value);
+}
+
+// Parses exactly count tokens from [p, end) into out.
+template<class T>
+bool ParseTokens(const char *p, const char *end, T *out, size_t count, bool (*parse)(const char*, const char*, T&)) {
+	for (size_t i = 0; i < count; ++i) {
+		const char *begin = SkipSpace(p, end);
+		if (begin == end)
+			return false;
+		p = SkipToken(begin, end);
+		if (!parse(begin, p, out[i]))
+			return false;
+	}
+	return SkipSpace(p, end) == end;
+}
+
+template<class T>
+bool ParseList(const char *begin, const char *end, T *out, size_t count, ThreadPool *pool, bool (*parse)(const char*, const char*, T&)) {
+	if (!pool)
+		return ParseTokens(begin, end, out, count, parse);
+
+	// Chunks start after a newline, so none of them starts inside a token.
+	UINT chunk_cnt = 4 * pool->ThreadCount();
+	std::vector<const char*> bounds(chunk_cnt + 1, end);
+	bounds[0] = begin;
+	for (UINT i = 1; i < chunk_cnt; ++i) {
+		const char *p = std::max(begin + (end - begin) * i / chunk_cnt, bounds[i - 1]);
+		const void *newline = std::memchr(p, '\n', end - p);
+		bounds[i] = newline ? static_cast<const char*>(newline) + 1 : end;
+	}
+
+	std::vector<size_t> first(chunk_cnt + 1, 0);
+	pool->ParallelFor(chunk_cnt, [&](UINT i) {
+		first[i + 1] = CountTokens(bounds[i], bounds[i + 1]);
+	});
+	for (UINT i = 0; i < chunk_cnt; ++i)
+		first[i + 1] += first[i];
+	if (first[chunk_cnt] != count)
+		return false;
+
+	std::vector<char> chunk_ok(chunk_cnt, 0);
+	pool->ParallelFor(chunk_cnt, [&](UINT i) {
+		chunk_ok[i] = ParseTokens(bounds[i], bounds[i + 1], out + first[i], first[i + 1] - first[i], parse);
+	});
+	return std::find(chunk_ok.begin(), chunk_ok.end(), 0) == chunk_ok.end();
+}
+
+// A list runs up to its closing brace, or to the end of the text.
+const char* ListEnd(const char *p, const char *end) {
+	const void *brace = std::memchr(p, '}', end - p);
+	return brace ? static_cast<const char*>(brace) : end;
+}
+
+}
+
+bool ModelLoader::LoadTextModel(const std::string &filename, std::vector<Vertex> &vertices, std::vector<UINT> &indices) {
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+
+	fin.seekg(0, std::ios::end);
+	std::streamoff size = fin.tellg();
+	fin.seekg(0, std::ios::beg);
+	if (size <= 0)
+		return false;
+
+	std::vector<char> text(static_cast<size_t>(size));
+	if (!fin.read(text.data(), size))
+		return false;
+
+	return ParseTextModel(text.data(), text.size(), vertices, indices);
+}
+
+bool ModelLoader::LoadTextModel(std::istream &in, std::vector<Vertex> &vertices, std::vector<UINT> &indices) {
+	std::ostringstream buffer;
+	buffer << in.rdbuf();
+	std::string text = buffer.str();
+	return ParseTextModel(text.data(), text.size(), vertices, indices);
+}
+
+bool ModelLoader::ParseTextModel(const char *text, size_t size, std::vector<Vertex> &vertices, std::vector<UINT> &indices, UINT thread_cnt) {
+	PROFILE_ZONE("ModelLoader::ParseTextModel");
+
+	const char *p = text;
+	const char *end = text + size;
+
+	UINT vcount = 0;
+	UINT tcount = 0;
+	NextToken(p, end);
+	if (!NextUint(p, end, vcount))
+		return false;
+	NextToken(p, end);
+	if (!NextUint(p, end, tcount))
+		return false;
+	for (int i = 0; i < 4; ++i)
+		NextToken(p, end);
+
+	std::unique_ptr<ThreadPool> pool;
+	if (thread_cnt != 1 && (thread_cnt > 1 || size >= kParallelMinBytes)) {
+		pool.reset(new ThreadPool(thread_cnt));
+		if (pool->ThreadCount() == 1)
+			pool.reset();
+	}
+
+	vertices.resize(vcount);
+	const char *vertex_end = ListEnd(p, end);
+	float *floats = vcount ? &vertices[0].position.x : nullptr;
+	if (!ParseList(p, vertex_end, floats, 6 * static_cast<size_t>(vcount), pool.get(), ParseFloat))
+		return false;
+
+	p = vertex_end;
+	for (int i = 0; i < 3; ++i)
+		NextToken(p, end);
+
+	indices.resize(3 * static_cast<size_t>(tcount));
+	const char *index_end = ListEnd(p, end);
+	UINT *out = tcount ? indices.data() : nullptr;
+	return ParseList(p, index_end, out, indices.size(), pool.get(), ParseUint);
+}
@@ -0,0 +1,42 @@
+#ifndef MODELLOADER_H
+#define MODELLOADER_H
+
+#include"mathhelper.h"
+#include<cstddef>
+#include<istream>
+#include<string>
+#include<vector>
+
+// Reads the text models in the demos' Models/ directories (skull.txt,
+// car.txt): a vertex and a triangle count, then a position and normal per
+// vertex and three indices per triangle.
+//
+// The whole file is read at once and parsed without iostreams.  The numbers
+// come out bit for bit as operator>> reads them: short decimals, which is
+// nearly all of them, are converted exactly in float arithmetic and anything
+// else goes through strtof.
+class ModelLoader {
+public:
+	struct Vertex {
+		DirectX::XMFLOAT3 position;
+		DirectX::XMFLOAT3 normal;
+	};
+
+	// Models at least this large are parsed on every hardware thread.
+	static const size_t kParallelMinBytes = 1 << 20;
+
+	// Returns false if the file cannot be opened or ends early.
+	static bool LoadTextModel(const std::string &filename, std::vector<Vertex> &vertices, std::vector<UINT> &indices);
+
+	// Reads the rest of the stream.
+	static bool LoadTextModel(std::istream &in, std::vector<Vertex> &vertices, std::vector<UINT> &indices);
+
+	// Parses a model held in memory.  thread_cnt 1 parses on the calling
+	// thread and 0 picks serial or parallel by the size of the text.  A
+	// parallel parse cuts the lists into line-aligned chunks, counts the
+	// numbers in each to find where its output starts, then parses them all
+	// at once.
+	static bool ParseTextModel(const char *text, size_t size, std::vector<Vertex> &vertices, std::vector<UINT> &indices, UINT thread_cnt = 0);
+};
+
+#endif
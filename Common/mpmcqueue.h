@@ -0,0 +1,93 @@
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include<atomic>
+#include<cstddef>
+#include<memory>
+
+// A bounded multi-producer multi-consumer queue that never takes a lock.
+// Every cell carries a sequence number telling whether it is ready to be
+// written or read in the current lap, so producers and consumers only
+// contend on the position they claim with a compare-exchange.
+// TryPush() fails when the queue is full, TryPop() when it is empty.
+template<typename T>
+class MpmcQueue {
+public:
+	// capacity is rounded up to a power of two.
+	explicit MpmcQueue(size_t capacity) {
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+
+		cells_.reset(new Cell[size]);
+		mask_ = size - 1;
+		for (size_t i = 0; i < size; ++i)
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	size_t Capacity() const {
+		return mask_ + 1;
+	}
+
+	bool TryPush(const T &value) {
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell &cell = cells_[pos & mask_];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+			if (diff == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					cell.value = value;
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				// The cell still holds the value from the last lap: full.
+				return false;
+			} else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool TryPop(T &value) {
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell &cell = cells_[pos & mask_];
+			size_t seq = cell.sequence.load(std::memory_order_acquire);
+			ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+			if (diff == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					value = cell.value;
+					cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				// Nothing has been written to the cell yet: empty.
+				return false;
+			} else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+	struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+private:
+	std::unique_ptr<Cell[]> cells_;
+	size_t mask_ = 0;
+
+	// Kept on separate cache lines so producers and consumers do not
+	// invalidate each other's position.
+	alignas(64) std::atomic<size_t> enqueue_pos_{0};
+	alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+#endif
@@ -0,0 +1,324 @@
+#include"profiler.h"
+#include<algorithm>
+#include<chrono>
+#include<fstream>
+#include<iomanip>
+#include<thread>
+
+thread_local Profiler::ThreadBuffer *Profiler::current_buffer_ = nullptr;
+thread_local Profiler::ThreadReleaser Profiler::thread_releaser_;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+uint64_t ClockNs() {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		Clock::now().time_since_epoch()).count());
+}
+
+// A finished zone with its time in nanoseconds.
+struct Zone {
+	const char *name;
+	uint32_t depth;
+	uint64_t begin_ns;
+	uint64_t end_ns;
+};
+
+Profiler::ZoneNode& Child(Profiler::ZoneNode &parent, const char *name) {
+	for (Profiler::ZoneNode &child : parent.children) {
+		if (child.name == name)
+			return child;
+	}
+	parent.children.emplace_back();
+	parent.children.back().name = name;
+	return parent.children.back();
+}
+
+void ComputeSelfTime(Profiler::ZoneNode &node) {
+	uint64_t children_ns = 0;
+	for (Profiler::ZoneNode &child : node.children) {
+		ComputeSelfTime(child);
+		children_ns += child.total_ns;
+	}
+	// Children on other threads can add up to more than the parent.
+	node.self_ns = node.total_ns > children_ns ? node.total_ns - children_ns : 0;
+}
+
+// Zones are sorted by start, so a zone's parent is the last open zone one
+// level up.  A zone whose parent started in an earlier frame hangs from the
+// deepest zone still open.
+void AddZones(Profiler::ZoneNode &thread_node, std::vector<Zone> &zones) {
+	std::sort(zones.begin(), zones.end(), [](const Zone &a, const Zone &b) {
+		return a.begin_ns != b.begin_ns ? a.begin_ns < b.begin_ns : a.depth < b.depth;
+	});
+
+	// Only the tail of a children vector grows while its owner is open, so
+	// the pointers to the open zones stay valid.
+	std::vector<Profiler::ZoneNode*> open;
+	for (const Zone &zone : zones) {
+		while (open.size() > zone.depth)
+			open.pop_back();
+
+		Profiler::ZoneNode &parent = open.empty() ? thread_node : *open.back();
+		Profiler::ZoneNode &node = Child(parent, zone.name);
+		++node.call_cnt;
+		node.total_ns += zone.end_ns - zone.begin_ns;
+		if (zone.depth == 0)
+			thread_node.total_ns += zone.end_ns - zone.begin_ns;
+		open.push_back(&node);
+	}
+}
+
+void WriteNode(std::ostream &out, const Profiler::ZoneNode &node, int depth) {
+	out << std::string(2 * depth, ' ') << node.name
+		<< "  calls " << node.call_cnt
+		<< "  total " << node.total_ns * 1e-6 << " ms"
+		<< "  self " << node.self_ns * 1e-6 << " ms\n";
+	for (const Profiler::ZoneNode &child : node.children)
+		WriteNode(out, child, depth + 1);
+}
+
+void WriteJsonString(std::ostream &out, const char *s) {
+	out << '"';
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\')
+			out << '\\';
+		out << *s;
+	}
+	out << '"';
+}
+
+std::string ThreadName(uint32_t thread_index, uint32_t main_thread_index) {
+	return thread_index == main_thread_index ? "main" : "thread " + std::to_string(thread_index);
+}
+
+}
+
+Profiler& Profiler::Instance() {
+	// Never destroyed, so that threads still running at exit can record.
+	static Profiler *profiler = new Profiler();
+	return *profiler;
+}
+
+Profiler::Profiler() {
+	origin_ticks_ = Now();
+	origin_ns_ = ClockNs();
+
+#if defined(PROFILER_USE_TSC)
+	// A first estimate of the counter rate; EndFrame() refines it as the
+	// time since the origin grows.
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	Calibrate();
+#else
+	ns_per_tick_ = 1e9 * Clock::period::num / Clock::period::den;
+#endif
+}
+
+void Profiler::Calibrate() {
+#if defined(PROFILER_USE_TSC)
+	uint64_t ticks = Now() - origin_ticks_;
+	uint64_t ns = ClockNs() - origin_ns_;
+	if (ticks > 0)
+		ns_per_tick_ = static_cast<double>(ns) / static_cast<double>(ticks);
+#endif
+}
+
+uint64_t Profiler::ToNs(uint64_t ticks) const {
+	// Nanoseconds since the profiler started.
+	if (ticks < origin_ticks_)
+		return 0;
+	return static_cast<uint64_t>((ticks - origin_ticks_) * ns_per_tick_);
+}
+
+Profiler::ThreadBuffer* Profiler::RegisterThread() {
+	Profiler &profiler = Instance();
+	// Touched so that its destructor runs when this thread exits.
+	thread_releaser_.armed = true;
+
+	std::unique_lock<std::mutex> lock(profiler.buffers_mutex_);
+	std::unique_ptr<ThreadBuffer> buffer;
+	if (!profiler.free_buffers_.empty()) {
+		buffer = std::move(profiler.free_buffers_.back());
+		profiler.free_buffers_.pop_back();
+	} else if (profiler.retired_cnt_ > kMaxRetiredBuffers) {
+		// The zones of the oldest exited thread were never gathered.
+		std::vector<std::unique_ptr<ThreadBuffer>> &buffers = profiler.buffers_;
+		auto oldest = std::find_if(buffers.begin(), buffers.end(),
+			[](const std::unique_ptr<ThreadBuffer> &b) { return b->retired; });
+		buffer = std::move(*oldest);
+		buffers.erase(oldest);
+		--profiler.retired_cnt_;
+		uint64_t write_pos = buffer->write_pos.load(std::memory_order_relaxed);
+		profiler.dropped_cnt_ += write_pos - buffer->read_pos;
+		buffer->read_pos = write_pos;
+	} else {
+		// Allocating and clearing 2.6 MB needs no lock.
+		lock.unlock();
+		buffer.reset(new ThreadBuffer());
+		buffer->events.reset(new Event[kBufferSize]);
+		for (uint64_t i = 0; i < kBufferSize; ++i)
+			buffer->events[i].sequence.store(0, std::memory_order_relaxed);
+		lock.lock();
+	}
+
+	// A recycled buffer keeps counting from where it was, so the sequences
+	// left in its slots never match a new zone.
+	buffer->retired = false;
+	buffer->depth = 0;
+	buffer->thread_index = profiler.thread_cnt_++;
+	current_buffer_ = buffer.get();
+	profiler.buffers_.push_back(std::move(buffer));
+	return current_buffer_;
+}
+
+Profiler::ThreadReleaser::~ThreadReleaser() {
+	if (!current_buffer_)
+		return;
+
+	// EndFrame() gathers what the thread left, then frees the buffer.
+	Profiler &profiler = Instance();
+	std::lock_guard<std::mutex> lock(profiler.buffers_mutex_);
+	current_buffer_->retired = true;
+	++profiler.retired_cnt_;
+	current_buffer_ = nullptr;
+}
+
+void Profiler::EndFrame() {
+	uint64_t frame_end = Now();
+	Calibrate();
+
+	main_thread_index_ = CurrentBuffer()->thread_index;
+
+	// Held throughout, so buffers are neither retired nor taken over while
+	// they are read; only threads starting or exiting wait for it.
+	std::lock_guard<std::mutex> lock(buffers_mutex_);
+
+	last_frame_ = ZoneNode();
+	last_frame_.name = "Frame";
+	last_frame_.call_cnt = 1;
+	if (frame_begin_ != 0)
+		last_frame_.total_ns = ToNs(frame_end) - ToNs(frame_begin_);
+
+	std::vector<Zone> zones;
+	for (const std::unique_ptr<ThreadBuffer> &owned : buffers_) {
+		ThreadBuffer *buffer = owned.get();
+		uint64_t write_pos = buffer->write_pos.load(std::memory_order_acquire);
+		uint64_t first = std::max(buffer->read_pos, write_pos > kBufferSize ? write_pos - kBufferSize : 0);
+		dropped_cnt_ += first - buffer->read_pos;
+		buffer->read_pos = write_pos;
+
+		zones.clear();
+		for (uint64_t pos = first; pos < write_pos; ++pos) {
+			const Event &event = buffer->events[pos & (kBufferSize - 1)];
+			uint64_t sequence = event.sequence.load(std::memory_order_acquire);
+			Zone zone;
+			zone.name = event.name.load(std::memory_order_relaxed);
+			zone.depth = event.depth.load(std::memory_order_relaxed);
+			uint64_t begin = event.begin.load(std::memory_order_relaxed);
+			uint64_t end = event.end.load(std::memory_order_relaxed);
+
+			// The owner may have lapped the ring and be rewriting the slot.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (sequence != pos + 1 || event.sequence.load(std::memory_order_relaxed) != sequence) {
+				++dropped_cnt_;
+				continue;
+			}
+
+			zone.begin_ns = ToNs(begin);
+			zone.end_ns = std::max(ToNs(end), zone.begin_ns);
+			zones.push_back(zone);
+		}
+		if (zones.empty())
+			continue;
+
+		if (capturing_) {
+			for (const Zone &zone : zones) {
+				if (captured_.size() >= max_captured_)
+					break;
+				CapturedEvent event = { zone.name, buffer->thread_index, zone.begin_ns, zone.end_ns };
+				captured_.push_back(event);
+			}
+		}
+
+		last_frame_.children.emplace_back();
+		ZoneNode &thread_node = last_frame_.children.back();
+		thread_node.name = ThreadName(buffer->thread_index, main_thread_index_);
+		thread_node.call_cnt = 1;
+		AddZones(thread_node, zones);
+	}
+	ComputeSelfTime(last_frame_);
+
+	// Everything exited threads left is gathered now.
+	for (size_t i = 0; i < buffers_.size();) {
+		if (buffers_[i]->retired) {
+			free_buffers_.push_back(std::move(buffers_[i]));
+			buffers_.erase(buffers_.begin() + i);
+			--retired_cnt_;
+		} else {
+			++i;
+		}
+	}
+
+	if (capturing_ && frame_begin_ != 0 && captured_.size() < max_captured_) {
+		CapturedEvent event = { "Frame", main_thread_index_, ToNs(frame_begin_), ToNs(frame_end) };
+		captured_.push_back(event);
+	}
+	frame_begin_ = frame_end;
+}
+
+void Profiler::WriteFrameTree(std::ostream &out) const {
+	WriteNode(out, last_frame_, 0);
+}
+
+void Profiler::StartCapture(size_t max_events) {
+	captured_.clear();
+	captured_.reserve(std::min<size_t>(max_events, 1 << 16));
+	max_captured_ = max_events;
+	capturing_ = true;
+}
+
+void Profiler::StopCapture() {
+	capturing_ = false;
+}
+
+void Profiler::WriteChromeTrace(std::ostream &out) const {
+	std::vector<uint32_t> threads;
+	for (const CapturedEvent &event : captured_)
+		threads.push_back(event.thread_index);
+	std::sort(threads.begin(), threads.end());
+	threads.erase(std::unique(threads.begin(), threads.end()), threads.end());
+
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	for (uint32_t thread : threads) {
+		out << (first ? "\n" : ",\n")
+			<< "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+			<< ",\"args\":{\"name\":\"" << ThreadName(thread, main_thread_index_) << "\"}}";
+		first = false;
+	}
+
+	// Trace timestamps are in microseconds.
+	std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(3);
+	for (const CapturedEvent &event : captured_) {
+		out << (first ? "\n" : ",\n") << "{\"name\":";
+		WriteJsonString(out, event.name);
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread_index
+			<< ",\"ts\":" << event.begin_ns * 1e-3
+			<< ",\"dur\":" << (event.end_ns - event.begin_ns) * 1e-3 << "}";
+		first = false;
+	}
+	out.flags(flags);
+	out << "\n]}\n";
+}
+
+bool Profiler::WriteChromeTrace(const std::string &filename) const {
+	std::ofstream fout(filename);
+	if (!fout)
+		return false;
+
+	WriteChromeTrace(fout);
+	return !fout.fail();
+}
+
@@ -0,0 +1,225 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// A scoped-zone profiler for the hot paths.  Define ENABLE_PROFILER in the
+// project to turn it on; without it the PROFILE_ macros expand to nothing.
+// The profiler itself is always built, so the benchmarks can time and check
+// it whether or not the project records zones.
+//
+//	void Waves::Step() {
+//		PROFILE_ZONE("Waves::Step");
+//		...
+//	}
+//
+// Zone names must be string literals.  Every thread writes the zones it
+// finishes into a ring buffer of its own, without locks; the buffer is
+// recycled for a new thread once its own exits.  PROFILE_FRAME(),
+// called once per frame, gathers them into a zone tree of the frame and,
+// while a capture runs, keeps them for WriteChromeTrace(), whose output
+// chrome://tracing and Perfetto open.
+
+#include<atomic>
+#include<cstdint>
+#include<memory>
+#include<mutex>
+#include<ostream>
+#include<string>
+#include<vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PROFILER_USE_TSC
+#if defined(_MSC_VER)
+#include<intrin.h>
+#else
+#include<x86intrin.h>
+#endif
+#else
+#include<chrono>
+#endif
+
+class Profiler {
+public:
+	// The calls of one zone at one place in the tree, added up.  The root is
+	// the frame and its children are the threads that finished zones in it.
+	struct ZoneNode {
+		std::string name;
+		uint32_t call_cnt = 0;
+		uint64_t total_ns = 0;
+		uint64_t self_ns = 0;
+		std::vector<ZoneNode> children;
+	};
+
+	static Profiler& Instance();
+
+	// Timestamps are raw ticks, the time stamp counter where there is one, and
+	// only turned into nanoseconds when the zones are gathered.
+	static uint64_t Now() {
+#if defined(PROFILER_USE_TSC)
+		return __rdtsc();
+#else
+		return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	}
+
+	// Called by ProfileZone.
+	static void Enter() {
+		++CurrentBuffer()->depth;
+	}
+	static void Leave(const char *name, uint64_t begin, uint64_t end) {
+		ThreadBuffer *buffer = CurrentBuffer();
+		uint64_t pos = buffer->write_pos.load(std::memory_order_relaxed);
+		Event &event = buffer->events[pos & (kBufferSize - 1)];
+
+		// A slot being rewritten has sequence 0, so EndFrame() can tell it
+		// from the slot of zone pos, which has sequence pos + 1.
+		event.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		event.name.store(name, std::memory_order_relaxed);
+		event.begin.store(begin, std::memory_order_relaxed);
+		event.end.store(end, std::memory_order_relaxed);
+		event.depth.store(--buffer->depth, std::memory_order_relaxed);
+		event.sequence.store(pos + 1, std::memory_order_release);
+		buffer->write_pos.store(pos + 1, std::memory_order_release);
+	}
+
+	// Ends the frame: gathers the zones all threads finished since the last
+	// call into LastFrame() and, while capturing, into the capture.
+	void EndFrame();
+
+	const ZoneNode& LastFrame() const {
+		return last_frame_;
+	}
+
+	// The tree of the last frame, one zone per line, indented by depth.
+	void WriteFrameTree(std::ostream &out) const;
+
+	// Collects every zone of the frames from StartCapture() to StopCapture(),
+	// at most max_events of them.
+	void StartCapture(size_t max_events = 1 << 20);
+	void StopCapture();
+	bool Capturing() const {
+		return capturing_;
+	}
+
+	// Writes the capture in the Chrome trace-event format.
+	void WriteChromeTrace(std::ostream &out) const;
+	bool WriteChromeTrace(const std::string &filename) const;
+
+	// Zones overwritten in a ring buffer before they were gathered.
+	uint64_t DroppedCount() const {
+		return dropped_cnt_.load(std::memory_order_relaxed);
+	}
+
+private:
+	// Zones a thread can finish between two frames before the oldest are lost.
+	static const uint64_t kBufferSize = 1 << 16;
+	// Buffers of exited threads kept for EndFrame() to gather; past this many
+	// a new thread takes the oldest over, zones and all, so that programs
+	// that churn threads and never end a frame stay bounded.
+	static const size_t kMaxRetiredBuffers = 16;
+
+	// The fields are atomics only so that the gathering thread may read a
+	// slot the owner is rewriting; relaxed stores cost the same as plain ones.
+	struct Event {
+		std::atomic<uint64_t> sequence;
+		std::atomic<const char*> name;
+		std::atomic<uint64_t> begin;
+		std::atomic<uint64_t> end;
+		std::atomic<uint32_t> depth;
+	};
+
+	struct ThreadBuffer {
+		uint32_t thread_index = 0;
+		uint32_t depth = 0;				// touched by the owner only
+		std::unique_ptr<Event[]> events;
+		std::atomic<uint64_t> write_pos{0};
+		uint64_t read_pos = 0;			// touched under buffers_mutex_ only
+		bool retired = false;			// the owner exited; under buffers_mutex_
+	};
+
+	// Retires the thread's buffer when the thread exits.
+	struct ThreadReleaser {
+		bool armed = false;
+		~ThreadReleaser();
+	};
+
+	struct CapturedEvent {
+		const char *name;
+		uint32_t thread_index;
+		uint64_t begin_ns;
+		uint64_t end_ns;
+	};
+
+	Profiler();
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	static ThreadBuffer* CurrentBuffer() {
+		ThreadBuffer *buffer = current_buffer_;
+		return buffer ? buffer : RegisterThread();
+	}
+	static ThreadBuffer* RegisterThread();
+
+	uint64_t ToNs(uint64_t ticks) const;
+	void Calibrate();
+
+private:
+	static thread_local ThreadBuffer *current_buffer_;
+	static thread_local ThreadReleaser thread_releaser_;
+
+	// Buffers of live threads and of exited ones not gathered yet, then
+	// gathered ones waiting for a new thread.
+	std::mutex buffers_mutex_;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+	std::vector<std::unique_ptr<ThreadBuffer>> free_buffers_;
+	size_t retired_cnt_ = 0;
+	uint32_t thread_cnt_ = 0;
+
+	uint64_t origin_ticks_;
+	uint64_t origin_ns_;
+	double ns_per_tick_ = 1.0;
+
+	uint64_t frame_begin_ = 0;
+	uint32_t main_thread_index_ = 0;
+	ZoneNode last_frame_;
+	std::atomic<uint64_t> dropped_cnt_{0};
+
+	bool capturing_ = false;
+	size_t max_captured_ = 0;
+	std::vector<CapturedEvent> captured_;
+};
+
+// Times the enclosing scope as one zone.
+class ProfileZone {
+public:
+	explicit ProfileZone(const char *name) : name_(name) {
+		Profiler::Enter();
+		begin_ = Profiler::Now();
+	}
+	~ProfileZone() {
+		Profiler::Leave(name_, begin_, Profiler::Now());
+	}
+
+private:
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+	const char *name_;
+	uint64_t begin_;
+};
+
+#if defined(ENABLE_PROFILER)
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILER_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_FRAME() Profiler::Instance().EndFrame()
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_FRAME() ((void)0)
+
+#endif
+
+#endif
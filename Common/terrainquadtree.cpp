@@ -0,0 +1,266 @@
+#include"terrainquadtree.h"
+#include"profiler.h"
+#include<algorithm>
+#include<cfloat>
+#include<cmath>
+#include<cstddef>
+using namespace DirectX;
+
+TerrainQuadtree::TerrainQuadtree(const Desc &desc)
+	: desc_(desc) {
+	PROFILE_ZONE("TerrainQuadtree::TerrainQuadtree");
+
+	desc_.patch_vertices = std::max(desc_.patch_vertices | 1u, 3u);
+	desc_.max_depth = std::min(desc_.max_depth, 12u);
+	UINT n = desc_.patch_vertices;
+
+	// The 16 patterns.  Folding vertex (r, c) onto (r, c - 1) or (r - 1, c)
+	// leaves the triangles along the side as a fan over the coarse edge, and
+	// the ones it empties are dropped.
+	GeometryGenerator::MeshData grid;
+	GeometryGenerator(1).CreateGrid(desc_.size, desc_.size, n, n, grid);
+	for (UINT stitch = 0; stitch < 16; ++stitch) {
+		pattern_offsets_[stitch] = static_cast<UINT>(indices_.size());
+		for (size_t i = 0; i < grid.indices.size(); i += 3) {
+			UINT tri[3];
+			for (int k = 0; k < 3; ++k) {
+				UINT r = grid.indices[i + k] / n, c = grid.indices[i + k] % n;
+				if ((c & 1) && (((stitch & kNorth) && r == 0) || ((stitch & kSouth) && r == n - 1)))
+					--c;
+				if ((r & 1) && (((stitch & kWest) && c == 0) || ((stitch & kEast) && c == n - 1)))
+					--r;
+				tri[k] = r*n + c;
+			}
+			if (tri[0] != tri[1] && tri[1] != tri[2] && tri[0] != tri[2])
+				indices_.insert(indices_.end(), tri, tri + 3);
+		}
+	}
+	pattern_offsets_[16] = static_cast<UINT>(indices_.size());
+
+	// Each node's own error, then the errors and bounds of what lies below it.
+	nodes_.resize(desc_.max_depth + 1);
+	std::vector<float> heights;
+	for (UINT depth = 0; depth <= desc_.max_depth; ++depth) {
+		UINT side = 1u << depth;
+		nodes_[depth].resize(static_cast<size_t>(side)*side);
+		for (UINT z = 0; z < side; ++z) {
+			for (UINT x = 0; x < side; ++x)
+				MeasureNode(depth, x, z, heights);
+		}
+	}
+	for (UINT depth = desc_.max_depth; depth-- > 0;) {
+		UINT side = 1u << depth;
+		for (UINT z = 0; z < side; ++z) {
+			for (UINT x = 0; x < side; ++x) {
+				NodeInfo &node = nodes_[depth][z*side + x];
+				for (UINT k = 0; k < 4; ++k) {
+					const NodeInfo &child = nodes_[depth + 1][(2*z + k/2)*2*side + 2*x + k%2];
+					node.error = std::max(node.error, child.error);
+					node.min_y = std::min(node.min_y, child.min_y);
+					node.max_y = std::max(node.max_y, child.max_y);
+				}
+			}
+		}
+	}
+
+	UINT cells = 1u << desc_.max_depth;
+	cell_depth_.resize(static_cast<size_t>(cells)*cells);
+}
+
+int TerrainQuadtree::FirstColumn(UINT depth, UINT x) const {
+	// The root's columns run from -(n-1)/2 to (n-1)/2, centring it on the
+	// origin; each level doubles the column numbers of the one above.
+	int half = static_cast<int>(desc_.patch_vertices - 1) / 2;
+	return static_cast<int>(x*(desc_.patch_vertices - 1)) - half*(1 << depth);
+}
+
+int TerrainQuadtree::FirstRow(UINT depth, UINT z) const {
+	// Rows start at the node's maximum z, as CreateGrid's do.
+	int half = static_cast<int>(desc_.patch_vertices - 1) / 2;
+	return static_cast<int>((z + 1)*(desc_.patch_vertices - 1)) - half*(1 << depth);
+}
+
+float TerrainQuadtree::Step(UINT depth) const {
+	// Scaling by powers of two is exact, so lattice points shared by two
+	// levels get the same coordinates in both.
+	return ldexpf(desc_.size / (desc_.patch_vertices - 1), -static_cast<int>(depth));
+}
+
+void TerrainQuadtree::MeasureNode(UINT depth, UINT x, UINT z, std::vector<float> &heights) {
+	// Sample the node on the lattice of the level below, as HillHeight()
+	// would, one sin/cos per column and per row.
+	UINT n = desc_.patch_vertices;
+	UINT fine_n = 2*n - 1;
+	int first_col = 2*FirstColumn(depth, x), first_row = 2*FirstRow(depth, z);
+	float step = Step(depth + 1);
+
+	heights.resize(static_cast<size_t>(fine_n)*(fine_n + 3));
+	float *xs = heights.data() + static_cast<size_t>(fine_n)*fine_n;
+	float *sin_x = xs + fine_n, *cos_x = sin_x + fine_n;
+	for (UINT j = 0; j < fine_n; ++j) {
+		xs[j] = static_cast<float>(first_col + static_cast<int>(j))*step;
+		sin_x[j] = sinf(0.1f*xs[j]);
+		cos_x[j] = cosf(0.1f*xs[j]);
+	}
+
+	NodeInfo &node = nodes_[depth][z*(1u << depth) + x];
+	node.min_y = FLT_MAX;
+	node.max_y = -FLT_MAX;
+	for (UINT i = 0; i < fine_n; ++i) {
+		float row_z = static_cast<float>(first_row - static_cast<int>(i))*step;
+		float cos_z = cosf(0.1f*row_z);
+		float *row = heights.data() + static_cast<size_t>(i)*fine_n;
+		for (UINT j = 0; j < fine_n; ++j) {
+			row[j] = 0.3f*(row_z*sin_x[j] + xs[j]*cos_z);
+			node.min_y = std::min(node.min_y, row[j]);
+			node.max_y = std::max(node.max_y, row[j]);
+		}
+	}
+
+	// The node's own vertices are the even samples.  The odd ones sit on its
+	// edges or on the diagonals CreateGrid splits quads along, halfway
+	// between two of its vertices.
+	float error = 0.0f;
+	ptrdiff_t pitch = fine_n;
+	for (UINT i = 0; i < fine_n; ++i) {
+		const float *row = heights.data() + static_cast<size_t>(i)*fine_n;
+		for (UINT j = (i & 1) ? 0 : 1; j < fine_n; j += (i & 1) ? 1 : 2) {
+			const float *sample = row + j;
+			float a, b;
+			if (!(i & 1)) {
+				a = sample[-1];
+				b = sample[1];
+			} else if (!(j & 1)) {
+				a = sample[-pitch];
+				b = sample[pitch];
+			} else {
+				a = sample[1 - pitch];
+				b = sample[pitch - 1];
+			}
+			error = std::max(error, fabsf(*sample - 0.5f*(a + b)));
+		}
+	}
+	node.error = error;
+}
+
+void TerrainQuadtree::Mark(UINT depth, UINT x, UINT z) {
+	UINT shift = desc_.max_depth - depth;
+	UINT cells = 1u << desc_.max_depth;
+	for (UINT cz = z << shift; cz < (z + 1) << shift; ++cz) {
+		for (UINT cx = x << shift; cx < (x + 1) << shift; ++cx)
+			cell_depth_[static_cast<size_t>(cz)*cells + cx] = static_cast<uint8_t>(depth);
+	}
+}
+
+bool TerrainQuadtree::NeighbourDepths(UINT depth, UINT x, UINT z, Side side, UINT &min_depth, UINT &max_depth) const {
+	UINT shift = desc_.max_depth - depth;
+	UINT cells = 1u << desc_.max_depth;
+	UINT first = (side == kNorth || side == kSouth ? x : z) << shift;
+	UINT last = first + (1u << shift);
+
+	// The row or column of cells just outside the side.
+	UINT outside;
+	switch (side) {
+	case kNorth:
+	case kEast:
+		outside = ((side == kNorth ? z : x) + 1) << shift;
+		if (outside >= cells)
+			return false;
+		break;
+	default:
+		outside = (side == kSouth ? z : x) << shift;
+		if (outside == 0)
+			return false;
+		--outside;
+		break;
+	}
+
+	min_depth = ~0u;
+	max_depth = 0;
+	for (UINT i = first; i < last; ++i) {
+		size_t cell = side == kNorth || side == kSouth ? static_cast<size_t>(outside)*cells + i : static_cast<size_t>(i)*cells + outside;
+		min_depth = std::min<UINT>(min_depth, cell_depth_[cell]);
+		max_depth = std::max<UINT>(max_depth, cell_depth_[cell]);
+	}
+	return true;
+}
+
+void TerrainQuadtree::SelectNode(UINT depth, UINT x, UINT z) {
+	const NodeInfo &node = nodes_[depth][z*(1u << depth) + x];
+
+	// Distance from the eye to the node's bounding box.
+	float step = Step(depth);
+	float min_x = FirstColumn(depth, x)*step, max_x = min_x + (desc_.patch_vertices - 1)*step;
+	float max_z = FirstRow(depth, z)*step, min_z = max_z - (desc_.patch_vertices - 1)*step;
+	float dx = std::max(std::max(min_x - eye_.x, eye_.x - max_x), 0.0f);
+	float dy = std::max(std::max(node.min_y - eye_.y, eye_.y - node.max_y), 0.0f);
+	float dz = std::max(std::max(min_z - eye_.z, eye_.z - max_z), 0.0f);
+	float distance = sqrtf(dx*dx + dy*dy + dz*dz);
+
+	if (depth == desc_.max_depth || node.error*pixels_per_unit_ <= max_error_pixels_*distance) {
+		NodeId id = { depth, x, z };
+		selected_.push_back(id);
+		Mark(depth, x, z);
+		return;
+	}
+	for (UINT k = 0; k < 4; ++k)
+		SelectNode(depth + 1, 2*x + k%2, 2*z + k/2);
+}
+
+void TerrainQuadtree::Select(const XMFLOAT3 &eye, float fov_y, float screen_height, float max_error_pixels,
+	std::vector<DrawItem> &draws) {
+	PROFILE_ZONE("TerrainQuadtree::Select");
+
+	eye_ = eye;
+	pixels_per_unit_ = 0.5f*screen_height / tanf(0.5f*fov_y);
+	max_error_pixels_ = max_error_pixels;
+	selected_.clear();
+	SelectNode(0, 0, 0);
+
+	// Split nodes until no neighbour is more than one level finer, so the
+	// stitching only ever has to skip every other vertex.  Splitting only
+	// makes nodes finer, so this ends.
+	const Side sides[4] = { kNorth, kEast, kSouth, kWest };
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t i = 0; i < selected_.size(); ++i) {
+			NodeId id = selected_[i];
+			bool split = false;
+			for (Side side : sides) {
+				UINT min_depth, max_depth;
+				if (NeighbourDepths(id.depth, id.x, id.z, side, min_depth, max_depth) && max_depth > id.depth + 1)
+					split = true;
+			}
+			if (!split)
+				continue;
+
+			for (UINT k = 0; k < 4; ++k) {
+				NodeId child = { id.depth + 1, 2*id.x + k%2, 2*id.z + k/2 };
+				if (k == 0)
+					selected_[i] = child;
+				else
+					selected_.push_back(child);
+				Mark(child.depth, child.x, child.z);
+			}
+			changed = true;
+		}
+	}
+
+	draws.clear();
+	for (const NodeId &id : selected_) {
+		DrawItem draw = { id.depth, id.x, id.z, 0, 0, 0 };
+		for (Side side : sides) {
+			UINT min_depth, max_depth;
+			if (NeighbourDepths(id.depth, id.x, id.z, side, min_depth, max_depth) && min_depth < id.depth)
+				draw.stitch |= side;
+		}
+		PatternRange(draw.stitch, draw.index_offset, draw.index_cnt);
+		draws.push_back(draw);
+	}
+}
+
+void TerrainQuadtree::BuildNode(UINT depth, UINT x, UINT z, ChunkedTerrain::Vertex *vertices) const {
+	// The texture repeats once per leaf.
+	ChunkedTerrain::BuildPatch(FirstColumn(depth, x), FirstRow(depth, z), Step(depth), desc_.patch_vertices,
+		Step(desc_.max_depth)*(desc_.patch_vertices - 1), vertices);
+}
@@ -0,0 +1,129 @@
+#ifndef TERRAINQUADTREE_H
+#define TERRAINQUADTREE_H
+
+#include"chunkedterrain.h"
+#include<cstdint>
+#include<vector>
+
+// Level of detail for the hills over a square centred on the origin.  Every
+// node of the quadtree is a patch of the same grid, so a node at depth d is
+// 2^(max_depth - d) times coarser than a leaf.  Select() walks down from the
+// root until a node's geometric error, projected to the screen, is small
+// enough, then splits nodes until neighbours are at most one level apart.
+//
+// Where a node meets a coarser neighbour, its index pattern folds every
+// other edge vertex onto the one before it, so the shared edge has the
+// coarse node's vertices alone and no T-junctions crack open.  There is one
+// pattern for each combination of coarser sides; all of them index the same
+// VertexCount() vertices, laid out as CreateGrid lays out a grid.
+class TerrainQuadtree {
+public:
+	struct Desc {
+		float size = 1280.0f;			// world units along a side of the root
+		UINT patch_vertices = 33;		// along a side of every node; odd
+		UINT max_depth = 6;
+	};
+
+	// Sides of a node, by the grid rows and columns on them.
+	enum Side {
+		kNorth = 1,		// row 0, maximum z
+		kEast = 2,		// last column, maximum x
+		kSouth = 4,		// last row, minimum z
+		kWest = 8		// column 0, minimum x
+	};
+
+	// A node, its coarser sides and the range of Indices() that draws it.
+	// Nodes at depth d are numbered from 0 to 2^d - 1 along x and z, from
+	// the minimum corner.
+	struct DrawItem {
+		UINT depth;
+		UINT x;
+		UINT z;
+		UINT stitch;				// Side bits
+		UINT index_offset;
+		UINT index_cnt;
+	};
+
+	// Measures every node's error up front.
+	explicit TerrainQuadtree(const Desc &desc);
+
+	const Desc &GetDesc() const {
+		return desc_;
+	}
+
+	UINT VertexCount() const {
+		return desc_.patch_vertices*desc_.patch_vertices;
+	}
+
+	// The 16 stitching patterns, one after the other.
+	const std::vector<UINT> &Indices() const {
+		return indices_;
+	}
+
+	// The largest vertical distance, in world units, between the node's
+	// surface and its children's, or its own error if that is larger: the
+	// error of drawing the node instead of anything below it.
+	float NodeError(UINT depth, UINT x, UINT z) const {
+		return nodes_[depth][z*(1u << depth) + x].error;
+	}
+
+	// Picks the nodes to draw from eye, for a screen screen_height pixels high
+	// seen through a vertical field of view of fov_y radians, such that no
+	// node's error covers more than max_error_pixels.
+	void Select(const DirectX::XMFLOAT3 &eye, float fov_y, float screen_height, float max_error_pixels,
+		std::vector<DrawItem> &draws);
+
+	// Fills the VertexCount() vertices of a node.
+	void BuildNode(UINT depth, UINT x, UINT z, ChunkedTerrain::Vertex *vertices) const;
+
+	// The pattern for a combination of Side bits, without the stitching when
+	// stitch is 0.
+	void PatternRange(UINT stitch, UINT &index_offset, UINT &index_cnt) const {
+		index_offset = pattern_offsets_[stitch];
+		index_cnt = pattern_offsets_[stitch + 1] - pattern_offsets_[stitch];
+	}
+
+private:
+	struct NodeId {
+		UINT depth;
+		UINT x;
+		UINT z;
+	};
+
+	struct NodeInfo {
+		float error = 0.0f;
+		float min_y = 0.0f;
+		float max_y = 0.0f;
+	};
+
+	// The lattice coordinates of a node's first column and row, in steps of
+	// its own depth.
+	int FirstColumn(UINT depth, UINT x) const;
+	int FirstRow(UINT depth, UINT z) const;
+	float Step(UINT depth) const;
+
+	void MeasureNode(UINT depth, UINT x, UINT z, std::vector<float> &heights);
+	void SelectNode(UINT depth, UINT x, UINT z);
+	// The deepest and shallowest selected depths in the leaf cells just past
+	// a side of a node; false when the side is on the edge of the root.
+	bool NeighbourDepths(UINT depth, UINT x, UINT z, Side side, UINT &min_depth, UINT &max_depth) const;
+	void Mark(UINT depth, UINT x, UINT z);
+
+private:
+	Desc desc_;
+	std::vector<UINT> indices_;
+	UINT pattern_offsets_[17];
+
+	// nodes_[depth][z * 2^depth + x]
+	std::vector<std::vector<NodeInfo>> nodes_;
+
+	// Select()'s state: the camera terms, the nodes picked and, per leaf
+	// cell, the depth of the node covering it.
+	DirectX::XMFLOAT3 eye_;
+	float pixels_per_unit_ = 0.0f;
+	float max_error_pixels_ = 0.0f;
+	std::vector<NodeId> selected_;
+	std::vector<uint8_t> cell_depth_;
+};
+
+#endif
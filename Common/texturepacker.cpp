@@ -0,0 +1,336 @@
+#include"texturepacker.h"
+#include"blockcompression.h"
+#include"mappedfile.h"
+#include"texturepipeline.h"
+#include<algorithm>
+#include<cstring>
+#include<fstream>
+#include<memory>
+using namespace DirectX;
+
+namespace {
+
+const uint32_t kFourCCDX10 = MAKEFOURCC('D', 'X', '1', '0');
+const uint32_t kFlagsCaps = 0x00000001;			// DDSD_CAPS
+const uint32_t kFlagsPixelFormat = 0x00001000;	// DDSD_PIXELFORMAT
+const uint32_t kFlagsMipMapCount = 0x00020000;	// DDSD_MIPMAPCOUNT
+const uint32_t kCapsComplex = 0x00000008;		// DDSCAPS_COMPLEX
+const uint32_t kCapsTexture = 0x00001000;		// DDSCAPS_TEXTURE
+const uint32_t kCapsMipMap = 0x00400000;		// DDSCAPS_MIPMAP
+
+UINT RoundUp(UINT value, UINT multiple) {
+	return (value + multiple - 1) / multiple * multiple;
+}
+
+// Writes the headers of a 2D texture or array, with the DX10 header so any
+// format and array size can be told, and returns their size.
+size_t WriteHeaders(DXGI_FORMAT format, UINT width, UINT height, UINT mip_cnt, UINT array_size, std::vector<uint8_t> &out) {
+	DDS_HEADER header;
+	memset(&header, 0, sizeof(header));
+	header.size = sizeof(DDS_HEADER);
+	header.flags = kFlagsCaps | DDS_HEIGHT | DDS_WIDTH | kFlagsPixelFormat | kFlagsMipMapCount;
+	header.height = height;
+	header.width = width;
+	header.depth = 1;
+	header.mipMapCount = mip_cnt;
+	header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+	header.ddspf.flags = DDS_FOURCC;
+	header.ddspf.fourCC = kFourCCDX10;
+	header.caps = kCapsTexture | (mip_cnt > 1 ? kCapsComplex | kCapsMipMap : 0) | (array_size > 1 ? kCapsComplex : 0);
+
+	DDS_HEADER_DXT10 dx10;
+	memset(&dx10, 0, sizeof(dx10));
+	dx10.dxgiFormat = format;
+	dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	dx10.arraySize = array_size;
+
+	size_t header_bytes = sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10);
+	out.resize(header_bytes);
+	memcpy(out.data(), &DDS_MAGIC, sizeof(uint32_t));
+	memcpy(out.data() + sizeof(uint32_t), &header, sizeof(header));
+	memcpy(out.data() + sizeof(uint32_t) + sizeof(DDS_HEADER), &dx10, sizeof(dx10));
+	return header_bytes;
+}
+
+// Finds the subresources of each source, and of a full chain built for it
+// when it has fewer than min_levels levels.
+HRESULT FindSources(const std::vector<TexturePacker::Source> &sources, UINT min_levels, const MipGenerator::Desc &mips,
+	std::vector<TexturePipeline::Texture> &textures, std::vector<std::vector<uint8_t>> &generated, ThreadPool *pool) {
+	textures.resize(sources.size());
+	generated.resize(sources.size());
+	for (size_t i = 0; i < sources.size(); ++i) {
+		HRESULT hr = TexturePipeline::FindSubresources(sources[i].data, sources[i].size, textures[i]);
+		if (FAILED(hr))
+			return hr;
+		const DDS_TEXTURE_INFO &info = textures[i].info;
+		if (info.resourceDimension != DDS_DIMENSION_TEXTURE2D || info.isCubeMap)
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+		if (info.mipCount < min_levels) {
+			hr = MipGenerator::GenerateDDS(sources[i].data, sources[i].size, mips, generated[i], pool);
+			if (SUCCEEDED(hr))
+				hr = TexturePipeline::FindSubresources(generated[i].data(), generated[i].size(), textures[i]);
+			if (FAILED(hr))
+				return hr;
+		}
+	}
+	return S_OK;
+}
+
+// Lays the cells out on shelves, tallest first, across a power-of-two width
+// that is no wider than max_width; of those widths, the one with the least
+// area wins.  width is left 0 when a cell is wider than max_width.
+void PlaceCells(const std::vector<UINT> &cell_widths, const std::vector<UINT> &cell_heights, UINT align, UINT max_width,
+	std::vector<UINT> &xs, std::vector<UINT> &ys, UINT &width, UINT &height) {
+	width = height = 0;
+	std::vector<size_t> order(cell_widths.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return cell_heights[a] != cell_heights[b] ? cell_heights[a] > cell_heights[b] : cell_widths[a] > cell_widths[b];
+	});
+
+	UINT widest = *std::max_element(cell_widths.begin(), cell_widths.end());
+	UINT try_width = align;
+	while (try_width < widest)
+		try_width *= 2;
+
+	std::vector<UINT> try_xs(order.size()), try_ys(order.size());
+	for (; try_width <= max_width; try_width *= 2) {
+		UINT x = 0, shelf_y = 0, shelf_height = 0;
+		for (size_t i : order) {
+			if (x + cell_widths[i] > try_width) {
+				shelf_y += shelf_height;
+				x = shelf_height = 0;
+			}
+			try_xs[i] = x;
+			try_ys[i] = shelf_y;
+			x += cell_widths[i];
+			shelf_height = std::max(shelf_height, cell_heights[i]);
+		}
+		UINT try_height = RoundUp(shelf_y + shelf_height, align);
+
+		uint64_t area = static_cast<uint64_t>(try_width)*try_height;
+		if (width == 0 || area < static_cast<uint64_t>(width)*height) {
+			width = try_width;
+			height = try_height;
+			xs = try_xs;
+			ys = try_ys;
+		}
+		// Wider still only adds empty columns once everything fits on a shelf.
+		if (try_height == RoundUp(cell_heights[order[0]], align))
+			break;
+	}
+}
+
+// Fills a cell of the atlas with one level of an input, whose texels start
+// at (x, y); the rest of the cell repeats its edges, or wraps around them.
+void FillCell(const uint8_t *rgba, UINT width, UINT height, UINT x, UINT y, UINT cell_x, UINT cell_y,
+	UINT cell_width, UINT cell_height, bool wrap, uint8_t *atlas, size_t atlas_pitch) {
+	auto source = [wrap](int d, UINT n) -> UINT {
+		if (wrap)
+			return static_cast<UINT>((d % static_cast<int>(n) + static_cast<int>(n)) % static_cast<int>(n));
+		return static_cast<UINT>(std::min(std::max(d, 0), static_cast<int>(n) - 1));
+	};
+
+	size_t row_bytes = 4*static_cast<size_t>(width);
+	for (UINT cy = cell_y; cy < cell_y + cell_height; ++cy) {
+		const uint8_t *in = rgba + row_bytes*source(static_cast<int>(cy) - static_cast<int>(y), height);
+		uint8_t *out = atlas + atlas_pitch*cy;
+		memcpy(out + 4*static_cast<size_t>(x), in, row_bytes);
+		for (UINT cx = cell_x; cx < x; ++cx)
+			memcpy(out + 4*static_cast<size_t>(cx), in + 4*source(static_cast<int>(cx) - static_cast<int>(x), width), 4);
+		for (UINT cx = x + width; cx < cell_x + cell_width; ++cx)
+			memcpy(out + 4*static_cast<size_t>(cx), in + 4*source(static_cast<int>(cx) - static_cast<int>(x), width), 4);
+	}
+}
+
+bool SaveFile(const std::string &filename, const std::vector<uint8_t> &data) {
+	std::ofstream fout(filename, std::ios::binary);
+	fout.write(reinterpret_cast<const char*>(data.data()), data.size());
+	return static_cast<bool>(fout);
+}
+
+bool MapFiles(const std::vector<std::string> &filenames, std::vector<std::unique_ptr<MappedFile>> &files,
+	std::vector<TexturePacker::Source> &sources) {
+	for (const std::string &filename : filenames) {
+		files.emplace_back(new MappedFile);
+		if (!files.back()->Open(filename))
+			return false;
+		TexturePacker::Source source = { files.back()->Data(), files.back()->Size() };
+		sources.push_back(source);
+	}
+	return true;
+}
+
+}
+
+HRESULT TexturePacker::PackArray(const std::vector<Source> &sources, std::vector<uint8_t> &out, ThreadPool *pool) {
+	if (sources.empty())
+		return E_INVALIDARG;
+
+	std::vector<TexturePipeline::Texture> textures;
+	std::vector<std::vector<uint8_t>> generated;
+	HRESULT hr = FindSources(sources, 0, MipGenerator::Desc(), textures, generated, pool);
+	if (FAILED(hr))
+		return hr;
+
+	const DDS_TEXTURE_INFO &first = textures[0].info;
+	bool same_levels = true;
+	for (const TexturePipeline::Texture &texture : textures) {
+		const DDS_TEXTURE_INFO &info = texture.info;
+		if (info.width != first.width || info.height != first.height || info.format != first.format)
+			return E_INVALIDARG;
+		same_levels = same_levels && info.mipCount == first.mipCount;
+	}
+
+	// Chains of different lengths are all made full, so they agree.
+	UINT level_cnt = first.mipCount;
+	if (!same_levels) {
+		level_cnt = MipGenerator::LevelCount(first.width, first.height);
+		hr = FindSources(sources, level_cnt, MipGenerator::Desc(), textures, generated, pool);
+		if (FAILED(hr))
+			return hr;
+	}
+
+	UINT array_size = 0;
+	size_t slice_bytes = 0;
+	for (const TexturePipeline::Texture &texture : textures)
+		array_size += texture.info.arraySize;
+	for (UINT level = 0; level < level_cnt; ++level)
+		slice_bytes += textures[0].subresources[level].slice_pitch;
+
+	size_t header_bytes = WriteHeaders(first.format, first.width, first.height, level_cnt, array_size, out);
+	out.resize(header_bytes + slice_bytes*array_size);
+	uint8_t *bits = out.data() + header_bytes;
+	for (const TexturePipeline::Texture &texture : textures) {
+		for (const TexturePipeline::Subresource &subresource : texture.subresources) {
+			memcpy(bits, subresource.data, subresource.slice_pitch);
+			bits += subresource.slice_pitch;
+		}
+	}
+	return S_OK;
+}
+
+HRESULT TexturePacker::PackArrayFiles(const std::vector<std::string> &in_filenames, const std::string &out_filename,
+	ThreadPool *pool) {
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<Source> sources;
+	if (!MapFiles(in_filenames, files, sources))
+		return E_FAIL;
+	std::vector<uint8_t> out;
+	HRESULT hr = PackArray(sources, out, pool);
+	if (FAILED(hr))
+		return hr;
+	files.clear();
+	return SaveFile(out_filename, out) ? S_OK : E_FAIL;
+}
+
+HRESULT TexturePacker::PackAtlas(const std::vector<Source> &sources, const AtlasDesc &desc, std::vector<uint8_t> &out,
+	std::vector<Entry> &entries, ThreadPool *pool) {
+	if (sources.empty())
+		return E_INVALIDARG;
+
+	std::vector<TexturePipeline::Texture> textures;
+	std::vector<std::vector<uint8_t>> generated;
+	HRESULT hr = FindSources(sources, 0, desc.mips, textures, generated, pool);
+	if (FAILED(hr))
+		return hr;
+	for (const TexturePipeline::Texture &texture : textures) {
+		if (texture.info.arraySize != 1)
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+	}
+
+	// Level l exists while every input and the gutter still halve evenly l
+	// times, so each input keeps its place and a gutter of a texel or more.
+	UINT level_cnt = 1;
+	for (;; ++level_cnt) {
+		UINT step = 1u << level_cnt;
+		bool halves = level_cnt < 16 && desc.gutter >= step;
+		for (size_t i = 0; i < textures.size() && halves; ++i)
+			halves = textures[i].info.width % step == 0 && textures[i].info.height % step == 0;
+		if (!halves)
+			break;
+	}
+	hr = FindSources(sources, level_cnt, desc.mips, textures, generated, pool);
+	if (FAILED(hr))
+		return hr;
+
+	// Cells start on whole blocks of the smallest level, and inputs on whole
+	// texels of it.
+	DXGI_FORMAT format = desc.format == DXGI_FORMAT_UNKNOWN ? textures[0].info.format : desc.format;
+	UINT unit = 1u << (level_cnt - 1);
+	UINT align = (BlockCompression::BlockBytes(format) != 0 ? 4 : 1)*unit;
+	UINT inset = RoundUp(desc.gutter, unit);
+	std::vector<UINT> cell_widths(textures.size()), cell_heights(textures.size()), cell_xs, cell_ys;
+	for (size_t i = 0; i < textures.size(); ++i) {
+		cell_widths[i] = RoundUp(textures[i].info.width + 2*inset, align);
+		cell_heights[i] = RoundUp(textures[i].info.height + 2*inset, align);
+	}
+	UINT width = 0, height = 0;
+	PlaceCells(cell_widths, cell_heights, align, desc.max_width, cell_xs, cell_ys, width, height);
+	if (width == 0)
+		return E_INVALIDARG;
+
+	entries.resize(textures.size());
+	for (size_t i = 0; i < textures.size(); ++i) {
+		Entry &entry = entries[i];
+		entry.x = cell_xs[i] + inset;
+		entry.y = cell_ys[i] + inset;
+		entry.width = textures[i].info.width;
+		entry.height = textures[i].info.height;
+		entry.scale_u = static_cast<float>(entry.width) / width;
+		entry.scale_v = static_cast<float>(entry.height) / height;
+		entry.offset_u = static_cast<float>(entry.x) / width;
+		entry.offset_v = static_cast<float>(entry.y) / height;
+	}
+
+	std::vector<size_t> level_bytes(level_cnt), row_bytes(level_cnt);
+	size_t total_bytes = WriteHeaders(format, width, height, level_cnt, 1, out);
+	for (UINT level = 0; level < level_cnt; ++level) {
+		GetSurfaceInfo(width >> level, height >> level, format, &level_bytes[level], &row_bytes[level], nullptr);
+		total_bytes += level_bytes[level];
+	}
+	size_t offset = out.size();
+	out.resize(total_bytes);
+
+	// Each level from the same level of the inputs, never from the one above.
+	std::vector<uint8_t> atlas, rgba;
+	for (UINT level = 0; level < level_cnt; ++level) {
+		UINT atlas_width = width >> level, atlas_height = height >> level;
+		size_t atlas_pitch = 4*static_cast<size_t>(atlas_width);
+		atlas.assign(atlas_pitch*atlas_height, 0);
+
+		for (size_t i = 0; i < textures.size(); ++i) {
+			const TexturePipeline::Subresource &subresource = textures[i].subresources[level];
+			UINT input_width = entries[i].width >> level, input_height = entries[i].height >> level;
+			rgba.resize(4*static_cast<size_t>(input_width)*input_height);
+			if (!MipGenerator::DecodeLevel(textures[i].info.format, subresource.data, subresource.row_pitch,
+				input_width, input_height, rgba.data(), 4*input_width, pool))
+				return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+			FillCell(rgba.data(), input_width, input_height, entries[i].x >> level, entries[i].y >> level,
+				cell_xs[i] >> level, cell_ys[i] >> level, cell_widths[i] >> level, cell_heights[i] >> level,
+				desc.wrap, atlas.data(), atlas_pitch);
+		}
+
+		if (!MipGenerator::EncodeLevel(format, atlas.data(), atlas_pitch, atlas_width, atlas_height,
+			out.data() + offset, row_bytes[level], pool))
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+		offset += level_bytes[level];
+	}
+	return S_OK;
+}
+
+HRESULT TexturePacker::PackAtlasFiles(const std::vector<std::string> &in_filenames, const std::string &out_filename,
+	const AtlasDesc &desc, std::vector<Entry> &entries, ThreadPool *pool) {
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<Source> sources;
+	if (!MapFiles(in_filenames, files, sources))
+		return E_FAIL;
+	std::vector<uint8_t> out;
+	HRESULT hr = PackAtlas(sources, desc, out, entries, pool);
+	if (FAILED(hr))
+		return hr;
+	files.clear();
+	return SaveFile(out_filename, out) ? S_OK : E_FAIL;
+}
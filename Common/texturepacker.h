@@ -0,0 +1,75 @@
+#ifndef TEXTUREPACKER_H
+#define TEXTUREPACKER_H
+
+#include"mipgenerator.h"
+#include<cstddef>
+#include<cstdint>
+#include<string>
+#include<vector>
+
+class ThreadPool;
+
+// Packs several DDS textures into one, so the draws that use them can share a
+// single shader resource view:
+//
+//   array   textures of one size and format become the slices of a
+//           Texture2DArray, their blocks copied as they are
+//   atlas   textures of any size are laid out side by side in one Texture2D,
+//           each in a cell with a gutter around it, and the scale and offset
+//           that move its texture coordinates into the atlas are returned
+//
+// Both build DDS files in memory, which DDSTextureLoader and TexturePipeline
+// load like any other, so packing can be done offline or at load time.
+//
+// The atlas is mip-aware: each level is put together from the same level of
+// every input, with a gutter rebuilt around it, instead of being filtered
+// from the atlas level above, so no level mixes texels of two inputs.  The
+// cells are placed so that every input lands on whole texels, and on whole
+// blocks of its own, all the way down the chain; that is what ends the chain
+// early, when the gutter or the inputs' sizes run out of halvings.
+class TexturePacker {
+public:
+	// A DDS file in memory.
+	struct Source {
+		const uint8_t *data;
+		size_t size;
+	};
+
+	struct AtlasDesc {
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;	// the first source's when UNKNOWN
+		UINT gutter = 8;			// texels around each input in the top level, halved with each level
+		UINT max_width = 4096;
+		bool wrap = false;			// gutters repeat the far edge, for inputs tiled with frac() in the shader
+		MipGenerator::Desc mips;	// for inputs shipped without enough levels
+	};
+
+	// Where an input went.  Its texture coordinates map into the atlas as
+	// uv*scale + offset.
+	struct Entry {
+		UINT x;
+		UINT y;
+		UINT width;
+		UINT height;
+		float scale_u;
+		float scale_v;
+		float offset_u;
+		float offset_v;
+	};
+
+	// The slices of the sources in order, each source's own slices together.
+	// Sources of different sizes or formats, cubes and volumes are refused;
+	// when the sources' chains differ in length, the short ones are generated
+	// in full.
+	static HRESULT PackArray(const std::vector<Source> &sources, std::vector<uint8_t> &out, ThreadPool *pool = nullptr);
+	static HRESULT PackArrayFiles(const std::vector<std::string> &in_filenames, const std::string &out_filename,
+		ThreadPool *pool = nullptr);
+
+	// Single 2D textures in any format MipGenerator handles; entries are in
+	// the order of the sources.
+	static HRESULT PackAtlas(const std::vector<Source> &sources, const AtlasDesc &desc, std::vector<uint8_t> &out,
+		std::vector<Entry> &entries, ThreadPool *pool = nullptr);
+	static HRESULT PackAtlasFiles(const std::vector<std::string> &in_filenames, const std::string &out_filename,
+		const AtlasDesc &desc, std::vector<Entry> &entries, ThreadPool *pool = nullptr);
+};
+
+#endif
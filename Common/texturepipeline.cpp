@@ -0,0 +1,274 @@
+#include"texturepipeline.h"
+#include"mappedfile.h"
+#include"mipgenerator.h"
+#include"profiler.h"
+#include"threadpool.h"
+#include<algorithm>
+#include<chrono>
+#include<cstring>
+#include<thread>
+using namespace DirectX;
+
+namespace {
+
+double NowMs() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+TexturePipeline::TexturePipeline(const Desc &desc, Backend &backend)
+	: desc_(desc), backend_(backend) {
+	desc_.io_threads = std::max(desc_.io_threads, 1u);
+	desc_.max_in_flight = std::max(desc_.max_in_flight, 1u);
+	if (desc_.cpu_threads == 0)
+		desc_.cpu_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// Both pools count a calling thread that never works for them, so ask for
+	// one more.  Reads must not run inline: StartReads() holds mutex_.
+	cpu_pool_.reset(new ThreadPool(desc_.cpu_threads + 1));
+	io_pool_.reset(new ThreadPool(desc_.io_threads + 1));
+}
+
+TexturePipeline::~TexturePipeline() {
+	WaitAll();
+}
+
+UINT TexturePipeline::Load(const std::string &filename) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	// wall_ms counts from here when nothing else is loading.
+	if (unfinished_ == 0)
+		start_ms_ = NowMs();
+
+	UINT handle = static_cast<UINT>(jobs_.size());
+	jobs_.emplace_back();
+	Job &job = jobs_.back();
+	job.filename = filename;
+	job.texture.handle = handle;
+	job.texture.filename = &job.filename;
+	++unfinished_;
+
+	to_read_.push_back(&job);
+	StartReads();
+	return handle;
+}
+
+void TexturePipeline::StartReads() {
+	while (in_flight_ < desc_.max_in_flight && !to_read_.empty()) {
+		Job *job = to_read_.front();
+		to_read_.pop_front();
+		job->state = kReading;
+		++in_flight_;
+		io_pool_->Submit([this, job]() { Read(*job); });
+	}
+}
+
+void TexturePipeline::Read(Job &job) {
+	PROFILE_ZONE("TexturePipeline::Read");
+
+	double start = NowMs();
+	std::unique_ptr<MappedFile> file(new MappedFile);
+	if (!file->Open(job.filename)) {
+		job.read_ms = NowMs() - start;
+		Finish(job, E_FAIL);
+		return;
+	}
+
+	// Fault every page in here, so the parse and create stages never wait on
+	// the disk.
+	const size_t kPageSize = 4096;
+	uint8_t touched = 0;
+	for (size_t i = 0; i < file->Size(); i += kPageSize)
+		touched ^= file->Data()[i];
+	volatile uint8_t sink = touched;
+	(void)sink;
+
+	job.bytes = file->Size();
+	job.file = std::move(file);
+	job.read_ms = NowMs() - start;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job.state = kParsing;
+	}
+	cpu_pool_->Submit([this, &job]() { Parse(job); });
+}
+
+HRESULT TexturePipeline::FindSubresources(const uint8_t *data, size_t size, Texture &texture) {
+	const DDS_HEADER *header = nullptr;
+	size_t offset = 0;
+	HRESULT hr = ParseDDSHeader(data, size, &header, &offset);
+	if (SUCCEEDED(hr))
+		hr = GetDDSTextureInfo(header, &texture.info);
+	if (FAILED(hr))
+		return hr;
+
+	// Array slices (six per cube) one after the other, each with its whole
+	// mip chain, and every depth slice of a volume mip together.
+	const DDS_TEXTURE_INFO &info = texture.info;
+	const uint8_t *bits = data + offset;
+	const uint8_t *end = data + size;
+	texture.subresources.clear();
+	texture.subresources.reserve(static_cast<size_t>(info.arraySize)*info.mipCount);
+	for (uint32_t slice = 0; slice < info.arraySize; ++slice) {
+		size_t width = info.width, height = info.height, depth = info.depth;
+		for (uint32_t level = 0; level < info.mipCount; ++level) {
+			size_t num_bytes = 0, row_bytes = 0;
+			GetSurfaceInfo(width, height, info.format, &num_bytes, &row_bytes, nullptr);
+			if (num_bytes == 0 || static_cast<size_t>(end - bits) / depth < num_bytes)
+				return E_FAIL;
+
+			Subresource subresource = { bits, static_cast<UINT>(row_bytes), static_cast<UINT>(num_bytes) };
+			texture.subresources.push_back(subresource);
+			bits += num_bytes*depth;
+
+			width = std::max<size_t>(width / 2, 1);
+			height = std::max<size_t>(height / 2, 1);
+			depth = std::max<size_t>(depth / 2, 1);
+		}
+	}
+	return S_OK;
+}
+
+void TexturePipeline::Parse(Job &job) {
+	PROFILE_ZONE("TexturePipeline::Parse");
+
+	double start = NowMs();
+	HRESULT hr = FindSubresources(job.file->Data(), job.file->Size(), job.texture);
+	// Formats the generator does not handle keep their single level.
+	if (SUCCEEDED(hr) && desc_.generate_mips && job.texture.info.mipCount == 1 &&
+		MipGenerator::LevelCount(job.texture.info.width, job.texture.info.height) > 1 &&
+		SUCCEEDED(MipGenerator::GenerateDDS(job.file->Data(), job.file->Size(), MipGenerator::Desc(), job.generated)))
+		hr = FindSubresources(job.generated.data(), job.generated.size(), job.texture);
+	job.parse_ms = NowMs() - start;
+	if (FAILED(hr)) {
+		Finish(job, hr);
+		return;
+	}
+
+	if (backend_.FreeThreaded()) {
+		Create(job);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex_);
+	job.state = kCreating;
+	to_create_.push_back(&job);
+	progress_cv_.notify_all();
+}
+
+void TexturePipeline::Create(Job &job) {
+	PROFILE_ZONE("TexturePipeline::Create");
+
+	double start = NowMs();
+	HRESULT hr = backend_.Create(job.texture);
+	job.create_ms = NowMs() - start;
+	Finish(job, hr);
+}
+
+void TexturePipeline::Finish(Job &job, HRESULT hr) {
+	job.file.reset();
+	job.generated.clear();
+	job.generated.shrink_to_fit();
+	job.texture.subresources.clear();
+	job.texture.subresources.shrink_to_fit();
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	job.state = kDone;
+	job.hr = hr;
+
+	++stats_.textures;
+	if (FAILED(hr))
+		++stats_.failed;
+	stats_.bytes += job.bytes;
+	stats_.read_ms += job.read_ms;
+	stats_.parse_ms += job.parse_ms;
+	stats_.create_ms += job.create_ms;
+	if (--unfinished_ == 0)
+		stats_.wall_ms += NowMs() - start_ms_;
+
+	--in_flight_;
+	StartReads();
+	progress_cv_.notify_all();
+}
+
+void TexturePipeline::Pump() {
+	for (;;) {
+		Job *job;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (to_create_.empty())
+				return;
+			job = to_create_.front();
+			to_create_.pop_front();
+		}
+		Create(*job);
+	}
+}
+
+HRESULT TexturePipeline::Wait(UINT handle) {
+	for (;;) {
+		Pump();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		const Job &job = jobs_[handle];
+		progress_cv_.wait(lock, [&] { return job.state == kDone || !to_create_.empty(); });
+		if (job.state == kDone)
+			return job.hr;
+	}
+}
+
+void TexturePipeline::WaitAll() {
+	for (;;) {
+		Pump();
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		progress_cv_.wait(lock, [this] { return unfinished_ == 0 || !to_create_.empty(); });
+		if (unfinished_ == 0)
+			return;
+	}
+}
+
+TexturePipeline::Stats TexturePipeline::GetStats() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return stats_;
+}
+
+HRESULT NullTextureBackend::Create(const TexturePipeline::Texture &texture) {
+	const DDS_TEXTURE_INFO &info = texture.info;
+	uint64_t sum = 0;
+	for (size_t i = 0; i < texture.subresources.size(); ++i) {
+		const TexturePipeline::Subresource &subresource = texture.subresources[i];
+		size_t level = i % info.mipCount;
+		size_t bytes = static_cast<size_t>(subresource.slice_pitch)*std::max<size_t>(info.depth >> level, 1);
+		size_t j = 0;
+		for (; j + sizeof(uint64_t) <= bytes; j += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, subresource.data + j, sizeof(word));
+			sum += word;
+		}
+		for (; j < bytes; ++j)
+			sum += subresource.data[j];
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (texture.handle >= infos_.size()) {
+		infos_.resize(texture.handle + 1);
+		created_.resize(texture.handle + 1, false);
+	}
+	infos_[texture.handle] = info;
+	created_[texture.handle] = true;
+	checksum_ += sum;
+	return S_OK;
+}
+
+bool NullTextureBackend::GetInfo(UINT handle, DDS_TEXTURE_INFO &info) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (handle >= created_.size() || !created_[handle])
+		return false;
+	info = infos_[handle];
+	return true;
+}
+
+uint64_t NullTextureBackend::Checksum() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return checksum_;
+}
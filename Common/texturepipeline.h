@@ -0,0 +1,177 @@
+#ifndef TEXTUREPIPELINE_H
+#define TEXTUREPIPELINE_H
+
+#include"DDSHeader.h"
+#include<condition_variable>
+#include<cstddef>
+#include<cstdint>
+#include<deque>
+#include<memory>
+#include<mutex>
+#include<string>
+#include<vector>
+
+class MappedFile;
+class ThreadPool;
+
+// Loads DDS files in three stages that overlap across files, so startup waits
+// on the disk rather than on one file after another:
+//   - read: a few I/O threads map each file and fault its pages in, with at
+//     most max_in_flight files read and not yet created, so memory stays
+//     bounded however many are queued;
+//   - parse: the CPU threads validate the headers and find every
+//     subresource's texels in the mapping, as DDSTextureLoader's FillInitData
+//     does, having built the mip chain first if asked to;
+//   - create: a Backend makes the texture from the subresources, on the CPU
+//     threads when it is free-threaded and otherwise in Pump() and Wait().
+//
+// Load() returns a handle at once; Wait() on it gives the outcome.  A headless
+// backend, such as NullTextureBackend, stands in for Direct3D.
+class TexturePipeline {
+public:
+	struct Desc {
+		UINT io_threads = 2;
+		UINT cpu_threads = 0;		// counts no calling thread; 0 picks hardware_concurrency
+		UINT max_in_flight = 8;		// files read and not yet created
+		bool generate_mips = false;	// gives single-level files a full chain, see MipGenerator
+	};
+
+	// Where one subresource's texels lie in the file, in the order of
+	// D3D11CalcSubresource: every mip of the first array slice, then the next.
+	struct Subresource {
+		const uint8_t *data;
+		UINT row_pitch;
+		UINT slice_pitch;
+	};
+
+	struct Texture {
+		UINT handle;
+		const std::string *filename;
+		DirectX::DDS_TEXTURE_INFO info;
+		std::vector<Subresource> subresources;
+	};
+
+	class Backend {
+	public:
+		virtual ~Backend() {}
+
+		// Whether Create() may run on several threads at once.
+		virtual bool FreeThreaded() const = 0;
+
+		// The subresources point into a mapping that is closed when this
+		// returns.
+		virtual HRESULT Create(const Texture &texture) = 0;
+	};
+
+	// Time spent in each stage, summed over the files, and from the first
+	// Load() to the last file done.
+	struct Stats {
+		UINT textures = 0;
+		UINT failed = 0;
+		uint64_t bytes = 0;
+		double read_ms = 0.0;
+		double parse_ms = 0.0;
+		double create_ms = 0.0;
+		double wall_ms = 0.0;
+	};
+
+	TexturePipeline(const Desc &desc, Backend &backend);
+	// Waits for every file queued.
+	~TexturePipeline();
+
+	// Queues a file and returns its handle, numbered from 0 in call order.
+	UINT Load(const std::string &filename);
+
+	// Creates the textures whose files are parsed, when the backend is not
+	// free-threaded; otherwise does nothing.
+	void Pump();
+
+	// Waits for a file to be created, pumping meanwhile, and returns how it
+	// went: S_OK, the failing HRESULT, or E_FAIL when it could not be read.
+	HRESULT Wait(UINT handle);
+	void WaitAll();
+
+	Stats GetStats() const;
+
+	// Fills in the info and subresources of a DDS file in memory, which the
+	// subresources then point into.
+	static HRESULT FindSubresources(const uint8_t *data, size_t size, Texture &texture);
+
+private:
+	TexturePipeline(const TexturePipeline&) = delete;
+	TexturePipeline& operator=(const TexturePipeline&) = delete;
+
+	enum JobState {
+		kQueued,
+		kReading,
+		kParsing,
+		kCreating,
+		kDone
+	};
+
+	struct Job {
+		std::string filename;
+		std::unique_ptr<MappedFile> file;
+		std::vector<uint8_t> generated;		// the file with its chain, if generated
+		Texture texture;
+		JobState state = kQueued;
+		HRESULT hr = S_OK;
+		uint64_t bytes = 0;
+		double read_ms = 0.0;
+		double parse_ms = 0.0;
+		double create_ms = 0.0;
+	};
+
+	// Starts reading queued files while there is room.  Called with mutex_
+	// held.
+	void StartReads();
+	void Read(Job &job);
+	void Parse(Job &job);
+	void Create(Job &job);
+	// Releases the file and lets the next one be read.
+	void Finish(Job &job, HRESULT hr);
+
+private:
+	Desc desc_;
+	Backend &backend_;
+
+	// Jobs never move once queued, so the stages hold on to them by pointer
+	// while Load() adds more.
+	std::deque<Job> jobs_;
+	std::deque<Job*> to_read_;
+	std::deque<Job*> to_create_;
+	UINT in_flight_ = 0;
+	UINT unfinished_ = 0;
+
+	Stats stats_;
+	double start_ms_ = 0.0;
+
+	mutable std::mutex mutex_;
+	std::condition_variable progress_cv_;
+
+	// Last, so their workers finish before anything they use goes away.
+	std::unique_ptr<ThreadPool> cpu_pool_;
+	std::unique_ptr<ThreadPool> io_pool_;
+};
+
+// Makes no textures: records each one's description, and reads every texel
+// as an upload would.
+class NullTextureBackend : public TexturePipeline::Backend {
+public:
+	bool FreeThreaded() const override {
+		return true;
+	}
+	HRESULT Create(const TexturePipeline::Texture &texture) override;
+
+	// The description of a handle created so far; false for one that is not.
+	bool GetInfo(UINT handle, DirectX::DDS_TEXTURE_INFO &info) const;
+	uint64_t Checksum() const;
+
+private:
+	mutable std::mutex mutex_;
+	std::vector<DirectX::DDS_TEXTURE_INFO> infos_;
+	std::vector<bool> created_;
+	uint64_t checksum_ = 0;
+};
+
+#endif
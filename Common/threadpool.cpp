@@ -0,0 +1,93 @@
+#include"threadpool.h"
+#include<algorithm>
+#include<atomic>
+
+ThreadPool::ThreadPool(UINT thread_cnt) {
+	if (thread_cnt == 0)
+		thread_cnt = std::max(1u, std::thread::hardware_concurrency());
+
+	// The thread calling ParallelFor() is one of the threads.
+	for (UINT i = 1; i < thread_cnt; ++i)
+		workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	job_cv_.notify_all();
+
+	for (std::thread &worker : workers_)
+		worker.join();
+}
+
+void ThreadPool::WorkerLoop() {
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			job_cv_.wait(lock, [this] { return quit_ || !jobs_.empty(); });
+			if (quit_ && jobs_.empty())
+				return;
+
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+		job();
+	}
+}
+
+void ThreadPool::Submit(std::function<void()> job) {
+	if (workers_.empty()) {
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		jobs_.push_back(std::move(job));
+	}
+	job_cv_.notify_one();
+}
+
+void ThreadPool::ParallelFor(UINT task_cnt, const std::function<void(UINT)> &task) {
+	if (task_cnt == 0)
+		return;
+
+	UINT helper_cnt = std::min(static_cast<UINT>(workers_.size()), task_cnt - 1);
+	if (helper_cnt == 0) {
+		for (UINT i = 0; i < task_cnt; ++i)
+			task(i);
+		return;
+	}
+
+	// Indices are handed out dynamically so that uneven tasks still balance.
+	std::atomic<UINT> next_index(0);
+	UINT helpers_running = helper_cnt;
+
+	auto drain = [&]() {
+		for (UINT i = next_index++; i < task_cnt; i = next_index++)
+			task(i);
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		for (UINT i = 0; i < helper_cnt; ++i) {
+			jobs_.push_back([&]() {
+				drain();
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (--helpers_running == 0)
+					done_cv_.notify_all();
+			});
+		}
+	}
+	job_cv_.notify_all();
+
+	drain();
+
+	// Everything captured above lives on this stack frame, so wait for the
+	// helpers to leave it even if the calling thread did all the work.
+	std::unique_lock<std::mutex> lock(mutex_);
+	done_cv_.wait(lock, [&] { return helpers_running == 0; });
+}
@@ -0,0 +1,54 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include<Windows.h>
+#include<condition_variable>
+#include<deque>
+#include<functional>
+#include<mutex>
+#include<thread>
+#include<vector>
+
+// A fixed set of worker threads fed from a single job queue.
+// ParallelFor() is a fork-join helper: the calling thread takes part in the
+// work and the call returns only when every index has been processed.
+// Do not call ParallelFor() from inside a job running on the same pool.
+// Submit() hands a job to the workers and returns at once, for work that
+// should not hold up the calling thread.
+class ThreadPool {
+public:
+	// thread_cnt counts the calling thread, so ThreadPool(4) spawns 3 workers.
+	// 0 picks std::thread::hardware_concurrency().
+	explicit ThreadPool(UINT thread_cnt = 0);
+	~ThreadPool();
+
+	UINT ThreadCount() const {
+		return static_cast<UINT>(workers_.size()) + 1;
+	}
+
+	// Runs task(i) for every i in [0, task_cnt), spread over all threads.
+	void ParallelFor(UINT task_cnt, const std::function<void(UINT)> &task);
+
+	// Queues job for the next free worker.  A pool without workers
+	// (ThreadPool(1)) runs it before returning.  Jobs still queued when the
+	// pool is destroyed run first.
+	void Submit(std::function<void()> job);
+
+private:
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void WorkerLoop();
+
+private:
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> jobs_;
+
+	std::mutex mutex_;
+	std::condition_variable job_cv_;
+	std::condition_variable done_cv_;
+
+	bool quit_ = false;
+};
+
+#endif
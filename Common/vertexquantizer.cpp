@@ -0,0 +1,296 @@
+#include"vertexquantizer.h"
+#include"profiler.h"
+#include<algorithm>
+#include<cfloat>
+#include<cmath>
+#include<cstring>
+
+using namespace DirectX;
+
+namespace {
+
+template<class T>
+const T &At(const T *first, size_t stride, size_t i) {
+	return *reinterpret_cast<const T *>(reinterpret_cast<const char *>(first) + i * stride);
+}
+
+template<class T>
+T &At(T *first, size_t stride, size_t i) {
+	return *reinterpret_cast<T *>(reinterpret_cast<char *>(first) + i * stride);
+}
+
+float SignNotZero(float x) {
+	return x < 0.0f ? -1.0f : 1.0f;
+}
+
+// What the input assembler reads back from R16G16_SNORM: -32768 and -32767
+// are both -1.
+float SnormToFloat(int16_t q) {
+	return std::max(q / 32767.0f, -1.0f);
+}
+
+float Dot(const XMFLOAT3 &a, const XMFLOAT3 &b) {
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+XMFLOAT3 Normalized(const XMFLOAT3 &v) {
+	float length = std::sqrt(Dot(v, v));
+	if (length == 0.0f)
+		return v;
+	return XMFLOAT3(v.x / length, v.y / length, v.z / length);
+}
+
+// Zero vectors (a degenerate tangent, say) count as no error.
+float AngleDegrees(const XMFLOAT3 &a, const XMFLOAT3 &b) {
+	if (Dot(a, a) == 0.0f || Dot(b, b) == 0.0f)
+		return 0.0f;
+	float cos_angle = std::min(std::max(Dot(Normalized(a), Normalized(b)), -1.0f), 1.0f);
+	return std::acos(cos_angle) * (180.0f / MathHelper::Pi);
+}
+
+float Distance(const XMFLOAT3 &a, const XMFLOAT3 &b) {
+	XMFLOAT3 d(a.x - b.x, a.y - b.y, a.z - b.z);
+	return std::sqrt(Dot(d, d));
+}
+
+}
+
+VertexQuantizer::Bounds VertexQuantizer::ComputeBounds(const XMFLOAT3 *positions, size_t stride, size_t cnt) {
+	Bounds bounds;
+	if (cnt == 0) {
+		bounds.min = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		bounds.extent = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		return bounds;
+	}
+
+	XMFLOAT3 lo(FLT_MAX, FLT_MAX, FLT_MAX);
+	XMFLOAT3 hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < cnt; ++i) {
+		const XMFLOAT3 &p = At(positions, stride, i);
+		lo.x = std::min(lo.x, p.x); hi.x = std::max(hi.x, p.x);
+		lo.y = std::min(lo.y, p.y); hi.y = std::max(hi.y, p.y);
+		lo.z = std::min(lo.z, p.z); hi.z = std::max(hi.z, p.z);
+	}
+	bounds.min = lo;
+	bounds.extent = XMFLOAT3(hi.x - lo.x, hi.y - lo.y, hi.z - lo.z);
+	return bounds;
+}
+
+void VertexQuantizer::EncodePositions(const XMFLOAT3 *positions, size_t stride, size_t cnt,
+	const Bounds &bounds, uint16_t *out, size_t out_stride) {
+	// A flat axis encodes as 0 and decodes back to min.
+	float scale_x = bounds.extent.x > 0.0f ? 65535.0f / bounds.extent.x : 0.0f;
+	float scale_y = bounds.extent.y > 0.0f ? 65535.0f / bounds.extent.y : 0.0f;
+	float scale_z = bounds.extent.z > 0.0f ? 65535.0f / bounds.extent.z : 0.0f;
+
+	for (size_t i = 0; i < cnt; ++i) {
+		const XMFLOAT3 &p = At(positions, stride, i);
+		uint16_t *q = &At(out, out_stride, i);
+		q[0] = static_cast<uint16_t>(std::min(std::max((p.x - bounds.min.x) * scale_x, 0.0f), 65535.0f) + 0.5f);
+		q[1] = static_cast<uint16_t>(std::min(std::max((p.y - bounds.min.y) * scale_y, 0.0f), 65535.0f) + 0.5f);
+		q[2] = static_cast<uint16_t>(std::min(std::max((p.z - bounds.min.z) * scale_z, 0.0f), 65535.0f) + 0.5f);
+		q[3] = 65535;
+	}
+}
+
+void VertexQuantizer::EncodeOctahedral(const XMFLOAT3 *normals, size_t stride, size_t cnt,
+	int16_t *out, size_t out_stride) {
+	for (size_t i = 0; i < cnt; ++i) {
+		const XMFLOAT3 &n = At(normals, stride, i);
+		int16_t *q = &At(out, out_stride, i);
+
+		// Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower
+		// half over the upper one.
+		float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (l1 == 0.0f) {
+			q[0] = q[1] = 0;
+			continue;
+		}
+		float u = n.x / l1;
+		float v = n.y / l1;
+		if (n.z < 0.0f) {
+			float folded_u = (1.0f - std::fabs(v)) * SignNotZero(u);
+			v = (1.0f - std::fabs(u)) * SignNotZero(v);
+			u = folded_u;
+		}
+
+		// Rounding each axis on its own is not always the closest direction;
+		// try the four neighbouring codes and keep the best.
+		float fu = std::floor(u * 32767.0f);
+		float fv = std::floor(v * 32767.0f);
+		XMFLOAT3 unit = Normalized(n);
+		float best_dot = -2.0f;
+		for (int k = 0; k < 4; ++k) {
+			int16_t c[2] = {
+				static_cast<int16_t>(std::min(std::max(fu + (k & 1), -32767.0f), 32767.0f)),
+				static_cast<int16_t>(std::min(std::max(fv + (k >> 1), -32767.0f), 32767.0f))
+			};
+			float d = Dot(DecodeOctahedral(c), unit);
+			if (d > best_dot) {
+				best_dot = d;
+				q[0] = c[0];
+				q[1] = c[1];
+			}
+		}
+	}
+}
+
+void VertexQuantizer::EncodeUnorm1010102(const XMFLOAT3 *vectors, size_t stride, size_t cnt,
+	uint32_t *out, size_t out_stride) {
+	for (size_t i = 0; i < cnt; ++i) {
+		const XMFLOAT3 &v = At(vectors, stride, i);
+		uint32_t x = static_cast<uint32_t>(std::min(std::max(v.x * 0.5f + 0.5f, 0.0f), 1.0f) * 1023.0f + 0.5f);
+		uint32_t y = static_cast<uint32_t>(std::min(std::max(v.y * 0.5f + 0.5f, 0.0f), 1.0f) * 1023.0f + 0.5f);
+		uint32_t z = static_cast<uint32_t>(std::min(std::max(v.z * 0.5f + 0.5f, 0.0f), 1.0f) * 1023.0f + 0.5f);
+		At(out, out_stride, i) = x | (y << 10) | (z << 20) | (3u << 30);
+	}
+}
+
+void VertexQuantizer::EncodeHalf2(const XMFLOAT2 *texcoords, size_t stride, size_t cnt,
+	uint16_t *out, size_t out_stride) {
+	for (size_t i = 0; i < cnt; ++i) {
+		const XMFLOAT2 &t = At(texcoords, stride, i);
+		uint16_t *q = &At(out, out_stride, i);
+		q[0] = FloatToHalf(t.x);
+		q[1] = FloatToHalf(t.y);
+	}
+}
+
+XMFLOAT3 VertexQuantizer::DecodePosition(const uint16_t *q, const Bounds &bounds) {
+	return XMFLOAT3(
+		bounds.min.x + q[0] / 65535.0f * bounds.extent.x,
+		bounds.min.y + q[1] / 65535.0f * bounds.extent.y,
+		bounds.min.z + q[2] / 65535.0f * bounds.extent.z);
+}
+
+XMFLOAT3 VertexQuantizer::DecodeOctahedral(const int16_t *q) {
+	float x = SnormToFloat(q[0]);
+	float y = SnormToFloat(q[1]);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	float t = std::max(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	return Normalized(XMFLOAT3(x, y, z));
+}
+
+XMFLOAT3 VertexQuantizer::DecodeUnorm1010102(uint32_t q) {
+	return XMFLOAT3(
+		(q & 0x3ff) / 1023.0f * 2.0f - 1.0f,
+		((q >> 10) & 0x3ff) / 1023.0f * 2.0f - 1.0f,
+		((q >> 20) & 0x3ff) / 1023.0f * 2.0f - 1.0f);
+}
+
+uint16_t VertexQuantizer::FloatToHalf(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+	uint32_t abs = bits & 0x7fffffff;
+
+	if (abs >= 0x7f800000)
+		return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 | ((abs >> 13) & 0x3ff) : 0);
+	// 65520 and up round to infinity.
+	if (abs >= 0x477ff000)
+		return sign | 0x7c00;
+
+	uint32_t h;
+	uint32_t rem;
+	uint32_t halfway;
+	if (abs < 0x38800000) {
+		// Below the smallest normal half: shift the mantissa, with its
+		// implicit bit, down to a multiple of 2^-24.
+		uint32_t shift = 126 - (abs >> 23);
+		if (shift > 24)
+			return sign;
+		uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+		h = mantissa >> shift;
+		rem = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else {
+		h = (abs - 0x38000000) >> 13;
+		rem = abs & 0x1fff;
+		halfway = 0x1000;
+	}
+	if (rem > halfway || (rem == halfway && (h & 1)))
+		++h;
+	return sign | static_cast<uint16_t>(h);
+}
+
+float VertexQuantizer::HalfToFloat(uint16_t h) {
+	uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+
+	uint32_t bits;
+	if (exponent == 0x1f) {
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else if (exponent != 0) {
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	else {
+		float f = mantissa * (1.0f / 16777216.0f);
+		return sign ? -f : f;
+	}
+
+	float f;
+	std::memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+VertexQuantizer::Bounds VertexQuantizer::Quantize(const XMFLOAT3 *positions, const XMFLOAT3 *normals, size_t stride,
+	size_t cnt, std::vector<PosNormal> &out) {
+	PROFILE_ZONE("VertexQuantizer::Quantize");
+
+	Bounds bounds = ComputeBounds(positions, stride, cnt);
+	out.resize(cnt);
+	if (cnt == 0)
+		return bounds;
+	EncodePositions(positions, stride, cnt, bounds, out[0].position, sizeof(PosNormal));
+	EncodeOctahedral(normals, stride, cnt, out[0].normal, sizeof(PosNormal));
+	return bounds;
+}
+
+VertexQuantizer::Bounds VertexQuantizer::Quantize(const std::vector<GeometryGenerator::Vertex> &vertices,
+	std::vector<Vertex> &out) {
+	PROFILE_ZONE("VertexQuantizer::Quantize");
+
+	const size_t stride = sizeof(GeometryGenerator::Vertex);
+	size_t cnt = vertices.size();
+	out.resize(cnt);
+	if (cnt == 0)
+		return ComputeBounds(nullptr, stride, 0);
+
+	Bounds bounds = ComputeBounds(&vertices[0].position, stride, cnt);
+	EncodePositions(&vertices[0].position, stride, cnt, bounds, out[0].position, sizeof(Vertex));
+	EncodeOctahedral(&vertices[0].normal, stride, cnt, out[0].normal, sizeof(Vertex));
+	EncodeUnorm1010102(&vertices[0].tangent, stride, cnt, &out[0].tangent, sizeof(Vertex));
+	EncodeHalf2(&vertices[0].texcoord, stride, cnt, out[0].texcoord, sizeof(Vertex));
+	return bounds;
+}
+
+VertexQuantizer::Error VertexQuantizer::MeasureError(const XMFLOAT3 *positions, const XMFLOAT3 *normals, size_t stride,
+	const std::vector<PosNormal> &quantized, const Bounds &bounds) {
+	Error error;
+	for (size_t i = 0; i < quantized.size(); ++i) {
+		const PosNormal &q = quantized[i];
+		error.position = std::max(error.position, Distance(DecodePosition(q.position, bounds), At(positions, stride, i)));
+		error.normal = std::max(error.normal, AngleDegrees(DecodeOctahedral(q.normal), At(normals, stride, i)));
+	}
+	return error;
+}
+
+VertexQuantizer::Error VertexQuantizer::MeasureError(const std::vector<GeometryGenerator::Vertex> &vertices,
+	const std::vector<Vertex> &quantized, const Bounds &bounds) {
+	Error error;
+	for (size_t i = 0; i < quantized.size(); ++i) {
+		const GeometryGenerator::Vertex &v = vertices[i];
+		const Vertex &q = quantized[i];
+		error.position = std::max(error.position, Distance(DecodePosition(q.position, bounds), v.position));
+		error.normal = std::max(error.normal, AngleDegrees(DecodeOctahedral(q.normal), v.normal));
+		error.tangent = std::max(error.tangent, AngleDegrees(DecodeUnorm1010102(q.tangent), v.tangent));
+		error.texcoord = std::max(error.texcoord, std::fabs(HalfToFloat(q.texcoord[0]) - v.texcoord.x));
+		error.texcoord = std::max(error.texcoord, std::fabs(HalfToFloat(q.texcoord[1]) - v.texcoord.y));
+	}
+	return error;
+}
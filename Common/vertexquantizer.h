@@ -0,0 +1,89 @@
+#ifndef VERTEXQUANTIZER_H
+#define VERTEXQUANTIZER_H
+
+#include"geometrygenerator.h"
+#include<cstddef>
+#include<cstdint>
+#include<vector>
+
+// Packs float vertices into formats the input assembler expands for free:
+//
+//   position  DXGI_FORMAT_R16G16B16A16_UNORM  16 bits per axis across the
+//             mesh's bounding box; DecodeTransform() maps it back and goes in
+//             front of the world matrix
+//   normal    DXGI_FORMAT_R16G16_SNORM        octahedral; the vertex shader
+//             unfolds it (see DecodeOctahedral())
+//   tangent   DXGI_FORMAT_R10G10B10A2_UNORM   x*0.5+0.5 per axis; the shader
+//             computes v*2-1
+//   texcoord  DXGI_FORMAT_R16G16_FLOAT        half floats
+//
+// A GeometryGenerator::Vertex goes from 44 bytes to 20 and a position/normal
+// pair from 24 bytes to 12.  The decoders here do what the hardware and the
+// shaders do, so MeasureError() reports what ends up on screen.
+class VertexQuantizer {
+public:
+	struct Bounds {
+		DirectX::XMFLOAT3 min;
+		DirectX::XMFLOAT3 extent;	// max - min
+	};
+
+	struct PosNormal {
+		uint16_t position[4];		// w is always 1
+		int16_t normal[2];
+	};
+
+	struct Vertex {
+		uint16_t position[4];
+		int16_t normal[2];
+		uint32_t tangent;
+		uint16_t texcoord[2];
+	};
+
+	// The largest differences from the float vertices.
+	struct Error {
+		float position = 0.0f;		// distance, in model units
+		float normal = 0.0f;		// angle, in degrees
+		float tangent = 0.0f;		// angle, in degrees
+		float texcoord = 0.0f;		// per component
+	};
+
+	// Arrays of attributes take a pointer to the first vertex's attribute and
+	// the size of a vertex, so they read straight out of interleaved buffers.
+	static Bounds ComputeBounds(const DirectX::XMFLOAT3 *positions, size_t stride, size_t cnt);
+
+	// Scales and offsets [0, 1] positions back into the mesh's bounds.
+	static DirectX::XMMATRIX DecodeTransform(const Bounds &bounds) {
+		return DirectX::XMMatrixScaling(bounds.extent.x, bounds.extent.y, bounds.extent.z) *
+			DirectX::XMMatrixTranslation(bounds.min.x, bounds.min.y, bounds.min.z);
+	}
+
+	// The encode kernels.  Each writes cnt values out_stride bytes apart.
+	static void EncodePositions(const DirectX::XMFLOAT3 *positions, size_t stride, size_t cnt,
+		const Bounds &bounds, uint16_t *out, size_t out_stride);
+	static void EncodeOctahedral(const DirectX::XMFLOAT3 *normals, size_t stride, size_t cnt,
+		int16_t *out, size_t out_stride);
+	static void EncodeUnorm1010102(const DirectX::XMFLOAT3 *vectors, size_t stride, size_t cnt,
+		uint32_t *out, size_t out_stride);
+	static void EncodeHalf2(const DirectX::XMFLOAT2 *texcoords, size_t stride, size_t cnt,
+		uint16_t *out, size_t out_stride);
+
+	static DirectX::XMFLOAT3 DecodePosition(const uint16_t *q, const Bounds &bounds);
+	static DirectX::XMFLOAT3 DecodeOctahedral(const int16_t *q);
+	static DirectX::XMFLOAT3 DecodeUnorm1010102(uint32_t q);
+
+	// Round to nearest even, with denormals, infinities and NaNs kept.
+	static uint16_t FloatToHalf(float f);
+	static float HalfToFloat(uint16_t h);
+
+	// Whole meshes; both return the bounds to pass to DecodeTransform().
+	static Bounds Quantize(const DirectX::XMFLOAT3 *positions, const DirectX::XMFLOAT3 *normals, size_t stride,
+		size_t cnt, std::vector<PosNormal> &out);
+	static Bounds Quantize(const std::vector<GeometryGenerator::Vertex> &vertices, std::vector<Vertex> &out);
+
+	static Error MeasureError(const DirectX::XMFLOAT3 *positions, const DirectX::XMFLOAT3 *normals, size_t stride,
+		const std::vector<PosNormal> &quantized, const Bounds &bounds);
+	static Error MeasureError(const std::vector<GeometryGenerator::Vertex> &vertices,
+		const std::vector<Vertex> &quantized, const Bounds &bounds);
+};
+
+#endif
@@ -2,25 +2,193 @@
 // Waves.cpp by Frank Luna (C) 2011 All Rights Reserved.
 //***************************************************************************************
 
-#include "Waves.h"
+#include "waves.h"
+#include "threadpool.h"
+#include "mpmcqueue.h"
+#include "profiler.h"
 #include <algorithm>
 #include <vector>
-#include <cassert>
+#include <cmath>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
 using namespace DirectX;
 
+namespace
+{
+	// Disturbances DisturbMany() can hold between two steps.
+	const UINT DisturbanceQueueSize = 4096;
+
+	// Size of an activity tile; see Waves::SetActivityThreshold().  Bands are
+	// cut at multiples of TileRows.
+	const UINT TileRows    = 16;
+	const UINT TileColumns = 64;
+
+	// Tile row and column of interior grid point (i, j).
+	UINT TileRowOf(UINT i) { return (i-1) / TileRows; }
+	UINT TileColOf(UINT j) { return (j-1) / TileColumns; }
+
+	// The vector kernels below do exactly the scalar operations in the same order
+	// (no FMA, no reciprocal estimates), so they match the scalar loops bit for bit.
+	// Each one handles columns [j, end) as far as full vectors go and returns the
+	// first column left for the scalar tail.
+
+#if defined(__AVX__)
+	UINT HeightRow8(float* prev, const float* curr, const float* up, const float* down,
+		UINT j, UINT end, float k1, float k2, float k3)
+	{
+		__m256 K1 = _mm256_set1_ps(k1);
+		__m256 K2 = _mm256_set1_ps(k2);
+		__m256 K3 = _mm256_set1_ps(k3);
+		for(; j+8 <= end; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(down+j), _mm256_loadu_ps(up+j));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr+j+1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr+j-1));
+
+			__m256 h = _mm256_add_ps(
+				_mm256_mul_ps(K1, _mm256_loadu_ps(prev+j)),
+				_mm256_mul_ps(K2, _mm256_loadu_ps(curr+j)));
+			_mm256_storeu_ps(prev+j, _mm256_add_ps(h, _mm256_mul_ps(K3, sum)));
+		}
+		return j;
+	}
+
+	UINT NormalRow8(const float* row, const float* up, const float* down,
+		float* nx, float* ny, float* nz, UINT j, UINT end, float twoDx)
+	{
+		__m256 TwoDx   = _mm256_set1_ps(twoDx);
+		__m256 TwoDxSq = _mm256_mul_ps(TwoDx, TwoDx);
+		for(; j+8 <= end; j += 8)
+		{
+			__m256 x = _mm256_sub_ps(_mm256_loadu_ps(row+j-1), _mm256_loadu_ps(row+j+1));
+			__m256 z = _mm256_sub_ps(_mm256_loadu_ps(down+j), _mm256_loadu_ps(up+j));
+
+			__m256 len = _mm256_add_ps(_mm256_mul_ps(x, x), TwoDxSq);
+			len = _mm256_sqrt_ps(_mm256_add_ps(len, _mm256_mul_ps(z, z)));
+			_mm256_storeu_ps(nx+j, _mm256_div_ps(x, len));
+			_mm256_storeu_ps(ny+j, _mm256_div_ps(TwoDx, len));
+			_mm256_storeu_ps(nz+j, _mm256_div_ps(z, len));
+		}
+		return j;
+	}
+
+	UINT TangentRow8(const float* row, float* tx, float* ty, UINT j, UINT end, float twoDx)
+	{
+		__m256 TwoDx   = _mm256_set1_ps(twoDx);
+		__m256 TwoDxSq = _mm256_mul_ps(TwoDx, TwoDx);
+		for(; j+8 <= end; j += 8)
+		{
+			__m256 y = _mm256_sub_ps(_mm256_loadu_ps(row+j+1), _mm256_loadu_ps(row+j-1));
+
+			__m256 len = _mm256_sqrt_ps(_mm256_add_ps(TwoDxSq, _mm256_mul_ps(y, y)));
+			_mm256_storeu_ps(tx+j, _mm256_div_ps(TwoDx, len));
+			_mm256_storeu_ps(ty+j, _mm256_div_ps(y, len));
+		}
+		return j;
+	}
+#endif
+
+#if defined(_XM_SSE_INTRINSICS_)
+	UINT HeightRow4(float* prev, const float* curr, const float* up, const float* down,
+		UINT j, UINT end, float k1, float k2, float k3)
+	{
+		__m128 K1 = _mm_set1_ps(k1);
+		__m128 K2 = _mm_set1_ps(k2);
+		__m128 K3 = _mm_set1_ps(k3);
+		for(; j+4 <= end; j += 4)
+		{
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(down+j), _mm_loadu_ps(up+j));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr+j+1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr+j-1));
+
+			__m128 h = _mm_add_ps(
+				_mm_mul_ps(K1, _mm_loadu_ps(prev+j)),
+				_mm_mul_ps(K2, _mm_loadu_ps(curr+j)));
+			_mm_storeu_ps(prev+j, _mm_add_ps(h, _mm_mul_ps(K3, sum)));
+		}
+		return j;
+	}
+
+	UINT NormalRow4(const float* row, const float* up, const float* down,
+		float* nx, float* ny, float* nz, UINT j, UINT end, float twoDx)
+	{
+		__m128 TwoDx   = _mm_set1_ps(twoDx);
+		__m128 TwoDxSq = _mm_mul_ps(TwoDx, TwoDx);
+		for(; j+4 <= end; j += 4)
+		{
+			__m128 x = _mm_sub_ps(_mm_loadu_ps(row+j-1), _mm_loadu_ps(row+j+1));
+			__m128 z = _mm_sub_ps(_mm_loadu_ps(down+j), _mm_loadu_ps(up+j));
+
+			__m128 len = _mm_add_ps(_mm_mul_ps(x, x), TwoDxSq);
+			len = _mm_sqrt_ps(_mm_add_ps(len, _mm_mul_ps(z, z)));
+			_mm_storeu_ps(nx+j, _mm_div_ps(x, len));
+			_mm_storeu_ps(ny+j, _mm_div_ps(TwoDx, len));
+			_mm_storeu_ps(nz+j, _mm_div_ps(z, len));
+		}
+		return j;
+	}
+
+	UINT TangentRow4(const float* row, float* tx, float* ty, UINT j, UINT end, float twoDx)
+	{
+		__m128 TwoDx   = _mm_set1_ps(twoDx);
+		__m128 TwoDxSq = _mm_mul_ps(TwoDx, TwoDx);
+		for(; j+4 <= end; j += 4)
+		{
+			__m128 y = _mm_sub_ps(_mm_loadu_ps(row+j+1), _mm_loadu_ps(row+j-1));
+
+			__m128 len = _mm_sqrt_ps(_mm_add_ps(TwoDxSq, _mm_mul_ps(y, y)));
+			_mm_storeu_ps(tx+j, _mm_div_ps(TwoDx, len));
+			_mm_storeu_ps(ty+j, _mm_div_ps(y, len));
+		}
+		return j;
+	}
+#endif
+
+	// Largest |a[j]| or |b[j]| over [j, end).
+	float PeakAbs(const float* a, const float* b, UINT j, UINT end)
+	{
+		float peak = 0.0f;
+#if defined(_XM_SSE_INTRINSICS_)
+		__m128 SignMask = _mm_set1_ps(-0.0f);
+		__m128 Peak     = _mm_setzero_ps();
+		for(; j+4 <= end; j += 4)
+		{
+			Peak = _mm_max_ps(Peak, _mm_andnot_ps(SignMask, _mm_loadu_ps(a+j)));
+			Peak = _mm_max_ps(Peak, _mm_andnot_ps(SignMask, _mm_loadu_ps(b+j)));
+		}
+		Peak = _mm_max_ps(Peak, _mm_movehl_ps(Peak, Peak));
+		Peak = _mm_max_ss(Peak, _mm_shuffle_ps(Peak, Peak, _MM_SHUFFLE(1, 1, 1, 1)));
+		peak = _mm_cvtss_f32(Peak);
+#endif
+		for(; j < end; ++j)
+			peak = std::max(peak, std::max(std::fabs(a[j]), std::fabs(b[j])));
+		return peak;
+	}
+}
+
 Waves::Waves()
 : mNumRows(0), mNumCols(0), mVertexCount(0), mTriangleCount(0), 
   mK1(0.0f), mK2(0.0f), mK3(0.0f), mTimeStep(0.0f), mSpatialStep(0.0f),
-  mPrevSolution(0), mCurrSolution(0), mNormals(0), mTangentX(0)
+  mHalfWidth(0.0f), mHalfDepth(0.0f), mPrevHeights(0), mCurrHeights(0),
+  mNormalsX(0), mNormalsY(0), mNormalsZ(0), mTangentsX(0), mTangentsY(0),
+  mTexU(0), mAccumTime(0.0f), mMaxSubSteps(4), mSimdEnabled(true), mDeferredNormals(false),
+  mDisturbanceQueue(new MpmcQueue<Disturbance>(DisturbanceQueueSize)), mThreadPool(0), mBandRows(0), mNumBands(0), mActivityThreshold(0.0f), mNumTileRows(0), mNumTileCols(0)
 {
 }
 
 Waves::~Waves()
 {
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
-	delete[] mNormals;
-	delete[] mTangentX;
+	delete[] mPrevHeights;
+	delete[] mCurrHeights;
+	delete[] mNormalsX;
+	delete[] mNormalsY;
+	delete[] mNormalsZ;
+	delete[] mTangentsX;
+	delete[] mTangentsY;
+	delete[] mTexU;
+	delete mDisturbanceQueue;
+	delete mThreadPool;
 }
 
 UINT Waves::RowCount()const
@@ -63,6 +231,7 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 
 	mTimeStep    = dt;
 	mSpatialStep = dx;
+	mAccumTime   = 0.0f;
 
 	float d = damping*dt+2.0f;
 	float e = (speed*speed)*(dt*dt)/(dx*dx);
@@ -71,115 +240,753 @@ void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
 	mK3     = (2.0f*e) / d;
 
 	// In case Init() called again.
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
-	delete[] mNormals;
-	delete[] mTangentX;
+	delete[] mPrevHeights;
+	delete[] mCurrHeights;
+	delete[] mNormalsX;
+	delete[] mNormalsY;
+	delete[] mNormalsZ;
+	delete[] mTangentsX;
+	delete[] mTangentsY;
+	delete[] mTexU;
+
+	mPrevHeights = new float[m*n];
+	mCurrHeights = new float[m*n];
+	mNormalsX    = new float[m*n];
+	mNormalsY    = new float[m*n];
+	mNormalsZ    = new float[m*n];
+	mTangentsX   = new float[m*n];
+	mTangentsY   = new float[m*n];
+	mTexU        = new float[n];
+
+	// The grid starts flat.  x and z of the grid points are not stored; see GridX()
+	// and GridZ().
+	mHalfWidth = (n-1)*dx*0.5f;
+	mHalfDepth = (m-1)*dx*0.5f;
+
+	std::fill(mPrevHeights, mPrevHeights + m*n, 0.0f);
+	std::fill(mCurrHeights, mCurrHeights + m*n, 0.0f);
+	std::fill(mNormalsX,    mNormalsX + m*n,    0.0f);
+	std::fill(mNormalsY,    mNormalsY + m*n,    1.0f);
+	std::fill(mNormalsZ,    mNormalsZ + m*n,    0.0f);
+	std::fill(mTangentsX,   mTangentsX + m*n,   1.0f);
+	std::fill(mTangentsY,   mTangentsY + m*n,   0.0f);
+
+	for(UINT j = 0; j < n; ++j)
+		mTexU[j] = 0.5f + GridX(j) / Width();
 
-	mPrevSolution = new XMFLOAT3[m*n];
-	mCurrSolution = new XMFLOAT3[m*n];
-	mNormals      = new XMFLOAT3[m*n];
-	mTangentX     = new XMFLOAT3[m*n];
+	// The tiles only depend on the grid size, so the result of the sparse
+	// solver does not depend on the thread count either.
+	UINT interiorRows = m > 2 ? m-2 : 0;
+	UINT interiorCols = n > 2 ? n-2 : 0;
+	mNumTileRows = (interiorRows + TileRows-1) / TileRows;
+	mNumTileCols = (interiorCols + TileColumns-1) / TileColumns;
 
-	// Generate grid vertices in system memory.
+	UINT numTiles = mNumTileRows*mNumTileCols;
+	mTileActive.assign(numTiles, 1);
+	mTileNextActive.assign(numTiles, 0);
+	mTileDirty.assign(numTiles, 1);
+	mTileChanging.assign(numTiles, 1);
+	mTilePeaks.resize(numTiles);
 
-	float halfWidth = (n-1)*dx*0.5f;
-	float halfDepth = (m-1)*dx*0.5f;
-	for(UINT i = 0; i < m; ++i)
+	ChooseBands();
+}
+
+UINT Waves::Update(float dt)
+{
+	PROFILE_ZONE("Waves::Update");
+
+	// Without a positive time step there is no step to take, and the
+	// carried-over time would be divided by zero.
+	if(mVertexCount == 0 || mTimeStep <= 0.0f)
+		return 0;
+
+	mAccumTime += dt;
+
+	// Take as many fixed steps as the elapsed time covers.  A long frame could
+	// call for more steps than the next frame has time for, so past the cap the
+	// backlog is dropped and the simulation runs slower than real time instead.
+	UINT steps = 0;
+	while(mAccumTime >= mTimeStep && steps < mMaxSubSteps)
 	{
-		float z = halfDepth - i*dx;
-		for(UINT j = 0; j < n; ++j)
-		{
-			float x = -halfWidth + j*dx;
+		// Tiles solved by any step of this call are dirty.
+		if(steps == 0)
+			std::fill(mTileDirty.begin(), mTileDirty.end(), 0);
 
-			mPrevSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mCurrSolution[i*n+j] = XMFLOAT3(x, 0.0f, z);
-			mNormals[i*n+j]      = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			mTangentX[i*n+j]     = XMFLOAT3(1.0f, 0.0f, 0.0f);
-		}
+		Step();
+		mAccumTime -= mTimeStep;
+		++steps;
 	}
+
+	if(mAccumTime >= mTimeStep)
+		mAccumTime = std::fmod(mAccumTime, mTimeStep);
+
+	// Without a step the solutions stay, but their blend moves with the alpha
+	// wherever they differ.
+	if(steps == 0)
+		mTileDirty = mTileChanging;
+
+	return steps;
+}
+
+float Waves::InterpolationAlpha()const
+{
+	return mTimeStep > 0.0f ? mAccumTime / mTimeStep : 1.0f;
 }
 
-void Waves::Update(float dt)
+void Waves::Step()
 {
-	static float t = 0;
+	PROFILE_ZONE("Waves::Step");
 
-	// Accumulate time.
-	t += dt;
+	ApplyQueuedDisturbances();
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	// The grid is cut into bands of rows.  A band writes the new heights of
+	// its rows and normals for every row whose neighbours it owns, while those
+	// rows are still in cache.  The two edge rows of a band need heights from
+	// the neighbouring bands, so they wait until every band has finished.
+	// With deferred normals only the heights are advanced here.
+	if(mThreadPool)
+	{
+		mThreadPool->ParallelFor(mNumBands, [this](UINT band) { SolveBand(band); });
+		if(!mDeferredNormals)
+			mThreadPool->ParallelFor(mNumBands, [this](UINT band) { SolveBandSeams(band); });
+	}
+	else
 	{
-		// Only update interior points; we use zero boundary conditions.
-		for(UINT i = 1; i < mNumRows-1; ++i)
+		for(UINT band = 0; band < mNumBands; ++band)
+			SolveBand(band);
+		for(UINT band = 0; band < mNumBands && !mDeferredNormals; ++band)
+			SolveBandSeams(band);
+	}
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevHeights, mCurrHeights);
+
+	UpdateActivity();
+}
+
+void Waves::SolveBand(UINT band)
+{
+	PROFILE_ZONE("Waves::SolveBand");
+
+	UINT rowBegin = 1 + band*mBandRows;
+	UINT rowEnd   = std::min(rowBegin + mBandRows, mNumRows-1);
+
+	// Only the columns of active tiles are solved.  Bands hold whole tile
+	// rows, so the peaks of a tile are only ever written by one band.
+	bool trackPeaks = mActivityThreshold > 0.0f;
+	std::vector<std::pair<UINT, UINT>> spans;
+	std::vector<std::pair<UINT, UINT>> normalSpans;
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		UINT tileRow = TileRowOf(i);
+		if(i == rowBegin || tileRow != TileRowOf(i-1))
 		{
-			for(UINT j = 1; j < mNumCols-1; ++j)
+			ActiveColumns(tileRow, tileRow, 0, spans);
+			if(trackPeaks)
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				TilePeaks zero = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+				std::fill(mTilePeaks.begin() + tileRow*mNumTileCols,
+					mTilePeaks.begin() + (tileRow+1)*mNumTileCols, zero);
 			}
 		}
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+		for(size_t s = 0; s < spans.size(); ++s)
+			UpdateHeightRow(i, spans[s].first, spans[s].second);
+
+		if(trackPeaks)
+			TrackPeaks(tileRow, i);
+
+		// Row i-1 now has new heights above and below it.
+		if(!mDeferredNormals && i >= rowBegin+2)
+		{
+			NormalColumns(i-1, normalSpans);
+			for(size_t s = 0; s < normalSpans.size(); ++s)
+				UpdateNormalRow(mPrevHeights, i-1, normalSpans[s].first, normalSpans[s].second);
+		}
+	}
+}
+
+void Waves::SolveBandSeams(UINT band)
+{
+	UINT rowBegin = 1 + band*mBandRows;
+	UINT rowEnd   = std::min(rowBegin + mBandRows, mNumRows-1);
+
+	std::vector<std::pair<UINT, UINT>> spans;
+	NormalColumns(rowBegin, spans);
+	for(size_t s = 0; s < spans.size(); ++s)
+		UpdateNormalRow(mPrevHeights, rowBegin, spans[s].first, spans[s].second);
+
+	if(rowEnd-1 > rowBegin)
+	{
+		NormalColumns(rowEnd-1, spans);
+		for(size_t s = 0; s < spans.size(); ++s)
+			UpdateNormalRow(mPrevHeights, rowEnd-1, spans[s].first, spans[s].second);
+	}
+}
+
+void Waves::ActiveColumns(UINT firstTileRow, UINT lastTileRow, UINT pad,
+	std::vector<std::pair<UINT, UINT>>& spans)const
+{
+	// Column ranges of the tiles active in any of the tile rows, widened by
+	// pad columns and merged where they touch.
+	spans.clear();
+	for(UINT t = 0; t < mNumTileCols; ++t)
+	{
+		bool active = false;
+		for(UINT tileRow = firstTileRow; tileRow <= lastTileRow && !active; ++tileRow)
+			active = mTileActive[tileRow*mNumTileCols + t] != 0;
+		if(!active)
+			continue;
+
+		UINT colBegin = 1 + t*TileColumns;
+		UINT colEnd   = std::min(colBegin + TileColumns + pad, mNumCols-1);
+		colBegin -= std::min(pad, colBegin-1);
+
+		if(!spans.empty() && spans.back().second >= colBegin)
+			spans.back().second = colEnd;
+		else
+			spans.push_back(std::make_pair(colBegin, colEnd));
+	}
+}
+
+void Waves::NormalColumns(UINT i, std::vector<std::pair<UINT, UINT>>& spans)const
+{
+	// A normal depends on the heights around it, so it needs updating next to
+	// any active tile: one column further, and in the rows above and below.
+	UINT firstTileRow = TileRowOf(std::max(i-1, 1u));
+	UINT lastTileRow  = TileRowOf(std::min(i+1, mNumRows-2));
+	ActiveColumns(firstTileRow, lastTileRow, 1, spans);
+}
+
+void Waves::TrackPeaks(UINT tileRow, UINT i)
+{
+	// Both solutions must be calm before a tile can sleep, or flattening it
+	// would be visible in the next step.
+	const float* next = mPrevHeights + i*mNumCols;
+	const float* curr = mCurrHeights + i*mNumCols;
+
+	bool firstRow = (i-1) % TileRows == 0;
+	bool lastRow  = (i-1) % TileRows == TileRows-1 || i == mNumRows-2;
+
+	for(UINT t = 0; t < mNumTileCols; ++t)
+	{
+		UINT tile = tileRow*mNumTileCols + t;
+		if(!mTileActive[tile])
+			continue;
+
+		UINT colBegin = 1 + t*TileColumns;
+		UINT colEnd   = std::min(colBegin + TileColumns, mNumCols-1);
+
+		TilePeaks& peaks = mTilePeaks[tile];
+		float rowPeak = PeakAbs(next, curr, colBegin, colEnd);
+		peaks.Tile  = std::max(peaks.Tile, rowPeak);
+		peaks.Left  = std::max(peaks.Left, PeakAbs(next, curr, colBegin, colBegin+1));
+		peaks.Right = std::max(peaks.Right, PeakAbs(next, curr, colEnd-1, colEnd));
+		if(firstRow)
+			peaks.Top = rowPeak;
+		if(lastRow)
+			peaks.Bottom = rowPeak;
+	}
+}
+
+void Waves::UpdateActivity()
+{
+	for(size_t tile = 0; tile < mTileActive.size(); ++tile)
+	{
+		mTileDirty[tile] |= mTileActive[tile];
+		mTileChanging[tile] = mTileActive[tile];
+	}
+
+	if(mActivityThreshold <= 0.0f)
+		return;
+
+	// A tile stays awake while it has waves above the threshold, and wakes
+	// its neighbour when they reach the shared edge.
+	std::fill(mTileNextActive.begin(), mTileNextActive.end(), 0);
+	for(UINT tile = 0; tile < mTileActive.size(); ++tile)
+	{
+		if(!mTileActive[tile])
+			continue;
+
+		const TilePeaks& peaks = mTilePeaks[tile];
+		UINT tileRow = tile / mNumTileCols;
+		UINT tileCol = tile % mNumTileCols;
+
+		if(peaks.Tile >= mActivityThreshold)
+			mTileNextActive[tile] = 1;
+		if(peaks.Top >= mActivityThreshold && tileRow > 0)
+			mTileNextActive[tile-mNumTileCols] = 1;
+		if(peaks.Bottom >= mActivityThreshold && tileRow+1 < mNumTileRows)
+			mTileNextActive[tile+mNumTileCols] = 1;
+		if(peaks.Left >= mActivityThreshold && tileCol > 0)
+			mTileNextActive[tile-1] = 1;
+		if(peaks.Right >= mActivityThreshold && tileCol+1 < mNumTileCols)
+			mTileNextActive[tile+1] = 1;
+	}
+
+	for(UINT tile = 0; tile < mTileActive.size(); ++tile)
+	{
+		if(mTileActive[tile] && !mTileNextActive[tile])
+			FlattenTile(tile);
+	}
+
+	mTileActive.swap(mTileNextActive);
+}
+
+void Waves::FlattenTile(UINT tile)
+{
+	// What is left in a sleeping tile is below the threshold; zero it so the
+	// tile is exactly at rest when it wakes up again.
+	UINT rowBegin = 1 + (tile / mNumTileCols)*TileRows;
+	UINT rowEnd   = std::min(rowBegin + TileRows, mNumRows-1);
+	UINT colBegin = 1 + (tile % mNumTileCols)*TileColumns;
+	UINT colEnd   = std::min(colBegin + TileColumns, mNumCols-1);
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		UINT first = i*mNumCols + colBegin;
+		UINT last  = i*mNumCols + colEnd;
+		std::fill(mPrevHeights + first, mPrevHeights + last, 0.0f);
+		std::fill(mCurrHeights + first, mCurrHeights + last, 0.0f);
+		if(!mDeferredNormals)
+		{
+			std::fill(mNormalsX + first,  mNormalsX + last,  0.0f);
+			std::fill(mNormalsY + first,  mNormalsY + last,  1.0f);
+			std::fill(mNormalsZ + first,  mNormalsZ + last,  0.0f);
+			std::fill(mTangentsX + first, mTangentsX + last, 1.0f);
+			std::fill(mTangentsY + first, mTangentsY + last, 0.0f);
+		}
+	}
+}
+
+void Waves::SetActivityThreshold(float threshold)
+{
+	mActivityThreshold = std::max(threshold, 0.0f);
+
+	// Everything is solved again until the tiles find out they are calm.
+	std::fill(mTileActive.begin(), mTileActive.end(), 1);
+}
+
+UINT Waves::ActiveTileCount()const
+{
+	return static_cast<UINT>(std::count(mTileActive.begin(), mTileActive.end(), 1));
+}
+
+void Waves::DirtyRowRanges(std::vector<std::pair<UINT, UINT>>& ranges)const
+{
+	ranges.clear();
+	for(UINT tileRow = 0; tileRow < mNumTileRows; ++tileRow)
+	{
+		std::vector<BYTE>::const_iterator first = mTileDirty.begin() + tileRow*mNumTileCols;
+		if(std::find(first, first + mNumTileCols, 1) == first + mNumTileCols)
+			continue;
+
+		// The normals of the rows just outside the tiles depend on them too.
+		UINT rowBegin = tileRow*TileRows;
+		UINT rowEnd   = std::min(rowBegin + TileRows + 2, mNumRows);
+
+		if(!ranges.empty() && ranges.back().second >= rowBegin)
+			ranges.back().second = rowEnd;
+		else
+			ranges.push_back(std::make_pair(rowBegin, rowEnd));
+	}
+}
+
+void Waves::UpdateHeightRow(UINT i, UINT colBegin, UINT colEnd)
+{
+	// After this update we will be discarding the old previous
+	// buffer, so overwrite that buffer with the new update.
+	// Note how we can do this inplace (read/write to same element) 
+	// because we won't need prev_ij again and the assignment happens last.
+
+	// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+	// Moreover, our +z axis goes "down"; this is just to 
+	// keep consistent with our row indices going down.
+
+	float* prev       = mPrevHeights + i*mNumCols;
+	const float* curr = mCurrHeights + i*mNumCols;
+	const float* up   = curr - mNumCols;
+	const float* down = curr + mNumCols;
 
-		t = 0.0f; // reset time
+	// Only update interior points; we use zero boundary conditions.
+	UINT j   = colBegin;
+	UINT end = colEnd;
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		for(UINT i = 1; i < mNumRows-1; ++i)
+	if(mSimdEnabled)
+	{
+#if defined(__AVX__)
+		j = HeightRow8(prev, curr, up, down, j, end, mK1, mK2, mK3);
+#endif
+#if defined(_XM_SSE_INTRINSICS_)
+		j = HeightRow4(prev, curr, up, down, j, end, mK1, mK2, mK3);
+#endif
+	}
+
+	for(; j < end; ++j)
+	{
+		prev[j] = 
+			mK1*prev[j] +
+			mK2*curr[j] +
+			mK3*(down[j] + 
+			     up[j] + 
+			     curr[j+1] + 
+			     curr[j-1]);
+	}
+}
+
+void Waves::UpdateNormalRow(const float* heights, UINT i, UINT colBegin, UINT colEnd)
+{
+	UINT offset = i*mNumCols;
+	const float* row = heights + offset;
+	ComputeNormalRow(row - mNumCols, row, row + mNumCols,
+		mNormalsX + offset, mNormalsY + offset, mNormalsZ + offset, colBegin, colEnd);
+	ComputeTangentRow(row, mTangentsX + offset, mTangentsY + offset, colBegin, colEnd);
+}
+
+void Waves::ComputeNormalRow(const float* up, const float* row, const float* down,
+	float* nx, float* ny, float* nz, UINT colBegin, UINT colEnd)const
+{
+	//
+	// Compute normals using finite difference scheme.
+	//
+
+	UINT j   = colBegin;
+	UINT end = colEnd;
+
+	if(mSimdEnabled)
+	{
+#if defined(__AVX__)
+		j = NormalRow8(row, up, down, nx, ny, nz, j, end, 2.0f*mSpatialStep);
+#endif
+#if defined(_XM_SSE_INTRINSICS_)
+		j = NormalRow4(row, up, down, nx, ny, nz, j, end, 2.0f*mSpatialStep);
+#endif
+	}
+
+	for(; j < end; ++j)
+	{
+		float l = row[j-1];
+		float r = row[j+1];
+		float t = up[j];
+		float b = down[j];
+
+		XMFLOAT3 normal(-r+l, 2.0f*mSpatialStep, b-t);
+		XMStoreFloat3(&normal, XMVector3Normalize(XMLoadFloat3(&normal)));
+		nx[j] = normal.x;
+		ny[j] = normal.y;
+		nz[j] = normal.z;
+	}
+}
+
+void Waves::ComputeTangentRow(const float* row, float* tx, float* ty,
+	UINT colBegin, UINT colEnd)const
+{
+	UINT j   = colBegin;
+	UINT end = colEnd;
+
+	if(mSimdEnabled)
+	{
+#if defined(__AVX__)
+		j = TangentRow8(row, tx, ty, j, end, 2.0f*mSpatialStep);
+#endif
+#if defined(_XM_SSE_INTRINSICS_)
+		j = TangentRow4(row, tx, ty, j, end, 2.0f*mSpatialStep);
+#endif
+	}
+
+	for(; j < end; ++j)
+	{
+		float l = row[j-1];
+		float r = row[j+1];
+
+		XMFLOAT3 tangent(2.0f*mSpatialStep, r-l, 0.0f);
+		XMStoreFloat3(&tangent, XMVector3Normalize(XMLoadFloat3(&tangent)));
+		tx[j] = tangent.x;
+		ty[j] = tangent.y;
+	}
+}
+
+XMFLOAT3 Waves::Normal(int i)const
+{
+	if(!mDeferredNormals)
+		return XMFLOAT3(mNormalsX[i], mNormalsY[i], mNormalsZ[i]);
+
+	UINT row = i / mNumCols;
+	UINT col = i % mNumCols;
+	if(row == 0 || row == mNumRows-1 || col == 0 || col == mNumCols-1)
+		return XMFLOAT3(0.0f, 1.0f, 0.0f);
+
+	float l = mCurrHeights[i-1];
+	float r = mCurrHeights[i+1];
+	float t = mCurrHeights[i-mNumCols];
+	float b = mCurrHeights[i+mNumCols];
+
+	XMFLOAT3 normal(-r+l, 2.0f*mSpatialStep, b-t);
+	XMStoreFloat3(&normal, XMVector3Normalize(XMLoadFloat3(&normal)));
+	return normal;
+}
+
+XMFLOAT3 Waves::TangentX(int i)const
+{
+	if(!mDeferredNormals)
+		return XMFLOAT3(mTangentsX[i], mTangentsY[i], 0.0f);
+
+	UINT row = i / mNumCols;
+	UINT col = i % mNumCols;
+	if(row == 0 || row == mNumRows-1 || col == 0 || col == mNumCols-1)
+		return XMFLOAT3(1.0f, 0.0f, 0.0f);
+
+	float l = mCurrHeights[i-1];
+	float r = mCurrHeights[i+1];
+
+	XMFLOAT3 tangent(2.0f*mSpatialStep, r-l, 0.0f);
+	XMStoreFloat3(&tangent, XMVector3Normalize(XMLoadFloat3(&tangent)));
+	return tangent;
+}
+
+void Waves::SetDeferredNormals(bool deferred)
+{
+	// The stored planes are stale after running deferred, so bring them up to
+	// date before the accessors start reading them again.
+	if(mDeferredNormals && !deferred)
+	{
+		for(UINT i = 1; i+1 < mNumRows; ++i)
+			UpdateNormalRow(mCurrHeights, i, 1, mNumCols-1);
+	}
+
+	mDeferredNormals = deferred;
+}
+
+void Waves::WriteVertices(void* vertices, const VertexLayout& layout, float alpha)const
+{
+	WriteVertices(vertices, layout, alpha, 0, mNumRows);
+}
+
+void Waves::WriteVertices(void* vertices, const VertexLayout& layout, float alpha,
+	UINT rowBegin, UINT rowEnd)const
+{
+	PROFILE_ZONE("Waves::WriteVertices");
+
+	rowEnd = std::min(rowEnd, mNumRows);
+	if(rowBegin >= rowEnd)
+		return;
+
+	// Rows are written in bands like the solver, but every row, boundary included.
+	UINT numBands = (rowEnd-rowBegin + mBandRows-1) / mBandRows;
+
+	auto writeBand = [&](UINT band)
+	{
+		UINT first = rowBegin + band*mBandRows;
+		UINT last  = std::min(first + mBandRows, rowEnd);
+		WriteVertexRows(static_cast<BYTE*>(vertices), layout, alpha, first, last);
+	};
+
+	if(mThreadPool)
+		mThreadPool->ParallelFor(numBands, writeBand);
+	else
+	{
+		for(UINT band = 0; band < numBands; ++band)
+			writeBand(band);
+	}
+}
+
+void Waves::WriteVertexRows(BYTE* vertices, const VertexLayout& layout, float alpha,
+	UINT rowBegin, UINT rowEnd)const
+{
+	bool writePos    = layout.PosOffset    != VertexLayout::NoAttribute;
+	bool writeNormal = layout.NormalOffset != VertexLayout::NoAttribute;
+	bool writeTex    = layout.TexOffset    != VertexLayout::NoAttribute;
+
+	// Blended heights have no stored normals, so they derive theirs like the
+	// deferred mode does.
+	bool blend         = alpha < 1.0f;
+	bool deriveNormals = writeNormal && (mDeferredNormals || blend);
+
+	// Derived normals are computed a row at a time into scratch rows, which
+	// stay in cache while the row is interleaved into the destination.  When
+	// blending, the last three blended height rows are kept as well, since
+	// each row is needed again as the neighbour of the next two.
+	std::vector<float> scratch((deriveNormals ? 3 : 0)*mNumCols + (blend ? 3 : 0)*mNumCols);
+	float* normalRows  = scratch.data();
+	float* blendedRows = normalRows + (deriveNormals ? 3 : 0)*mNumCols;
+	UINT blendedRow[3] = { mNumRows, mNumRows, mNumRows };
+
+	auto rowHeights = [&](UINT i) -> const float*
+	{
+		if(!blend)
+			return mCurrHeights + i*mNumCols;
+
+		float* dst = blendedRows + (i%3)*mNumCols;
+		if(blendedRow[i%3] != i)
+		{
+			const float* prev = mPrevHeights + i*mNumCols;
+			const float* curr = mCurrHeights + i*mNumCols;
+			for(UINT j = 0; j < mNumCols; ++j)
+				dst[j] = prev[j] + (curr[j]-prev[j])*alpha;
+			blendedRow[i%3] = i;
+		}
+		return dst;
+	};
+
+	for(UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const float* nx = mNormalsX + i*mNumCols;
+		const float* ny = mNormalsY + i*mNumCols;
+		const float* nz = mNormalsZ + i*mNumCols;
+		if(deriveNormals)
 		{
-			for(UINT j = 1; j < mNumCols-1; ++j)
+			float* sx = normalRows;
+			float* sy = sx + mNumCols;
+			float* sz = sy + mNumCols;
+
+			// Boundary rows never move, so their normals point straight up.
+			if(i == 0 || i == mNumRows-1)
+			{
+				std::fill(sx, sx + mNumCols, 0.0f);
+				std::fill(sy, sy + mNumCols, 1.0f);
+				std::fill(sz, sz + mNumCols, 0.0f);
+			}
+			else
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				sx[0] = sx[mNumCols-1] = 0.0f;
+				sy[0] = sy[mNumCols-1] = 1.0f;
+				sz[0] = sz[mNumCols-1] = 0.0f;
+				ComputeNormalRow(rowHeights(i-1), rowHeights(i), rowHeights(i+1), sx, sy, sz, 1, mNumCols-1);
 			}
+			nx = sx;
+			ny = sy;
+			nz = sz;
 		}
+
+		const float* heights = rowHeights(i);
+		float z = GridZ(i);
+
+		// Derive tex-coords in [0,1] from position.
+		float v = 0.5f - z / Depth();
+
+		BYTE* vertex = vertices + i*mNumCols*layout.Stride;
+		for(UINT j = 0; j < mNumCols; ++j, vertex += layout.Stride)
+		{
+			if(writePos)
+				*reinterpret_cast<XMFLOAT3*>(vertex + layout.PosOffset) = XMFLOAT3(GridX(j), heights[j], z);
+			if(writeNormal)
+				*reinterpret_cast<XMFLOAT3*>(vertex + layout.NormalOffset) = XMFLOAT3(nx[j], ny[j], nz[j]);
+			if(writeTex)
+				*reinterpret_cast<XMFLOAT2*>(vertex + layout.TexOffset) = XMFLOAT2(mTexU[j], v);
+		}
+	}
+}
+
+void Waves::SetThreadCount(UINT threadCount)
+{
+	if(threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	if(threadCount != ThreadCount())
+	{
+		delete mThreadPool;
+		mThreadPool = threadCount > 1 ? new ThreadPool(threadCount) : 0;
 	}
+
+	ChooseBands();
+}
+
+UINT Waves::ThreadCount()const
+{
+	return mThreadPool ? mThreadPool->ThreadCount() : 1;
+}
+
+void Waves::ChooseBands()
+{
+	UINT interiorRows = mNumRows > 2 ? mNumRows-2 : 0;
+
+	// A few bands per thread keeps the pool balanced when some threads get
+	// descheduled, but bands should stay tall enough that the seam rows
+	// solved after the join are only a small part of the work.
+	mBandRows = interiorRows / (4*ThreadCount());
+	mBandRows = std::min(std::max(mBandRows, 16u), 64u);
+	mBandRows -= mBandRows % TileRows;
+	mNumBands = (interiorRows + mBandRows-1) / mBandRows;
 }
 
 void Waves::Disturb(UINT i, UINT j, float magnitude)
+{
+	ApplyDisturbance(i, j, magnitude);
+}
+
+UINT Waves::DisturbMany(const Disturbance* disturbances, UINT count)
+{
+	UINT queued = 0;
+	while(queued < count && mDisturbanceQueue->TryPush(disturbances[queued]))
+		++queued;
+
+	return queued;
+}
+
+void Waves::ApplyQueuedDisturbances()
+{
+	Disturbance disturbance;
+	while(mDisturbanceQueue->TryPop(disturbance))
+		mDisturbanceBatch.push_back(disturbance);
+
+	if(mDisturbanceBatch.empty())
+		return;
+
+	// Apply the batch in memory order rather than in the order the
+	// producers happened to push it.
+	std::sort(mDisturbanceBatch.begin(), mDisturbanceBatch.end(),
+		[](const Disturbance& a, const Disturbance& b)
+		{
+			return a.Row < b.Row || (a.Row == b.Row && a.Column < b.Column);
+		});
+
+	for(size_t k = 0; k < mDisturbanceBatch.size(); ++k)
+	{
+		const Disturbance& d = mDisturbanceBatch[k];
+		ApplyDisturbance(d.Row, d.Column, d.Magnitude);
+	}
+
+	mDisturbanceBatch.clear();
+}
+
+void Waves::ApplyDisturbance(UINT i, UINT j, float magnitude)
 {
 	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows-2);
-	assert(j > 1 && j < mNumCols-2);
+	if(mNumRows < 5 || mNumCols < 5)
+		return;
+
+	i = std::min(std::max(i, 2u), mNumRows-3);
+	j = std::min(std::max(j, 2u), mNumCols-3);
 
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	mCurrHeights[i*mNumCols+j]     += magnitude;
+	mCurrHeights[i*mNumCols+j+1]   += halfMag;
+	mCurrHeights[i*mNumCols+j-1]   += halfMag;
+	mCurrHeights[(i+1)*mNumCols+j] += halfMag;
+	mCurrHeights[(i-1)*mNumCols+j] += halfMag;
+
+	// Wake the tiles the disturbance touched.  Their current solution moved
+	// away from the previous one, so they are dirty until the next step too.
+	UINT tileRow = TileRowOf(i);
+	UINT tileCol = TileColOf(j);
+	UINT tiles[5] =
+	{
+		tileRow*mNumTileCols + tileCol,
+		TileRowOf(i-1)*mNumTileCols + tileCol,
+		TileRowOf(i+1)*mNumTileCols + tileCol,
+		tileRow*mNumTileCols + TileColOf(j-1),
+		tileRow*mNumTileCols + TileColOf(j+1)
+	};
+	for(UINT k = 0; k < 5; ++k)
+	{
+		mTileActive[tiles[k]]   = 1;
+		mTileDirty[tiles[k]]    = 1;
+		mTileChanging[tiles[k]] = 1;
+	}
 }
 	
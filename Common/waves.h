@@ -11,6 +11,11 @@
 
 #include <Windows.h>
 #include <DirectXMath.h>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+template<typename T> class MpmcQueue;
 
 class Waves
 {
@@ -25,19 +30,143 @@ public:
 	float Width()const;
 	float Depth()const;
 
+	// The solution is stored as planes of floats, one value per grid point, so the
+	// accessors below rebuild the vectors on the fly and return them by value.
+	// x and z never change and are derived from the grid coordinates.
+
 	// Returns the solution at the ith grid point.
-	const DirectX::XMFLOAT3& operator[](int i)const { return mCurrSolution[i]; }
+	DirectX::XMFLOAT3 operator[](int i)const
+	{
+		return DirectX::XMFLOAT3(GridX(i % mNumCols), mCurrHeights[i], GridZ(i / mNumCols));
+	}
 
 	// Returns the solution normal at the ith grid point.
-	const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+	DirectX::XMFLOAT3 Normal(int i)const;
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-	const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+	DirectX::XMFLOAT3 TangentX(int i)const;
+
+	// Returns the height of the ith grid point.
+	float Height(int i)const { return mCurrHeights[i]; }
 
 	void Init(UINT m, UINT n, float dx, float dt, float speed, float damping);
-	void Update(float dt);
+
+	// Raises grid point (i, j) by magnitude and its four neighbours by half as
+	// much.  Points too close to the boundary are moved inwards.
 	void Disturb(UINT i, UINT j, float magnitude);
 
+	struct Disturbance
+	{
+		UINT Row;
+		UINT Column;
+		float Magnitude;
+	};
+
+	// Queues disturbances to be applied at the start of the next step.  Unlike
+	// Disturb() this may be called from any thread, also while Update() runs,
+	// but not concurrently with Init().  Returns how many were queued; the
+	// rest are dropped when the queue is full.
+	UINT DisturbMany(const Disturbance* disturbances, UINT count);
+
+	// Advances the simulation by dt seconds of real time in fixed steps of the
+	// dt given to Init().  Time left over is carried to the next call, and at
+	// most MaxSubSteps() steps are taken per call.  Returns the step count,
+	// which is always 0 if Init() was given a dt of 0 or less.
+	UINT Update(float dt);
+
+	// How far the carried-over time is into the next step, in [0,1).  Pass it
+	// to WriteVertices() to draw the surface between the last two solutions.
+	float InterpolationAlpha()const;
+
+	// Caps the steps one Update() may take, so a slow frame does not make the
+	// next one slower still.  Time beyond the cap is dropped.
+	void SetMaxSubSteps(UINT maxSubSteps) { mMaxSubSteps = maxSubSteps; }
+	UINT MaxSubSteps()const { return mMaxSubSteps; }
+
+	// Splits each step into bands of rows that are solved on a worker pool.
+	// 1 (the default) runs everything on the calling thread, 0 uses every
+	// hardware thread.  The result does not depend on the thread count.
+	void SetThreadCount(UINT threadCount);
+	UINT ThreadCount()const;
+
+	// Byte offsets of the attributes inside one client vertex.  Set the offset
+	// of an attribute the vertex does not have to NoAttribute.
+	struct VertexLayout
+	{
+		static const UINT NoAttribute = 0xffffffff;
+
+		UINT Stride;
+		UINT PosOffset;
+		UINT NormalOffset;
+		UINT TexOffset;
+	};
+
+	// Writes every grid point straight into interleaved client vertices, e.g. a
+	// mapped dynamic vertex buffer: position, normal, and tex-coords in [0,1]
+	// derived from the position.  The destination is only written, in order,
+	// never read back.  With alpha < 1 the heights are blended from the
+	// previous solution towards the current one.
+	void WriteVertices(void* vertices, const VertexLayout& layout, float alpha = 1.0f)const;
+
+	// Writes rows [rowBegin, rowEnd) of the grid only.  vertices still points at
+	// the first vertex of the grid.
+	void WriteVertices(void* vertices, const VertexLayout& layout, float alpha,
+		UINT rowBegin, UINT rowEnd)const;
+
+	// The grid is tracked in tiles.  A tile whose heights all stay below the
+	// threshold is flattened and skipped by the height and normal updates until
+	// a neighbouring tile or Disturb() wakes it, so calm water costs nothing.
+	// Waves fading below the threshold are cut off, which is the only error.
+	// 0 (the default) solves every tile.
+	void SetActivityThreshold(float threshold);
+	float ActivityThreshold()const { return mActivityThreshold; }
+	UINT TileCount()const { return static_cast<UINT>(mTileActive.size()); }
+	UINT ActiveTileCount()const;
+
+	// Row ranges [first, second) whose vertices WriteVertices() may write
+	// differently than it did before the last Update(), whatever the alpha.
+	// After steps these are the rows around every tile the steps solved.
+	// After an Update() that took no step they are the rows around the tiles
+	// whose last two solutions differ, as their blend still moves with the
+	// alpha.  Disturb() adds its tiles at once.  A client that keeps its
+	// vertex buffer between frames only needs to rewrite these each frame.
+	void DirtyRowRanges(std::vector<std::pair<UINT, UINT>>& ranges)const;
+
+	// With deferred normals Update() only advances the heights, and normals are
+	// derived where they are consumed: in WriteVertices(), fused with the
+	// copy, or in Normal()/TangentX().  Clients that stream through
+	// WriteVertices() save a full pass over the grid every step.
+	void SetDeferredNormals(bool deferred);
+
+	// Switches between the SSE/AVX row kernels (the default) and the plain
+	// scalar loops, which are kept as the reference to validate the former.
+	void SetSimdEnabled(bool enabled) { mSimdEnabled = enabled; }
+
+private:
+	float GridX(UINT j)const { return -mHalfWidth + j*mSpatialStep; }
+	float GridZ(UINT i)const { return mHalfDepth - i*mSpatialStep; }
+
+	void Step();
+	void ApplyQueuedDisturbances();
+	void ApplyDisturbance(UINT i, UINT j, float magnitude);
+	void ChooseBands();
+	void SolveBand(UINT band);
+	void SolveBandSeams(UINT band);
+	void ActiveColumns(UINT firstTileRow, UINT lastTileRow, UINT pad,
+		std::vector<std::pair<UINT, UINT>>& spans)const;
+	void NormalColumns(UINT i, std::vector<std::pair<UINT, UINT>>& spans)const;
+	void TrackPeaks(UINT tileRow, UINT i);
+	void UpdateActivity();
+	void FlattenTile(UINT tile);
+	void UpdateHeightRow(UINT i, UINT colBegin, UINT colEnd);
+	void UpdateNormalRow(const float* heights, UINT i, UINT colBegin, UINT colEnd);
+	void ComputeNormalRow(const float* up, const float* row, const float* down,
+		float* nx, float* ny, float* nz, UINT colBegin, UINT colEnd)const;
+	void ComputeTangentRow(const float* row, float* tx, float* ty,
+		UINT colBegin, UINT colEnd)const;
+	void WriteVertexRows(BYTE* vertices, const VertexLayout& layout, float alpha,
+		UINT rowBegin, UINT rowEnd)const;
+
 private:
 	UINT mNumRows;
 	UINT mNumCols;
@@ -53,10 +182,60 @@ private:
 	float mTimeStep;
 	float mSpatialStep;
 
-	DirectX::XMFLOAT3* mPrevSolution;
-	DirectX::XMFLOAT3* mCurrSolution;
-	DirectX::XMFLOAT3* mNormals;
-	DirectX::XMFLOAT3* mTangentX;
+	float mHalfWidth;
+	float mHalfDepth;
+
+	float* mPrevHeights;
+	float* mCurrHeights;
+
+	float* mNormalsX;
+	float* mNormalsY;
+	float* mNormalsZ;
+
+	// The tangent along x has no z component.
+	float* mTangentsX;
+	float* mTangentsY;
+
+	// Tex-coord u of each column.
+	float* mTexU;
+
+	// Simulated time owed to the fixed-step scheduler.
+	float mAccumTime;
+	UINT mMaxSubSteps;
+
+	bool mSimdEnabled;
+	bool mDeferredNormals;
+
+	// Filled by DisturbMany() from any thread, drained by Step().
+	MpmcQueue<Disturbance>* mDisturbanceQueue;
+	std::vector<Disturbance> mDisturbanceBatch;
+
+	ThreadPool* mThreadPool;
+	UINT mBandRows;
+	UINT mNumBands;
+
+	// Largest |height| seen in a tile during the last step, over the whole tile
+	// and over each of its edges; an edge above the threshold wakes the tile
+	// on that side.
+	struct TilePeaks
+	{
+		float Tile;
+		float Top;
+		float Bottom;
+		float Left;
+		float Right;
+	};
+
+	// Tiles are indexed tileRow*mNumTileCols + tileColumn.
+	float mActivityThreshold;
+	UINT mNumTileRows;
+	UINT mNumTileCols;
+	std::vector<BYTE> mTileActive;
+	std::vector<BYTE> mTileNextActive;
+	std::vector<BYTE> mTileDirty;
+	// Tiles whose previous and current solutions may differ.
+	std::vector<BYTE> mTileChanging;
+	std::vector<TilePeaks> mTilePeaks;
 };
 
-#endif // WAVES_H
\ No newline at end of file
+#endif // WAVES_H
@@ -0,0 +1,66 @@
+// Converts the demos' text models (skull.txt, car.txt) to the binary .mesh
+// format that MeshFile maps in place, reordered by MeshOptimizer and with
+// the LOD chain MeshSimplifier builds for it.
+//
+//   MeshConverter input.txt [output.mesh]
+//
+// The output defaults to the input with its extension replaced by .mesh.
+
+#include"meshfile.h"
+#include"meshoptimizer.h"
+#include<iostream>
+#include<string>
+#include<vector>
+
+int main(int argc, char *argv[]) {
+	if (argc < 2 || argc > 3) {
+		std::cerr << "usage: " << argv[0] << " input.txt [output.mesh]\n";
+		return 1;
+	}
+
+	std::string input = argv[1];
+	std::string output;
+	if (argc == 3) {
+		output = argv[2];
+	}
+	else {
+		size_t dot = input.find_last_of('.');
+		size_t slash = input.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			dot = input.size();
+		output = input.substr(0, dot) + ".mesh";
+	}
+
+	std::vector<ModelLoader::Vertex> vertices;
+	std::vector<UINT> indices;
+	if (!ModelLoader::LoadTextModel(input, vertices, indices)) {
+		std::cerr << "Cannot read " << input << "\n";
+		return 1;
+	}
+
+	MeshOptimizer::Report report = MeshOptimizer::Optimize(vertices, indices);
+	std::cout << "ACMR " << report.before.acmr << " -> " << report.after.acmr
+		<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr
+		<< " (" << MeshOptimizer::kDefaultCacheSize << "-entry FIFO)\n";
+
+	std::vector<MeshFile::Lod> lods;
+	MeshFile::BuildLods(vertices, indices, lods);
+
+	if (!MeshFile::Write(output, vertices, indices, lods)) {
+		std::cerr << "Cannot write " << output << "\n";
+		return 1;
+	}
+
+	MeshFile mesh;
+	if (!mesh.Open(output)) {
+		std::cerr << "Cannot read back " << output << "\n";
+		return 1;
+	}
+	std::cout << output << ": " << mesh.VertexCount() << " vertices, "
+		<< mesh.IndexCount() / 3 << " triangles\n";
+	for (UINT i = 0; i < mesh.LodCount(); ++i) {
+		std::cout << "LOD " << i << ": " << mesh.Lods()[i].index_cnt / 3 << " triangles, error "
+			<< mesh.Lods()[i].error << "\n";
+	}
+	return 0;
+}